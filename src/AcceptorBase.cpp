@@ -46,6 +46,7 @@
 # include <sys/socket.h>
 # include <sys/ioctl.h>
 # include <sys/fcntl.h>
+# include <sys/stat.h>
 # include <sys/time.h>
 # include <sys/uio.h>
 # include <netinet/tcp.h>
@@ -88,6 +89,12 @@ void AcceptorBase::cleanup()
         ::shutdown(fd, 2);
         unregisterFd(fd, true);
     }
+#ifndef KUMA_OS_WIN
+    if (!unix_path_.empty()) {
+        ::unlink(unix_path_.c_str());
+        unix_path_.clear();
+    }
+#endif
 }
 
 KMError AcceptorBase::listen(const std::string &host, uint16_t port)
@@ -97,11 +104,32 @@ KMError AcceptorBase::listen(const std::string &host, uint16_t port)
         return KMError::INVALID_STATE;
     }
     sockaddr_storage ss_addr = {0};
-    struct addrinfo hints = {0};
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_flags = AI_ADDRCONFIG; // will block 10 seconds in some case if not set AI_ADDRCONFIG
-    if(km_set_sock_addr(host.c_str(), port, &hints, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) != 0) {
-        return KMError::INVALID_PARAM;
+    if (km_is_unix_address(host)) {
+        if (km_set_unix_addr(host, ss_addr) != 0) {
+            return KMError::INVALID_PARAM;
+        }
+#ifndef KUMA_OS_WIN
+        std::string path = host.substr(5);
+        if (path[0] != '@') {
+            // remove the stale socket file left by previous listener, the
+            // file of a live listener is kept
+            struct stat st;
+            if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                if (!isStaleUnixSocket(ss_addr)) {
+                    KUMA_ERRXTRACE("startListen, EADDRINUSE, path="<<path);
+                    return KMError::ALREADY_EXIST;
+                }
+                ::unlink(path.c_str());
+            }
+        }
+#endif
+    } else {
+        struct addrinfo hints = {0};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_flags = AI_ADDRCONFIG; // will block 10 seconds in some case if not set AI_ADDRCONFIG
+        if(km_set_sock_addr(host.c_str(), port, &hints, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) != 0) {
+            return KMError::INVALID_PARAM;
+        }
     }
     ss_family_ = ss_addr.ss_family;
     fd_ = ::socket(ss_addr.ss_family, SOCK_STREAM, 0);
@@ -116,6 +144,9 @@ KMError AcceptorBase::listen(const std::string &host, uint16_t port)
         KUMA_ERRXTRACE("startListen, bind failed, err="<<getLastError());
         return KMError::FAILED;
     }
+    if (ss_addr.ss_family == AF_UNIX && host[5] != '@') {
+        unix_path_ = host.substr(5);
+    }
     if(::listen(fd_, 128) != 0) {
         closeFd(fd_);
         fd_ = INVALID_FD;
@@ -127,6 +158,23 @@ KMError AcceptorBase::listen(const std::string &host, uint16_t port)
     return KMError::NOERR;
 }
 
+#ifndef KUMA_OS_WIN
+bool AcceptorBase::isStaleUnixSocket(const sockaddr_storage &ss_addr)
+{
+    // connect to a unix socket completes or fails immediately, nobody is
+    // listening on it only if ECONNREFUSED
+    SOCKET_FD fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (INVALID_FD == fd) {
+        return false;
+    }
+    set_nonblocking(fd);
+    int ret = ::connect(fd, (const struct sockaddr*)&ss_addr, km_get_addr_length(ss_addr));
+    bool stale = ret != 0 && errno == ECONNREFUSED;
+    closeFd(fd);
+    return stale;
+}
+#endif
+
 bool AcceptorBase::registerFd(SOCKET_FD fd)
 {
     auto loop = loop_.lock();
@@ -58,6 +58,9 @@ protected:
     void onClose(KMError err);
     void cleanup();
     virtual void ioReady(KMEvent events, void* ol, size_t io_size);
+#ifndef KUMA_OS_WIN
+    static bool isStaleUnixSocket(const sockaddr_storage &ss_addr);
+#endif
     
 protected:
     SOCKET_FD           fd_{ INVALID_FD };
@@ -71,6 +74,7 @@ protected:
     sa_family_t
 #endif
                         ss_family_ = AF_INET;
+    std::string         unix_path_; // socket file to remove on close
     
     AcceptCallback      accept_cb_;
     ErrorCallback       error_cb_;
@@ -0,0 +1,463 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "DnsClient.h"
+#include "util/kmtrace.h"
+
+#if defined(KUMA_OS_WIN)
+# include <Ws2tcpip.h>
+# include <windows.h>
+#else
+# include <string.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netdb.h>
+#endif
+
+#include <algorithm>
+
+using namespace kuma;
+
+namespace {
+    const size_t kHeaderSize = 12;
+    const uint16_t kTypeA = 1;
+    const uint16_t kTypeSOA = 6;
+    const uint16_t kTypeAAAA = 28;
+    const uint16_t kClassIN = 1;
+    const uint16_t kFlagResponse = 0x8000;
+    const uint16_t kFlagTruncated = 0x0200;
+    const uint16_t kFlagRecursionDesired = 0x0100;
+    const uint16_t kRcodeNoError = 0;
+    const uint16_t kRcodeNXDomain = 3;
+    
+    const uint32_t kQueryTimeoutMs = 2000;
+    const uint32_t kTimerIntervalMs = 200;
+    const int kMaxTries = 3;
+    const uint32_t kMaxTtlSeconds = 86400;
+    const uint32_t kDefaultNegativeTtlSeconds = 30;
+}
+
+DnsClient::DnsClient(const EventLoopPtr &loop)
+: loop_(loop)
+, timer_(loop->getTimerMgr())
+, rand_gen_(std::random_device()())
+{
+    KM_SetObjKey("DnsClient");
+}
+
+DnsClient::~DnsClient()
+{
+    close();
+}
+
+KMError DnsClient::setServers(const ServerList &servers)
+{
+    // fail the pending questions since the servers are changed
+    while (!questions_.empty()) {
+        finishQuestion(questions_.begin()->first, KMError::FAILED, DnsResolver::AddressList(), 0);
+    }
+    for (auto &server : servers_) {
+        server.udp->close();
+    }
+    servers_.clear();
+    
+    auto loop = loop_.lock();
+    if (!loop) {
+        return KMError::INVALID_STATE;
+    }
+    for (auto &s : servers) {
+        sockaddr_storage ss_addr;
+        memset(&ss_addr, 0, sizeof(ss_addr));
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_flags = AI_NUMERICHOST;
+        if (km_set_sock_addr(s.first.c_str(), s.second, &hints, (struct sockaddr*)&ss_addr, sizeof(ss_addr)) != 0) {
+            KUMA_WARNXTRACE("setServers, invalid server address, ip=" << s.first);
+            continue;
+        }
+        Server server;
+        // normalized address, it is used to match the source address of response
+        km_get_sock_addr(ss_addr, server.ip, nullptr);
+        server.port = s.second;
+        server.udp.reset(new UdpSocket::Impl(loop));
+        auto ret = server.udp->bind(AF_INET6 == ss_addr.ss_family ? "::" : "0.0.0.0", 0, 0);
+        if (ret != KMError::NOERR) {
+            KUMA_WARNXTRACE("setServers, failed to bind, ip=" << server.ip << ", err=" << int(ret));
+            continue;
+        }
+        size_t server_index = servers_.size();
+        server.udp->setReadCallback([this, server_index] (KMError) {
+            onReceive(server_index);
+        });
+        KUMA_INFOXTRACE("setServers, ip=" << server.ip << ", port=" << server.port);
+        servers_.push_back(std::move(server));
+    }
+    return servers_.empty() && !servers.empty() ? KMError::INVALID_PARAM : KMError::NOERR;
+}
+
+KMError DnsClient::query(const std::string &host, QueryCallback cb)
+{
+    if (servers_.empty()) {
+        return KMError::INVALID_STATE;
+    }
+    std::vector<uint8_t> qname;
+    if (!encodeName(host, qname)) {
+        return KMError::INVALID_PARAM;
+    }
+    auto query = std::make_shared<Query>();
+    query->host = host;
+    if (!query->host.empty() && query->host.back() == '.') {
+        query->host.pop_back();
+    }
+    query->cb = std::move(cb);
+    for (auto qtype : { kTypeAAAA, kTypeA }) {
+        if (questions_.empty()) {
+            timer_.schedule(kTimerIntervalMs, TimerMode::REPEATING, [this] { onTimer(); });
+        }
+        auto id = newQuestionId();
+        auto &q = questions_[id];
+        q.id = id;
+        q.qtype = qtype;
+        q.query = query;
+        ++query->pending;
+        if (!sendQuestion(q)) {
+            questions_.erase(id);
+            --query->pending;
+            ++query->failed;
+        }
+    }
+    if (questions_.empty()) {
+        timer_.cancel();
+    }
+    return query->pending > 0 ? KMError::NOERR : KMError::FAILED;
+}
+
+void DnsClient::close()
+{
+    timer_.cancel();
+    questions_.clear();
+    for (auto &server : servers_) {
+        server.udp->close();
+    }
+    servers_.clear();
+}
+
+uint16_t DnsClient::newQuestionId()
+{
+    std::uniform_int_distribution<uint32_t> dis(0, 0xFFFF);
+    uint16_t id = 0;
+    do {
+        id = static_cast<uint16_t>(dis(rand_gen_));
+    } while (questions_.find(id) != questions_.end());
+    return id;
+}
+
+bool DnsClient::sendQuestion(Question &q)
+{
+    if (q.server_index >= servers_.size()) {
+        return false;
+    }
+    std::vector<uint8_t> buf(kHeaderSize);
+    encode_u16(&buf[0], q.id);
+    encode_u16(&buf[2], kFlagRecursionDesired);
+    encode_u16(&buf[4], 1); // QDCOUNT
+    if (!encodeName(q.query->host, buf)) {
+        return false;
+    }
+    uint8_t qtail[4];
+    encode_u16(qtail, q.qtype);
+    encode_u16(qtail + 2, kClassIN);
+    buf.insert(buf.end(), qtail, qtail + sizeof(qtail));
+    
+    auto &server = servers_[q.server_index];
+    q.start_tick = get_tick_count_ms();
+    int ret = server.udp->send(&buf[0], buf.size(), server.ip, server.port);
+    if (ret < 0) {
+        KUMA_WARNXTRACE("sendQuestion, failed to send, host=" << q.query->host << ", server=" << server.ip);
+        return false;
+    }
+    return true;
+}
+
+void DnsClient::onReceive(size_t server_index)
+{
+    uint8_t buf[4096];
+    char ip[128] = { 0 };
+    uint16_t port = 0;
+    while (server_index < servers_.size()) {
+        auto *udp = servers_[server_index].udp.get();
+        int ret = udp->receive(buf, sizeof(buf), ip, sizeof(ip), port);
+        if (ret <= 0) {
+            break;
+        }
+        auto &server = servers_[server_index];
+        if (server.port != port || server.ip != ip) {
+            KUMA_WARNXTRACE("onReceive, unexpected source, ip=" << ip << ", port=" << port);
+            continue;
+        }
+        handleResponse(server_index, buf, ret);
+        if (server_index >= servers_.size() || servers_[server_index].udp.get() != udp) {
+            break; // servers are changed in callback
+        }
+    }
+}
+
+void DnsClient::handleResponse(size_t server_index, const uint8_t *buf, size_t len)
+{
+    if (len < kHeaderSize) {
+        return;
+    }
+    auto id = decode_u16(buf);
+    auto it = questions_.find(id);
+    if (it == questions_.end()) {
+        return;
+    }
+    auto &q = it->second;
+    auto flags = decode_u16(buf + 2);
+    auto qdcount = decode_u16(buf + 4);
+    auto ancount = decode_u16(buf + 6);
+    auto nscount = decode_u16(buf + 8);
+    if (!(flags & kFlagResponse) || qdcount != 1 || q.server_index != server_index) {
+        return;
+    }
+    size_t offset = kHeaderSize;
+    std::string name;
+    if (!readName(buf, len, offset, name) || offset + 4 > len) {
+        return;
+    }
+    // the question must match, the response may be forged otherwise
+    if (decode_u16(buf + offset) != q.qtype || !is_equal(name, q.query->host)) {
+        return;
+    }
+    offset += 4;
+    
+    if (flags & kFlagTruncated) {
+        // DNS over TCP is not supported, let resolver fall back to getaddrinfo
+        KUMA_INFOXTRACE("handleResponse, truncated, host=" << q.query->host);
+        finishQuestion(id, KMError::FAILED, DnsResolver::AddressList(), 0);
+        return;
+    }
+    auto rcode = flags & 0x000F;
+    if (rcode != kRcodeNoError && rcode != kRcodeNXDomain) {
+        KUMA_INFOXTRACE("handleResponse, host=" << q.query->host << ", rcode=" << rcode);
+        retryQuestion(id);
+        return;
+    }
+    
+    DnsResolver::AddressList addrs;
+    uint32_t ttl = kMaxTtlSeconds;
+    uint32_t negative_ttl = kDefaultNegativeTtlSeconds;
+    for (int i = 0; i < ancount + nscount; ++i) {
+        if (!readName(buf, len, offset, name) || offset + 10 > len) {
+            retryQuestion(id); // malformed response
+            return;
+        }
+        auto rr_type = decode_u16(buf + offset);
+        auto rr_class = decode_u16(buf + offset + 2);
+        auto rr_ttl = decode_u32(buf + offset + 4);
+        auto rd_len = decode_u16(buf + offset + 8);
+        offset += 10;
+        if (offset + rd_len > len) {
+            retryQuestion(id);
+            return;
+        }
+        if (i < ancount) {
+            // the addresses of CNAME target are in answer section as well
+            sockaddr_storage ss_addr;
+            memset(&ss_addr, 0, sizeof(ss_addr));
+            if (rr_class == kClassIN && rr_type == q.qtype && kTypeA == rr_type && 4 == rd_len) {
+                auto *sa = (sockaddr_in*)&ss_addr;
+                sa->sin_family = AF_INET;
+                memcpy(&sa->sin_addr, buf + offset, 4);
+                addrs.push_back(ss_addr);
+                ttl = std::min(ttl, rr_ttl);
+            } else if (rr_class == kClassIN && rr_type == q.qtype && kTypeAAAA == rr_type && 16 == rd_len) {
+                auto *sa = (sockaddr_in6*)&ss_addr;
+                sa->sin6_family = AF_INET6;
+                memcpy(&sa->sin6_addr, buf + offset, 16);
+                addrs.push_back(ss_addr);
+                ttl = std::min(ttl, rr_ttl);
+            }
+        } else if (rr_type == kTypeSOA) {
+            // RFC 2308, negative TTL is the minimum of SOA TTL and SOA MINIMUM
+            size_t soa_offset = offset;
+            std::string mname, rname;
+            if (readName(buf, len, soa_offset, mname) && readName(buf, len, soa_offset, rname) &&
+                soa_offset + 20 <= offset + rd_len) {
+                negative_ttl = std::min(rr_ttl, decode_u32(buf + soa_offset + 16));
+            }
+        }
+        offset += rd_len;
+    }
+    if (!addrs.empty()) {
+        finishQuestion(id, KMError::NOERR, std::move(addrs), ttl * 1000);
+    } else {
+        negative_ttl = std::min(negative_ttl, kMaxTtlSeconds);
+        finishQuestion(id, KMError::NOT_EXIST, std::move(addrs), negative_ttl * 1000);
+    }
+}
+
+void DnsClient::onTimer()
+{
+    std::vector<uint16_t> timeout_ids;
+    auto now_tick = get_tick_count_ms();
+    for (auto &kv : questions_) {
+        auto start_tick = kv.second.start_tick;
+        if (calc_time_elapse_delta_ms(now_tick, start_tick) >= kQueryTimeoutMs) {
+            timeout_ids.push_back(kv.first);
+        }
+    }
+    for (auto id : timeout_ids) {
+        auto it = questions_.find(id);
+        if (it != questions_.end()) {
+            KUMA_INFOXTRACE("onTimer, timeout, host=" << it->second.query->host << ", qtype=" << it->second.qtype);
+        }
+        retryQuestion(id);
+    }
+}
+
+void DnsClient::retryQuestion(uint16_t id)
+{
+    auto it = questions_.find(id);
+    if (it == questions_.end()) {
+        return;
+    }
+    auto &q = it->second;
+    if (++q.tries >= kMaxTries) {
+        finishQuestion(id, KMError::FAILED, DnsResolver::AddressList(), 0);
+        return;
+    }
+    // try next server, with a new ID
+    Question retry_q = std::move(q);
+    questions_.erase(it);
+    retry_q.id = newQuestionId();
+    retry_q.server_index = (retry_q.server_index + 1) % servers_.size();
+    auto &nq = questions_[retry_q.id];
+    nq = std::move(retry_q);
+    if (!sendQuestion(nq)) {
+        finishQuestion(nq.id, KMError::FAILED, DnsResolver::AddressList(), 0);
+    }
+}
+
+void DnsClient::finishQuestion(uint16_t id, KMError err, DnsResolver::AddressList &&addrs, uint32_t ttl_ms)
+{
+    auto it = questions_.find(id);
+    if (it == questions_.end()) {
+        return;
+    }
+    auto query = std::move(it->second.query);
+    auto qtype = it->second.qtype;
+    questions_.erase(it);
+    if (questions_.empty()) {
+        timer_.cancel();
+    }
+    
+    if (KMError::NOERR == err) {
+        if (kTypeAAAA == qtype) {
+            query->addrs_v6 = std::move(addrs);
+        } else {
+            query->addrs_v4 = std::move(addrs);
+        }
+        query->ttl_ms = std::min(query->ttl_ms, ttl_ms);
+    } else if (KMError::NOT_EXIST == err) {
+        query->negative_ttl_ms = std::min(query->negative_ttl_ms, ttl_ms);
+    } else {
+        ++query->failed;
+    }
+    if (--query->pending > 0) {
+        return;
+    }
+    
+    // IPv6 addresses go first, Happy Eyeballs will take care of the broken IPv6 path
+    DnsResolver::AddressList result(std::move(query->addrs_v6));
+    result.insert(result.end(), query->addrs_v4.begin(), query->addrs_v4.end());
+    auto cb = std::move(query->cb);
+    if (!cb) {
+        return;
+    }
+    if (!result.empty()) {
+        cb(KMError::NOERR, result, query->ttl_ms);
+    } else if (0 == query->failed) {
+        cb(KMError::NOT_EXIST, result, query->negative_ttl_ms);
+    } else {
+        cb(KMError::FAILED, result, 0);
+    }
+}
+
+bool DnsClient::encodeName(const std::string &host, std::vector<uint8_t> &buf)
+{
+    if (host.empty() || host.size() > 254 || host[0] == '.') {
+        return false;
+    }
+    size_t pos = 0;
+    while (pos < host.size()) {
+        auto end = host.find('.', pos);
+        if (end == std::string::npos) {
+            end = host.size();
+        }
+        auto label_len = end - pos;
+        if (0 == label_len || label_len > 63) {
+            return false;
+        }
+        buf.push_back(static_cast<uint8_t>(label_len));
+        buf.insert(buf.end(), host.begin() + pos, host.begin() + end);
+        pos = end + 1;
+    }
+    buf.push_back(0);
+    return true;
+}
+
+bool DnsClient::readName(const uint8_t *buf, size_t len, size_t &offset, std::string &name)
+{
+    name.clear();
+    size_t pos = offset;
+    bool jumped = false;
+    int jumps = 0;
+    while (pos < len) {
+        uint8_t label_len = buf[pos];
+        if (0 == label_len) {
+            if (!jumped) {
+                offset = pos + 1;
+            }
+            return true;
+        } else if ((label_len & 0xC0) == 0xC0) { // compression pointer
+            if (pos + 2 > len || ++jumps > 16) {
+                return false;
+            }
+            if (!jumped) {
+                offset = pos + 2;
+                jumped = true;
+            }
+            pos = decode_u16(buf + pos) & 0x3FFF;
+        } else if (label_len > 63 || pos + 1 + label_len > len) {
+            return false;
+        } else {
+            if (!name.empty()) {
+                name.push_back('.');
+            }
+            name.append((const char*)buf + pos + 1, label_len);
+            pos += 1 + label_len;
+        }
+    }
+    return false;
+}
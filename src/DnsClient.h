@@ -0,0 +1,116 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DnsClient_h__
+#define __DnsClient_h__
+
+#include "kmdefs.h"
+#include "DnsResolver.h"
+#include "EventLoopImpl.h"
+#include "UdpSocketImpl.h"
+#include "util/kmobject.h"
+#include "util/util.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+
+KUMA_NS_BEGIN
+
+/**
+ * DnsClient resolves host name by sending A and AAAA queries to the upstream
+ * DNS servers over UDP. all the interfaces should be called in loop thread
+ */
+class DnsClient : public KMObject
+{
+public:
+    /* err is NOERR if any address is resolved, NOT_EXIST if the name does not exist
+     * or has no address, otherwise the query is failed, e.g. timeout or server
+     * failure. ttl_ms is the TTL of the positive or negative answer
+     */
+    using QueryCallback = std::function<void(KMError err, const DnsResolver::AddressList &addrs, uint32_t ttl_ms)>;
+    using ServerList = std::vector<std::pair<std::string, uint16_t>>;
+    
+    DnsClient(const EventLoopPtr &loop);
+    ~DnsClient();
+    
+    KMError setServers(const ServerList &servers);
+    bool hasServers() const { return !servers_.empty(); }
+    KMError query(const std::string &host, QueryCallback cb);
+    void close();
+    
+    // append the name in DNS wire format to buf
+    static bool encodeName(const std::string &host, std::vector<uint8_t> &buf);
+    /* read the name at offset, the compression pointers are followed. offset is moved
+     * to the end of the name in place
+     */
+    static bool readName(const uint8_t *buf, size_t len, size_t &offset, std::string &name);
+    
+private:
+    struct Server
+    {
+        std::string ip;
+        uint16_t port = 0;
+        std::unique_ptr<UdpSocket::Impl> udp;
+    };
+    struct Query
+    {
+        std::string host;
+        QueryCallback cb;
+        int pending = 0;
+        int failed = 0;
+        DnsResolver::AddressList addrs_v6;
+        DnsResolver::AddressList addrs_v4;
+        uint32_t ttl_ms = -1;
+        uint32_t negative_ttl_ms = -1;
+    };
+    using QueryPtr = std::shared_ptr<Query>;
+    struct Question
+    {
+        uint16_t id = 0;
+        uint16_t qtype = 0;
+        QueryPtr query;
+        size_t server_index = 0;
+        int tries = 0;
+        TICK_COUNT_TYPE start_tick = 0;
+    };
+    
+    bool sendQuestion(Question &q);
+    void onReceive(size_t server_index);
+    void handleResponse(size_t server_index, const uint8_t *buf, size_t len);
+    void onTimer();
+    void retryQuestion(uint16_t id);
+    void finishQuestion(uint16_t id, KMError err, DnsResolver::AddressList &&addrs, uint32_t ttl_ms);
+    uint16_t newQuestionId();
+    
+private:
+    EventLoopWeakPtr            loop_;
+    std::vector<Server>         servers_;
+    std::map<uint16_t, Question> questions_;
+    Timer::Impl                 timer_;
+    std::mt19937                rand_gen_;
+};
+
+KUMA_NS_END
+
+#endif /* __DnsClient_h__ */
@@ -20,6 +20,7 @@
  */
 
 #include "DnsResolver.h"
+#include "DnsClient.h"
 #include "util/util.h"
 #include "util/kmtrace.h"
 
@@ -40,45 +41,57 @@
 
 #include <atomic>
 #include <chrono>
+#include <algorithm>
+#include <future>
+#include <sstream>
 using namespace std::chrono;
 
 using namespace kuma;
 
 KUMA_NS_BEGIN
 
-const int record_expires_intrval_ms = 10000; // 10 senonds
+const uint32_t kDefaultTtlMs = 10000; // TTL of getaddrinfo result, 10 seconds
+const uint32_t kNegativeTtlMs = 5000; // TTL of getaddrinfo failure
+const uint32_t kMinTtlMs = 1000;
+const uint32_t kMaxTtlMs = 3600*1000;
+const uint16_t kDnsPort = 53;
+const size_t kCacheShardCount = 16;
+const size_t kMaxRecordsPerShard = 1024;
 static std::string toEAIString(int v);
 
 class DnsRecord
 {
 public:
-    DnsRecord() = default;
-    DnsRecord(const DnsRecord &rhs)
-    : host(rhs.host), time(rhs.time)
-    {
-        memcpy(&addr, &rhs.addr, sizeof(addr));
-    }
-    DnsRecord(DnsRecord &&rhs)
-    : host(std::move(rhs.host)), time(std::move(rhs.time))
-    {
-        memcpy(&addr, &rhs.addr, sizeof(addr));
-    }
-    DnsRecord& operator=(const DnsRecord &rhs)
-    {
-        if (&rhs != this) {
-            host = rhs.host;
-            time = rhs.time;
-            memcpy(&addr, &rhs.addr, sizeof(addr));
-        }
-        return *this;
-    }
-    
-    std::string host;
-    sockaddr_storage addr{0};
-    time_point<steady_clock> time;
+    DnsResolver::AddressList addrs; // negative record if empty
+    time_point<steady_clock> expire_time;
+    std::list<std::string>::iterator lru_it;
+};
+
+// the cache is sharded by host to reduce the lock contention
+struct DnsCacheShard
+{
+    LockType locker;
+    std::unordered_map<std::string, DnsRecord> records;
+    // the hosts from most to least recently used
+    std::list<std::string> lru;
 };
-static LockType s_records_locker;
-static std::map<std::string, DnsRecord> s_dns_records;
+static DnsCacheShard s_cache_shards[kCacheShardCount];
+
+static DnsCacheShard& getCacheShard(const std::string &host)
+{
+    return s_cache_shards[std::hash<std::string>()(host) % kCacheShardCount];
+}
+
+static bool isLocalHost(const std::string &host)
+{
+    const std::string localhost("localhost");
+    if (is_equal(host, localhost)) {
+        return true;
+    }
+    return host.size() > localhost.size() &&
+        host[host.size() - localhost.size() - 1] == '.' &&
+        is_equal(host.substr(host.size() - localhost.size()), localhost);
+}
 
 KUMA_NS_END
 
@@ -109,22 +122,41 @@ DnsResolver::Token DnsResolver::resolve(const std::string &host, uint16_t port,
         return Token();
     }
     auto slot = std::make_shared<Slot>(std::move(cb), port);
+    bool first_request = false;
     {
         LockGuard g(locker_);
         auto &slots = requests_[host];
+        first_request = slots.empty();
         slots.push_back(slot);
     }
-    conv_.notify_one();
+    if (first_request) {
+        startResolve(host);
+    }
     return slot;
 }
 
 KMError DnsResolver::resolve(const std::string &host, uint16_t port, sockaddr_storage &addr)
 {
-    if (getAddress(host, addr) == KMError::NOERR) {
-        km_set_addr_port(port, addr);
+    AddressList addrs;
+    auto ret = resolve(host, port, addrs);
+    if (ret == KMError::NOERR) {
+        memcpy(&addr, &addrs[0], sizeof(addr));
+    }
+    return ret;
+}
+
+KMError DnsResolver::resolve(const std::string &host, uint16_t port, AddressList &addrs)
+{
+    auto ret = getAddress(host, addrs);
+    if (ret == KMError::NOERR) {
+        for (auto &addr : addrs) {
+            km_set_addr_port(port, addr);
+        }
         return KMError::NOERR;
+    } else if (ret != KMError::NOT_EXIST) {
+        return ret;
     }
-    return doResolve(host, port, addr);
+    return doResolve(host, port, addrs);
 }
 
 void DnsResolver::cancel(const std::string &host, const Token &t)
@@ -135,6 +167,57 @@ void DnsResolver::cancel(const std::string &host, const Token &t)
     }
 }
 
+KMError DnsResolver::setServers(const std::string &servers)
+{
+    DnsClient::ServerList server_list;
+    std::stringstream ss(servers);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        trim_left(item);
+        trim_right(item);
+        if (item.empty()) {
+            continue;
+        }
+        std::string ip(item);
+        uint16_t port = kDnsPort;
+        if (item[0] == '[') { // [ipv6]:port
+            auto pos = item.find(']');
+            if (pos == std::string::npos) {
+                return KMError::INVALID_PARAM;
+            }
+            ip = item.substr(1, pos - 1);
+            if (pos + 1 < item.size() && item[pos + 1] == ':') {
+                port = static_cast<uint16_t>(atoi(item.c_str() + pos + 2));
+            }
+        } else if (std::count(item.begin(), item.end(), ':') == 1) { // ipv4:port
+            auto pos = item.find(':');
+            ip = item.substr(0, pos);
+            port = static_cast<uint16_t>(atoi(item.c_str() + pos + 1));
+        }
+        if (!km_is_ip_address(ip.c_str())) {
+            KUMA_ERRTRACE("DnsResolver::setServers, invalid server, server=" << item);
+            return KMError::INVALID_PARAM;
+        }
+        server_list.emplace_back(ip, port);
+    }
+    
+    LockGuard g(dns_locker_);
+    if (server_list.empty()) {
+        use_dns_client_ = false;
+        stopDnsLoop();
+        return KMError::NOERR;
+    }
+    if (!startDnsLoop()) {
+        return KMError::FAILED;
+    }
+    KMError ret = KMError::FAILED;
+    dns_loop_->sync([this, &server_list, &ret] {
+        ret = dns_client_->setServers(server_list);
+    });
+    use_dns_client_ = ret == KMError::NOERR;
+    return ret;
+}
+
 bool DnsResolver::init()
 {
     stop_flag_ = false;
@@ -149,6 +232,11 @@ bool DnsResolver::init()
 
 void DnsResolver::stop()
 {
+    {
+        LockGuard g(dns_locker_);
+        use_dns_client_ = false;
+        stopDnsLoop();
+    }
     stop_flag_ = true;
     conv_.notify_all();
     
@@ -164,83 +252,229 @@ void DnsResolver::stop()
     threads_.clear();
 }
 
+bool DnsResolver::startDnsLoop()
+{
+    if (dns_loop_) {
+        return true;
+    }
+    auto loop = std::make_shared<EventLoop::Impl>();
+    std::promise<bool> ready;
+    auto ready_future = ready.get_future();
+    dns_thread_ = std::thread([this, loop, &ready] {
+        // loop must be initialized in its own thread
+        if (!loop->init()) {
+            ready.set_value(false);
+            return;
+        }
+        dns_client_.reset(new DnsClient(loop));
+        ready.set_value(true);
+        loop->loop();
+        dns_client_.reset();
+    });
+    if (!ready_future.get()) {
+        KUMA_ERRTRACE("DnsResolver::startDnsLoop, failed to init event loop");
+        dns_thread_.join();
+        return false;
+    }
+    dns_loop_ = loop;
+    return true;
+}
+
+void DnsResolver::stopDnsLoop()
+{
+    if (!dns_loop_) {
+        return;
+    }
+    dns_loop_->sync([this] {
+        dns_client_->close();
+    });
+    dns_loop_->stop();
+    if (dns_thread_.joinable()) {
+        dns_thread_.join();
+    }
+    dns_loop_.reset();
+}
+
+void DnsResolver::startResolve(const std::string &host)
+{
+    if (use_dns_client_ && !isLocalHost(host)) {
+        LockGuard g(dns_locker_);
+        if (dns_loop_ && dns_loop_->post([this, host] { queryByClient(host); }) == KMError::NOERR) {
+            return;
+        }
+    }
+    startFallback(host);
+}
+
+void DnsResolver::startFallback(const std::string &host)
+{
+    {
+        LockGuard g(locker_);
+        fallback_hosts_.push_back(host);
+    }
+    conv_.notify_one();
+}
+
+void DnsResolver::queryByClient(const std::string &host)
+{
+    AddressList addrs;
+    auto ret = getAddress(host, addrs);
+    if (ret != KMError::NOT_EXIST) { // resolved by others, or negatively cached
+        onResolved(host, ret, addrs);
+        return;
+    }
+    if (!dns_client_ || dns_client_->query(host, [this, host] (KMError err, const AddressList &addrs, uint32_t ttl_ms) {
+        onQueryResult(host, err, addrs, ttl_ms);
+    }) != KMError::NOERR) {
+        startFallback(host);
+    }
+}
+
+void DnsResolver::onQueryResult(const std::string &host, KMError err, const AddressList &addrs, uint32_t ttl_ms)
+{
+    if (err == KMError::NOERR) {
+        addRecord(host, addrs, ttl_ms);
+        onResolved(host, err, addrs);
+    } else if (err == KMError::NOT_EXIST) {
+        KUMA_INFOTRACE("DNS resolving, host not exist, host=" << host << ", ttl=" << ttl_ms);
+        addRecord(host, addrs, ttl_ms);
+        onResolved(host, KMError::FAILED, addrs);
+    } else {
+        KUMA_WARNTRACE("DNS query failed, fall back to getaddrinfo, host=" << host);
+        startFallback(host);
+    }
+}
+
+void DnsResolver::onResolved(const std::string &host, KMError err, const AddressList &addrs)
+{
+    SlotList slots;
+    {
+        LockGuard g(locker_);
+        auto it = requests_.find(host);
+        if (it != requests_.end()) {
+            slots.swap(it->second);
+            requests_.erase(it);
+        }
+    }
+    char ip[128] = { 0 };
+    if (!addrs.empty()) {
+        km_get_sock_addr((struct sockaddr*)&addrs[0], sizeof(addrs[0]), ip, sizeof(ip), nullptr);
+    }
+    KUMA_INFOTRACE("DNS resolved, host="<<host<<", ip="<<ip<<", count="<<addrs.size()<<", requests="<<slots.size());
+    for (auto &slot : slots) {
+        if (slot) {
+            AddressList slot_addrs(addrs);
+            for (auto &addr : slot_addrs) {
+                km_set_addr_port(slot->port, addr);
+            }
+            (*slot)(err, slot_addrs);
+        }
+    }
+}
+
 void DnsResolver::dnsProc()
 {
     while (!stop_flag_) {
         std::string host;
-        SlotList slots;
         
         {
             std::unique_lock<std::mutex> lk(locker_);
-            conv_.wait(lk, [this] { return !requests_.empty() || stop_flag_; });
+            conv_.wait(lk, [this] { return !fallback_hosts_.empty() || stop_flag_; });
             if (stop_flag_) {
                 break;
             }
-            auto it = requests_.begin();
-            if (it != requests_.end()) {
-                host = std::move(it->first);
-                slots.swap(it->second);
-                requests_.erase(it);
-            }
+            host = std::move(fallback_hosts_.front());
+            fallback_hosts_.pop_front();
         }
         
         if (host.empty()) {
             continue;
         }
 
-        sockaddr_storage addr = { 0 };
-        auto ret = doResolve(host, 0, addr);
-        char ip[128] = { 0 };
-        km_get_sock_addr((struct sockaddr*)&addr, sizeof(addr), ip, sizeof(ip), nullptr);
-        KUMA_INFOTRACE("DNS resolved, host="<<host<<", ip="<<ip);
-        for (auto &slot : slots) {
-            if (slot) {
-                km_set_addr_port(slot->port, addr);
-                (*slot)(ret, addr);
-            }
+        AddressList addrs;
+        auto ret = getAddress(host, addrs);
+        if (ret == KMError::NOT_EXIST) {
+            ret = doResolve(host, 0, addrs);
         }
+        onResolved(host, ret, addrs);
     }
     
     KUMA_INFOTRACE("DNS resolving thread exited");
 }
 
-KMError DnsResolver::doResolve(const std::string &host, uint16_t port, sockaddr_storage &addr)
+KMError DnsResolver::doResolve(const std::string &host, uint16_t port, AddressList &addrs)
 {
     struct addrinfo hints = { 0 };
     hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM; // avoid duplicated address for each socket type
     hints.ai_flags = AI_ADDRCONFIG; // will block 10 seconds in some case if not set AI_ADDRCONFIG
-    auto ret = km_set_sock_addr(host.c_str(), port, &hints, (struct sockaddr*)&addr, sizeof(addr));
+    addrs.clear();
+    auto ret = km_get_sock_addrs(host.c_str(), port, &hints, addrs);
     if (ret != 0) {
         KUMA_ERRTRACE("DNS resolving failure, host=" << host << ", err=" << toEAIString(ret));
+        if (ret == EAI_NONAME
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+            || ret == EAI_NODATA
+#endif
+            ) {
+            addRecord(host, AddressList(), kNegativeTtlMs);
+        }
         return KMError::FAILED;
     } else {
-        DnsRecord dr;
-        dr.host = host;
-        dr.time = steady_clock::now();
-        memcpy(&(dr.addr), &addr, sizeof(addr));
-        addRecord(dr);
+        addRecord(host, addrs, kDefaultTtlMs);
         return KMError::NOERR;
     }
 }
 
-void DnsResolver::addRecord(const DnsRecord &dr)
+void DnsResolver::addRecord(const std::string &host, const AddressList &addrs, uint32_t ttl_ms)
 {
-    LockGuard g(s_records_locker);
-    s_dns_records[dr.host] = dr;
+    ttl_ms = std::max(kMinTtlMs, std::min(ttl_ms, kMaxTtlMs));
+    auto now = steady_clock::now();
+    auto &shard = getCacheShard(host);
+    LockGuard g(shard.locker);
+    auto it = shard.records.find(host);
+    if (it != shard.records.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+    } else {
+        if (shard.records.size() >= kMaxRecordsPerShard) {
+            // evict the least recently used host
+            shard.records.erase(shard.lru.back());
+            shard.lru.pop_back();
+        }
+        shard.lru.push_front(host);
+        it = shard.records.emplace(host, DnsRecord()).first;
+        it->second.lru_it = shard.lru.begin();
+    }
+    it->second.addrs = addrs;
+    it->second.expire_time = now + milliseconds(ttl_ms);
 }
 
 KMError DnsResolver::getAddress(const std::string &host, sockaddr_storage &addr)
 {
-    LockGuard g(s_records_locker);
-    auto it = s_dns_records.find(host);
-    if (it != s_dns_records.end()) {
-        auto current = steady_clock::now();
-        auto diff_ms = duration_cast<milliseconds>(current - it->second.time).count();
-        if (diff_ms < record_expires_intrval_ms) {
-            memcpy(&addr, &it->second.addr, sizeof(addr));
+    AddressList addrs;
+    auto ret = getAddress(host, addrs);
+    if (ret == KMError::NOERR) {
+        memcpy(&addr, &addrs[0], sizeof(addr));
+    }
+    return ret;
+}
+
+KMError DnsResolver::getAddress(const std::string &host, AddressList &addrs)
+{
+    auto &shard = getCacheShard(host);
+    LockGuard g(shard.locker);
+    auto it = shard.records.find(host);
+    if (it != shard.records.end()) {
+        if (steady_clock::now() < it->second.expire_time) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+            if (it->second.addrs.empty()) {
+                return KMError::FAILED;
+            }
+            addrs = it->second.addrs;
             return KMError::NOERR;
         }
-        s_dns_records.erase(it);
+        shard.lru.erase(it->second.lru_it);
+        shard.records.erase(it);
     }
     return KMError::NOT_EXIST;
 }
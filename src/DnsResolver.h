@@ -23,6 +23,7 @@
 #define __DnsResolver_h__
 
 #include "kmdefs.h"
+#include "EventLoopImpl.h"
 
 #include <string>
 #include <map>
@@ -34,6 +35,7 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 
 #if defined(KUMA_OS_WIN)
 # include <Ws2tcpip.h>
@@ -47,10 +49,11 @@ using LockGuard = std::lock_guard<LockType>;
 using LockTypeR = std::recursive_mutex;
 using LockGuardR = std::lock_guard<LockTypeR>;
 
-class DnsRecord;
+class DnsClient;
 class DnsResolver final {
 public:
-    using ResolveCallback = std::function<void(KMError err, const sockaddr_storage &addr)>;
+    using AddressList = std::vector<sockaddr_storage>;
+    using ResolveCallback = std::function<void(KMError err, const AddressList &addrs)>;
     class Slot
     {
     public:
@@ -62,10 +65,10 @@ public:
         
     protected:
         friend class DnsResolver;
-        void operator()(KMError err, const sockaddr_storage &addr) {
+        void operator()(KMError err, const AddressList &addrs) {
             if (cb) {
                 LockGuardR g(m);
-                if (cb) cb(err, addr);
+                if (cb) cb(err, addrs);
             }
         }
         ResolveCallback cb;
@@ -75,10 +78,22 @@ public:
     using Token = std::weak_ptr<Slot>;
     
     static DnsResolver& get();
+    /* return NOT_EXIST if the host is not in cache, FAILED if the host is negatively cached
+     */
     KMError getAddress(const std::string &host, sockaddr_storage &addr);
+    KMError getAddress(const std::string &host, AddressList &addrs);
+    /* the callback will get all the addresses of host. the IPv6 addresses go first if
+     * host is resolved by the DNS client, otherwise in the order returned by getaddrinfo
+     */
     Token resolve(const std::string &host, uint16_t port, ResolveCallback cb);
     KMError resolve(const std::string &host, uint16_t port, sockaddr_storage &addr);
+    KMError resolve(const std::string &host, uint16_t port, AddressList &addrs);
     void cancel(const std::string &host, const Token &t);
+    /* set the upstream DNS servers, e.g. "8.8.8.8, [2001:4860:4860::8888]:53", the hosts
+     * will be resolved by UDP DNS client. getaddrinfo is used if no server is set or
+     * the query is failed
+     */
+    KMError setServers(const std::string &servers);
     void stop();
     
 protected:
@@ -87,18 +102,35 @@ protected:
     
     bool init();
     void dnsProc();
-    KMError doResolve(const std::string &host, uint16_t port, sockaddr_storage &addr);
+    KMError doResolve(const std::string &host, uint16_t port, AddressList &addrs);
+    void startResolve(const std::string &host);
+    void startFallback(const std::string &host);
+    void queryByClient(const std::string &host);
+    void onQueryResult(const std::string &host, KMError err, const AddressList &addrs, uint32_t ttl_ms);
+    void onResolved(const std::string &host, KMError err, const AddressList &addrs);
+    bool startDnsLoop();
+    void stopDnsLoop();
     
-    void addRecord(const DnsRecord &dr);
+    void addRecord(const std::string &host, const AddressList &addrs, uint32_t ttl_ms);
     
 protected:
     LockType locker_;
     using SlotList = std::list<std::shared_ptr<Slot>>;
+    // the hosts being resolved and their requests, the requests of same host are coalesced
     std::unordered_map<std::string, SlotList> requests_;
+    // the hosts waiting for getaddrinfo
+    std::list<std::string> fallback_hosts_;
     std::vector<std::thread> threads_;
-    int thread_count_ = 1;
+    int thread_count_ = 2;
     bool stop_flag_ = false;
     std::condition_variable conv_;
+    
+    // the UDP DNS client runs in dns_loop_
+    LockType dns_locker_;
+    EventLoopPtr dns_loop_;
+    std::thread dns_thread_;
+    std::unique_ptr<DnsClient> dns_client_;
+    std::atomic<bool> use_dns_client_{ false };
 };
 
 KUMA_NS_END
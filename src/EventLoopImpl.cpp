@@ -21,10 +21,12 @@
 
 #include "EventLoopImpl.h"
 #include "poll/IOPoll.h"
+#include "RateLimiter.h"
 #include "util/kmqueue.h"
 #include "util/kmtrace.h"
 #include <thread>
 #include <condition_variable>
+#include <atomic>
 
 KUMA_NS_BEGIN
 
@@ -186,6 +188,92 @@ void EventLoop::Impl::removePendingObject(PendingObject *obj)
     }
 }
 
+RateLimitManager* EventLoop::Impl::getRateLimitMgr()
+{
+    if (!rate_limit_mgr_) {
+        rate_limit_mgr_.reset(new RateLimitManager(timer_mgr_));
+    }
+    return rate_limit_mgr_.get();
+}
+
+size_t EventLoop::Impl::allocLocalSlot()
+{
+    static std::atomic<size_t> slot_seed{ 0 };
+    return slot_seed++;
+}
+
+LoopLocal* EventLoop::Impl::getLocal(size_t slot) const
+{
+    return slot < locals_.size() ? locals_[slot].get() : nullptr;
+}
+
+void EventLoop::Impl::setLocal(size_t slot, std::unique_ptr<LoopLocal> local)
+{
+    if (slot >= locals_.size()) {
+        locals_.resize(slot + 1);
+    }
+    locals_[slot] = std::move(local);
+}
+
+KMError EventLoop::Impl::setRateLimit(const std::string &group, uint32_t rate, uint32_t burst)
+{
+    return sync([=] {
+        getRateLimitMgr()->setRate(group, rate, burst);
+    });
+}
+
+KMError EventLoop::Impl::getRateLimitStats(const std::string &group, RateLimitStats &stats)
+{
+    KMError ret = KMError::NOT_EXIST;
+    auto err = sync([&] {
+        ret = getRateLimitMgr()->getStats(group, stats);
+    });
+    return err != KMError::NOERR ? err : ret;
+}
+
+void EventLoop::Impl::appendFlushObject(FlushObject *obj)
+{
+    KUMA_ASSERT(inSameThread());
+    if (obj->flush_queued_) {
+        return;
+    }
+    obj->prev_ = nullptr;
+    obj->next_ = flush_objects_;
+    if (flush_objects_) {
+        flush_objects_->prev_ = obj;
+    }
+    flush_objects_ = obj;
+    obj->flush_queued_ = true;
+}
+
+void EventLoop::Impl::removeFlushObject(FlushObject *obj)
+{
+    if (!obj->flush_queued_) {
+        return;
+    }
+    if (flush_objects_ == obj) {
+        flush_objects_ = obj->next_;
+    }
+    if (obj->prev_) {
+        obj->prev_->next_ = obj->next_;
+    }
+    if (obj->next_) {
+        obj->next_->prev_ = obj->prev_;
+    }
+    obj->next_ = obj->prev_ = nullptr;
+    obj->flush_queued_ = false;
+}
+
+void EventLoop::Impl::flushObjects()
+{
+    // the object may be destroyed or other objects may be appended in onLoopFlush
+    while (flush_objects_) {
+        auto obj = flush_objects_;
+        removeFlushObject(obj);
+        obj->onLoopFlush();
+    }
+}
+
 void EventLoop::Impl::processTasks()
 {
     TaskQueue tq;
@@ -219,7 +307,9 @@ void EventLoop::Impl::loopOnce(uint32_t max_wait_ms)
     if(wait_ms > max_wait_ms) {
         wait_ms = max_wait_ms;
     }
+    flushObjects();
     poll_->wait((uint32_t)wait_ms);
+    flushObjects();
 }
 
 void EventLoop::Impl::loop(uint32_t max_wait_ms)
@@ -228,6 +318,7 @@ void EventLoop::Impl::loop(uint32_t max_wait_ms)
         loopOnce(max_wait_ms);
     }
     processTasks();
+    flushObjects();
     
     while (pending_objects_) {
         auto obj = pending_objects_;
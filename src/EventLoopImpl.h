@@ -34,10 +34,13 @@
 #include <stdint.h>
 #include <thread>
 #include <list>
+#include <vector>
+#include <memory>
 
 KUMA_NS_BEGIN
 
 class IOPoll;
+class RateLimitManager;
 using EventLoopToken = EventLoop::Token::Impl;
 
 class TaskSlot
@@ -87,6 +90,32 @@ public:
     PendingObject* prev_ = nullptr;
 };
 
+/**
+ * FlushObject will be flushed at the end of current loop iteration, it is used to
+ * coalesce the small writes issued in one iteration
+ */
+class FlushObject
+{
+public:
+    virtual ~FlushObject() {}
+    virtual void onLoopFlush() = 0;
+
+public:
+    FlushObject* next_ = nullptr;
+    FlushObject* prev_ = nullptr;
+    bool flush_queued_ = false;
+};
+
+/**
+ * LoopLocal is the per-loop state of upper layers, it is kept in a slot of the
+ * loop and destroyed with the loop
+ */
+class LoopLocal
+{
+public:
+    virtual ~LoopLocal() {}
+};
+
 class EventLoop::Impl final : public KMObject
 {
 public:
@@ -122,9 +151,24 @@ public:
 
     void appendPendingObject(PendingObject *obj);
     void removePendingObject(PendingObject *obj);
+    
+    void appendFlushObject(FlushObject *obj);
+    void removeFlushObject(FlushObject *obj);
+    
+    // created on first use, should only be accessed in loop thread
+    RateLimitManager* getRateLimitMgr();
+    KMError setRateLimit(const std::string &group, uint32_t rate, uint32_t burst);
+    KMError getRateLimitStats(const std::string &group, RateLimitStats &stats);
+    
+    // slot is allocated once per type of LoopLocal, the locals should only be
+    // accessed in loop thread
+    static size_t allocLocalSlot();
+    LoopLocal* getLocal(size_t slot) const;
+    void setLocal(size_t slot, std::unique_ptr<LoopLocal> local);
 
 protected:
     void processTasks();
+    void flushObjects();
     
 protected:
     using ObserverQueue = DLQueue<ObserverCallback>;
@@ -145,6 +189,10 @@ protected:
     TimerManagerPtr     timer_mgr_;
 
     PendingObject*      pending_objects_ = nullptr;
+    FlushObject*        flush_objects_ = nullptr;
+    
+    std::unique_ptr<RateLimitManager> rate_limit_mgr_;
+    std::vector<std::unique_ptr<LoopLocal>> locals_;
 };
 using EventLoopPtr = std::shared_ptr<EventLoop::Impl>;
 using EventLoopWeakPtr = std::weak_ptr<EventLoop::Impl>;
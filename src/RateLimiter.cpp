@@ -0,0 +1,263 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "RateLimiter.h"
+#include "util/util.h"
+#include "util/kmtrace.h"
+
+using namespace kuma;
+
+namespace {
+    // the throttled limiters are resumed with this interval
+    const uint32_t kResumeIntervalMs = 10;
+    // default burst is the bytes of 100ms, but not less than max datagram size
+    const uint32_t kDefaultBurstMs = 100;
+    const uint32_t kMinDefaultBurst = 64*1024;
+}
+
+//////////////////////////////////////////////////////////////////////////
+TokenBucket::TokenBucket(uint32_t rate, uint32_t burst)
+{
+    setRate(rate, burst);
+}
+
+void TokenBucket::setRate(uint32_t rate, uint32_t burst)
+{
+    rate_ = rate;
+    burst_ = burst;
+    if (rate_ > 0 && burst_ == 0) {
+        burst_ = static_cast<uint32_t>((uint64_t)rate_ * kDefaultBurstMs / 1000);
+        if (burst_ < kMinDefaultBurst) {
+            burst_ = kMinDefaultBurst;
+        }
+    }
+    tokens_ = burst_;
+    last_tick_ = get_tick_count_ms();
+}
+
+size_t TokenBucket::available(TICK_COUNT_TYPE now_ms)
+{
+    if (unlimited()) {
+        return SIZE_MAX;
+    }
+    auto elapsed = calc_time_elapse_delta_ms(now_ms, last_tick_);
+    if (elapsed > 0) {
+        tokens_ += (double)rate_ * elapsed / 1000;
+        if (tokens_ > burst_) {
+            tokens_ = burst_;
+        }
+        last_tick_ = now_ms;
+    }
+    return tokens_ > 0 ? static_cast<size_t>(tokens_) : 0;
+}
+
+void TokenBucket::consume(size_t bytes)
+{
+    stats_.bytes_sent += bytes;
+    if (!unlimited()) {
+        tokens_ -= bytes;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+RateLimiter::RateLimiter(const EventLoopPtr &loop, ResumeCallback cb)
+: loop_(loop)
+, resume_cb_(std::move(cb))
+{
+    
+}
+
+RateLimiter::~RateLimiter()
+{
+    if (list_) {
+        auto loop = loop_.lock();
+        if (loop) {
+            loop->getRateLimitMgr()->removeWaiter(this);
+        }
+    }
+}
+
+KMError RateLimiter::setRate(uint32_t rate, uint32_t burst, const std::string &group)
+{
+    auto loop = loop_.lock();
+    if (!loop) {
+        return KMError::INVALID_STATE;
+    }
+    auto *mgr = loop->getRateLimitMgr();
+    bucket_.setRate(rate, burst);
+    group_bucket_ = group.empty() ? nullptr : mgr->getBucket(group);
+    loop_bucket_ = mgr->getBucket("");
+    return KMError::NOERR;
+}
+
+size_t RateLimiter::quota(size_t len)
+{
+    auto now_ms = get_tick_count_ms();
+    size_t ret = std::min(len, bucket_.available(now_ms));
+    if (ret > 0 && group_bucket_) {
+        ret = std::min(ret, group_bucket_->available(now_ms));
+    }
+    if (ret > 0) {
+        ret = std::min(ret, loop_bucket_->available(now_ms));
+    }
+    return ret;
+}
+
+void RateLimiter::consume(size_t bytes)
+{
+    bucket_.consume(bytes);
+    if (group_bucket_) {
+        group_bucket_->consume(bytes);
+    }
+    loop_bucket_->consume(bytes);
+}
+
+void RateLimiter::wait()
+{
+    auto loop = loop_.lock();
+    if (!loop || loop->getRateLimitMgr()->isWaiting(this)) {
+        return;
+    }
+    bucket_.onThrottled();
+    if (group_bucket_) {
+        group_bucket_->onThrottled();
+    }
+    loop_bucket_->onThrottled();
+    if (resume_cb_) {
+        loop->getRateLimitMgr()->appendWaiter(this);
+    }
+}
+
+void RateLimiter::onResume()
+{
+    if (resume_cb_) resume_cb_();
+}
+
+//////////////////////////////////////////////////////////////////////////
+RateLimitManager::RateLimitManager(const TimerManagerPtr &timer_mgr)
+: timer_(timer_mgr)
+{
+    buckets_.emplace("", std::make_shared<TokenBucket>());
+}
+
+RateLimitManager::~RateLimitManager()
+{
+    timer_.cancel();
+    while (waiters_) {
+        removeWaiter(waiters_);
+    }
+    while (resuming_) {
+        removeWaiter(resuming_);
+    }
+}
+
+KMError RateLimitManager::setRate(const std::string &group, uint32_t rate, uint32_t burst)
+{
+    getBucket(group)->setRate(rate, burst);
+    return KMError::NOERR;
+}
+
+KMError RateLimitManager::getStats(const std::string &group, RateLimitStats &stats)
+{
+    auto it = buckets_.find(group);
+    if (it == buckets_.end()) {
+        return KMError::NOT_EXIST;
+    }
+    stats = it->second->getStats();
+    return KMError::NOERR;
+}
+
+TokenBucketPtr RateLimitManager::getBucket(const std::string &group)
+{
+    auto &bucket = buckets_[group];
+    if (!bucket) {
+        // the group may be configured later
+        bucket = std::make_shared<TokenBucket>();
+    }
+    return bucket;
+}
+
+void RateLimitManager::appendWaiter(RateLimiter *limiter)
+{
+    if (limiter->list_) {
+        return;
+    }
+    limiter->list_ = &waiters_;
+    limiter->prev_ = waiters_tail_;
+    limiter->next_ = nullptr;
+    if (waiters_tail_) {
+        waiters_tail_->next_ = limiter;
+    } else {
+        waiters_ = limiter;
+    }
+    waiters_tail_ = limiter;
+    if (!timer_scheduled_) {
+        timer_scheduled_ = true;
+        timer_.schedule(kResumeIntervalMs, TimerMode::ONE_SHOT, [this] { onTimer(); });
+    }
+}
+
+void RateLimitManager::removeWaiter(RateLimiter *limiter)
+{
+    if (!limiter->list_) {
+        return;
+    }
+    if (limiter == waiters_tail_) {
+        waiters_tail_ = limiter->prev_;
+    }
+    if (limiter->prev_) {
+        limiter->prev_->next_ = limiter->next_;
+    } else {
+        *limiter->list_ = limiter->next_;
+    }
+    if (limiter->next_) {
+        limiter->next_->prev_ = limiter->prev_;
+    }
+    limiter->prev_ = limiter->next_ = nullptr;
+    limiter->list_ = nullptr;
+}
+
+void RateLimitManager::onTimer()
+{
+    timer_scheduled_ = false;
+    // the limiters may wait again or be destroyed in resume callback, so move
+    // them to resuming list and resume them one by one
+    resuming_ = waiters_;
+    if (resuming_ && resuming_->next_) {
+        // rotate the list, otherwise the first limiter would always take the
+        // tokens of shared group and loop buckets
+        auto *first = resuming_;
+        resuming_ = first->next_;
+        resuming_->prev_ = nullptr;
+        first->prev_ = waiters_tail_;
+        first->next_ = nullptr;
+        waiters_tail_->next_ = first;
+    }
+    waiters_ = waiters_tail_ = nullptr;
+    for (auto *limiter = resuming_; limiter; limiter = limiter->next_) {
+        limiter->list_ = &resuming_;
+    }
+    while (resuming_) {
+        auto *limiter = resuming_;
+        removeWaiter(limiter);
+        limiter->onResume();
+    }
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __RateLimiter_H__
+#define __RateLimiter_H__
+
+#include "kmdefs.h"
+#include "EventLoopImpl.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+KUMA_NS_BEGIN
+
+/* token bucket, the tokens are bytes and refilled lazily when queried.
+ * rate 0 means unlimited
+ */
+class TokenBucket
+{
+public:
+    TokenBucket(uint32_t rate = 0, uint32_t burst = 0);
+    
+    void setRate(uint32_t rate, uint32_t burst);
+    bool unlimited() const { return rate_ == 0; }
+    size_t available(TICK_COUNT_TYPE now_ms);
+    void consume(size_t bytes);
+    void onThrottled() { ++stats_.throttled_count; }
+    const RateLimitStats& getStats() const { return stats_; }
+    
+private:
+    uint32_t            rate_ = 0;
+    uint32_t            burst_ = 0;
+    double              tokens_ = 0;
+    TICK_COUNT_TYPE     last_tick_ = 0;
+    RateLimitStats      stats_;
+};
+using TokenBucketPtr = std::shared_ptr<TokenBucket>;
+
+class RateLimitManager;
+
+/* rate limiter of one connection, the connection bucket is chained with the group
+ * bucket and loop bucket, a send is allowed only if all of them have tokens.
+ * when throttled, the limiter waits in RateLimitManager and resume callback is
+ * called after tokens refilled. it should only be accessed in loop thread
+ */
+class RateLimiter
+{
+public:
+    using ResumeCallback = std::function<void(void)>;
+    
+    RateLimiter(const EventLoopPtr &loop, ResumeCallback cb);
+    ~RateLimiter();
+    
+    KMError setRate(uint32_t rate, uint32_t burst, const std::string &group);
+    // bytes can be sent now, not more than len
+    size_t quota(size_t len);
+    void consume(size_t bytes);
+    // wait for tokens refilled, resume callback will be called if it is set
+    void wait();
+    const RateLimitStats& getStats() const { return bucket_.getStats(); }
+    
+private:
+    friend class RateLimitManager;
+    void onResume();
+    
+private:
+    EventLoopWeakPtr    loop_;
+    ResumeCallback      resume_cb_;
+    TokenBucket         bucket_;
+    TokenBucketPtr      group_bucket_;
+    TokenBucketPtr      loop_bucket_;
+    
+    // intrusive list node of RateLimitManager, list_ is the head of the list
+    // the limiter is in
+    RateLimiter*        prev_ = nullptr;
+    RateLimiter*        next_ = nullptr;
+    RateLimiter**       list_ = nullptr;
+};
+
+/* one per event loop, it holds the group and loop buckets, and resumes all the
+ * throttled limiters with a single timer, so the number of limiters is not bound
+ * by timers
+ */
+class RateLimitManager
+{
+public:
+    RateLimitManager(const TimerManagerPtr &timer_mgr);
+    ~RateLimitManager();
+    
+    // empty group is the loop level limit
+    KMError setRate(const std::string &group, uint32_t rate, uint32_t burst);
+    KMError getStats(const std::string &group, RateLimitStats &stats);
+    TokenBucketPtr getBucket(const std::string &group);
+    
+    void appendWaiter(RateLimiter *limiter);
+    void removeWaiter(RateLimiter *limiter);
+    bool isWaiting(const RateLimiter *limiter) const { return limiter->list_ == &waiters_; }
+    
+private:
+    void onTimer();
+    
+private:
+    std::map<std::string, TokenBucketPtr> buckets_;
+    RateLimiter*        waiters_ = nullptr;
+    RateLimiter*        waiters_tail_ = nullptr;
+    RateLimiter*        resuming_ = nullptr;
+    Timer::Impl         timer_;
+    bool                timer_scheduled_ = false;
+};
+
+KUMA_NS_END
+
+#endif
@@ -39,6 +39,7 @@
 # include <arpa/inet.h>
 # include <netinet/tcp.h>
 # include <netinet/in.h>
+# include <sys/sendfile.h>
 # ifdef KUMA_OS_ANDROID
 #  include <sys/uio.h>
 # endif
@@ -61,10 +62,16 @@
 # error "UNSUPPORTED OS"
 #endif
 
+#include <algorithm>
+
 using namespace kuma;
 
+// RFC 8305, Connection Attempt Delay
+const uint32_t kConnectionAttemptDelayMs = 250;
+
 SocketBase::SocketBase(const EventLoopPtr &loop)
     : loop_(loop), timer_(loop?loop->getTimerMgr():nullptr)
+    , attempt_timer_(loop?loop->getTimerMgr():nullptr)
 {
     KM_SetObjKey("SocketBase");
 }
@@ -79,6 +86,7 @@ SocketBase::~SocketBase()
 void SocketBase::cleanup()
 {
     timer_.cancel();
+    cleanupAttempts();
     if (!dns_token_.expired()) {
         DnsResolver::get().cancel("", dns_token_);
         dns_token_.reset();
@@ -141,14 +149,25 @@ KMError SocketBase::connect(const std::string &host, uint16_t port, EventCallbac
             onConnect(KMError::TIMEOUT);
         });
     }
-    if (!km_is_ip_address(host.c_str())) {
+    if (km_is_unix_address(host)) {
         sockaddr_storage ss_addr = { 0 };
-        if (DnsResolver::get().getAddress(host, ss_addr) == KMError::NOERR) {
-            return connect_i(ss_addr, timeout_ms);
+        if (km_set_unix_addr(host, ss_addr) != 0) {
+            KUMA_ERRXTRACE("connect, invalid unix domain socket address, host=" << host);
+            return KMError::INVALID_PARAM;
+        }
+        return connect_i(ss_addr, timeout_ms);
+    }
+    if (!km_is_ip_address(host.c_str())) {
+        DnsResolver::AddressList addrs;
+        if (DnsResolver::get().getAddress(host, addrs) == KMError::NOERR) {
+            for (auto &addr : addrs) {
+                km_set_addr_port(port, addr);
+            }
+            return connect_i(addrs, timeout_ms);
         }
         setState(RESOLVING);
-        dns_token_ = DnsResolver::get().resolve(host, port, [this](KMError err, const sockaddr_storage &addr) {
-            onResolved(err, addr);
+        dns_token_ = DnsResolver::get().resolve(host, port, [this](KMError err, const DnsResolver::AddressList &addrs) {
+            onResolved(err, addrs);
         });
         return KMError::NOERR;
     }
@@ -220,6 +239,158 @@ KMError SocketBase::connect_i(const sockaddr_storage &ss_addr, uint32_t timeout_
     return KMError::NOERR;
 }
 
+KMError SocketBase::connect_i(const DnsResolver::AddressList &addrs, uint32_t timeout_ms)
+{
+    if (addrs.empty()) {
+        return KMError::INVALID_PARAM;
+    }
+    if (addrs.size() == 1 || fd_ != INVALID_FD) {
+        // single address or the socket is already bound
+        return connect_i(addrs[0], timeout_ms);
+    }
+    
+    // interleave the address families, starting with the family of first address
+    DnsResolver::AddressList first_family, second_family;
+    for (auto &addr : addrs) {
+        if (addr.ss_family == addrs[0].ss_family) {
+            first_family.push_back(addr);
+        } else {
+            second_family.push_back(addr);
+        }
+    }
+    conn_addrs_.clear();
+    for (size_t i = 0; i < first_family.size() || i < second_family.size(); ++i) {
+        if (i < first_family.size()) {
+            conn_addrs_.push_back(first_family[i]);
+        }
+        if (i < second_family.size()) {
+            conn_addrs_.push_back(second_family[i]);
+        }
+    }
+    next_addr_index_ = 0;
+    setState(State::CONNECTING);
+    auto ret = startNextAttempt();
+    if (ret != KMError::NOERR) {
+        cleanup();
+        setState(State::CLOSED);
+    }
+    return ret;
+}
+
+KMError SocketBase::startNextAttempt()
+{
+    auto loop = loop_.lock();
+    if (!loop) {
+        return KMError::INVALID_STATE;
+    }
+    while (next_addr_index_ < conn_addrs_.size()) {
+        auto &ss_addr = conn_addrs_[next_addr_index_++];
+        char ip[128] = { 0 };
+        uint16_t port = 0;
+        km_get_sock_addr((struct sockaddr*)&ss_addr, sizeof(ss_addr), ip, sizeof(ip), &port);
+        
+        SOCKET_FD fd = createFd(ss_addr.ss_family);
+        if (INVALID_FD == fd) {
+            KUMA_ERRXTRACE("startNextAttempt, socket failed, ip=" << ip << ", err=" << getLastError());
+            continue;
+        }
+        setSocketOption(fd);
+        int addr_len = km_get_addr_length(ss_addr);
+        int ret = ::connect(fd, (struct sockaddr *)&ss_addr, addr_len);
+        if (ret < 0 &&
+#ifdef KUMA_OS_WIN
+            WSAEWOULDBLOCK
+#else
+            EINPROGRESS
+#endif
+            != getLastError()) {
+            KUMA_WARNXTRACE("startNextAttempt, connect failed, ip=" << ip << ", err=" << getLastError());
+            closeFd(fd);
+            continue;
+        }
+        if (loop->registerFd(fd, KUMA_EV_NETWORK, [this, fd](KMEvent ev, void* ol, size_t io_size) {
+            onAttemptEvent(fd, ev, ol, io_size);
+        }) != KMError::NOERR) {
+            closeFd(fd);
+            continue;
+        }
+        attempt_fds_.push_back(fd);
+        KUMA_INFOXTRACE("startNextAttempt, fd=" << fd << ", ip=" << ip << ", port=" << port
+            << ", attempts=" << attempt_fds_.size());
+        if (next_addr_index_ < conn_addrs_.size()) {
+            attempt_timer_.schedule(kConnectionAttemptDelayMs, TimerMode::ONE_SHOT, [this] {
+                if (startNextAttempt() != KMError::NOERR) {
+                    onConnect(KMError::FAILED);
+                }
+            });
+        }
+        return KMError::NOERR;
+    }
+    return attempt_fds_.empty() ? KMError::FAILED : KMError::NOERR;
+}
+
+void SocketBase::onAttemptEvent(SOCKET_FD fd, KMEvent events, void* ol, size_t io_size)
+{
+    if (fd == fd_) { // the winner
+        ioReady(events, ol, io_size);
+        return;
+    }
+    if (getState() != State::CONNECTING) {
+        return;
+    }
+    int err = 0;
+#if defined(KUMA_OS_LINUX) || defined(KUMA_OS_MAC)
+    socklen_t len = sizeof(err);
+#else
+    int len = sizeof(err);
+#endif
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&err, &len);
+    if ((events & KUMA_EV_ERROR) || err != 0) {
+        KUMA_WARNXTRACE("onAttemptEvent, attempt failed, fd=" << fd << ", events=" << events << ", err=" << err);
+        removeAttempt(fd, true);
+        // start next attempt immediately
+        attempt_timer_.cancel();
+        if (startNextAttempt() != KMError::NOERR) {
+            onConnect(KMError::POLL_ERROR);
+        }
+        return;
+    }
+    
+    // the first established connection wins, cancel others
+    removeAttempt(fd, false);
+    cleanupAttempts();
+    fd_ = fd;
+    registered_ = true;
+    KUMA_INFOXTRACE("onAttemptEvent, connected, fd=" << fd_);
+    ioReady(events, ol, io_size);
+}
+
+void SocketBase::removeAttempt(SOCKET_FD fd, bool close_fd)
+{
+    auto it = std::find(attempt_fds_.begin(), attempt_fds_.end(), fd);
+    if (it != attempt_fds_.end()) {
+        attempt_fds_.erase(it);
+        if (close_fd) {
+            auto loop = loop_.lock();
+            if (loop) {
+                loop->unregisterFd(fd, true);
+            } else {
+                closeFd(fd);
+            }
+        }
+    }
+}
+
+void SocketBase::cleanupAttempts()
+{
+    attempt_timer_.cancel();
+    while (!attempt_fds_.empty()) {
+        removeAttempt(attempt_fds_.back(), true);
+    }
+    conn_addrs_.clear();
+    next_addr_index_ = 0;
+}
+
 KMError SocketBase::attachFd(SOCKET_FD fd)
 {
     if (getState() != State::IDLE) {
@@ -364,6 +535,55 @@ int SocketBase::send(const iovec* iovs, int count)
     return ret;
 }
 
+int SocketBase::sendFile(int file_fd, int64_t offset, size_t length)
+{
+    if (!isReady()) {
+        KUMA_WARNXTRACE("sendFile, invalid state=" << getState());
+        return 0;
+    }
+    if (0 == length) {
+        return 0;
+    }
+    if (length > 0x7FFFF000) {
+        length = 0x7FFFF000;
+    }
+    int ret = 0;
+#if defined(KUMA_OS_LINUX)
+    off_t off = static_cast<off_t>(offset);
+    ret = (int)::sendfile(fd_, file_fd, &off, length);
+#elif defined(KUMA_OS_MAC)
+    off_t len = static_cast<off_t>(length);
+    ret = ::sendfile(file_fd, fd_, static_cast<off_t>(offset), &len, nullptr, 0);
+    if (len > 0 || ret == 0) {
+        // the bytes sent is returned in len even if it is interrupted
+        ret = static_cast<int>(len);
+    }
+#else
+    KUMA_ERRXTRACE("sendFile, not supported");
+    return -1;
+#endif
+    if (0 == ret) {
+        KUMA_ERRXTRACE("sendFile, end of file, offset=" << offset);
+        ret = -1;
+    }
+    else if (ret < 0) {
+        if (EAGAIN == getLastError() || EWOULDBLOCK == getLastError()) {
+            ret = 0;
+        }
+        else {
+            KUMA_ERRXTRACE("sendFile, fail, err=" << getLastError());
+        }
+    }
+    
+    if (ret >= 0 && static_cast<size_t>(ret) < length) {
+        notifySendBlocked();
+    } else if (ret < 0) {
+        cleanup();
+        setState(State::CLOSED);
+    }
+    return ret;
+}
+
 int SocketBase::send(const KMBuffer &buf)
 {
     IOVEC iovs;
@@ -409,6 +629,118 @@ int SocketBase::receive(void* data, size_t length)
     return ret;
 }
 
+int SocketBase::sendFd(SOCKET_FD fd, const void* data, size_t length)
+{
+#ifdef KUMA_OS_WIN
+    return -1;
+#else
+    if (!isReady()) {
+        KUMA_WARNXTRACE("sendFd, invalid state=" << getState());
+        return 0;
+    }
+    if (!data || 0 == length) {
+        return -1;
+    }
+    iovec iov;
+    iov.iov_base = (char*)data;
+    iov.iov_len = length;
+    union {
+        cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } cmsg_buf;
+    memset(&cmsg_buf, 0, sizeof(cmsg_buf));
+    msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf.buf;
+    msg.msg_controllen = sizeof(cmsg_buf.buf);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    
+    int ret = (int)::sendmsg(fd_, &msg, 0);
+    if (ret < 0) {
+        if (EAGAIN == getLastError() || EWOULDBLOCK == getLastError()) {
+            ret = 0;
+        } else {
+            KUMA_ERRXTRACE("sendFd, failed, err=" << getLastError());
+        }
+    }
+    if (ret >= 0 && static_cast<size_t>(ret) < length) {
+        notifySendBlocked();
+    } else if (ret < 0) {
+        cleanup();
+        setState(State::CLOSED);
+    }
+    return ret;
+#endif
+}
+
+int SocketBase::receiveFd(SOCKET_FD &fd, void* data, size_t length)
+{
+    fd = INVALID_FD;
+#ifdef KUMA_OS_WIN
+    return -1;
+#else
+    if (!isReady()) {
+        return 0;
+    }
+    iovec iov;
+    iov.iov_base = (char*)data;
+    iov.iov_len = length;
+    union {
+        cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * 4)];
+    } cmsg_buf;
+    msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf.buf;
+    msg.msg_controllen = sizeof(cmsg_buf.buf);
+    int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+    int ret = (int)::recvmsg(fd_, &msg, flags);
+    if (0 == ret) {
+        KUMA_WARNXTRACE("receiveFd, peer closed, err=" << getLastError());
+        ret = -1;
+    } else if (ret < 0) {
+        if (EAGAIN == getLastError() || EWOULDBLOCK == getLastError()) {
+            ret = 0;
+        } else {
+            KUMA_ERRXTRACE("receiveFd, failed, err=" << getLastError());
+        }
+    } else {
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            auto fd_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < fd_count; ++i) {
+                int recv_fd = INVALID_FD;
+                memcpy(&recv_fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (INVALID_FD == fd) {
+                    fd = recv_fd;
+                } else {
+                    closeFd(recv_fd); // only one fd is accepted
+                }
+            }
+        }
+        if (msg.msg_flags & MSG_CTRUNC) {
+            KUMA_WARNXTRACE("receiveFd, control data truncated");
+        }
+    }
+    if (ret < 0) {
+        cleanup();
+        setState(State::CLOSED);
+    }
+    return ret;
+#endif
+}
+
 KMError SocketBase::close()
 {
     KUMA_INFOXTRACE("close, state=" << getState());
@@ -447,30 +779,35 @@ KMError SocketBase::resume()
 
 void SocketBase::setSocketOption()
 {
-    if (INVALID_FD == fd_) {
+    setSocketOption(fd_);
+}
+
+void SocketBase::setSocketOption(SOCKET_FD fd)
+{
+    if (INVALID_FD == fd) {
         return;
     }
 
 #ifdef KUMA_OS_LINUX
-    fcntl(fd_, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
 #endif
 
     // nonblock
-    set_nonblocking(fd_);
+    set_nonblocking(fd);
 
     if (0) {
         int opt_val = 1;
-        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, (char*)&opt_val, sizeof(int));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt_val, sizeof(int));
     }
 
-    if (set_tcpnodelay(fd_) != 0) {
-        KUMA_WARNXTRACE("setSocketOption, failed to set TCP_NODELAY, fd=" << fd_ << ", err=" << getLastError());
+    if (set_tcpnodelay(fd) != 0 && getLastError() != EOPNOTSUPP) { // EOPNOTSUPP on unix domain socket
+        KUMA_WARNXTRACE("setSocketOption, failed to set TCP_NODELAY, fd=" << fd << ", err=" << getLastError());
     }
     
 #ifdef KUMA_OS_MAC
     // ignore SIGPIPE
     int opt_val = 1;
-    if (setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &opt_val, sizeof(opt_val))) {
+    if (setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt_val, sizeof(opt_val))) {
         // failed
     }
 #endif
@@ -492,13 +829,15 @@ void SocketBase::notifySendReady()
     }
 }
 
-void SocketBase::onResolved(KMError err, const sockaddr_storage &addr)
+void SocketBase::onResolved(KMError err, const DnsResolver::AddressList &addrs)
 {
     auto loop = loop_.lock();
     if (loop) {
-        loop->async([=] { // addr is captured by value
+        loop->async([=] { // addrs is captured by value
             if (err == KMError::NOERR) {
-                connect_i(addr, -1);
+                if (connect_i(addrs, -1) != KMError::NOERR) {
+                    onConnect(KMError::FAILED);
+                }
             }
             else {
                 onConnect(err);
@@ -46,6 +46,14 @@ public:
     virtual int send(const iovec* iovs, int count);
     virtual int send(const KMBuffer &buf);
     virtual int receive(void* data, size_t length);
+    /* pass file descriptor over unix domain socket (SCM_RIGHTS), the fd is sent
+     * along with the data, length should not be 0
+     */
+    virtual int sendFd(SOCKET_FD fd, const void* data, size_t length);
+    virtual int receiveFd(SOCKET_FD &fd, void* data, size_t length);
+    /* send file data by sendfile, return -1 if sendfile is not supported
+     */
+    virtual int sendFile(int file_fd, int64_t offset, size_t length);
     virtual KMError pause();
     virtual KMError resume();
     virtual KMError close();
@@ -70,8 +78,14 @@ protected:
     State getState() const { return state_; }
     void setState(State state) { state_ = state; }
     void setSocketOption();
+    void setSocketOption(SOCKET_FD fd);
     KMError connect_i(const std::string &addr, uint16_t port, uint32_t timeout_ms);
     virtual KMError connect_i(const sockaddr_storage &ss_addr, uint32_t timeout_ms);
+    /* Happy Eyeballs (RFC 8305), the addresses are interleaved by address family,
+     * and a new connection attempt is started every 250ms or when previous attempt
+     * failed. the first established connection wins and others are cancelled
+     */
+    virtual KMError connect_i(const DnsResolver::AddressList &addrs, uint32_t timeout_ms);
     void cleanup();
     virtual bool registerFd(SOCKET_FD fd);
     virtual void unregisterFd(SOCKET_FD fd, bool close_fd);
@@ -79,7 +93,11 @@ protected:
     virtual void notifySendReady();
 
 protected:
-    void onResolved(KMError err, const sockaddr_storage &addr);
+    void onResolved(KMError err, const DnsResolver::AddressList &addrs);
+    KMError startNextAttempt();
+    void onAttemptEvent(SOCKET_FD fd, KMEvent events, void* ol, size_t io_size);
+    void removeAttempt(SOCKET_FD fd, bool close_fd);
+    void cleanupAttempts();
 
     virtual void ioReady(KMEvent events, void* ol, size_t io_size);
     virtual void onConnect(KMError err);
@@ -100,6 +118,12 @@ protected:
     EventCallback       error_cb_;
 
     Timer::Impl         timer_;
+    
+    // the racing connection attempts of Happy Eyeballs
+    DnsResolver::AddressList    conn_addrs_;
+    size_t                      next_addr_index_{ 0 };
+    std::vector<SOCKET_FD>      attempt_fds_;
+    Timer::Impl                 attempt_timer_;
 };
 
 KUMA_NS_END
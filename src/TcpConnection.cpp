@@ -30,7 +30,8 @@ using namespace kuma;
 TcpConnection::TcpConnection(const EventLoopPtr &loop)
 : tcp_(loop)
 {
-    
+    // coalesce the writes (e.g. HTTP header and body) issued in one callback
+    tcp_.setAutoCork(true);
 }
 
 TcpConnection::~TcpConnection()
@@ -40,6 +41,8 @@ TcpConnection::~TcpConnection()
 
 void TcpConnection::cleanup()
 {
+    init_token_.reset();
+    read_paused_ = false;
     tcp_.close();
 }
 
@@ -68,9 +71,8 @@ KMError TcpConnection::connect(const std::string &host, uint16_t port)
 void TcpConnection::saveInitData(const KMBuffer *init_buf)
 {
     if(init_buf && init_buf->chainLength() > 0) {
-        auto chain_size = init_buf->chainLength();
-        initData_.resize(chain_size);
-        init_buf->readChained(&initData_[0], initData_.size());
+        // the data is shared instead of copied if init_buf is refcounted
+        init_buf_.reset(init_buf->clone());
     }
 }
 
@@ -80,31 +82,53 @@ KMError TcpConnection::attachFd(SOCKET_FD fd, const KMBuffer *init_buf)
     setupCallbacks();
     saveInitData(init_buf);
     
-    return tcp_.attachFd(fd);
+    auto ret = tcp_.attachFd(fd);
+    if (ret == KMError::NOERR) {
+        postInitData();
+    }
+    return ret;
 }
 
-KMError TcpConnection::attachSocket(TcpSocket::Impl &&tcp, const KMBuffer *init_buf)
+KMError TcpConnection::attachSocket(TcpSocket::Impl &&tcp, const KMBuffer *init_buf, bool is_server)
 {
-    isServer_ = true;
+    isServer_ = is_server;
     setupCallbacks();
     saveInitData(init_buf);
     
-    return tcp_.attach(std::move(tcp));
+    auto ret = tcp_.attach(std::move(tcp));
+    if (ret == KMError::NOERR) {
+        postInitData();
+    }
+    return ret;
+}
+
+void TcpConnection::postInitData()
+{
+    if (init_buf_) {
+        // the init data may be all that peer sent, there is no read event for it
+        init_token_.eventLoop(eventLoop());
+        eventLoop()->post([this] { onReceive(KMError::NOERR); }, &init_token_);
+    }
 }
 
 int TcpConnection::send(const void* data, size_t len)
 {
     if(!sendBufferEmpty()) {
         // try to send buffered data
-        auto ret = sendBufferedData();
-        if (ret != KMError::NOERR) {
+        if (sendBufferedData() != KMError::NOERR) {
             return -1;
-        } else if (!sendBufferEmpty()) {
-            return 0;
         }
     }
-    int ret = tcp_.send(data, len);
-    if (ret > 0) {
+    if (sendBufferBlocked()) {
+        return 0;
+    } else if (!sendBufferEmpty()) {
+        // below high watermark, queue it behind the buffered data
+        KMBuffer buf(data, len, len);
+        appendSendBuffer(buf);
+        return int(len);
+    }
+    int ret = sendToSocket(data, len);
+    if (len > 0 && canQueueRefused(ret)) {
         if (static_cast<size_t>(ret) < len) {
             KMBuffer buf((char*)data + ret, len - ret, len - ret);
             appendSendBuffer(buf);
@@ -117,10 +141,25 @@ int TcpConnection::send(const void* data, size_t len)
 int TcpConnection::send(const iovec* iovs, int count)
 {
     if(!sendBufferEmpty()) {
+        // try to send buffered data
+        if (sendBufferedData() != KMError::NOERR) {
+            return -1;
+        }
+    }
+    if (sendBufferBlocked()) {
         return 0;
+    } else if (!sendBufferEmpty()) {
+        // below high watermark, queue it behind the buffered data
+        size_t total_len = 0;
+        for (int i=0; i<count; ++i) {
+            KMBuffer buf(iovs[i].iov_base, iovs[i].iov_len, iovs[i].iov_len);
+            appendSendBuffer(buf);
+            total_len += iovs[i].iov_len;
+        }
+        return int(total_len);
     }
-    int ret = tcp_.send(iovs, count);
-    if (ret >= 0) {
+    int ret = sendToSocket(iovs, count);
+    if (canQueueRefused(ret)) {
         size_t total_len = 0;
         for (int i=0; i<count; ++i) {
             total_len += iovs[i].iov_len;
@@ -143,26 +182,56 @@ int TcpConnection::send(const KMBuffer &buf)
 {
     if(!sendBufferEmpty()) {
         // try to send buffered data
-        auto ret = sendBufferedData();
-        if (ret != KMError::NOERR) {
+        if (sendBufferedData() != KMError::NOERR) {
             return -1;
-        } else if (!sendBufferEmpty()) {
-            return 0;
         }
     }
+    if (sendBufferBlocked()) {
+        return 0;
+    } else if (!sendBufferEmpty()) {
+        // below high watermark, queue it behind the buffered data
+        appendSendBuffer(buf);
+        return static_cast<int>(buf.chainLength());
+    }
     int chain_len = static_cast<int>(buf.chainLength());
-    int ret = tcp_.send(buf);
-    if (ret > 0) {
+    int ret = sendToSocket(buf);
+    if (chain_len > 0 && canQueueRefused(ret)) {
         if (ret < chain_len) {
             if (send_buffer_) {
                 send_buffer_->append(buf.subbuffer(ret, chain_len - ret));
             } else {
                 send_buffer_.reset(buf.subbuffer(ret, chain_len - ret));
             }
+            send_buffer_bytes_ += chain_len - ret;
         }
         return chain_len;
     }
     return ret;
+}
+
+int TcpConnection::sendFile(int file_fd, int64_t offset, size_t len)
+{
+    if(!sendBufferEmpty()) {
+        auto ret = sendBufferedData();
+        if (ret != KMError::NOERR) {
+            return -1;
+        } else if (!sendBufferEmpty()) {
+            return 0;
+        }
+    }
+    if (rate_limiter_) {
+        auto quota = rate_limiter_->quota(len);
+        int ret = quota > 0 ? tcp_.sendFile(file_fd, offset, quota) : 0;
+        if (ret > 0) {
+            rate_limiter_->consume(ret);
+        }
+        if (quota < len) {
+            // onSend will be called when tokens refilled
+            rate_limiter_->wait();
+        }
+        return ret;
+    }
+    return tcp_.sendFile(file_fd, offset, len);
 }
 
 KMError TcpConnection::close()
@@ -172,16 +241,121 @@ KMError TcpConnection::close()
     return KMError::NOERR;
 }
 
+KMError TcpConnection::setSendBufferWatermark(size_t high_mark, size_t low_mark)
+{
+    if (low_mark > high_mark) {
+        return KMError::INVALID_PARAM;
+    }
+    high_watermark_ = high_mark;
+    low_watermark_ = low_mark;
+    return KMError::NOERR;
+}
+
+KMError TcpConnection::setRateLimit(uint32_t rate, uint32_t burst, const std::string &group)
+{
+    auto loop = eventLoop();
+    if (!loop) {
+        return KMError::INVALID_STATE;
+    }
+    KMError ret = KMError::NOERR;
+    // the rate limiters of loop should be accessed in loop thread
+    loop->sync([&] {
+        if (!rate_limiter_) {
+            rate_limiter_.reset(new RateLimiter(loop, [this] {
+                if (tcp_.isReady()) {
+                    onSend(KMError::NOERR);
+                }
+            }));
+        }
+        ret = rate_limiter_->setRate(rate, burst, group);
+    });
+    return ret;
+}
+
+KMError TcpConnection::getRateLimitStats(RateLimitStats &stats) const
+{
+    if (!rate_limiter_) {
+        return KMError::INVALID_STATE;
+    }
+    stats = rate_limiter_->getStats();
+    return KMError::NOERR;
+}
+
+int TcpConnection::sendToSocket(const void* data, size_t len)
+{
+    if (!rate_limiter_) {
+        return tcp_.send(data, len);
+    }
+    iovec iov;
+    iov.iov_base = (char*)data;
+    iov.iov_len = len;
+    return sendToSocket(&iov, 1);
+}
+
+int TcpConnection::sendToSocket(const iovec* iovs, int count)
+{
+    if (!rate_limiter_) {
+        return tcp_.send(iovs, count);
+    }
+    size_t total_len = 0;
+    for (int i=0; i<count; ++i) {
+        total_len += iovs[i].iov_len;
+    }
+    if (total_len == 0) {
+        return 0;
+    }
+    auto quota = rate_limiter_->quota(total_len);
+    int ret = 0;
+    if (quota == total_len) {
+        ret = tcp_.send(iovs, count);
+    } else if (quota > 0) {
+        IOVEC limited_iovs;
+        size_t left = quota;
+        for (int i=0; i<count && left > 0; ++i) {
+            iovec iov = iovs[i];
+            if (iov.iov_len > left) {
+                iov.iov_len = left;
+            }
+            left -= iov.iov_len;
+            limited_iovs.push_back(iov);
+        }
+        ret = tcp_.send(&limited_iovs[0], static_cast<int>(limited_iovs.size()));
+    }
+    if (ret > 0) {
+        rate_limiter_->consume(ret);
+    }
+    if (quota < total_len) {
+        // onSend will be called when tokens refilled
+        rate_limiter_->wait();
+    }
+    return ret;
+}
+
+int TcpConnection::sendToSocket(const KMBuffer &buf)
+{
+    if (!rate_limiter_) {
+        return tcp_.send(buf);
+    }
+    IOVEC iovs;
+    buf.fillIov(iovs);
+    if (iovs.empty()) {
+        return 0;
+    }
+    return sendToSocket(&iovs[0], static_cast<int>(iovs.size()));
+}
+
 KMError TcpConnection::sendBufferedData()
 {
     if(send_buffer_ && !send_buffer_->empty()) {
-        int ret = tcp_.send(*send_buffer_);
+        int ret = sendToSocket(*send_buffer_);
         if(ret < 0) {
             return KMError::SOCK_ERROR;
         } else {
             send_buffer_->bytesRead(ret);
+            send_buffer_bytes_ -= ret;
             if (send_buffer_->empty()) {
                 send_buffer_.reset();
+                send_buffer_bytes_ = 0;
             }
         }
     }
@@ -195,12 +369,33 @@ void TcpConnection::appendSendBuffer(const KMBuffer &buf)
     } else {
         send_buffer_.reset(buf.clone());
     }
+    send_buffer_bytes_ += buf.chainLength();
 }
 
 void TcpConnection::reset()
 {
     send_buffer_.reset();
-    initData_.clear();
+    send_buffer_bytes_ = 0;
+    init_buf_.reset();
+}
+
+void TcpConnection::pauseRead()
+{
+    if (!read_paused_) {
+        read_paused_ = true;
+        tcp_.pause();
+    }
+}
+
+void TcpConnection::resumeRead()
+{
+    if (read_paused_) {
+        read_paused_ = false;
+        tcp_.resume();
+        // the data may be buffered in SSL, or its read event was consumed before pausing
+        init_token_.eventLoop(eventLoop());
+        eventLoop()->post([this] { onReceive(KMError::NOERR); }, &init_token_);
+    }
 }
 
 void TcpConnection::onSend(KMError err)
@@ -210,22 +405,24 @@ void TcpConnection::onSend(KMError err)
         onError(KMError::SOCK_ERROR);
         return;
     }
-    if (sendBufferEmpty()) {
+    if (sendBufferEmpty() || sendBufferBytes() < low_watermark_) {
         onWrite();
     }
 }
 
 void TcpConnection::onReceive(KMError err)
 {
-    if(!initData_.empty()) {
-        auto ret = handleInputData(&initData_[0], initData_.size());
-        if (ret != KMError::NOERR) {
-            return;
+    if(init_buf_) {
+        auto init_buf = std::move(init_buf_);
+        for (auto it = init_buf->begin(); it != init_buf->end(); ++it) {
+            if (it->length() > 0 &&
+                handleInputData(static_cast<uint8_t*>(it->readPtr()), it->length()) != KMError::NOERR) {
+                return;
+            }
         }
-        initData_.clear();
     }
     uint8_t buf[128*1024];
-    do {
+    while (!read_paused_) {
         int ret = tcp_.receive(buf, sizeof(buf));
         if (ret > 0) {
             if (handleInputData(buf, ret) != KMError::NOERR) {
@@ -238,7 +435,7 @@ void TcpConnection::onReceive(KMError err)
             onError(KMError::SOCK_ERROR);
             return;
         }
-    } while(true);
+    }
 }
 
 void TcpConnection::onClose(KMError err)
@@ -25,6 +25,7 @@
 #include "kmdefs.h"
 #include "TcpSocketImpl.h"
 #include "util/skbuffer.h"
+#include "RateLimiter.h"
 
 KUMA_NS_BEGIN
 
@@ -39,12 +40,30 @@ public:
     bool sslEnabled() const { return tcp_.sslEnabled(); }
     KMError connect(const std::string &host, uint16_t port);
     KMError attachFd(SOCKET_FD fd, const KMBuffer *init_buf);
-    KMError attachSocket(TcpSocket::Impl &&tcp, const KMBuffer *init_buf);
+    KMError attachSocket(TcpSocket::Impl &&tcp, const KMBuffer *init_buf, bool is_server = true);
     int send(const void* data, size_t len);
     int send(const iovec* iovs, int count);
     int send(const KMBuffer &buf);
+    /* the file data cannot be queued in send buffer, 0 is returned until the
+     * buffered data is all sent
+     */
+    int sendFile(int file_fd, int64_t offset, size_t len);
     KMError close();
     
+    /* send will return 0 when buffered bytes reach high_mark, and onWrite will be
+     * called when buffered bytes drain below low_mark. high_mark 0 means nothing
+     * can be buffered by send
+     */
+    KMError setSendBufferWatermark(size_t high_mark, size_t low_mark);
+    // including the corked bytes blocked in socket
+    size_t sendBufferBytes() const { return send_buffer_bytes_ + tcp_.pendingBytes(); }
+    
+    /* token bucket limit of egress rate, in bytes per second. the data exceeds the
+     * limit is queued in send buffer and sent when tokens refilled
+     */
+    KMError setRateLimit(uint32_t rate, uint32_t burst, const std::string &group);
+    KMError getRateLimitStats(RateLimitStats &stats) const;
+    
     EventLoopPtr eventLoop() { return tcp_.eventLoop(); }
     
 protected:
@@ -56,30 +75,60 @@ protected:
     virtual void onError(KMError err) = 0;
     bool isServer() { return isServer_; }
     bool sendBufferEmpty() { return !send_buffer_ || send_buffer_->empty(); }
+    bool sendBufferBlocked() {
+        auto bytes = sendBufferBytes();
+        return bytes > 0 && bytes >= high_watermark_;
+    }
     KMError sendBufferedData();
     void appendSendBuffer(const KMBuffer &buf);
     void reset();
     
+    /* stop reading socket until resumeRead is called, the data already read is
+     * still passed to handleInputData
+     */
+    void pauseRead();
+    void resumeRead();
+    bool readPaused() const { return read_paused_; }
+    
 private:
     void onSend(KMError err);
     void onReceive(KMError err);
     void onClose(KMError err);
     
+    // send to socket within the rate limit
+    int sendToSocket(const void* data, size_t len);
+    int sendToSocket(const iovec* iovs, int count);
+    int sendToSocket(const KMBuffer &buf);
+    /* the data refused by socket can be queued if it is sent partially, or nothing
+     * is sent because the corked data is blocked or the rate limit is reached. it
+     * cannot be queued if the socket is not connected or closed
+     */
+    bool canQueueRefused(int ret) const {
+        return ret > 0 || (0 == ret && tcp_.isReady() && (tcp_.pendingBytes() > 0 || rate_limiter_));
+    }
+    
 private:
     void cleanup();
     void setupCallbacks();
     void saveInitData(const KMBuffer *init_buf);
+    void postInitData();
     
 protected:
     TcpSocket::Impl tcp_;
     std::string host_;
     uint16_t port_{ 0 };
     KMBuffer::Ptr send_buffer_;
+    size_t send_buffer_bytes_{ 0 };
     
 private:
-    std::vector<uint8_t>    initData_;
+    KMBuffer::Ptr           init_buf_;
+    EventLoopToken          init_token_;
+    size_t                  high_watermark_{ 0 };
+    size_t                  low_watermark_{ 0 };
+    std::unique_ptr<RateLimiter> rate_limiter_;
     
     bool                    isServer_{ false };
+    bool                    read_paused_{ false };
 };
 
 KUMA_NS_END
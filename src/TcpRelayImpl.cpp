@@ -0,0 +1,309 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "kmconf.h"
+
+#if defined(KUMA_OS_LINUX)
+# include <unistd.h>
+# include <fcntl.h>
+# include <sys/socket.h>
+#endif
+
+#include <errno.h>
+
+#include "TcpRelayImpl.h"
+#include "util/kmtrace.h"
+
+using namespace kuma;
+
+namespace {
+#ifdef KUMA_OS_LINUX
+    const size_t kPipeSize = 256*1024;
+#endif
+    const size_t kBufferSize = 128*1024;
+}
+
+//////////////////////////////////////////////////////////////////////////
+TcpRelay::Impl::Impl(const EventLoopPtr &loop)
+: loop_(loop)
+, tcp1_(loop)
+, tcp2_(loop)
+{
+    forward_.src = &tcp1_;
+    forward_.dst = &tcp2_;
+    forward_.name = "forward";
+    backward_.src = &tcp2_;
+    backward_.dst = &tcp1_;
+    backward_.name = "backward";
+    KM_SetObjKey("TcpRelay");
+}
+
+TcpRelay::Impl::~Impl()
+{
+    cleanup();
+}
+
+KMError TcpRelay::Impl::setZeroCopy(bool enable)
+{
+    if (tcp1_.isReady() || tcp2_.isReady()) {
+        return KMError::INVALID_STATE;
+    }
+    zero_copy_ = enable;
+    return KMError::NOERR;
+}
+
+KMError TcpRelay::Impl::attach(TcpSocket::Impl &&tcp1, TcpSocket::Impl &&tcp2)
+{
+    if (tcp1_.isReady() || tcp2_.isReady() || closed_) {
+        return KMError::INVALID_STATE;
+    }
+    if (!tcp1.isReady() || !tcp2.isReady()) {
+        KUMA_ERRXTRACE("attach, socket is not connected");
+        return KMError::INVALID_PARAM;
+    }
+    auto ret = tcp1_.attach(std::move(tcp1));
+    if (ret != KMError::NOERR) {
+        return ret;
+    }
+    ret = tcp2_.attach(std::move(tcp2));
+    if (ret != KMError::NOERR) {
+        cleanup();
+        return ret;
+    }
+    
+#ifdef KUMA_OS_LINUX
+    if (zero_copy_ && (tcp1_.sslEnabled() || tcp2_.sslEnabled())) {
+        // the data must be decrypted and encrypted in user space
+        zero_copy_ = false;
+    }
+    if (zero_copy_ && (!createPipe(forward_) || !createPipe(backward_))) {
+        closePipe(forward_);
+        closePipe(backward_);
+        zero_copy_ = false;
+    }
+#else
+    zero_copy_ = false;
+#endif
+    if (!zero_copy_) {
+        forward_.buffer.resize(kBufferSize);
+        backward_.buffer.resize(kBufferSize);
+    }
+    KUMA_INFOXTRACE("attach, zero_copy=" << zero_copy_);
+    
+    tcp1_.setReadCallback([this] (KMError) { onEvent(forward_); });
+    tcp1_.setWriteCallback([this] (KMError) { onEvent(backward_); });
+    tcp1_.setErrorCallback([this] (KMError err) { onError(err); });
+    tcp2_.setReadCallback([this] (KMError) { onEvent(backward_); });
+    tcp2_.setWriteCallback([this] (KMError) { onEvent(forward_); });
+    tcp2_.setErrorCallback([this] (KMError err) { onError(err); });
+    
+    // the sockets may have been readable before attached
+    kick();
+    return KMError::NOERR;
+}
+
+KMError TcpRelay::Impl::pause()
+{
+    if (closed_ || !tcp1_.isReady() || !tcp2_.isReady()) {
+        return KMError::INVALID_STATE;
+    }
+    paused_ = true;
+    tcp1_.pause();
+    tcp2_.pause();
+    return KMError::NOERR;
+}
+
+KMError TcpRelay::Impl::resume()
+{
+    if (!paused_ || closed_) {
+        return KMError::INVALID_STATE;
+    }
+    paused_ = false;
+    tcp1_.resume();
+    tcp2_.resume();
+    // the events are dropped when paused
+    kick();
+    return KMError::NOERR;
+}
+
+KMError TcpRelay::Impl::close()
+{
+    KUMA_INFOXTRACE("close, forward=" << forward_.bytes << ", backward=" << backward_.bytes);
+    closed_ = true;
+    cleanup();
+    return KMError::NOERR;
+}
+
+bool TcpRelay::Impl::createPipe(Channel &ch)
+{
+#ifdef KUMA_OS_LINUX
+    if (::pipe2(ch.pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+        KUMA_WARNXTRACE("createPipe, failed, err=" << errno);
+        ch.pipe_fds[0] = ch.pipe_fds[1] = INVALID_FD;
+        return false;
+    }
+    // larger pipe means less splice calls, the default size is used if failed
+    ::fcntl(ch.pipe_fds[1], F_SETPIPE_SZ, kPipeSize);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TcpRelay::Impl::closePipe(Channel &ch)
+{
+    for (auto &fd : ch.pipe_fds) {
+        if (fd != INVALID_FD) {
+            closeFd(fd);
+            fd = INVALID_FD;
+        }
+    }
+    ch.pipe_bytes = 0;
+}
+
+void TcpRelay::Impl::kick()
+{
+    DESTROY_DETECTOR_SETUP();
+    onEvent(forward_);
+    DESTROY_DETECTOR_CHECK_VOID();
+    onEvent(backward_);
+}
+
+void TcpRelay::Impl::onEvent(Channel &ch)
+{
+    if (closed_ || paused_ || ch.done) {
+        return;
+    }
+    auto err = zero_copy_ ? pumpSplice(ch) : pumpBuffered(ch);
+    if (err != KMError::NOERR) {
+        onError(err);
+    } else if (forward_.done && backward_.done) {
+        KUMA_INFOXTRACE("onEvent, relay completed, forward=" << forward_.bytes << ", backward=" << backward_.bytes);
+        closed_ = true;
+        cleanup();
+        if (close_cb_) close_cb_(KMError::NOERR);
+    }
+}
+
+KMError TcpRelay::Impl::pumpSplice(Channel &ch)
+{
+#ifdef KUMA_OS_LINUX
+    while (true) {
+        if (ch.pipe_bytes > 0) {
+            auto ret = ::splice(ch.pipe_fds[0], nullptr, ch.dst->getFd(), nullptr, ch.pipe_bytes,
+                                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (ret < 0) {
+                if (EINTR == errno) {
+                    continue;
+                } else if (EAGAIN == errno) {
+                    // wait for dst writable
+                    ch.dst->notifySendBlocked();
+                    return KMError::NOERR;
+                }
+                KUMA_ERRXTRACE("pumpSplice, " << ch.name << ", failed to splice to socket, err=" << errno);
+                return KMError::SOCK_ERROR;
+            }
+            ch.pipe_bytes -= ret;
+            ch.bytes += ret;
+            continue;
+        }
+        if (ch.eof) {
+            // forward the half-close to peer
+            ::shutdown(ch.dst->getFd(), SHUT_WR);
+            ch.done = true;
+            return KMError::NOERR;
+        }
+        // the pipe is empty here, so EAGAIN means no data in socket
+        auto ret = ::splice(ch.src->getFd(), nullptr, ch.pipe_fds[1], nullptr, kPipeSize,
+                            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (ret < 0) {
+            if (EINTR == errno) {
+                continue;
+            } else if (EAGAIN == errno) {
+                return KMError::NOERR; // wait for src readable
+            }
+            KUMA_ERRXTRACE("pumpSplice, " << ch.name << ", failed to splice from socket, err=" << errno);
+            return KMError::SOCK_ERROR;
+        } else if (0 == ret) {
+            KUMA_INFOXTRACE("pumpSplice, " << ch.name << ", EOF, bytes=" << ch.bytes);
+            ch.eof = true;
+        } else {
+            ch.pipe_bytes += ret;
+        }
+    }
+#else
+    return KMError::UNSUPPORT;
+#endif
+}
+
+KMError TcpRelay::Impl::pumpBuffered(Channel &ch)
+{
+    while (true) {
+        if (ch.buffer_bytes > 0) {
+            int ret = ch.dst->send(&ch.buffer[ch.buffer_offset], ch.buffer_bytes);
+            if (ret < 0) {
+                KUMA_ERRXTRACE("pumpBuffered, " << ch.name << ", failed to send");
+                return KMError::SOCK_ERROR;
+            } else if (0 == ret) {
+                return KMError::NOERR; // wait for dst writable
+            }
+            ch.buffer_offset += ret;
+            ch.buffer_bytes -= ret;
+            ch.bytes += ret;
+            continue;
+        }
+        if (ch.eof) {
+            // src is closed by TcpSocket when EOF is received, half-close cannot
+            // be relayed, so both directions are finished
+            forward_.done = backward_.done = true;
+            return KMError::NOERR;
+        }
+        ch.buffer_offset = 0;
+        int ret = ch.src->receive(&ch.buffer[0], ch.buffer.size());
+        if (ret < 0) {
+            KUMA_INFOXTRACE("pumpBuffered, " << ch.name << ", EOF, bytes=" << ch.bytes);
+            ch.eof = true;
+        } else if (0 == ret) {
+            return KMError::NOERR; // wait for src readable
+        } else {
+            ch.buffer_bytes = ret;
+        }
+    }
+}
+
+void TcpRelay::Impl::onError(KMError err)
+{
+    KUMA_INFOXTRACE("onError, err=" << int(err) << ", forward=" << forward_.bytes << ", backward=" << backward_.bytes);
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    cleanup();
+    if (close_cb_) close_cb_(err);
+}
+
+void TcpRelay::Impl::cleanup()
+{
+    tcp1_.close();
+    tcp2_.close();
+    closePipe(forward_);
+    closePipe(backward_);
+}
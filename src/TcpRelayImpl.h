@@ -0,0 +1,101 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __TcpRelayImpl_H__
+#define __TcpRelayImpl_H__
+
+#include "kmdefs.h"
+#include "kmapi.h"
+#include "TcpSocketImpl.h"
+#include "util/kmobject.h"
+#include "util/DestroyDetector.h"
+
+#include <vector>
+
+KUMA_NS_BEGIN
+
+/* relay data between two connected TcpSockets. data is moved by splice through
+ * a pipe pair on Linux, so it never enters the user space. buffered copy is used
+ * if any of the sockets is SSL or splice is not available.
+ * the EOF of one direction is forwarded by shutdown, and the relay is closed when
+ * both directions are finished or any error happens
+ */
+class TcpRelay::Impl : public KMObject, public DestroyDetector
+{
+public:
+    using EventCallback = TcpRelay::EventCallback;
+    
+    Impl(const EventLoopPtr &loop);
+    ~Impl();
+    
+    KMError setZeroCopy(bool enable);
+    KMError attach(TcpSocket::Impl &&tcp1, TcpSocket::Impl &&tcp2);
+    KMError pause();
+    KMError resume();
+    KMError close();
+    
+    void setCloseCallback(EventCallback cb) { close_cb_ = std::move(cb); }
+    
+    bool isZeroCopy() const { return zero_copy_; }
+    uint64_t bytesForward() const { return forward_.bytes; }
+    uint64_t bytesBackward() const { return backward_.bytes; }
+    
+private:
+    // one direction of the relay
+    struct Channel {
+        TcpSocket::Impl*        src = nullptr;
+        TcpSocket::Impl*        dst = nullptr;
+        SOCKET_FD               pipe_fds[2] = { INVALID_FD, INVALID_FD };
+        size_t                  pipe_bytes = 0; // bytes in pipe, zero copy
+        std::vector<uint8_t>    buffer; // buffered copy
+        size_t                  buffer_offset = 0;
+        size_t                  buffer_bytes = 0;
+        bool                    eof = false;
+        bool                    done = false;
+        uint64_t                bytes = 0;
+        const char*             name = "";
+    };
+    
+    bool createPipe(Channel &ch);
+    void closePipe(Channel &ch);
+    void kick();
+    void onEvent(Channel &ch);
+    KMError pumpSplice(Channel &ch);
+    KMError pumpBuffered(Channel &ch);
+    void onError(KMError err);
+    void cleanup();
+    
+private:
+    EventLoopWeakPtr    loop_;
+    TcpSocket::Impl     tcp1_;
+    TcpSocket::Impl     tcp2_;
+    Channel             forward_;   // tcp1 -> tcp2
+    Channel             backward_;  // tcp2 -> tcp1
+    bool                zero_copy_ = true;
+    bool                paused_ = false;
+    bool                closed_ = false;
+    
+    EventCallback       close_cb_;
+};
+
+KUMA_NS_END
+
+#endif
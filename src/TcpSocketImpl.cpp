@@ -73,9 +73,13 @@
 #endif
 #include "ssl/BioHandler.h"
 #include "ssl/SioHandler.h"
+#include "ssl/SslCryptoPool.h"
 
 using namespace kuma;
 
+// max bytes coalesced in one loop iteration, larger data will be written immediately
+static const size_t kMaxCorkSize = 16*1024;
+
 TcpSocket::Impl::Impl(const EventLoopPtr &loop)
 : loop_(loop)
 {
@@ -89,6 +93,15 @@ TcpSocket::Impl::~Impl()
 
 void TcpSocket::Impl::cleanup()
 {
+#ifdef KUMA_HAS_OPENSSL
+    // wait for the running handshake step before SSL and fd are released
+    cancelSslHandshakeJob();
+#endif
+    resetCorkBuffer();
+    auto loop = eventLoop();
+    if (loop) {
+        loop->removeFlushObject(this);
+    }
     if (socket_) {
         socket_->close();
         socket_.reset();
@@ -114,6 +127,13 @@ SOCKET_FD TcpSocket::Impl::getFd() const
     return socket_->getFd();
 }
 
+void TcpSocket::Impl::notifySendBlocked()
+{
+    if (socket_) {
+        socket_->notifySendBlocked();
+    }
+}
+
 EventLoopPtr TcpSocket::Impl::eventLoop() const
 {
     return loop_.lock();
@@ -175,6 +195,7 @@ KMError TcpSocket::Impl::detachFd(SOCKET_FD &fd)
         return KMError::SSL_FAILED;
     }
 #endif
+    flushCorkBuffer();
     auto err = socket_->detachFd(fd);
     cleanup();
     return err;
@@ -190,7 +211,19 @@ KMError TcpSocket::Impl::attach(Impl &&other)
         KUMA_ERRXTRACE("attach, invalid socket");
         return KMError::INVALID_PARAM;
     }
+#ifdef KUMA_HAS_OPENSSL
+    if (other.ssl_job_) {
+        KUMA_ERRXTRACE("attach, SSL handshake is running in crypto pool");
+        return KMError::INVALID_STATE;
+    }
+#endif
     ssl_flags_ = other.ssl_flags_;
+    // flush the corked data of other, and take over the remaining
+    other.flushCorkBuffer();
+    cork_buffer_ = std::move(other.cork_buffer_);
+    cork_bytes_ = other.cork_bytes_;
+    cork_blocked_ = other.cork_blocked_;
+    other.resetCorkBuffer();
     socket_ = std::move(other.socket_);
     socket_->setReadCallback([this](KMError err) {
         onReceive(err);
@@ -279,6 +312,7 @@ KMError TcpSocket::Impl::detachFd(SOCKET_FD &fd, SSL* &ssl, BIO* &nbio)
     if (!socket_) {
         return KMError::INVALID_STATE;
     }
+    flushCorkBuffer();
     auto err = socket_->detachFd(fd);
     if (err != KMError::NOERR) {
         return err;
@@ -325,9 +359,14 @@ KMError TcpSocket::Impl::startSslHandshake(SslRole ssl_role)
         }
     }
 
+    if (offloadSslHandshake()) {
+        return KMError::NOERR;
+    }
     auto ssl_state = ssl_handler_->handshake();
     if (ssl_state == SslHandler::SslState::SSL_ERROR) {
         return KMError::SSL_FAILED;
+    } else if (ssl_state == SslHandler::SslState::SSL_SUCCESS) {
+        OpenSslLib::onHandshakeComplete(ssl_handler_->isServer(), ssl_handler_->isSessionReused());
     }
     return KMError::NOERR;
 }
@@ -346,8 +385,8 @@ bool TcpSocket::Impl::isReady() const
 {
     return socket_ && socket_->isReady()
 #ifdef KUMA_HAS_OPENSSL
-        && (!sslEnabled() ||
-        (ssl_handler_ && ssl_handler_->getState() == SslHandler::SslState::SSL_SUCCESS))
+        && (!sslEnabled() || (!ssl_job_ && ssl_handler_ &&
+        ssl_handler_->getState() == SslHandler::SslState::SSL_SUCCESS))
 #endif
         ;
 }
@@ -358,12 +397,19 @@ int TcpSocket::Impl::send(const void* data, size_t length)
         KUMA_WARNXTRACE("send, invalid state");
         return 0;
     }
+    if (auto_cork_ || cork_buffer_) {
+        iovec iov;
+        iov.iov_base = (char*)data;
+        iov.iov_len = length;
+        return sendCorked(&iov, 1);
+    }
 
     int ret = 0;
 #ifdef KUMA_HAS_OPENSSL
     if (sslEnabled()) {
         ret = ssl_handler_->send(data, length);
-        if(!is_bio_handler_ && ret >= 0 && static_cast<size_t>(ret) < length) {
+        if(!is_bio_handler_ && ret >= 0 &&
+           (static_cast<size_t>(ret) < length || ssl_handler_->hasPendingData())) {
             socket_->notifySendBlocked();
         }
     }
@@ -384,7 +430,14 @@ int TcpSocket::Impl::send(const iovec* iovs, int count)
         KUMA_WARNXTRACE("send 2, invalid state");
         return 0;
     }
+    if (auto_cork_ || cork_buffer_) {
+        return sendCorked(iovs, count);
+    }
+    return sendNow(iovs, count);
+}
 
+int TcpSocket::Impl::sendNow(const iovec* iovs, int count)
+{
     int ret = 0;
 #ifdef KUMA_HAS_OPENSSL
     if (sslEnabled()) {
@@ -396,7 +449,8 @@ int TcpSocket::Impl::send(const iovec* iovs, int count)
             return 0;
         }
         ret = ssl_handler_->send(iovs, count);
-        if(!is_bio_handler_ && ret >= 0 && static_cast<size_t>(ret) < bytes_total) {
+        if(!is_bio_handler_ && ret >= 0 &&
+           (static_cast<size_t>(ret) < bytes_total || ssl_handler_->hasPendingData())) {
             socket_->notifySendBlocked();
         }
     }
@@ -413,6 +467,28 @@ int TcpSocket::Impl::send(const iovec* iovs, int count)
 
 int TcpSocket::Impl::send(const KMBuffer &buf)
 {
+    if (!isReady()) {
+        KUMA_WARNXTRACE("send 3, invalid state");
+        return 0;
+    }
+    if (auto_cork_ && !cork_blocked_) {
+        // the refcounted data is corked by reference instead of copy
+        auto chain_len = buf.chainLength();
+        if (chain_len == 0) {
+            return 0;
+        }
+        auto loop = eventLoop();
+        if (loop && loop->inSameThread() && cork_bytes_ + chain_len <= kMaxCorkSize) {
+            if (cork_buffer_) {
+                cork_buffer_->append(buf.clone());
+            } else {
+                cork_buffer_.reset(buf.clone());
+            }
+            cork_bytes_ += chain_len;
+            loop->appendFlushObject(this);
+            return static_cast<int>(chain_len);
+        }
+    }
     IOVEC iovs;
     buf.fillIov(iovs);
     if (iovs.empty()) {
@@ -421,6 +497,94 @@ int TcpSocket::Impl::send(const KMBuffer &buf)
     return send(&iovs[0], static_cast<int>(iovs.size()));
 }
 
+int TcpSocket::Impl::sendCorked(const iovec *iovs, int count)
+{
+    if (cork_blocked_) {
+        return 0; // wait for onSend to flush the remaining corked data
+    }
+    size_t total_len = 0;
+    for (int i = 0; i < count; ++i) {
+        total_len += iovs[i].iov_len;
+    }
+    if (total_len == 0) {
+        return 0;
+    }
+    auto loop = eventLoop();
+    if (auto_cork_ && loop && loop->inSameThread() && cork_bytes_ + total_len <= kMaxCorkSize) {
+        for (int i = 0; i < count; ++i) {
+            if (iovs[i].iov_len > 0) {
+                KMBuffer buf(iovs[i].iov_base, iovs[i].iov_len, iovs[i].iov_len);
+                if (cork_buffer_) {
+                    cork_buffer_->append(buf.clone());
+                } else {
+                    cork_buffer_.reset(buf.clone());
+                }
+            }
+        }
+        cork_bytes_ += total_len;
+        loop->appendFlushObject(this);
+        return static_cast<int>(total_len);
+    }
+    if (!cork_buffer_) {
+        return sendNow(iovs, count);
+    }
+    // write the corked data and new data in one writev
+    IOVEC iov_vec;
+    cork_buffer_->fillIov(iov_vec);
+    iov_vec.insert(iov_vec.end(), iovs, iovs + count);
+    int ret = sendNow(&iov_vec[0], static_cast<int>(iov_vec.size()));
+    if (ret < 0) {
+        return ret;
+    }
+    if (static_cast<size_t>(ret) < cork_bytes_) {
+        cork_buffer_->bytesRead(ret);
+        cork_bytes_ -= ret;
+        cork_blocked_ = true;
+        return 0;
+    }
+    ret -= static_cast<int>(cork_bytes_);
+    resetCorkBuffer();
+    return ret;
+}
+
+KMError TcpSocket::Impl::flushCorkBuffer()
+{
+    if (!cork_buffer_ || !isReady()) {
+        return KMError::NOERR;
+    }
+    IOVEC iovs;
+    cork_buffer_->fillIov(iovs);
+    if (iovs.empty()) {
+        resetCorkBuffer();
+        return KMError::NOERR;
+    }
+    int ret = sendNow(&iovs[0], static_cast<int>(iovs.size()));
+    if (ret < 0) {
+        return KMError::SOCK_ERROR;
+    }
+    if (static_cast<size_t>(ret) < cork_bytes_) {
+        cork_buffer_->bytesRead(ret);
+        cork_bytes_ -= ret;
+        cork_blocked_ = true;
+    } else {
+        resetCorkBuffer();
+    }
+    return KMError::NOERR;
+}
+
+void TcpSocket::Impl::resetCorkBuffer()
+{
+    cork_buffer_.reset();
+    cork_bytes_ = 0;
+    cork_blocked_ = false;
+}
+
+KMError TcpSocket::Impl::setAutoCork(bool enable)
+{
+    auto_cork_ = enable;
+    return KMError::NOERR;
+}
+
 int TcpSocket::Impl::receive(void* data, size_t length)
 {
     if (!isReady()) {
@@ -443,12 +607,101 @@ int TcpSocket::Impl::receive(void* data, size_t length)
     return ret;
 }
 
+int TcpSocket::Impl::sendFd(SOCKET_FD fd, const void* data, size_t length)
+{
+    if (!isReady()) {
+        KUMA_WARNXTRACE("sendFd, invalid state");
+        return 0;
+    }
+    if (sslEnabled()) {
+        KUMA_ERRXTRACE("sendFd, not supported on SSL connection");
+        return -1;
+    }
+    // the corked data should be sent before fd
+    if (flushCorkBuffer() != KMError::NOERR) {
+        cleanup();
+        return -1;
+    }
+    if (cork_buffer_) {
+        return 0;
+    }
+    int ret = socket_->sendFd(fd, data, length);
+    if (ret < 0) {
+        cleanup();
+    }
+    return ret;
+}
+
+int TcpSocket::Impl::sendFile(int file_fd, int64_t offset, size_t length)
+{
+    if (!isReady()) {
+        KUMA_WARNXTRACE("sendFile, invalid state");
+        return 0;
+    }
+    // the corked data should be sent before file data
+    if (flushCorkBuffer() != KMError::NOERR) {
+        cleanup();
+        return -1;
+    }
+    if (cork_buffer_) {
+        return 0;
+    }
+    int ret = 0;
+#ifdef KUMA_HAS_OPENSSL
+    if (sslEnabled()) {
+#ifdef KUMA_OS_WIN
+        KUMA_ERRXTRACE("sendFile, not supported on SSL connection");
+        ret = -1;
+#else
+        // the file data has to be encrypted in user space, one TLS record each time
+        uint8_t buf[16*1024];
+        auto len = ::pread(file_fd, buf, length < sizeof(buf) ? length : sizeof(buf), static_cast<off_t>(offset));
+        if (len <= 0) {
+            KUMA_ERRXTRACE("sendFile, failed to read file, offset=" << offset << ", err=" << getLastError());
+            ret = -1;
+        } else {
+            ret = ssl_handler_->send(buf, len);
+            if(!is_bio_handler_ && ret >= 0 && (ret < len || ssl_handler_->hasPendingData())) {
+                socket_->notifySendBlocked();
+            }
+        }
+#endif
+    }
+    else
+#endif
+    {
+        ret = socket_->sendFile(file_fd, offset, length);
+    }
+    if (ret < 0) {
+        cleanup();
+    }
+    return ret;
+}
+
+int TcpSocket::Impl::receiveFd(SOCKET_FD &fd, void* data, size_t length)
+{
+    fd = INVALID_FD;
+    if (!isReady()) {
+        return 0;
+    }
+    if (sslEnabled()) {
+        KUMA_ERRXTRACE("receiveFd, not supported on SSL connection");
+        return -1;
+    }
+    int ret = socket_->receiveFd(fd, data, length);
+    if (ret < 0) {
+        cleanup();
+    }
+    return ret;
+}
+
 KMError TcpSocket::Impl::close()
 {
     KUMA_INFOXTRACE("close");
     auto loop = eventLoop();
     if (loop && !loop->stopped()) {
         loop->sync([this] {
+            flushCorkBuffer(); // corked data will be lost if socket is blocked
             cleanup();
         });
     }
@@ -481,7 +734,8 @@ void TcpSocket::Impl::onConnect(KMError err)
 #ifdef KUMA_HAS_OPENSSL
         if (sslEnabled()) {
             err = startSslHandshake(SslRole::CLIENT);
-            if (KMError::NOERR == err && ssl_handler_->getState() == SslHandler::SslState::SSL_HANDSHAKE) {
+            if (KMError::NOERR == err &&
+                (ssl_job_ || ssl_handler_->getState() == SslHandler::SslState::SSL_HANDSHAKE)) {
                 return; // continue to SSL handshake
             }
         }
@@ -508,8 +762,24 @@ void TcpSocket::Impl::onSend(KMError err)
             onClose(err);
             return;
         }
+        if (!is_bio_handler_ && ssl_handler_->hasPendingData()) {
+            // still blocked, send would return 0 until the record is sent
+            socket_->notifySendBlocked();
+            return;
+        }
     }
 #endif
+    if (cork_blocked_) {
+        cork_blocked_ = false;
+        if (flushCorkBuffer() != KMError::NOERR) {
+            KUMA_ERRXTRACE("onSend, failed to send corked data");
+            onClose(KMError::SOCK_ERROR);
+            return;
+        }
+        if (cork_blocked_) {
+            return;
+        }
+    }
 
     if (write_cb_ && isReady()) write_cb_(err);
 }
@@ -532,6 +802,17 @@ void TcpSocket::Impl::onClose(KMError err)
     if (error_cb_) error_cb_(err);
 }
 
+void TcpSocket::Impl::onLoopFlush()
+{
+    if (cork_blocked_) {
+        return;
+    }
+    if (flushCorkBuffer() != KMError::NOERR) {
+        KUMA_ERRXTRACE("onLoopFlush, failed to send corked data");
+        onClose(KMError::SOCK_ERROR);
+    }
+}
+
 bool TcpSocket::Impl::createSocket()
 {
     auto loop = eventLoop();
@@ -585,21 +866,38 @@ bool TcpSocket::Impl::createSslHandler()
 
 KMError TcpSocket::Impl::checkSslHandshake(KMError err)
 {
-    if (!sslEnabled() || ssl_handler_->getState() != SslHandler::SslState::SSL_HANDSHAKE) {
+    if (!sslEnabled()) {
+        return KMError::NOERR;
+    }
+    if (ssl_job_) {
+        // the handshake will be continued when the job is done
+        ssl_job_event_missed_ = true;
+        return KMError::AGAIN;
+    }
+    if (ssl_handler_->getState() != SslHandler::SslState::SSL_HANDSHAKE) {
         return KMError::NOERR;
     }
 
-    if (err == KMError::NOERR) {
-        auto ssl_state = ssl_handler_->handshake();
-        if (ssl_state == SslHandler::SslState::SSL_HANDSHAKE) {
-            return KMError::AGAIN; // continue handshake
-        } else if (ssl_state == SslHandler::SslState::SSL_SUCCESS) {
-            err = KMError::NOERR;
-        } else {
-            err = KMError::SSL_FAILED;
-        }
+    if (err != KMError::NOERR) {
+        return handleSslHandshake(SslHandler::SslState::SSL_ERROR);
     }
-    KUMA_INFOXTRACE("checkSslHandshake, completed, err=" << int(err));
+    if (offloadSslHandshake()) {
+        return KMError::AGAIN;
+    }
+    return handleSslHandshake(ssl_handler_->handshake());
+}
+
+KMError TcpSocket::Impl::handleSslHandshake(SslHandler::SslState ssl_state)
+{
+    KMError err = KMError::NOERR;
+    if (ssl_state == SslHandler::SslState::SSL_HANDSHAKE) {
+        return KMError::AGAIN; // continue handshake
+    } else if (ssl_state == SslHandler::SslState::SSL_SUCCESS) {
+        OpenSslLib::onHandshakeComplete(ssl_handler_->isServer(), ssl_handler_->isSessionReused());
+    } else {
+        err = KMError::SSL_FAILED;
+    }
+    KUMA_INFOXTRACE("handleSslHandshake, completed, err=" << int(err));
     if (connect_cb_) {
         auto connect_cb(std::move(connect_cb_));
         DESTROY_DETECTOR_SETUP();
@@ -612,6 +910,71 @@ KMError TcpSocket::Impl::checkSslHandshake(KMError err)
 
     return err;
 }
+
+bool TcpSocket::Impl::offloadSslHandshake()
+{
+    // BioHandler sends the handshake data by socket in loop thread
+    if (is_bio_handler_ || !SslCryptoPool::instance().getThreadCount()) {
+        return false;
+    }
+    auto loop = eventLoop();
+    if (!loop) {
+        return false;
+    }
+    auto job = std::make_shared<SslHandshakeJob>();
+    auto *ssl_handler = ssl_handler_.get();
+    EventLoopWeakPtr loop_weak = loop;
+    auto ret = SslCryptoPool::instance().post([this, job, ssl_handler, loop_weak] {
+        {
+            std::lock_guard<std::mutex> g(job->mutex);
+            if (job->canceled) {
+                return;
+            }
+            job->ssl_state = ssl_handler->handshake();
+        }
+        auto loop = loop_weak.lock();
+        if (loop) {
+            // job is canceled in cleanup before this object is destroyed
+            loop->post([this, job] {
+                if (!job->canceled) {
+                    onSslHandshakeOffloaded(job->ssl_state);
+                }
+            });
+        }
+    });
+    if (!ret) {
+        return false;
+    }
+    ssl_job_ = std::move(job);
+    ssl_job_event_missed_ = false;
+    return true;
+}
+
+void TcpSocket::Impl::onSslHandshakeOffloaded(SslHandler::SslState ssl_state)
+{
+    ssl_job_.reset();
+    if (ssl_state == SslHandler::SslState::SSL_HANDSHAKE) {
+        if (ssl_job_event_missed_) {
+            // the data may be received after SSL_do_handshake returned
+            onReceive(KMError::NOERR);
+        }
+        return;
+    }
+    if (handleSslHandshake(ssl_state) != KMError::NOERR) {
+        return;
+    }
+    // the application data may be received together with the handshake data
+    onReceive(KMError::NOERR);
+}
+
+void TcpSocket::Impl::cancelSslHandshakeJob()
+{
+    if (ssl_job_) {
+        std::lock_guard<std::mutex> g(ssl_job_->mutex);
+        ssl_job_->canceled = true;
+    }
+    ssl_job_.reset();
+}
 #endif
 
 int TcpSocket::Impl::sendData(const void* data, size_t length)
@@ -45,7 +45,7 @@
 KUMA_NS_BEGIN
 class SocketBase;
 
-class TcpSocket::Impl : public KMObject, public DestroyDetector
+class TcpSocket::Impl : public KMObject, public DestroyDetector, public FlushObject
 {
 public:
     using EventCallback = TcpSocket::EventCallback;
@@ -75,29 +75,56 @@ public:
     int send(const iovec* iovs, int count);
     int send(const KMBuffer &buf);
     int receive(void* data, size_t length);
+    int sendFd(SOCKET_FD fd, const void* data, size_t length);
+    int receiveFd(SOCKET_FD &fd, void* data, size_t length);
+    /* sendfile is used if SSL is not enabled, otherwise the file data is read
+     * and encrypted in user space
+     */
+    int sendFile(int file_fd, int64_t offset, size_t length);
     KMError close();
     
     KMError pause();
     KMError resume();
     
+    /* data sent in one loop iteration will be coalesced and written to socket
+     * in one writev at the end of the iteration
+     */
+    KMError setAutoCork(bool enable);
+    // the corked bytes waiting for socket writable, send returns 0 until they are sent
+    size_t pendingBytes() const { return cork_blocked_ ? cork_bytes_ : 0; }
+    /* for the IO bypassing send, e.g. splice, write event will be polled until
+     * the socket is writable when poller is level-triggered
+     */
+    void notifySendBlocked();
+
     void setReadCallback(EventCallback cb) { read_cb_ = std::move(cb); }
     void setWriteCallback(EventCallback cb) { write_cb_ = std::move(cb); }
     void setErrorCallback(EventCallback cb) { error_cb_ = std::move(cb); }
     
     SOCKET_FD getFd() const;
     EventLoopPtr eventLoop() const;
+    bool isReady() const;
     
 private:
     void onConnect(KMError err);
     void onSend(KMError err);
     void onReceive(KMError err);
     void onClose(KMError err);
+    void onLoopFlush() override;
     
     bool createSocket();
 #ifdef KUMA_HAS_OPENSSL
     bool createSslHandler();
     KMError checkSslHandshake(KMError err);
+    KMError handleSslHandshake(SslHandler::SslState ssl_state);
+    bool offloadSslHandshake();
+    void onSslHandshakeOffloaded(SslHandler::SslState ssl_state);
+    void cancelSslHandshakeJob();
 #endif
+    int sendNow(const iovec *iovs, int count);
+    int sendCorked(const iovec *iovs, int count);
+    KMError flushCorkBuffer();
+    void resetCorkBuffer();
     int sendData(const void *data, size_t length);
     int sendData(const iovec *iovs, int count);
     int sendData(const KMBuffer &buf);
@@ -105,7 +132,6 @@ private:
     
 private:
     void cleanup();
-    bool isReady() const;
     
 private:
     EventLoopWeakPtr    loop_;
@@ -118,8 +144,25 @@ private:
     AlpnProtos          alpn_protos_;
     std::string         ssl_server_name_;
     std::string         ssl_host_name_;
+    
+    // the handshake step running in SslCryptoPool, SSL object should not be
+    // accessed in loop thread until the job is done
+    struct SslHandshakeJob
+    {
+        std::mutex              mutex;
+        bool                    canceled = false;
+        SslHandler::SslState    ssl_state = SslHandler::SslState::SSL_HANDSHAKE;
+    };
+    std::shared_ptr<SslHandshakeJob> ssl_job_;
+    // IO event is received while the job is running
+    bool                ssl_job_event_missed_ = false;
 #endif
     
+    bool                auto_cork_ = false;
+    bool                cork_blocked_ = false;
+    KMBuffer::Ptr       cork_buffer_;
+    size_t              cork_bytes_ = 0;
+    
     EventCallback       connect_cb_;
     EventCallback       read_cb_;
     EventCallback       write_cb_;
@@ -71,6 +71,7 @@
 using namespace kuma;
 
 UdpSocket::Impl::Impl(const EventLoopPtr &loop)
+: loop_(loop)
 {
 #ifdef KUMA_OS_WIN
     if (loop->getPollType() == PollType::IOCP) {
@@ -107,17 +108,84 @@ KMError UdpSocket::Impl::mcastLeave(const std::string &mcast_addr, uint16_t mcas
 
 int UdpSocket::Impl::send(const void* data, size_t length, const std::string &host, uint16_t port)
 {
-    return socket_->send(data, length, host, port);
+    if (!checkRateLimit(length)) {
+        return 0;
+    }
+    int ret = socket_->send(data, length, host, port);
+    consumeRateLimit(ret);
+    return ret;
 }
 
 int UdpSocket::Impl::send(const iovec* iovs, int count, const std::string &host, uint16_t port)
 {
-    return socket_->send(iovs, count, host, port);
+    if (rate_limiter_) {
+        size_t length = 0;
+        for (int i = 0; i < count; ++i) {
+            length += iovs[i].iov_len;
+        }
+        if (!checkRateLimit(length)) {
+            return 0;
+        }
+    }
+    int ret = socket_->send(iovs, count, host, port);
+    consumeRateLimit(ret);
+    return ret;
 }
 
 int UdpSocket::Impl::send(const KMBuffer &buf, const char* host, uint16_t port)
 {
-    return socket_->send(buf, host, port);
+    if (rate_limiter_ && !checkRateLimit(buf.chainLength())) {
+        return 0;
+    }
+    int ret = socket_->send(buf, host, port);
+    consumeRateLimit(ret);
+    return ret;
+}
+
+KMError UdpSocket::Impl::setRateLimit(uint32_t rate, uint32_t burst, const std::string &group)
+{
+    auto loop = loop_.lock();
+    if (!loop) {
+        return KMError::INVALID_STATE;
+    }
+    KMError ret = KMError::NOERR;
+    // the rate limiters of loop should be accessed in loop thread
+    loop->sync([&] {
+        if (!rate_limiter_) {
+            // datagram is dropped when throttled, no need to resume
+            rate_limiter_.reset(new RateLimiter(loop, nullptr));
+        }
+        ret = rate_limiter_->setRate(rate, burst, group);
+    });
+    return ret;
+}
+
+KMError UdpSocket::Impl::getRateLimitStats(RateLimitStats &stats) const
+{
+    if (!rate_limiter_) {
+        return KMError::INVALID_STATE;
+    }
+    stats = rate_limiter_->getStats();
+    return KMError::NOERR;
+}
+
+bool UdpSocket::Impl::checkRateLimit(size_t length)
+{
+    if (!rate_limiter_) {
+        return true;
+    }
+    if (rate_limiter_->quota(length) < length) {
+        rate_limiter_->wait();
+        return false;
+    }
+    return true;
+}
+
+void UdpSocket::Impl::consumeRateLimit(int sent)
+{
+    if (rate_limiter_ && sent > 0) {
+        rate_limiter_->consume(sent);
+    }
 }
 
 int UdpSocket::Impl::receive(void *data, size_t length, char *ip, size_t ip_len, uint16_t &port)
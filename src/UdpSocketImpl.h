@@ -26,6 +26,7 @@
 #include "kmapi.h"
 #include "evdefs.h"
 #include "UdpSocketBase.h"
+#include "RateLimiter.h"
 #include <stdint.h>
 #ifdef KUMA_OS_WIN
 # include <Ws2tcpip.h>
@@ -53,11 +54,20 @@ public:
     KMError mcastJoin(const std::string &mcast_addr, uint16_t mcast_port);
     KMError mcastLeave(const std::string &mcast_addr, uint16_t mcast_port);
 
+    KMError setRateLimit(uint32_t rate, uint32_t burst, const std::string &group);
+    KMError getRateLimitStats(RateLimitStats &stats) const;
+
     void setReadCallback(EventCallback cb);
     void setErrorCallback(EventCallback cb);
     
 private:
+    bool checkRateLimit(size_t length);
+    void consumeRateLimit(int sent);
+    
+private:
+    EventLoopWeakPtr loop_;
     std::unique_ptr<UdpSocketBase> socket_;
+    std::unique_ptr<RateLimiter> rate_limiter_;
 };
 
 KUMA_NS_END
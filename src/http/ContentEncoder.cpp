@@ -0,0 +1,367 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "ContentEncoder.h"
+#include "util/util.h"
+#include "util/kmtrace.h"
+
+#ifdef KUMA_HAS_ZLIB
+# include <zlib.h>
+#endif
+#ifdef KUMA_HAS_BROTLI
+# include <brotli/encode.h>
+#endif
+
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace kuma;
+
+// one HTTP/2 DATA frame of default max frame size
+#define ENCODE_BLOCK_SIZE   16*1024
+
+namespace {
+const std::string kIdentity = "identity";
+const std::string kGzip = "gzip";
+const std::string kDeflate = "deflate";
+const std::string kBrotli = "br";
+
+// the output blocks appended to out, a new block is allocated when the last one is full
+class OutputBlocks
+{
+public:
+    OutputBlocks(KMBuffer::Ptr &out) : out_(out) {}
+    
+    // the space of last block
+    KMBuffer* block()
+    {
+        if (!block_ || block_->space() == 0) {
+            block_ = new KMBuffer(ENCODE_BLOCK_SIZE);
+            if (out_) {
+                out_->append(block_);
+            } else {
+                out_.reset(block_);
+            }
+        }
+        return block_;
+    }
+    
+private:
+    KMBuffer::Ptr&  out_;
+    KMBuffer*       block_ = nullptr;
+};
+
+#ifdef KUMA_HAS_ZLIB
+class ZlibEncoder : public ContentEncoder
+{
+public:
+    ZlibEncoder(Type type) : ContentEncoder(type) {}
+    
+    ~ZlibEncoder()
+    {
+        if (initialized_) {
+            deflateEnd(&strm_);
+        }
+    }
+    
+    bool init(int level)
+    {
+        if (level < 0 || level > 9) {
+            level = Z_DEFAULT_COMPRESSION;
+        }
+        // window bits 15 and memory level 8 take about 256KB, +16 for gzip wrapper
+        int window_bits = type_ == Type::GZIP ? 15 + 16 : 15;
+        initialized_ = deflateInit2(&strm_, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        return initialized_;
+    }
+    
+    KMError encode(const KMBuffer *buf, bool finish, KMBuffer::Ptr &out) override
+    {
+        if (finished_) {
+            return KMError::INVALID_STATE;
+        }
+        OutputBlocks blocks(out);
+        if (buf) {
+            for (auto it = buf->begin(); it != buf->end(); ++it) {
+                if (it->length() > 0) {
+                    strm_.next_in = static_cast<Bytef*>(it->readPtr());
+                    strm_.avail_in = static_cast<uInt>(it->length());
+                    if (!deflate(blocks, Z_NO_FLUSH)) {
+                        return KMError::FAILED;
+                    }
+                }
+            }
+        }
+        finished_ = finish;
+        return deflate(blocks, finish ? Z_FINISH : Z_SYNC_FLUSH) ? KMError::NOERR : KMError::FAILED;
+    }
+    
+private:
+    bool deflate(OutputBlocks &blocks, int flush)
+    {
+        do {
+            auto *block = blocks.block();
+            auto space = block->space();
+            strm_.next_out = static_cast<Bytef*>(block->writePtr());
+            strm_.avail_out = static_cast<uInt>(space);
+            int ret = ::deflate(&strm_, flush);
+            if (ret == Z_STREAM_ERROR) {
+                KUMA_ERRTRACE("ZlibEncoder::deflate, failed, flush=" << flush);
+                return false;
+            }
+            block->bytesWritten(space - strm_.avail_out);
+            if (ret == Z_STREAM_END) {
+                break;
+            }
+            // all output is written if there is space left
+        } while (strm_.avail_out == 0 || strm_.avail_in > 0);
+        return true;
+    }
+    
+private:
+    z_stream    strm_{};
+    bool        initialized_ = false;
+    bool        finished_ = false;
+};
+#endif
+
+#ifdef KUMA_HAS_BROTLI
+class BrotliEncoder : public ContentEncoder
+{
+public:
+    BrotliEncoder() : ContentEncoder(Type::BROTLI) {}
+    
+    ~BrotliEncoder()
+    {
+        if (state_) {
+            BrotliEncoderDestroyInstance(state_);
+        }
+    }
+    
+    bool init(int level)
+    {
+        state_ = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+        if (!state_) {
+            return false;
+        }
+        // the default quality 11 is too slow for dynamic content
+        if (level < 0 || level > BROTLI_MAX_QUALITY) {
+            level = 5;
+        }
+        BrotliEncoderSetParameter(state_, BROTLI_PARAM_QUALITY, static_cast<uint32_t>(level));
+        // 256KB window instead of default 4MB
+        BrotliEncoderSetParameter(state_, BROTLI_PARAM_LGWIN, 18);
+        return true;
+    }
+    
+    KMError encode(const KMBuffer *buf, bool finish, KMBuffer::Ptr &out) override
+    {
+        if (finished_) {
+            return KMError::INVALID_STATE;
+        }
+        OutputBlocks blocks(out);
+        if (buf) {
+            for (auto it = buf->begin(); it != buf->end(); ++it) {
+                if (it->length() > 0) {
+                    if (!compress(blocks, BROTLI_OPERATION_PROCESS,
+                                  static_cast<const uint8_t*>(it->readPtr()), it->length())) {
+                        return KMError::FAILED;
+                    }
+                }
+            }
+        }
+        finished_ = finish;
+        return compress(blocks, finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH, nullptr, 0) ?
+            KMError::NOERR : KMError::FAILED;
+    }
+    
+private:
+    bool compress(OutputBlocks &blocks, BrotliEncoderOperation op, const uint8_t *data, size_t len)
+    {
+        size_t avail_in = len;
+        const uint8_t *next_in = data;
+        do {
+            auto *block = blocks.block();
+            size_t avail_out = block->space();
+            auto *next_out = static_cast<uint8_t*>(block->writePtr());
+            if (!BrotliEncoderCompressStream(state_, op, &avail_in, &next_in, &avail_out, &next_out, nullptr)) {
+                KUMA_ERRTRACE("BrotliEncoder::compress, failed, op=" << int(op));
+                return false;
+            }
+            block->bytesWritten(block->space() - avail_out);
+        } while (avail_in > 0 || BrotliEncoderHasMoreOutput(state_));
+        return true;
+    }
+    
+private:
+    BrotliEncoderState* state_ = nullptr;
+    bool                finished_ = false;
+};
+#endif
+
+// the qvalue of "gzip;q=0.8", 1 if it has no qvalue
+double getQValue(const std::string &token, size_t pos)
+{
+    while ((pos = token.find(';', pos)) != std::string::npos) {
+        ++pos;
+        while (pos < token.size() && token[pos] == ' ') {
+            ++pos;
+        }
+        if (pos + 1 < token.size() && (token[pos] == 'q' || token[pos] == 'Q') && token[pos + 1] == '=') {
+            return atof(token.c_str() + pos + 2);
+        }
+    }
+    return 1.0;
+}
+
+ContentEncoder::Type getEncodingType(const std::string &name)
+{
+    if (is_equal(name, kGzip) || is_equal(name, "x-gzip")) {
+        return ContentEncoder::Type::GZIP;
+    } else if (is_equal(name, kDeflate)) {
+        return ContentEncoder::Type::DEFLATE;
+    } else if (is_equal(name, kBrotli)) {
+        return ContentEncoder::Type::BROTLI;
+    }
+    return ContentEncoder::Type::IDENTITY;
+}
+} // namespace
+
+ContentEncoder::Ptr ContentEncoder::create(Type type, int level)
+{
+    switch (type) {
+#ifdef KUMA_HAS_ZLIB
+        case Type::GZIP:
+        case Type::DEFLATE: {
+            std::unique_ptr<ZlibEncoder> encoder(new ZlibEncoder(type));
+            if (encoder->init(level)) {
+                return Ptr(encoder.release());
+            }
+            KUMA_ERRTRACE("ContentEncoder::create, failed to init zlib, type=" << int(type));
+            break;
+        }
+#endif
+#ifdef KUMA_HAS_BROTLI
+        case Type::BROTLI: {
+            std::unique_ptr<BrotliEncoder> encoder(new BrotliEncoder());
+            if (encoder->init(level)) {
+                return Ptr(encoder.release());
+            }
+            KUMA_ERRTRACE("ContentEncoder::create, failed to init brotli");
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+    return Ptr();
+}
+
+bool ContentEncoder::isSupported(Type type)
+{
+    switch (type) {
+#ifdef KUMA_HAS_ZLIB
+        case Type::GZIP:
+        case Type::DEFLATE:
+            return true;
+#endif
+#ifdef KUMA_HAS_BROTLI
+        case Type::BROTLI:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+const std::string& ContentEncoder::getName(Type type)
+{
+    switch (type) {
+        case Type::GZIP:
+            return kGzip;
+        case Type::DEFLATE:
+            return kDeflate;
+        case Type::BROTLI:
+            return kBrotli;
+        default:
+            return kIdentity;
+    }
+}
+
+ContentEncoder::TypeVector ContentEncoder::parseEncodings(const std::string &encodings)
+{
+    TypeVector types;
+    for_each_token(encodings, ',', [&types] (std::string &name) {
+        auto type = getEncodingType(name);
+        if (isSupported(type) && std::find(types.begin(), types.end(), type) == types.end()) {
+            types.push_back(type);
+        }
+        return true;
+    });
+    return types;
+}
+
+ContentEncoder::Type ContentEncoder::negotiate(const TypeVector &types, const char *accept_encoding)
+{
+    if (types.empty() || !accept_encoding || !*accept_encoding) {
+        return Type::IDENTITY;
+    }
+    // the qvalue of each type, -1 if it is not listed
+    double qvalues[4] = { -1, -1, -1, -1 };
+    double any_qvalue = -1;
+    for_each_token(accept_encoding, ',', [&] (std::string &token) {
+        auto pos = token.find(';');
+        auto name = token.substr(0, pos);
+        trim_right(name);
+        auto qvalue = getQValue(token, pos == std::string::npos ? token.size() : pos);
+        if (name == "*") {
+            any_qvalue = qvalue;
+        } else {
+            auto type = getEncodingType(name);
+            if (type != Type::IDENTITY) {
+                qvalues[static_cast<int>(type)] = qvalue;
+            }
+        }
+        return true;
+    });
+    auto best_type = Type::IDENTITY;
+    double best_qvalue = 0;
+    for (auto type : types) {
+        auto qvalue = qvalues[static_cast<int>(type)];
+        if (qvalue < 0) {
+            qvalue = any_qvalue;
+        }
+        if (qvalue > best_qvalue) {
+            best_qvalue = qvalue;
+            best_type = type;
+        }
+    }
+    return best_type;
+}
+
+KMError ContentEncoder::encodeAll(Type type, int level, const KMBuffer &buf, KMBuffer::Ptr &out)
+{
+    auto encoder = create(type, level);
+    if (!encoder) {
+        return KMError::UNSUPPORT;
+    }
+    return encoder->encode(&buf, true, out);
+}
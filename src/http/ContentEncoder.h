@@ -0,0 +1,85 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __ContentEncoder_H__
+#define __ContentEncoder_H__
+
+#include "kmdefs.h"
+#include "kmbuffer.h"
+
+#include <string>
+#include <memory>
+#include <vector>
+
+KUMA_NS_BEGIN
+
+/* streaming encoder of Content-Encoding. gzip and deflate are supported if
+ * KUMA_HAS_ZLIB is defined, br is supported if KUMA_HAS_BROTLI is defined.
+ * the window of encoder is bounded, so is the memory of each stream
+ */
+class ContentEncoder
+{
+public:
+    enum class Type {
+        IDENTITY,
+        GZIP,
+        DEFLATE,
+        BROTLI
+    };
+    using Ptr = std::unique_ptr<ContentEncoder>;
+    using TypeVector = std::vector<Type>;
+    
+    virtual ~ContentEncoder() {}
+    
+    /* compress buf and append the output to out in blocks of at most ENCODE_BLOCK_SIZE.
+     * the output is flushed, the peer can decode it without waiting for more data.
+     * the stream is ended if finish is true, buf can be nullptr
+     */
+    virtual KMError encode(const KMBuffer *buf, bool finish, KMBuffer::Ptr &out) = 0;
+    Type getType() const { return type_; }
+    
+    /* level is the compression level of encoder, 1 - 9 for gzip and deflate,
+     * 0 - 11 for br, -1 for default. nullptr if type is not supported
+     */
+    static Ptr create(Type type, int level);
+    static bool isSupported(Type type);
+    static const std::string& getName(Type type);
+    /* the supported encodings of comma separated names in order of preference,
+     * e.g. "br, gzip, deflate"
+     */
+    static TypeVector parseEncodings(const std::string &encodings);
+    /* the encoding of types with the highest qvalue in Accept-Encoding value, the
+     * first one if same. IDENTITY if none is accepted
+     */
+    static Type negotiate(const TypeVector &types, const char *accept_encoding);
+    /* compress the whole buf at once, e.g. for precompressed variant */
+    static KMError encodeAll(Type type, int level, const KMBuffer &buf, KMBuffer::Ptr &out);
+    
+protected:
+    ContentEncoder(Type type) : type_(type) {}
+    
+protected:
+    Type    type_;
+};
+
+KUMA_NS_END
+
+#endif
@@ -0,0 +1,243 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "FileCache.h"
+#include "HttpDate.h"
+#include "util/kmtrace.h"
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <errno.h>
+
+#ifdef KUMA_OS_WIN
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+using namespace kuma;
+
+namespace {
+#ifdef KUMA_OS_WIN
+using FileStat = struct _stat64;
+int statFile(const std::string &path, FileStat &st) { return ::_stat64(path.c_str(), &st); }
+bool isDirectory(const FileStat &st) { return (st.st_mode & _S_IFMT) == _S_IFDIR; }
+bool isRegular(const FileStat &st) { return (st.st_mode & _S_IFMT) == _S_IFREG; }
+#else
+using FileStat = struct stat;
+int statFile(const std::string &path, FileStat &st) { return ::stat(path.c_str(), &st); }
+bool isDirectory(const FileStat &st) { return S_ISDIR(st.st_mode); }
+bool isRegular(const FileStat &st) { return S_ISREG(st.st_mode); }
+#endif
+
+int closeFile(int fd)
+{
+#ifdef KUMA_OS_WIN
+    return ::_close(fd);
+#else
+    return ::close(fd);
+#endif
+}
+
+int readFile(int fd, void *buf, size_t len, int64_t offset)
+{
+#ifdef KUMA_OS_WIN
+    // positional read, the fd may be read by other loops at the same time
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD nread = 0;
+    if (!::ReadFile(reinterpret_cast<HANDLE>(::_get_osfhandle(fd)), buf, static_cast<DWORD>(len), &nread, &ov)) {
+        return -1;
+    }
+    return static_cast<int>(nread);
+#else
+    ssize_t ret = 0;
+    do {
+        ret = ::pread(fd, buf, len, static_cast<off_t>(offset));
+    } while (ret < 0 && errno == EINTR);
+    return static_cast<int>(ret);
+#endif
+}
+} // namespace
+
+FileCache::File::~File()
+{
+    if (fd_ >= 0) {
+        closeFile(fd_);
+        fd_ = -1;
+    }
+}
+
+KMBuffer::Ptr FileCache::File::read(int64_t offset, size_t len)
+{
+    if (offset < 0 || offset >= size_ || 0 == len) {
+        return KMBuffer::Ptr();
+    }
+    if (static_cast<int64_t>(len) > size_ - offset) {
+        len = static_cast<size_t>(size_ - offset);
+    }
+    KMBuffer::Ptr buf(new KMBuffer(len));
+    auto *ptr = static_cast<char*>(buf->writePtr());
+    size_t total = 0;
+    while (total < len) {
+        int ret = readFile(fd_, ptr + total, len - total, offset + total);
+        if (ret <= 0) {
+            KUMA_ERRTRACE("FileCache::File::read, failed, offset=" << offset + total << ", err=" << errno);
+            return KMBuffer::Ptr();
+        }
+        total += ret;
+    }
+    buf->bytesWritten(len);
+    return buf;
+}
+
+void FileCache::setOptions(uint32_t ttl_ms, size_t max_files)
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    ttl_ms_ = ttl_ms;
+    max_files_ = max_files;
+    if (0 == ttl_ms_ || 0 == max_files_) {
+        ttl_ms_ = 0;
+        entries_.clear();
+        lru_list_.clear();
+    }
+    while (lru_list_.size() > max_files_) {
+        entries_.erase(lru_list_.back());
+        lru_list_.pop_back();
+    }
+}
+
+KMError FileCache::open(const std::string &path, FilePtr &file)
+{
+    file.reset();
+    auto now = Clock::now();
+    uint32_t ttl_ms = 0;
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        ttl_ms = ttl_ms_;
+        auto it = ttl_ms > 0 ? entries_.find(path) : entries_.end();
+        if (it != entries_.end()) {
+            lru_list_.splice(lru_list_.begin(), lru_list_, it->second.lru_it);
+            file = it->second.file;
+            if (now < it->second.check_time + std::chrono::milliseconds(ttl_ms)) {
+                return KMError::NOERR;
+            }
+        }
+    }
+    if (0 == ttl_ms) {
+        return openFile(path, file);
+    }
+    // stat outside the lock, the file may be on a slow disk
+    if (file) {
+        if (!isModified(path, *file)) {
+            std::lock_guard<std::mutex> g(mutex_);
+            auto it = entries_.find(path);
+            if (it != entries_.end() && it->second.file == file) {
+                it->second.check_time = now;
+            }
+            return KMError::NOERR;
+        }
+        file.reset();
+    }
+    auto ret = openFile(path, file);
+    std::lock_guard<std::mutex> g(mutex_);
+    auto it = entries_.find(path);
+    if (ret != KMError::NOERR) {
+        if (it != entries_.end()) {
+            lru_list_.erase(it->second.lru_it);
+            entries_.erase(it);
+        }
+        return ret;
+    }
+    if (it != entries_.end()) {
+        it->second.file = file;
+        it->second.check_time = now;
+        return KMError::NOERR;
+    }
+    lru_list_.push_front(path);
+    entries_[path] = Entry{file, now, lru_list_.begin()};
+    while (lru_list_.size() > max_files_) {
+        entries_.erase(lru_list_.back());
+        lru_list_.pop_back();
+    }
+    return KMError::NOERR;
+}
+
+KMError FileCache::openFile(const std::string &path, FilePtr &file)
+{
+    FileStat st;
+    if (statFile(path, st) != 0) {
+        return errno == ENOENT || errno == ENOTDIR ? KMError::NOT_EXIST : KMError::FAILED;
+    }
+    file = std::make_shared<File>();
+    if (isDirectory(st)) {
+        file->is_dir_ = true;
+        return KMError::NOERR;
+    } else if (!isRegular(st)) {
+        file.reset();
+        return KMError::FAILED;
+    }
+#ifdef KUMA_OS_WIN
+    int fd = ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+    if (fd < 0) {
+        KUMA_WARNTRACE("FileCache::openFile, failed to open " << path << ", err=" << errno);
+        file.reset();
+        return errno == ENOENT ? KMError::NOT_EXIST : KMError::FAILED;
+    }
+    file->fd_ = fd;
+    // the file may be replaced between stat and open
+#ifdef KUMA_OS_WIN
+    if (::_fstat64(fd, &st) != 0 || !isRegular(st)) {
+#else
+    if (::fstat(fd, &st) != 0 || !isRegular(st)) {
+#endif
+        file.reset();
+        return KMError::FAILED;
+    }
+    file->size_ = st.st_size;
+    file->mtime_ = st.st_mtime;
+    file->ino_ = st.st_ino;
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%llx-%llx\"",
+             (unsigned long long)file->mtime_, (unsigned long long)file->size_);
+    file->etag_ = etag;
+    file->last_modified_ = HttpDate::format(static_cast<time_t>(file->mtime_));
+    return KMError::NOERR;
+}
+
+bool FileCache::isModified(const std::string &path, const File &file)
+{
+    FileStat st;
+    if (statFile(path, st) != 0) {
+        return true;
+    }
+    if (file.is_dir_) {
+        return !isDirectory(st);
+    }
+    return st.st_size != file.size_ || st.st_mtime != file.mtime_ || static_cast<uint64_t>(st.st_ino) != file.ino_;
+}
@@ -0,0 +1,103 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __FileCache_H__
+#define __FileCache_H__
+
+#include "kmdefs.h"
+#include "kmbuffer.h"
+
+#include <string>
+#include <memory>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+
+KUMA_NS_BEGIN
+
+/* the open files of StaticFileHandler. the fd and stat result of a file are cached
+ * and revalidated by stat after ttl, the least recently used files are closed when
+ * there are more than max files. a file is closed after the last response using it
+ * is done, even if it is removed from cache
+ */
+class FileCache
+{
+public:
+    class File
+    {
+    public:
+        ~File();
+        
+        bool isDirectory() const { return is_dir_; }
+        int getFd() const { return fd_; }
+        int64_t getSize() const { return size_; }
+        const std::string& getETag() const { return etag_; }
+        const std::string& getLastModified() const { return last_modified_; }
+        
+        /* the file data in [offset, offset + len) read into a new buffer. the file is
+         * not memory mapped, a mapping would raise SIGBUS if the file is truncated
+         * while the buffer is in flight
+         */
+        KMBuffer::Ptr read(int64_t offset, size_t len);
+        
+    private:
+        friend class FileCache;
+        
+        int                 fd_ = -1;
+        bool                is_dir_ = false;
+        int64_t             size_ = 0;
+        int64_t             mtime_ = 0;
+        uint64_t            ino_ = 0;
+        std::string         etag_;
+        std::string         last_modified_;
+    };
+    using FilePtr = std::shared_ptr<File>;
+    
+    /* ttl_ms 0 disables the cache, the file is opened for each request */
+    void setOptions(uint32_t ttl_ms, size_t max_files);
+    /* KMError::NOT_EXIST if the file doesn't exist, KMError::FAILED if it cannot
+     * be opened
+     */
+    KMError open(const std::string &path, FilePtr &file);
+    
+private:
+    static KMError openFile(const std::string &path, FilePtr &file);
+    static bool isModified(const std::string &path, const File &file);
+    
+    using Clock = std::chrono::steady_clock;
+    struct Entry
+    {
+        FilePtr                             file;
+        Clock::time_point                   check_time;
+        std::list<std::string>::iterator    lru_it;
+    };
+    
+    std::mutex                              mutex_;
+    std::unordered_map<std::string, Entry>  entries_;
+    std::list<std::string>                  lru_list_; // most recently used first
+    uint32_t                                ttl_ms_ = 1000;
+    size_t                                  max_files_ = 1024;
+};
+
+KUMA_NS_END
+
+#endif
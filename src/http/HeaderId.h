@@ -0,0 +1,295 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __HeaderId_H__
+#define __HeaderId_H__
+
+#include "kmdefs.h"
+#include "httpdefs.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include <string>
+
+KUMA_NS_BEGIN
+
+/* well-known header names, the id of a header name is resolved by a perfect
+ * hash table which is generated at compile time
+ */
+#define KUMA_HEADER_ID_MAP(XX) \
+    XX(ACCEPT, "Accept") \
+    XX(ACCEPT_CHARSET, "Accept-Charset") \
+    XX(ACCEPT_ENCODING, "Accept-Encoding") \
+    XX(ACCEPT_LANGUAGE, "Accept-Language") \
+    XX(ACCEPT_RANGES, "Accept-Ranges") \
+    XX(ACCESS_CONTROL_ALLOW_HEADERS, "Access-Control-Allow-Headers") \
+    XX(ACCESS_CONTROL_ALLOW_METHODS, "Access-Control-Allow-Methods") \
+    XX(ACCESS_CONTROL_ALLOW_ORIGIN, "Access-Control-Allow-Origin") \
+    XX(ACCESS_CONTROL_REQUEST_HEADERS, "Access-Control-Request-Headers") \
+    XX(ACCESS_CONTROL_REQUEST_METHOD, "Access-Control-Request-Method") \
+    XX(AGE, "Age") \
+    XX(ALLOW, "Allow") \
+    XX(AUTHORIZATION, "Authorization") \
+    XX(CACHE_CONTROL, "Cache-Control") \
+    XX(CONNECTION, "Connection") \
+    XX(CONTENT_DISPOSITION, "Content-Disposition") \
+    XX(CONTENT_ENCODING, "Content-Encoding") \
+    XX(CONTENT_LANGUAGE, "Content-Language") \
+    XX(CONTENT_LENGTH, "Content-Length") \
+    XX(CONTENT_LOCATION, "Content-Location") \
+    XX(CONTENT_RANGE, "Content-Range") \
+    XX(CONTENT_TYPE, "Content-Type") \
+    XX(COOKIE, "Cookie") \
+    XX(DATE, "Date") \
+    XX(ETAG, "ETag") \
+    XX(EXPECT, "Expect") \
+    XX(EXPIRES, "Expires") \
+    XX(FORWARDED, "Forwarded") \
+    XX(FROM, "From") \
+    XX(HOST, "Host") \
+    XX(HTTP2_SETTINGS, "HTTP2-Settings") \
+    XX(IF_MATCH, "If-Match") \
+    XX(IF_MODIFIED_SINCE, "If-Modified-Since") \
+    XX(IF_NONE_MATCH, "If-None-Match") \
+    XX(IF_RANGE, "If-Range") \
+    XX(IF_UNMODIFIED_SINCE, "If-Unmodified-Since") \
+    XX(KEEP_ALIVE, "Keep-Alive") \
+    XX(LAST_MODIFIED, "Last-Modified") \
+    XX(LINK, "Link") \
+    XX(LOCATION, "Location") \
+    XX(MAX_FORWARDS, "Max-Forwards") \
+    XX(ORIGIN, "Origin") \
+    XX(PRAGMA, "Pragma") \
+    XX(PROXY_AUTHENTICATE, "Proxy-Authenticate") \
+    XX(PROXY_AUTHORIZATION, "Proxy-Authorization") \
+    XX(PROXY_CONNECTION, "Proxy-Connection") \
+    XX(RANGE, "Range") \
+    XX(REFERER, "Referer") \
+    XX(REFRESH, "Refresh") \
+    XX(RETRY_AFTER, "Retry-After") \
+    XX(SEC_WEBSOCKET_ACCEPT, "Sec-WebSocket-Accept") \
+    XX(SEC_WEBSOCKET_EXTENSIONS, "Sec-WebSocket-Extensions") \
+    XX(SEC_WEBSOCKET_KEY, "Sec-WebSocket-Key") \
+    XX(SEC_WEBSOCKET_PROTOCOL, "Sec-WebSocket-Protocol") \
+    XX(SEC_WEBSOCKET_VERSION, "Sec-WebSocket-Version") \
+    XX(SERVER, "Server") \
+    XX(SET_COOKIE, "Set-Cookie") \
+    XX(STRICT_TRANSPORT_SECURITY, "Strict-Transport-Security") \
+    XX(TE, "TE") \
+    XX(TRAILER, "Trailer") \
+    XX(TRANSFER_ENCODING, "Transfer-Encoding") \
+    XX(UPGRADE, "Upgrade") \
+    XX(USER_AGENT, "User-Agent") \
+    XX(VARY, "Vary") \
+    XX(VIA, "Via") \
+    XX(WWW_AUTHENTICATE, "WWW-Authenticate") \
+    XX(X_FORWARDED_FOR, "X-Forwarded-For") \
+    XX(X_REQUESTED_WITH, "X-Requested-With")
+
+enum class HeaderId : uint8_t {
+    UNKNOWN = 0,
+#define XX(id, name) id,
+    KUMA_HEADER_ID_MAP(XX)
+#undef XX
+    MAX
+};
+
+namespace hdrid {
+
+constexpr size_t kIdCount = static_cast<size_t>(HeaderId::MAX);
+constexpr uint32_t kSlotBits = 9;
+constexpr size_t kSlotCount = 1 << kSlotBits;
+
+constexpr const char* kNames[kIdCount] = {
+    "",
+#define XX(id, name) name,
+    KUMA_HEADER_ID_MAP(XX)
+#undef XX
+};
+
+constexpr size_t nameLength(const char* s)
+{
+    size_t n = 0;
+    while (s[n]) {
+        ++n;
+    }
+    return n;
+}
+
+constexpr uint8_t toLower(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+// ASCII only, much cheaper than strncasecmp which goes through locale
+inline bool equalIgnoreCase(const char* s1, const char* s2, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if (toLower(static_cast<uint8_t>(s1[i])) != toLower(static_cast<uint8_t>(s2[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// hash of length and 4 characters of lower case name, the cost doesn't depend
+// on name length, len should not be less than 2
+constexpr uint32_t hashName(const char* s, size_t len, uint32_t seed)
+{
+    uint64_t key = static_cast<uint64_t>(len & 0xFF)
+        | static_cast<uint64_t>(toLower(static_cast<uint8_t>(s[0]))) << 8
+        | static_cast<uint64_t>(toLower(static_cast<uint8_t>(s[len / 2]))) << 16
+        | static_cast<uint64_t>(toLower(static_cast<uint8_t>(s[len - 2]))) << 24
+        | static_cast<uint64_t>(toLower(static_cast<uint8_t>(s[len - 1]))) << 32;
+    uint64_t multiplier = (seed * 0x9E3779B97F4A7C15ull + 0xD6E8FEB86659FD93ull) | 1;
+    return static_cast<uint32_t>((key * multiplier) >> 32);
+}
+
+constexpr uint32_t slotOf(const char* s, size_t len, uint32_t seed)
+{
+    return hashName(s, len, seed) >> (32 - kSlotBits);
+}
+
+// the first seed with which all names go to different slots
+constexpr uint32_t findSeed()
+{
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        bool used[kSlotCount] = {};
+        bool collided = false;
+        for (size_t i = 1; i < kIdCount && !collided; ++i) {
+            auto slot = slotOf(kNames[i], nameLength(kNames[i]), seed);
+            collided = used[slot];
+            used[slot] = true;
+        }
+        if (!collided) {
+            return seed;
+        }
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t kSeed = findSeed();
+static_assert(kSeed != UINT32_MAX, "no perfect hash seed for header names");
+
+constexpr std::array<uint8_t, kSlotCount> buildSlots()
+{
+    std::array<uint8_t, kSlotCount> slots{};
+    for (size_t i = 1; i < kIdCount; ++i) {
+        slots[slotOf(kNames[i], nameLength(kNames[i]), kSeed)] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+constexpr std::array<uint8_t, kSlotCount> kSlots = buildSlots();
+
+constexpr std::array<uint8_t, kIdCount> buildLengths()
+{
+    std::array<uint8_t, kIdCount> lens{};
+    for (size_t i = 0; i < kIdCount; ++i) {
+        lens[i] = static_cast<uint8_t>(nameLength(kNames[i]));
+    }
+    return lens;
+}
+
+constexpr std::array<uint8_t, kIdCount> kLengths = buildLengths();
+
+constexpr size_t kMaxNameLength = 32;
+using LowerName = std::array<char, kMaxNameLength>;
+
+constexpr std::array<LowerName, kIdCount> buildLowerNames()
+{
+    std::array<LowerName, kIdCount> names{};
+    for (size_t i = 0; i < kIdCount; ++i) {
+        for (size_t j = 0; kNames[i][j]; ++j) {
+            names[i][j] = static_cast<char>(toLower(static_cast<uint8_t>(kNames[i][j])));
+        }
+    }
+    return names;
+}
+
+constexpr std::array<LowerName, kIdCount> kLowerNames = buildLowerNames();
+
+// lower is in lower case already
+inline bool equalLowerName(const char* lower, const char* name, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if (lower[i] != static_cast<char>(toLower(static_cast<uint8_t>(name[i])))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace hdrid
+
+inline HeaderId getHeaderId(const char* name, size_t len)
+{
+    if (len < 2 || len >= hdrid::kMaxNameLength) {
+        return HeaderId::UNKNOWN;
+    }
+    auto i = hdrid::kSlots[hdrid::slotOf(name, len, hdrid::kSeed)];
+    if (i != 0 && hdrid::kLengths[i] == len && hdrid::equalLowerName(hdrid::kLowerNames[i].data(), name, len)) {
+        return static_cast<HeaderId>(i);
+    }
+    return HeaderId::UNKNOWN;
+}
+
+inline HeaderId getHeaderId(const std::string& name)
+{
+    return getHeaderId(name.c_str(), name.size());
+}
+
+inline const char* getHeaderName(HeaderId id)
+{
+    return hdrid::kNames[static_cast<size_t>(id) < hdrid::kIdCount ? static_cast<size_t>(id) : 0];
+}
+
+/* index of the first header of each well-known id in a header list, header
+ * with UNKNOWN id is not indexed and should be searched in the list
+ */
+class HeaderSlots
+{
+public:
+    void clear() { slots_.fill(0); }
+    void set(HeaderId id, size_t index)
+    {
+        if (id != HeaderId::UNKNOWN && slots_[static_cast<size_t>(id)] == 0) {
+            slots_[static_cast<size_t>(id)] = static_cast<uint32_t>(index + 1);
+        }
+    }
+    // return -1 if not found
+    int get(HeaderId id) const { return static_cast<int>(slots_[static_cast<size_t>(id)]) - 1; }
+    void build(const HeaderVector &headers)
+    {
+        clear();
+        for (size_t i = 0; i < headers.size(); ++i) {
+            set(getHeaderId(headers[i].first), i);
+        }
+    }
+    
+private:
+    std::array<uint32_t, hdrid::kIdCount> slots_{};
+};
+
+KUMA_NS_END
+
+#endif /* __HeaderId_H__ */
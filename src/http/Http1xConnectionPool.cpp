@@ -0,0 +1,299 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Http1xConnectionPool.h"
+#include "util/kmtrace.h"
+#include "util/util.h"
+
+#include <mutex>
+#include <atomic>
+
+using namespace kuma;
+
+namespace {
+    std::mutex s_pool_mutex;
+    std::map<EventLoop::Impl*, Http1xConnectionPool::Ptr> s_pools;
+    
+    std::atomic<size_t> s_max_idle_per_host{6};
+    std::atomic<size_t> s_max_conns_per_host{0};
+    std::atomic<uint32_t> s_idle_timeout_ms{60*1000};
+}
+
+Http1xConnectionPool::Http1xConnectionPool(const EventLoopPtr &loop)
+: loop_(loop), idle_timer_(loop->getTimerMgr())
+{
+    loop_token_.eventLoop(loop);
+}
+
+Http1xConnectionPool::~Http1xConnectionPool()
+{
+    idle_timer_.cancel();
+    loop_token_.reset();
+    clear();
+}
+
+Http1xConnectionPool::Ptr Http1xConnectionPool::get(const EventLoopPtr &loop)
+{
+    auto *loop_ptr = loop.get();
+    {
+        std::lock_guard<std::mutex> g(s_pool_mutex);
+        auto it = s_pools.find(loop_ptr);
+        if (it != s_pools.end()) {
+            return it->second;
+        }
+    }
+    Ptr pool(new Http1xConnectionPool(loop));
+    auto ret = loop->appendObserver([loop_ptr] (LoopActivity act) {
+        if (act == LoopActivity::EXIT) {
+            Ptr pool;
+            {
+                std::lock_guard<std::mutex> g(s_pool_mutex);
+                auto it = s_pools.find(loop_ptr);
+                if (it != s_pools.end()) {
+                    pool = std::move(it->second);
+                    s_pools.erase(it);
+                }
+            }
+            if (pool) {
+                pool->clear();
+            }
+        }
+    }, &pool->loop_token_);
+    if (ret != KMError::NOERR) {
+        return Ptr();
+    }
+    std::lock_guard<std::mutex> g(s_pool_mutex);
+    s_pools[loop_ptr] = pool;
+    return pool;
+}
+
+std::string Http1xConnectionPool::getKey(const std::string &host, uint16_t port, uint32_t ssl_flags)
+{
+    return host + ":" + std::to_string(port) + "/" + std::to_string(ssl_flags);
+}
+
+void Http1xConnectionPool::setLimits(size_t max_idle_per_host, size_t max_conns_per_host, uint32_t idle_timeout_ms)
+{
+    s_max_idle_per_host = max_idle_per_host;
+    s_max_conns_per_host = max_conns_per_host;
+    s_idle_timeout_ms = idle_timeout_ms;
+}
+
+Http1xConnectionPool::TcpSocketPtr Http1xConnectionPool::checkout(const std::string &key)
+{
+    auto it = conn_map_.find(key);
+    if (it == conn_map_.end()) {
+        return TcpSocketPtr();
+    }
+    auto &conn_list = it->second;
+    TcpSocketPtr tcp;
+    // the most recently used connection is at the back
+    while (!conn_list.empty() && !tcp) {
+        tcp = std::move(conn_list.back().tcp);
+        conn_list.pop_back();
+        --idle_count_;
+        if (!isHealthy(*tcp)) {
+            KUMA_INFOTRACE("Http1xConnectionPool::checkout, drop broken connection, key=" << key);
+            tcp.reset();
+        }
+    }
+    if (conn_list.empty()) {
+        conn_map_.erase(it);
+    }
+    if (tcp) {
+        tcp->setReadCallback(nullptr);
+        tcp->setWriteCallback(nullptr);
+        tcp->setErrorCallback(nullptr);
+    }
+    return tcp;
+}
+
+void Http1xConnectionPool::checkin(const std::string &key, TcpSocketPtr &&tcp)
+{
+    size_t max_idle = s_max_idle_per_host;
+    uint32_t idle_timeout_ms = s_idle_timeout_ms;
+    if (!tcp || !isHealthy(*tcp) || idle_timeout_ms == 0 || max_idle == 0) {
+        return;
+    }
+    auto &conn_list = conn_map_[key];
+    while (!conn_list.empty() && conn_list.size() >= max_idle) {
+        // drop the oldest one
+        conn_list.pop_front();
+        --idle_count_;
+    }
+    auto *tcp_ptr = tcp.get();
+    // any data or event on an idle connection means it is closed by peer or unusable
+    tcp->setReadCallback([this, key, tcp_ptr] (KMError) {
+        if (!isHealthy(*tcp_ptr)) {
+            removeConnection(key, tcp_ptr);
+        }
+    });
+    tcp->setWriteCallback(nullptr);
+    tcp->setErrorCallback([this, key, tcp_ptr] (KMError) {
+        removeConnection(key, tcp_ptr);
+    });
+    conn_list.push_back({std::move(tcp), get_tick_count_ms()});
+    ++idle_count_;
+    if (idle_count_ == 1) {
+        idle_timer_.schedule(idle_timeout_ms, TimerMode::ONE_SHOT, [this] { onIdleTimer(); });
+    }
+}
+
+bool Http1xConnectionPool::acquireSlot(const std::string &key, void *owner, SlotCallback cb)
+{
+    size_t max_conns = s_max_conns_per_host;
+    auto &slots = slot_map_[key];
+    if (max_conns == 0 || (slots.active < max_conns && slots.waiters.empty())) {
+        ++slots.active;
+        return true;
+    }
+    slots.waiters.push_back({owner, std::move(cb)});
+    return false;
+}
+
+void Http1xConnectionPool::releaseSlot(const std::string &key)
+{
+    auto it = slot_map_.find(key);
+    if (it == slot_map_.end()) {
+        return;
+    }
+    auto &slots = it->second;
+    if (slots.active > 0) {
+        --slots.active;
+    }
+    if (!slots.waiters.empty()) {
+        // the waiter may check out the connection just put back to pool
+        auto loop = loop_.lock();
+        if (loop) {
+            loop->post([this, key] { dispatchSlots(key); }, &loop_token_);
+        }
+    } else if (slots.active == 0) {
+        slot_map_.erase(it);
+    }
+}
+
+void Http1xConnectionPool::cancelSlot(const std::string &key, void *owner)
+{
+    auto it = slot_map_.find(key);
+    if (it == slot_map_.end()) {
+        return;
+    }
+    auto &waiters = it->second.waiters;
+    for (auto itw = waiters.begin(); itw != waiters.end(); ++itw) {
+        if (itw->owner == owner) {
+            waiters.erase(itw);
+            break;
+        }
+    }
+    if (it->second.active == 0 && waiters.empty()) {
+        slot_map_.erase(it);
+    }
+}
+
+void Http1xConnectionPool::dispatchSlots(const std::string &key)
+{
+    while (true) {
+        // the slot map may be changed in callback
+        auto it = slot_map_.find(key);
+        if (it == slot_map_.end()) {
+            return;
+        }
+        auto &slots = it->second;
+        size_t max_conns = s_max_conns_per_host;
+        if (slots.waiters.empty() || (max_conns != 0 && slots.active >= max_conns)) {
+            return;
+        }
+        auto cb = std::move(slots.waiters.front().cb);
+        slots.waiters.pop_front();
+        ++slots.active;
+        cb();
+    }
+}
+
+void Http1xConnectionPool::onIdleTimer()
+{
+    auto now_tick = get_tick_count_ms();
+    uint32_t idle_timeout_ms = s_idle_timeout_ms;
+    TICK_COUNT_TYPE next_expire = idle_timeout_ms;
+    for (auto it = conn_map_.begin(); it != conn_map_.end(); ) {
+        auto &conn_list = it->second;
+        while (!conn_list.empty()) {
+            auto idle_ms = calc_time_elapse_delta_ms(now_tick, conn_list.front().idle_tick);
+            if (idle_ms < idle_timeout_ms) {
+                if (idle_timeout_ms - idle_ms < next_expire) {
+                    next_expire = idle_timeout_ms - idle_ms;
+                }
+                break;
+            }
+            conn_list.pop_front();
+            --idle_count_;
+        }
+        if (conn_list.empty()) {
+            it = conn_map_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (idle_count_ > 0) {
+        idle_timer_.schedule(static_cast<uint32_t>(next_expire), TimerMode::ONE_SHOT, [this] { onIdleTimer(); });
+    }
+}
+
+void Http1xConnectionPool::removeConnection(const std::string &key, TcpSocket::Impl *tcp)
+{
+    auto it = conn_map_.find(key);
+    if (it == conn_map_.end()) {
+        return;
+    }
+    auto &conn_list = it->second;
+    for (auto itc = conn_list.begin(); itc != conn_list.end(); ++itc) {
+        if (itc->tcp.get() == tcp) {
+            KUMA_INFOTRACE("Http1xConnectionPool::removeConnection, key=" << key);
+            conn_list.erase(itc);
+            --idle_count_;
+            break;
+        }
+    }
+    if (conn_list.empty()) {
+        conn_map_.erase(it);
+    }
+    if (idle_count_ == 0) {
+        idle_timer_.cancel();
+    }
+}
+
+void Http1xConnectionPool::clear()
+{
+    idle_timer_.cancel();
+    conn_map_.clear();
+    slot_map_.clear();
+    idle_count_ = 0;
+}
+
+bool Http1xConnectionPool::isHealthy(TcpSocket::Impl &tcp)
+{
+    if (!tcp.isReady()) {
+        return false;
+    }
+    // no response is expected on idle connection, receive returns 0 if nothing to read
+    uint8_t buf[1];
+    return tcp.receive(buf, sizeof(buf)) == 0;
+}
@@ -0,0 +1,118 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __Http1xConnectionPool_H__
+#define __Http1xConnectionPool_H__
+
+#include "kmdefs.h"
+#include "TcpSocketImpl.h"
+#include "EventLoopImpl.h"
+
+#include <memory>
+#include <map>
+#include <list>
+#include <string>
+#include <functional>
+
+KUMA_NS_BEGIN
+
+/**
+ * Http1xConnectionPool keeps the idle keep-alive connections of HTTP/1.x requests,
+ * and limits the active connections of each host. there is one pool per event loop,
+ * and it should only be accessed in loop thread
+ */
+class Http1xConnectionPool
+{
+public:
+    using TcpSocketPtr = std::unique_ptr<TcpSocket::Impl>;
+    using SlotCallback = std::function<void(void)>;
+    using Ptr = std::shared_ptr<Http1xConnectionPool>;
+    
+    Http1xConnectionPool(const EventLoopPtr &loop);
+    ~Http1xConnectionPool();
+    
+    /* get a healthy idle connection, return nullptr if no one available
+     */
+    TcpSocketPtr checkout(const std::string &key);
+    
+    /* put a connection back to pool, it will be closed if pool is full
+     */
+    void checkin(const std::string &key, TcpSocketPtr &&tcp);
+    
+    /* take an active connection slot of host key for owner, return false if the host
+     * has max active connections, then cb will be called in a posted task once a slot
+     * is released, the slot is already taken for owner when cb is called
+     */
+    bool acquireSlot(const std::string &key, void *owner, SlotCallback cb);
+    /* release the slot when the connection is closed or put back to pool
+     */
+    void releaseSlot(const std::string &key);
+    void cancelSlot(const std::string &key, void *owner);
+    
+    size_t idleCount() const { return idle_count_; }
+    
+public:
+    static Ptr get(const EventLoopPtr &loop);
+    static std::string getKey(const std::string &host, uint16_t port, uint32_t ssl_flags);
+    /* the limits are shared by the pools of all the event loops, 0 max_conns_per_host
+     * means no limit of active connections
+     */
+    static void setLimits(size_t max_idle_per_host, size_t max_conns_per_host, uint32_t idle_timeout_ms);
+    
+private:
+    struct IdleConnection
+    {
+        TcpSocketPtr        tcp;
+        TICK_COUNT_TYPE     idle_tick;
+    };
+    using ConnectionList = std::list<IdleConnection>;
+    using ConnectionMap = std::map<std::string, ConnectionList>;
+    
+    struct SlotWaiter
+    {
+        void*               owner;
+        SlotCallback        cb;
+    };
+    struct HostSlots
+    {
+        size_t                  active = 0;
+        std::list<SlotWaiter>   waiters;
+    };
+    using SlotMap = std::map<std::string, HostSlots>;
+    
+    void onIdleTimer();
+    void removeConnection(const std::string &key, TcpSocket::Impl *tcp);
+    void dispatchSlots(const std::string &key);
+    void clear();
+    static bool isHealthy(TcpSocket::Impl &tcp);
+    
+private:
+    EventLoopWeakPtr    loop_;
+    EventLoopToken      loop_token_;
+    Timer::Impl         idle_timer_;
+    ConnectionMap       conn_map_;
+    SlotMap             slot_map_;
+    size_t              idle_count_ = 0;
+};
+
+KUMA_NS_END
+
+#endif
@@ -23,6 +23,7 @@
 #include "util/kmtrace.h"
 #include "util/util.h"
 #include "HttpCache.h"
+#include "Http1xConnectionPool.h"
 
 #include <sstream>
 #include <iterator>
@@ -48,12 +49,17 @@ Http1xRequest::Http1xRequest(const EventLoopPtr &loop, std::string ver)
 
 Http1xRequest::~Http1xRequest()
 {
+    if (canReuseConnection()) {
+        releaseConnection();
+    }
+    releaseSlot();
     loop_token_.reset();
 }
 
 void Http1xRequest::cleanup()
 {
     TcpConnection::close();
+    releaseSlot();
     loop_token_.reset();
 }
 
@@ -67,7 +73,7 @@ void Http1xRequest::checkHeaders()
     if(!req_message_.hasHeader("Accept")) {
         addHeader("Accept", "*/*");
     }
-    if(!req_message_.hasHeader(strContentType)) {
+    if(!req_message_.hasHeader(HeaderId::CONTENT_TYPE)) {
         addHeader(strContentType, "application/octet-stream");
     }
     if(!req_message_.hasHeader("User-Agent")) {
@@ -93,8 +99,7 @@ void Http1xRequest::buildRequest()
         ss << "#" << uri_.getFragment();
     }
     auto url(ss.str());
-    auto req = req_message_.buildHeader(method_, url, version_);
-    KMBuffer buf(req.c_str(), req.size(), req.size());
+    auto buf = req_message_.buildHeader(method_, url, version_);
     appendSendBuffer(buf);
 }
 
@@ -116,39 +121,118 @@ KMError Http1xRequest::sendRequest()
             port = std::stoi(str_port);
         }
         TcpConnection::setSslFlags(ssl_flags);
-        return TcpConnection::connect(uri_.getHost().c_str(), port);
+        conn_host_ = uri_.getConnectHost();
+        conn_port_ = port;
+        conn_key_ = Http1xConnectionPool::getKey(conn_host_, port, ssl_flags);
+        auto pool = Http1xConnectionPool::get(eventLoop());
+        if (pool) {
+            bool acquired = pool->acquireSlot(conn_key_, this, [this] {
+                slot_waiting_ = false;
+                slot_acquired_ = true;
+                auto err = startConnection();
+                if (err != KMError::NOERR) {
+                    cleanup();
+                    setState(State::IN_ERROR);
+                    if(error_cb_) error_cb_(err);
+                }
+            });
+            if (!acquired) {
+                KUMA_INFOXTRACE("sendRequest, wait for connection slot, key=" << conn_key_);
+                slot_waiting_ = true;
+                return KMError::NOERR;
+            }
+            slot_acquired_ = true;
+        }
+        return startConnection();
     } else { // connection reuse
+        conn_reused_ = true;
         sendRequestHeader();
         return KMError::NOERR;
     }
 }
 
+KMError Http1xRequest::startConnection()
+{
+    auto pool = Http1xConnectionPool::get(eventLoop());
+    if (pool) {
+        auto tcp = pool->checkout(conn_key_);
+        if (tcp && TcpConnection::attachSocket(std::move(*tcp), nullptr, false) == KMError::NOERR) {
+            KUMA_INFOXTRACE("startConnection, reuse pooled connection, key=" << conn_key_);
+            conn_reused_ = true;
+            sendRequestHeader();
+            return KMError::NOERR;
+        }
+    }
+    conn_reused_ = false;
+    return TcpConnection::connect(conn_host_, conn_port_);
+}
+
+bool Http1xRequest::retryRequest()
+{
+    if (!conn_reused_ || rsp_received_ || req_message_.hasBody() || !isIdempotent()) {
+        return false;
+    }
+    if (getState() != State::SENDING_HEADER && getState() != State::RECVING_RESPONSE) {
+        return false;
+    }
+    KUMA_INFOXTRACE("retryRequest, reused connection is closed, key=" << conn_key_);
+    conn_reused_ = false;
+    TcpConnection::close();
+    TcpConnection::reset();
+    rsp_parser_.reset();
+    setState(State::CONNECTING);
+    return TcpConnection::connect(conn_host_, conn_port_) == KMError::NOERR;
+}
+
+bool Http1xRequest::isIdempotent() const
+{
+    return is_equal(method_, "GET") || is_equal(method_, "HEAD") ||
+        is_equal(method_, "OPTIONS") || is_equal(method_, "TRACE") ||
+        is_equal(method_, "PUT") || is_equal(method_, "DELETE");
+}
+
 bool Http1xRequest::processHttpCache()
 {
-    if (!HttpCache::isCacheable(method_, req_message_.getHeaders())) {
+    auto entry = getCacheEntry(req_message_.getHeaders());
+    if (!entry) {
         return false;
     }
-    std::string cache_key = getCacheKey();
-    
-    int status_code = 0;
-    HeaderVector rsp_headers;
-    KMBuffer rsp_body;
-    if (HttpCache::instance().getCache(cache_key, status_code, rsp_headers, rsp_body)) {
-        // cache hit
-        setState(State::RECVING_RESPONSE);
-        rsp_parser_.setHeaders(std::move(rsp_headers));
-        rsp_parser_.setStatusCode(status_code);
-        rsp_cache_body_.reset(rsp_body.clone());
-        auto loop = TcpConnection::eventLoop();
-        loop->post([this] { onCacheComplete(); }, &loop_token_);
-        return true;
-    }
-    return false;
+    // cache hit
+    applyCacheEntry(*entry);
+    return true;
+}
+
+bool Http1xRequest::processStaleCache()
+{
+    // the stale response cannot be served once the response header is delivered
+    if (getState() > State::RECVING_RESPONSE || rsp_parser_.headerComplete()) {
+        return false;
+    }
+    auto entry = getStaleCacheEntry();
+    if (!entry) {
+        return false;
+    }
+    KUMA_INFOXTRACE("processStaleCache, key=" << cache_key_);
+    TcpConnection::close();
+    releaseSlot();
+    applyCacheEntry(*entry);
+    return true;
+}
+
+void Http1xRequest::applyCacheEntry(const HttpCache::Entry &entry)
+{
+    setState(State::RECVING_RESPONSE);
+    rsp_parser_.setHeaders(getCacheHeaders(entry));
+    rsp_parser_.setStatusCode(entry.getStatusCode());
+    // the body data is shared with the cache entry
+    rsp_cache_body_.reset(entry.getBody() ? entry.getBody()->clone() : nullptr);
+    auto loop = TcpConnection::eventLoop();
+    loop->post([this] { onCacheComplete(); }, &loop_token_);
 }
 
 int Http1xRequest::sendData(const void* data, size_t len)
 {
-    if(!sendBufferEmpty() || getState() != State::SENDING_BODY) {
+    if(sendBufferBlocked() || getState() != State::SENDING_BODY) {
         return 0;
     }
     auto ret = req_message_.sendData(data, len);
@@ -164,7 +248,7 @@ int Http1xRequest::sendData(const void* data, size_t len)
 
 int Http1xRequest::sendData(const KMBuffer &buf)
 {
-    if(!sendBufferEmpty() || getState() != State::SENDING_BODY) {
+    if(sendBufferBlocked() || getState() != State::SENDING_BODY) {
         return 0;
     }
     auto ret = req_message_.sendData(buf);
@@ -192,6 +276,9 @@ void Http1xRequest::reset()
 KMError Http1xRequest::close()
 {
     KUMA_INFOXTRACE("close");
+    if (canReuseConnection()) {
+        releaseConnection();
+    }
     cleanup();
     setState(State::CLOSED);
     return KMError::NOERR;
@@ -199,12 +286,17 @@ KMError Http1xRequest::close()
 
 void Http1xRequest::sendRequestHeader()
 {
+    keep_alive_ = false;
+    rsp_received_ = false;
     rsp_parser_.setDataCallback([this] (KMBuffer &buf) { onHttpData(buf); });
     rsp_parser_.setEventCallback([this] (HttpEvent ev) { onHttpEvent(ev); });
     buildRequest();
     setState(State::SENDING_HEADER);
     auto ret = sendBufferedData();
     if(ret != KMError::NOERR) {
+        if (retryRequest() || processStaleCache()) {
+            return;
+        }
         cleanup();
         setState(State::IN_ERROR);
         if(error_cb_) error_cb_(KMError::SOCK_ERROR);
@@ -224,6 +316,9 @@ void Http1xRequest::sendRequestHeader()
 void Http1xRequest::onConnect(KMError err)
 {
     if(err != KMError::NOERR) {
+        if (processStaleCache()) {
+            return;
+        }
         if(error_cb_) error_cb_(err);
         return ;
     }
@@ -232,6 +327,9 @@ void Http1xRequest::onConnect(KMError err)
 
 KMError Http1xRequest::handleInputData(uint8_t *src, size_t len)
 {
+    if (len > 0) {
+        rsp_received_ = true;
+    }
     DESTROY_DETECTOR_SETUP();
     int bytes_used = rsp_parser_.parse((char*)src, len);
     DESTROY_DETECTOR_CHECK(KMError::DESTROYED);
@@ -266,6 +364,9 @@ void Http1xRequest::onWrite()
 void Http1xRequest::onError(KMError err)
 {
     KUMA_INFOXTRACE("onError, err="<<int(err));
+    if (retryRequest()) {
+        return;
+    }
     if (getState() == State::RECVING_RESPONSE) {
         DESTROY_DETECTOR_SETUP();
         bool completed = rsp_parser_.setEOF();
@@ -275,6 +376,9 @@ void Http1xRequest::onError(KMError err)
             return;
         }
     }
+    if (getState() < State::COMPLETE && processStaleCache()) {
+        return;
+    }
     cleanup();
     if(getState() < State::COMPLETE) {
         setState(State::IN_ERROR);
@@ -286,6 +390,7 @@ void Http1xRequest::onError(KMError err)
 
 void Http1xRequest::onHttpData(KMBuffer &buf)
 {
+    appendCacheResponse(buf);
     if(data_cb_) data_cb_(buf);
 }
 
@@ -294,14 +399,25 @@ void Http1xRequest::onHttpEvent(HttpEvent ev)
     KUMA_INFOXTRACE("onHttpEvent, ev="<<int(ev));
     switch (ev) {
         case HttpEvent::HEADER_COMPLETE:
+            if (!cache_key_.empty()) {
+                HeaderVector headers;
+                rsp_parser_.forEachHeader([&headers] (const char* name, const char* value) {
+                    headers.emplace_back(name, value);
+                });
+                beginCacheResponse(rsp_parser_.getStatusCode(), std::move(headers));
+            }
             if(header_cb_) header_cb_();
             break;
             
         case HttpEvent::COMPLETE:
+            endCacheResponse();
             onComplete();
             break;
             
         case HttpEvent::HTTP_ERROR:
+            if (processStaleCache()) {
+                break;
+            }
             cleanup();
             setState(State::IN_ERROR);
             if(error_cb_) error_cb_(KMError::FAILED);
@@ -314,6 +430,7 @@ void Http1xRequest::onHttpEvent(HttpEvent ev)
 
 void Http1xRequest::onComplete()
 {
+    keep_alive_ = isKeepAlive();
     setState(State::COMPLETE);
     if(response_cb_) response_cb_();
 }
@@ -334,3 +451,63 @@ void Http1xRequest::onCacheComplete()
     }
     onComplete();
 }
+
+bool Http1xRequest::isKeepAlive()
+{
+    if (rsp_parser_.getStatusCode() == 101 || !req_message_.isCompleted()) {
+        return false;
+    }
+    if (contains_token(req_message_.getHeader(HeaderId::CONNECTION), "close", ',')) {
+        return false;
+    }
+    auto conn = rsp_parser_.getHeaderValue(HeaderId::CONNECTION);
+    if (is_equal(rsp_parser_.getVersion(), "HTTP/1.0")) {
+        return contains_token(conn, "keep-alive", ',');
+    }
+    return !contains_token(conn, "close", ',');
+}
+
+bool Http1xRequest::canReuseConnection()
+{
+    if (getState() != State::COMPLETE && getState() != State::WAIT_FOR_REUSE) {
+        return false;
+    }
+    return keep_alive_ && !conn_key_.empty() && sendBufferEmpty() && tcp_.isReady();
+}
+
+void Http1xRequest::releaseConnection()
+{
+    auto loop = eventLoop();
+    if (!loop || !loop->inSameThread()) {
+        return;
+    }
+    auto pool = Http1xConnectionPool::get(loop);
+    if (!pool) {
+        return;
+    }
+    Http1xConnectionPool::TcpSocketPtr tcp(new TcpSocket::Impl(loop));
+    if (tcp->attach(std::move(tcp_)) == KMError::NOERR) {
+        KUMA_INFOXTRACE("releaseConnection, key=" << conn_key_);
+        pool->checkin(conn_key_, std::move(tcp));
+    }
+    keep_alive_ = false;
+    releaseSlot();
+}
+
+void Http1xRequest::releaseSlot()
+{
+    if (!slot_acquired_ && !slot_waiting_) {
+        return;
+    }
+    auto loop = eventLoop();
+    auto pool = loop && loop->inSameThread() ? Http1xConnectionPool::get(loop) : nullptr;
+    if (pool) {
+        if (slot_waiting_) {
+            pool->cancelSlot(conn_key_, this);
+        } else {
+            pool->releaseSlot(conn_key_);
+        }
+    }
+    slot_acquired_ = false;
+    slot_waiting_ = false;
+}
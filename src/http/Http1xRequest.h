@@ -45,10 +45,20 @@ public:
     int sendData(const KMBuffer &buf) override;
     void reset() override; // reset for connection reuse
     KMError close() override;
+    KMError setSendBufferWatermark(size_t high_mark, size_t low_mark) override {
+        return TcpConnection::setSendBufferWatermark(high_mark, low_mark);
+    }
+    size_t getBufferedBytes() const override { return sendBufferBytes(); }
+    KMError setRateLimit(uint32_t rate, uint32_t burst, const std::string &group) override {
+        return TcpConnection::setRateLimit(rate, burst, group);
+    }
+    KMError getRateLimitStats(RateLimitStats &stats) const override {
+        return TcpConnection::getRateLimitStats(stats);
+    }
     
     int getStatusCode() const override { return rsp_parser_.getStatusCode(); }
     const std::string& getVersion() const override { return rsp_parser_.getVersion(); }
-    const std::string& getHeaderValue(std::string name) const override { return rsp_parser_.getHeaderValue(std::move(name)); }
+    const char* getHeaderValue(const char* name) const override { return rsp_parser_.getHeaderValue(name); }
     void forEachHeader(HttpParser::Impl::EnumrateCallback cb) override { return rsp_parser_.forEachHeader(std::move(cb)); }
     
 protected: // callbacks of tcp_socket
@@ -65,16 +75,37 @@ private:
     void sendRequestHeader();
     bool isVersion2() override { return false; }
     bool processHttpCache();
+    bool processStaleCache();
+    void applyCacheEntry(const HttpCache::Entry &entry);
     
     void onHttpData(KMBuffer &buf);
     void onHttpEvent(HttpEvent ev);
     void onComplete();
     void onCacheComplete();
     
+    bool isKeepAlive();
+    bool canReuseConnection();
+    void releaseConnection();
+    KMError startConnection();
+    void releaseSlot();
+    bool retryRequest();
+    bool isIdempotent() const;
+    
 private:
     HttpMessage             req_message_;
     HttpParser::Impl        rsp_parser_;
     KMBuffer::Ptr           rsp_cache_body_;
+    std::string             conn_key_; // key of connection pool
+    std::string             conn_host_;
+    uint16_t                conn_port_ = 0;
+    bool                    keep_alive_ = false;
+    // the connection slot of host is taken or being waited in connection pool
+    bool                    slot_acquired_ = false;
+    bool                    slot_waiting_ = false;
+    // the request is sent on a reused connection, it is retried once if the
+    // connection is closed by peer before any response data
+    bool                    conn_reused_ = false;
+    bool                    rsp_received_ = false;
     
     EventLoopToken          loop_token_;
 };
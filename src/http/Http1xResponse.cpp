@@ -21,12 +21,16 @@
 
 #include "Http1xResponse.h"
 #include "EventLoopImpl.h"
+#include "HttpDate.h"
 #include "util/kmtrace.h"
 
 #include <iterator>
 
 using namespace kuma;
 
+#define MAX_PIPELINED_REQUESTS  32
+#define MAX_PIPELINED_BYTES     1024*1024
+
 //////////////////////////////////////////////////////////////////////////
 Http1xResponse::Http1xResponse(const EventLoopPtr &loop, std::string ver)
 : HttpResponse::Impl(std::move(ver)), TcpConnection(loop)
@@ -40,6 +44,9 @@ Http1xResponse::Http1xResponse(const EventLoopPtr &loop, std::string ver)
     });
     rsp_message_.setBSender([this] (const KMBuffer &buf) -> int {
         return TcpConnection::send(buf);
+    });
+    rsp_message_.setFSender([this] (int file_fd, int64_t offset, size_t len) -> int {
+        return TcpConnection::sendFile(file_fd, offset, len);
     });
     KM_SetObjKey("Http1xResponse");
 }
@@ -53,6 +60,9 @@ void Http1xResponse::cleanup()
 {
     TcpConnection::close();
     loop_token_.reset();
+    pending_requests_.clear();
+    pending_bytes_ = 0;
+    pending_data_.reset();
 }
 
 KMError Http1xResponse::setSslFlags(uint32_t ssl_flags)
@@ -89,17 +99,28 @@ void Http1xResponse::addHeader(std::string name, std::string value)
     rsp_message_.addHeader(std::move(name), std::move(value));
 }
 
+KMError Http1xResponse::addTrailer(std::string name, std::string value)
+{
+    if (!rsp_message_.addTrailer(std::move(name), std::move(value))) {
+        return KMError::INVALID_PARAM;
+    }
+    return KMError::NOERR;
+}
+
 void Http1xResponse::checkHeaders()
 {
-    if(!rsp_message_.hasHeader(strContentType)) {
+    if(!rsp_message_.hasHeader(HeaderId::CONTENT_TYPE)) {
         addHeader(strContentType, "application/octet-stream");
     }
 }
 
 void Http1xResponse::buildResponse(int status_code, const std::string& desc, const std::string& ver)
 {
-    auto rsp = rsp_message_.buildHeader(status_code, desc, ver);
-    KMBuffer buf(rsp.c_str(), rsp.size(), rsp.size());
+    // the header buffer is refcounted, it is shared instead of copied by send buffer
+    auto buf = rsp_message_.buildHeader(status_code, desc, ver, HttpDate::ofLoop(eventLoop().get())->get());
+    if (is_equal(req_parser_.getMethod(), "HEAD")) {
+        rsp_message_.setNoBody();
+    }
     appendSendBuffer(buf);
 }
 
@@ -116,61 +137,102 @@ KMError Http1xResponse::sendResponse(int status_code, const std::string& desc, c
         cleanup();
         setState(State::IN_ERROR);
         return KMError::SOCK_ERROR;
-    } else if (sendBufferEmpty()) {
-        if(!rsp_message_.hasBody()) {
+    } else if (!rsp_message_.hasBody()) {
+        if (responseSent()) {
             setState(State::COMPLETE);
-            eventLoop()->post([this] { notifyComplete(); }, &loop_token_);
-        } else {
-            setState(State::SENDING_BODY);
-            eventLoop()->post([this] { if (write_cb_) write_cb_(KMError::NOERR); }, &loop_token_);
+            postResponseComplete();
         }
+    } else if (sendBufferEmpty()) {
+        setState(State::SENDING_BODY);
+        eventLoop()->post([this] { notifyWrite(); }, &loop_token_);
     }
     return KMError::NOERR;
 }
 
 int Http1xResponse::sendData(const void* data, size_t len)
 {
-    if(!sendBufferEmpty() || getState() != State::SENDING_BODY) {
+    if(getState() != State::SENDING_BODY) {
         return 0;
     }
-    int ret = rsp_message_.sendData(data, len);
-    if(ret < 0) {
-        setState(State::IN_ERROR);
-    } else if(ret >= 0) {
-        if (rsp_message_.isCompleted() && sendBufferEmpty()) {
-            setState(State::COMPLETE);
-            eventLoop()->post([this] { notifyComplete(); }, &loop_token_);
+    if (chunk_end_pending_) {
+        return 0;
+    }
+    if(sendBufferBlocked()) {
+        if (!data && !len && rsp_message_.isChunked()) {
+            // the last chunk is sent in onWrite
+            chunk_end_pending_ = true;
         }
+        return 0;
     }
+    int ret = rsp_message_.sendData(data, len);
+    checkBodySent(ret);
     return ret;
 }
 
 int Http1xResponse::sendData(const KMBuffer &buf)
 {
-    if(!sendBufferEmpty() || getState() != State::SENDING_BODY) {
+    if(getState() != State::SENDING_BODY) {
+        return 0;
+    }
+    if (chunk_end_pending_) {
+        return 0;
+    }
+    if(sendBufferBlocked()) {
+        if (buf.chainLength() == 0 && rsp_message_.isChunked()) {
+            chunk_end_pending_ = true;
+        }
         return 0;
     }
     int ret = rsp_message_.sendData(buf);
+    checkBodySent(ret);
+    return ret;
+}
+
+int Http1xResponse::sendFile(int file_fd, int64_t offset, size_t len)
+{
+    if(getState() != State::SENDING_BODY) {
+        return 0;
+    }
+    int ret = rsp_message_.sendFile(file_fd, offset, len);
+    checkBodySent(ret);
+    return ret;
+}
+
+bool Http1xResponse::canSendFile() const
+{
+#ifdef KUMA_OS_WIN
+    return false;
+#else
+    return true;
+#endif
+}
+
+void Http1xResponse::checkBodySent(int ret)
+{
     if(ret < 0) {
         setState(State::IN_ERROR);
-    } else if(ret >= 0) {
-        if (rsp_message_.isCompleted() && sendBufferEmpty()) {
-            setState(State::COMPLETE);
-            eventLoop()->post([this] { notifyComplete(); }, &loop_token_);
-        }
+    } else if (rsp_message_.isCompleted() && responseSent()) {
+        setState(State::COMPLETE);
+        postResponseComplete();
     }
-    return ret;
 }
 
 void Http1xResponse::reset()
 {
-    // reset TcpConnection
-    TcpConnection::reset();
+    if (getState() != State::COMPLETE) {
+        // reset TcpConnection, the data of completed response is kept in send buffer
+        TcpConnection::reset();
+    }
     
     HttpResponse::Impl::reset();
     req_parser_.reset();
     rsp_message_.reset();
     setState(State::RECVING_REQUEST);
+    complete_pending_ = false;
+    chunk_end_pending_ = false;
+    if (!pending_requests_.empty() && !completing_) {
+        eventLoop()->post([this] { processPendingRequest(); }, &loop_token_);
+    }
 }
 
 KMError Http1xResponse::close()
@@ -182,37 +244,181 @@ KMError Http1xResponse::close()
 }
 
 KMError Http1xResponse::handleInputData(uint8_t *src, size_t len)
+{
+    if (pending_requests_.empty() && !req_parser_.complete()) {
+        DESTROY_DETECTOR_SETUP();
+        int bytes_used = req_parser_.parse((char*)src, len);
+        DESTROY_DETECTOR_CHECK(KMError::DESTROYED);
+        if(getState() == State::IN_ERROR || getState() == State::CLOSED) {
+            return KMError::FAILED;
+        }
+        src += bytes_used;
+        len -= bytes_used;
+    }
+    if (len > 0) {
+        // the requests pipelined behind current one
+        parseAhead(src, len);
+    }
+    return KMError::NOERR;
+}
+
+void Http1xResponse::parseAhead(const uint8_t *src, size_t len)
+{
+    if (pending_data_) {
+        savePendingData(src, len);
+        return;
+    }
+    while (len > 0) {
+        if (pending_requests_.empty() || pending_requests_.back().complete) {
+            if (pipelineFull()) {
+                savePendingData(src, len);
+                pauseRead();
+                return;
+            }
+            addPendingRequest();
+        }
+        auto &req = pending_requests_.back();
+        if (req.error) {
+            // the connection will be closed when this request is delivered
+            return;
+        }
+        int bytes_used = req.parser.parse((const char*)src, len);
+        req.bytes += bytes_used;
+        pending_bytes_ += bytes_used;
+        src += bytes_used;
+        len -= bytes_used;
+    }
+    if (pipelineFull()) {
+        pauseRead();
+    }
+}
+
+void Http1xResponse::addPendingRequest()
+{
+    pending_requests_.emplace_back();
+    auto *req = &pending_requests_.back();
+    req->parser.setDataCallback([req] (KMBuffer &buf) {
+        if (req->body) {
+            req->body->append(buf.clone());
+        } else {
+            req->body.reset(buf.clone());
+        }
+    });
+    req->parser.setEventCallback([req] (HttpEvent ev) {
+        if (ev == HttpEvent::HEADER_COMPLETE) {
+            req->header_complete = true;
+        } else if (ev == HttpEvent::COMPLETE) {
+            req->complete = true;
+        } else if (ev == HttpEvent::HTTP_ERROR) {
+            req->error = true;
+        }
+    });
+}
+
+void Http1xResponse::savePendingData(const uint8_t *src, size_t len)
+{
+    KMBuffer buf(src, len, len);
+    if (pending_data_) {
+        pending_data_->append(buf.clone());
+    } else {
+        pending_data_.reset(buf.clone());
+    }
+}
+
+bool Http1xResponse::pipelineFull() const
+{
+    return pending_requests_.size() >= MAX_PIPELINED_REQUESTS || pending_bytes_ >= MAX_PIPELINED_BYTES;
+}
+
+KMError Http1xResponse::processPendingRequest()
+{
+    if (pending_requests_.empty() || getState() != State::RECVING_REQUEST) {
+        return KMError::NOERR;
+    }
+    auto req = std::move(pending_requests_.front());
+    pending_requests_.pop_front();
+    pending_bytes_ -= req.bytes;
+    req_parser_ = std::move(req.parser);
+    req_parser_.setDataCallback([this] (KMBuffer &buf) { onHttpData(buf); });
+    req_parser_.setEventCallback([this] (HttpEvent ev) { onHttpEvent(ev); });
+    auto ret = deliverRequest(req);
+    if (ret != KMError::NOERR) {
+        return ret;
+    }
+    if (readPaused() && !pipelineFull()) {
+        if (pending_data_) {
+            auto data = std::move(pending_data_);
+            for (auto it = data->begin(); it != data->end(); ++it) {
+                if (it->length() > 0) {
+                    ret = handleInputData(static_cast<uint8_t*>(it->readPtr()), it->length());
+                    if (ret != KMError::NOERR) {
+                        return ret;
+                    }
+                }
+            }
+        }
+        if (!pending_data_ && !pipelineFull()) {
+            resumeRead();
+        }
+    }
+    return KMError::NOERR;
+}
+
+KMError Http1xResponse::deliverRequest(PendingRequest &req)
 {
     DESTROY_DETECTOR_SETUP();
-    int bytes_used = req_parser_.parse((char*)src, len);
-    DESTROY_DETECTOR_CHECK(KMError::DESTROYED);
-    if(getState() == State::IN_ERROR || getState() == State::CLOSED) {
-        return KMError::FAILED;
+    if (req.header_complete) {
+        onHttpEvent(HttpEvent::HEADER_COMPLETE);
+        DESTROY_DETECTOR_CHECK(KMError::DESTROYED);
+    }
+    if (req.body && getState() == State::RECVING_REQUEST) {
+        onHttpData(*req.body);
+        DESTROY_DETECTOR_CHECK(KMError::DESTROYED);
     }
-    if(bytes_used != len) {
-        KUMA_WARNXTRACE("handleInputData, bytes_used="<<bytes_used<<", bytes_read="<<len);
+    if (getState() == State::RECVING_REQUEST) {
+        if (req.error) {
+            onHttpEvent(HttpEvent::HTTP_ERROR);
+        } else if (req.complete) {
+            onHttpEvent(HttpEvent::COMPLETE);
+        }
+        DESTROY_DETECTOR_CHECK(KMError::DESTROYED);
+    }
+    if (getState() == State::IN_ERROR || getState() == State::CLOSED) {
+        return KMError::FAILED;
     }
     return KMError::NOERR;
 }
 
 void Http1xResponse::onWrite()
 {
+    // send buffer may be not empty if it is below low watermark
     if (getState() == State::SENDING_HEADER) {
         if(!rsp_message_.hasBody()) {
-            setState(State::COMPLETE);
-            notifyComplete();
+            if (responseSent()) {
+                setState(State::COMPLETE);
+                complete_pending_ = true;
+                onResponseComplete();
+            }
             return;
         } else {
             setState(State::SENDING_BODY);
         }
     } else if (getState() == State::SENDING_BODY) {
         if(rsp_message_.isCompleted()) {
-            setState(State::COMPLETE);
-            notifyComplete();
+            if (responseSent()) {
+                setState(State::COMPLETE);
+                complete_pending_ = true;
+                onResponseComplete();
+            }
             return ;
         }
+        if (chunk_end_pending_) {
+            chunk_end_pending_ = false;
+            sendData(nullptr, 0);
+            return;
+        }
     }
-    if(write_cb_) write_cb_(KMError::NOERR);
+    notifyWrite();
 }
 
 void Http1xResponse::onError(KMError err)
@@ -227,6 +433,32 @@ void Http1xResponse::onError(KMError err)
     }
 }
 
+void Http1xResponse::postResponseComplete()
+{
+    complete_pending_ = true;
+    eventLoop()->post([this] { onResponseComplete(); }, &loop_token_);
+}
+
+void Http1xResponse::onResponseComplete()
+{
+    // the responses of pipelined requests may complete in this loop without
+    // waiting for the posted notifications
+    while (complete_pending_) {
+        complete_pending_ = false;
+        {
+            DESTROY_DETECTOR_SETUP();
+            completing_ = true;
+            notifyComplete();
+            DESTROY_DETECTOR_CHECK_VOID();
+            completing_ = false;
+        }
+        // the application usually resets for next request in the callback
+        if (processPendingRequest() != KMError::NOERR) {
+            return;
+        }
+    }
+}
+
 void Http1xResponse::onHttpData(KMBuffer &buf)
 {
     if(data_cb_) data_cb_(buf);
@@ -242,7 +474,7 @@ void Http1xResponse::onHttpEvent(HttpEvent ev)
             
         case HttpEvent::COMPLETE:
             setState(State::WAIT_FOR_RESPONSE);
-            if(request_cb_) request_cb_();
+            notifyRequestComplete();
             break;
             
         case HttpEvent::HTTP_ERROR:
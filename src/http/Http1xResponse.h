@@ -33,6 +33,8 @@
 #include "HttpMessage.h"
 #include "EventLoopImpl.h"
 
+#include <deque>
+
 KUMA_NS_BEGIN
 
 class Http1xResponse : public KMObject, public HttpResponse::Impl, public DestroyDetector, public TcpConnection
@@ -45,20 +47,33 @@ public:
     KMError attachFd(SOCKET_FD fd, const KMBuffer *init_buf) override;
     KMError attachSocket(TcpSocket::Impl&& tcp, HttpParser::Impl&& parser, const KMBuffer *init_buf) override;
     void addHeader(std::string name, std::string value) override;
+    KMError addTrailer(std::string name, std::string value) override;
     KMError sendResponse(int status_code, const std::string& desc, const std::string& ver) override;
     int sendData(const void* data, size_t len) override;
     int sendData(const KMBuffer &buf) override;
+    int sendFile(int file_fd, int64_t offset, size_t len) override;
+    bool canSendFile() const override;
     void reset() override; // reset for connection reuse
     KMError close() override;
+    KMError setSendBufferWatermark(size_t high_mark, size_t low_mark) override {
+        return TcpConnection::setSendBufferWatermark(high_mark, low_mark);
+    }
+    size_t getBufferedBytes() const override { return sendBufferBytes(); }
+    KMError setRateLimit(uint32_t rate, uint32_t burst, const std::string &group) override {
+        return TcpConnection::setRateLimit(rate, burst, group);
+    }
+    KMError getRateLimitStats(RateLimitStats &stats) const override {
+        return TcpConnection::getRateLimitStats(stats);
+    }
     
     const std::string& getMethod() const override { return req_parser_.getMethod(); }
     const std::string& getPath() const override { return req_parser_.getUrlPath(); }
     const std::string& getVersion() const override { return req_parser_.getVersion(); }
-    const std::string& getParamValue(std::string name) const override {
-        return req_parser_.getParamValue(std::move(name));
+    const char* getParamValue(const char* name) const override {
+        return req_parser_.getParamValue(name);
     }
-    const std::string& getHeaderValue(std::string name) const override {
-        return req_parser_.getHeaderValue(std::move(name));
+    const char* getHeaderValue(const char* name) const override {
+        return req_parser_.getHeaderValue(name);
     }
     void forEachHeader(HttpParser::Impl::EnumrateCallback&& cb) override {
         return req_parser_.forEachHeader(std::move(cb));
@@ -69,21 +84,56 @@ protected:
     void onWrite() override;
     void onError(KMError err) override;
     
+    void postResponseComplete();
+    void onResponseComplete();
+    void checkBodySent(int ret);
+    
     // callbacks of HttpParser
     void onHttpData(KMBuffer &buf);
     void onHttpEvent(HttpEvent ev);
     
     bool isVersion2() override { return false; }
+    HttpHeader& getResponseHeader() override { return rsp_message_; }
     
 protected:
     void checkHeaders() override;
     void buildResponse(int status_code, const std::string& desc, const std::string& ver);
     void cleanup();
     
+    /* the request pipelined behind current one, it is parsed ahead and delivered
+     * after current response completes
+     */
+    struct PendingRequest
+    {
+        HttpParser::Impl    parser;
+        KMBuffer::Ptr       body;
+        size_t              bytes = 0;
+        bool                header_complete = false;
+        bool                complete = false;
+        bool                error = false;
+    };
+    void parseAhead(const uint8_t *src, size_t len);
+    void addPendingRequest();
+    void savePendingData(const uint8_t *src, size_t len);
+    bool pipelineFull() const;
+    KMError processPendingRequest();
+    KMError deliverRequest(PendingRequest &req);
+    // the response is complete once it is all buffered if next request is waiting
+    bool responseSent() { return sendBufferEmpty() || !pending_requests_.empty(); }
+    
 protected:
     HttpParser::Impl        req_parser_;
     HttpMessage             rsp_message_;
     EventLoopToken          loop_token_;
+    
+    std::deque<PendingRequest> pending_requests_;
+    size_t                  pending_bytes_ = 0;
+    // the data read while the pipeline is full
+    KMBuffer::Ptr           pending_data_;
+    bool                    completing_ = false;
+    bool                    complete_pending_ = false;
+    // the last chunk is sent on write if the send buffer was blocked when the body ended
+    bool                    chunk_end_pending_ = false;
 };
 
 KUMA_NS_END
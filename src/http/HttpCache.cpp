@@ -20,48 +20,352 @@
  */
 
 #include "HttpCache.h"
+#include "HeaderId.h"
 #include "util/kmtrace.h"
+#include "util/util.h"
+
+#include <algorithm>
+#include <stdlib.h>
 
 KUMA_NS_USING
 
-bool HttpCache::getCache(const std::string &key, int &status_code, HeaderVector &headers, KMBuffer &body)
+namespace {
+    const size_t kDefaultMaxBytes = 64*1024*1024;
+    const size_t kDefaultMaxEntries = 10000;
+    // memory of the entry except headers and body
+    const size_t kEntryOverhead = 256;
+    // the stale entry can be handed for revalidation again if no response is stored in this time
+    const seconds kRevalidateTimeout{30};
+    const milliseconds kExpiryInterval{1000};
+    const uint8_t kMaxFrequency = 15;
+}
+
+int HttpCache::Entry::getAge() const
 {
-    std::lock_guard<std::mutex> g(mutex_);
-    auto it = caches_.find(key);
-    if (it == caches_.end()) {
-        return false;
+    return static_cast<int>(duration_cast<seconds>(steady_clock::now() - receive_time_).count());
+}
+
+HttpCache::HttpCache()
+: max_bytes_(kDefaultMaxBytes), max_entries_(kDefaultMaxEntries)
+{
+    for (auto &shard : shards_) {
+        shard.sketch.resize(kDefaultMaxEntries / kShardCount);
+    }
+}
+
+HttpCache::~HttpCache()
+{
+    {
+        std::lock_guard<std::mutex> g(expiry_mutex_);
+        stopped_ = true;
+    }
+    expiry_cv_.notify_one();
+    if (expiry_thread_.joinable()) {
+        expiry_thread_.join();
     }
+}
+
+HttpCache::Shard& HttpCache::getShard(const std::string &key)
+{
+    return shards_[std::hash<std::string>()(key) % kShardCount];
+}
+
+std::string HttpCache::getVariantKey(Shard &shard, const std::string &key, const HeaderVector &req_headers)
+{
+    auto it = shard.varies.find(key);
+    if (it == shard.varies.end() || it->second.names.empty()) {
+        return key;
+    }
+    return getVariantKey(key, it->second.names, req_headers);
+}
+
+std::string HttpCache::getVariantKey(const std::string &key, const std::vector<std::string> &names,
+                                     const HeaderVector &req_headers)
+{
+    std::string vkey = key;
+    for (auto &name : names) {
+        vkey += '\n';
+        vkey += name;
+        vkey += ':';
+        bool first = true;
+        for (auto &kv : req_headers) {
+            if (is_equal(kv.first, name)) {
+                if (!first) {
+                    vkey += ',';
+                }
+                vkey += kv.second;
+                first = false;
+            }
+        }
+    }
+    return vkey;
+}
+
+HttpCache::EntryPtr HttpCache::getCache(const std::string &key, const HeaderVector &req_headers)
+{
+    auto &shard = getShard(key);
+    std::lock_guard<std::mutex> g(shard.mutex);
+    auto vkey = getVariantKey(shard, key, req_headers);
+    shard.sketch.increment(std::hash<std::string>()(vkey));
+    auto it = shard.nodes.find(vkey);
+    if (it == shard.nodes.end()) {
+        ++misses_;
+        return EntryPtr();
+    }
+    auto &node = it->second;
+    auto &entry = node.entry;
     auto now_time = steady_clock::now();
-    if (now_time > it->second.expire_time) {
-        caches_.erase(it);
+    if (now_time > entry->expire_time_) {
+        if (now_time > entry->expire_time_ + entry->stale_while_revalidate_) {
+            ++misses_;
+            return EntryPtr();
+        }
+        if (now_time > node.revalidate_time + kRevalidateTimeout) {
+            // the caller is to revalidate it, others get the stale one meanwhile
+            node.revalidate_time = now_time;
+            ++misses_;
+            return EntryPtr();
+        }
+        ++stale_hits_;
+    } else {
+        ++hits_;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, node.lru_it);
+    return entry;
+}
+
+HttpCache::EntryPtr HttpCache::getStaleCache(const std::string &key, const HeaderVector &req_headers)
+{
+    auto &shard = getShard(key);
+    std::lock_guard<std::mutex> g(shard.mutex);
+    auto vkey = getVariantKey(shard, key, req_headers);
+    auto it = shard.nodes.find(vkey);
+    if (it == shard.nodes.end()) {
+        return EntryPtr();
+    }
+    auto &entry = it->second.entry;
+    if (steady_clock::now() > entry->expire_time_ + entry->stale_if_error_) {
+        return EntryPtr();
+    }
+    ++stale_hits_;
+    return entry;
+}
+
+KMError HttpCache::setCache(const std::string &key, const HeaderVector &req_headers, int status_code,
+                            HeaderVector rsp_headers, const KMBuffer *body)
+{
+    CacheControl cc;
+    parseCacheControl(rsp_headers, cc);
+    if (cc.no_store || (cc.max_age <= 0 && cc.stale_while_revalidate <= 0 && cc.stale_if_error <= 0)) {
+        return KMError::INVALID_PARAM;
+    }
+    std::vector<std::string> vary_names;
+    bool vary_all = false;
+    for (auto &kv : rsp_headers) {
+        if (getHeaderId(kv.first) == HeaderId::VARY) {
+            for_each_token(kv.second, ',', [&] (std::string &name) {
+                if (name == "*") {
+                    vary_all = true;
+                    return false;
+                }
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                vary_names.emplace_back(std::move(name));
+                return true;
+            });
+        }
+    }
+    if (vary_all) {
+        return KMError::INVALID_PARAM;
+    }
+    std::sort(vary_names.begin(), vary_names.end());
+    vary_names.erase(std::unique(vary_names.begin(), vary_names.end()), vary_names.end());
+    // Age is added when it is served
+    rsp_headers.erase(std::remove_if(rsp_headers.begin(), rsp_headers.end(), [] (const KeyValuePair &kv) {
+        return getHeaderId(kv.first) == HeaderId::AGE;
+    }), rsp_headers.end());
+    
+    auto entry = std::make_shared<Entry>();
+    entry->key_ = getVariantKey(key, vary_names, req_headers);
+    entry->primary_key_ = key;
+    entry->hash_ = std::hash<std::string>()(entry->key_);
+    entry->status_code_ = status_code;
+    size_t header_size = 0;
+    for (auto &kv : rsp_headers) {
+        header_size += kv.first.size() + kv.second.size();
+    }
+    entry->headers_ = std::move(rsp_headers);
+    if (body && !body->empty()) {
+        entry->body_.reset(body->clone());
+        entry->body_size_ = body->chainLength();
+    }
+    entry->charge_ = entry->key_.size() + header_size + entry->body_size_ + kEntryOverhead;
+    entry->stale_while_revalidate_ = seconds(cc.stale_while_revalidate);
+    entry->stale_if_error_ = seconds(cc.stale_if_error);
+    entry->receive_time_ = steady_clock::now();
+    entry->expire_time_ = entry->receive_time_ + seconds(std::max(cc.max_age, 0));
+    KUMA_INFOTRACE("HttpCache::setCache, key="<<entry->key_<<", max_age="<<cc.max_age<<", body="<<entry->body_size_);
+    
+    auto &shard = getShard(key);
+    {
+        std::lock_guard<std::mutex> g(shard.mutex);
+        auto it = shard.nodes.find(entry->key_);
+        // the revalidated response replaces the old one
+        const Node *replaced = it != shard.nodes.end() ? &it->second : nullptr;
+        if (!evict(shard, entry->charge_, entry->hash_, replaced)) {
+            ++rejections_;
+            return KMError::FAILED;
+        }
+        if (replaced) {
+            removeNode(shard, it);
+        }
+        auto &vary = shard.varies[key];
+        vary.names = std::move(vary_names);
+        ++vary.count;
+        auto ret = shard.nodes.emplace(entry->key_, Node());
+        auto &node = ret.first->second;
+        shard.lru.push_front(&ret.first->first);
+        node.lru_it = shard.lru.begin();
+        shard.bytes += entry->charge_;
+        node.entry = std::move(entry);
+    }
+    ++stores_;
+    startExpiry();
+    return KMError::NOERR;
+}
+
+bool HttpCache::evict(Shard &shard, size_t charge, size_t hash, const Node *replaced)
+{
+    const size_t max_bytes = max_bytes_ / kShardCount;
+    const size_t max_entries = std::max<size_t>(max_entries_ / kShardCount, 1);
+    if (charge > max_bytes) {
         return false;
     }
-    status_code = it->second.status_code;
-    headers = it->second.headers;
-    body = *(it->second.body.get());
-    auto age = duration_cast<std::chrono::seconds>(now_time - it->second.receive_time).count();
-    headers.emplace_back("Age", std::to_string(age));
+    auto freq = shard.sketch.frequency(hash);
+    auto now_time = steady_clock::now();
+    size_t bytes = shard.bytes;
+    size_t count = shard.nodes.size();
+    if (replaced) {
+        bytes -= replaced->entry->charge_;
+        --count;
+    }
+    std::vector<const std::string*> victims;
+    for (auto rit = shard.lru.rbegin(); rit != shard.lru.rend() && (bytes + charge > max_bytes || count >= max_entries); ++rit) {
+        auto &node = shard.nodes.find(**rit)->second;
+        if (&node == replaced) {
+            continue;
+        }
+        auto &entry = node.entry;
+        auto stale_time = std::max(entry->stale_while_revalidate_, entry->stale_if_error_);
+        bool expired = now_time > entry->expire_time_ + stale_time;
+        // the candidate is rejected if a victim is used more, the ties are admitted
+        // so that the new responses are not blocked under uniform frequencies
+        if (!replaced && !expired && shard.sketch.frequency(entry->hash_) > freq) {
+            return false;
+        }
+        bytes -= entry->charge_;
+        --count;
+        victims.push_back(*rit);
+    }
+    for (auto key : victims) {
+        removeNode(shard, shard.nodes.find(*key));
+        ++evictions_;
+    }
     return true;
 }
-/*
-void HttpCache::setCache(const std::string &key, int status_code, HeaderVector headers, const uint8_t *body, size_t body_size)
+
+void HttpCache::trim(Shard &shard)
 {
-    HttpBody b;
-    if (body && body_size > 0) {
-        b.assign(body, body + body_size);
+    const size_t max_bytes = max_bytes_ / kShardCount;
+    const size_t max_entries = std::max<size_t>(max_entries_ / kShardCount, 1);
+    while (!shard.lru.empty() && (shard.bytes > max_bytes || shard.nodes.size() > max_entries)) {
+        removeNode(shard, shard.nodes.find(*shard.lru.back()));
+        ++evictions_;
     }
-    setCache(key, status_code, std::move(headers), std::move(b));
 }
-*/
-void HttpCache::setCache(const std::string &key, int status_code, HeaderVector headers, KMBuffer &body)
+
+void HttpCache::removeNode(Shard &shard, std::unordered_map<std::string, Node>::iterator it)
 {
-    auto max_age = getMaxAgeOfCache(headers);
-    KUMA_INFOTRACE("HttpCache::setCache, key="<<key<<", max_age="<<max_age<<", body="<<body.chainLength());
-    if (max_age <= 0) {
-        return;
+    auto &entry = it->second.entry;
+    shard.bytes -= entry->charge_;
+    shard.lru.erase(it->second.lru_it);
+    auto vit = shard.varies.find(entry->primary_key_);
+    if (vit != shard.varies.end() && --vit->second.count == 0) {
+        shard.varies.erase(vit);
+    }
+    shard.nodes.erase(it);
+}
+
+void HttpCache::startExpiry()
+{
+    std::call_once(expiry_once_, [this] {
+        expiry_thread_ = std::thread([this] {
+            std::unique_lock<std::mutex> lk(expiry_mutex_);
+            while (!stopped_) {
+                expiry_cv_.wait_for(lk, kExpiryInterval);
+                if (stopped_) {
+                    break;
+                }
+                lk.unlock();
+                expire();
+                lk.lock();
+            }
+        });
+    });
+}
+
+void HttpCache::expire()
+{
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> g(shard.mutex);
+        auto now_time = steady_clock::now();
+        for (auto it = shard.nodes.begin(); it != shard.nodes.end(); ) {
+            auto &entry = it->second.entry;
+            auto stale_time = std::max(entry->stale_while_revalidate_, entry->stale_if_error_);
+            if (now_time > entry->expire_time_ + stale_time) {
+                auto next = std::next(it);
+                removeNode(shard, it);
+                ++expirations_;
+                it = next;
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void HttpCache::setLimits(size_t max_bytes, size_t max_entries)
+{
+    max_bytes_ = max_bytes;
+    max_entries_ = max_entries;
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> g(shard.mutex);
+        shard.sketch.resize(max_entries / kShardCount);
+        trim(shard);
+    }
+}
+
+size_t HttpCache::getMaxBodySize() const
+{
+    auto max_bytes = max_bytes_ / kShardCount;
+    return max_bytes > kEntryOverhead ? max_bytes - kEntryOverhead : 0;
+}
+
+void HttpCache::getStats(HttpCacheStats &stats)
+{
+    stats.hits = hits_;
+    stats.stale_hits = stale_hits_;
+    stats.misses = misses_;
+    stats.stores = stores_;
+    stats.evictions = evictions_;
+    stats.expirations = expirations_;
+    stats.rejections = rejections_;
+    stats.entries = 0;
+    stats.bytes = 0;
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> g(shard.mutex);
+        stats.entries += shard.nodes.size();
+        stats.bytes += shard.bytes;
     }
-    std::lock_guard<std::mutex> g(mutex_);
-    caches_[key] = {status_code, std::move(headers), body, max_age};
 }
 
 HttpCache& HttpCache::instance()
@@ -77,7 +381,8 @@ bool HttpCache::isCacheable(const std::string &method, const HeaderVector &heade
     }
     bool cacheable = true;
     for (auto &kv : headers) {
-        if (is_equal(kv.first, strCacheControl)) {
+        auto id = getHeaderId(kv.first);
+        if (id == HeaderId::CACHE_CONTROL) {
             auto &directives = kv.second;
             for_each_token(directives, ',', [&cacheable] (std::string &d) {
                 if (is_equal(d, "no-store") || is_equal(d, "no-cache")) {
@@ -86,32 +391,113 @@ bool HttpCache::isCacheable(const std::string &method, const HeaderVector &heade
                 }
                 return true;
             });
-        } else if (is_equal(kv.first, strUpgrade)) {
+        } else if (id == HeaderId::UPGRADE) {
             return false;
         }
     }
     return cacheable;
 }
 
+bool HttpCache::isCacheableStatus(int status_code)
+{
+    switch (status_code) {
+        case 200: case 203: case 204: case 300: case 301: case 308:
+        case 404: case 405: case 410: case 414: case 501:
+            return true;
+        default:
+            return false;
+    }
+}
+
 int HttpCache::getMaxAgeOfCache(const HeaderVector &headers)
 {
-    int max_age = 0;
+    CacheControl cc;
+    parseCacheControl(headers, cc);
+    return cc.no_store ? 0 : cc.max_age;
+}
+
+void HttpCache::parseCacheControl(const HeaderVector &headers, CacheControl &cc)
+{
+    auto seconds_of = [] (const std::string &d, size_t n) {
+        return std::max(atoi(d.c_str() + n), 0);
+    };
     for (auto &kv : headers) {
-        if (is_equal(kv.first, strCacheControl)) {
+        if (getHeaderId(kv.first) == HeaderId::CACHE_CONTROL) {
             auto &directives = kv.second;
-            for_each_token(directives, ',', [&max_age] (std::string &d) {
+            for_each_token(directives, ',', [&] (std::string &d) {
                 if (is_equal(d, "no-store") || is_equal(d, "no-cache")) {
-                    return false;
-                }
-                auto p = d.find("max-age=");
-                if (p != std::string::npos) {
-                    auto s = d.substr(p + 8);
-                    max_age = std::stoi(s);
-                    return false;
+                    cc.no_store = true;
+                } else if (is_equal(d, "max-age=", 8)) {
+                    cc.max_age = seconds_of(d, 8);
+                } else if (is_equal(d, "stale-while-revalidate=", 23)) {
+                    cc.stale_while_revalidate = seconds_of(d, 23);
+                } else if (is_equal(d, "stale-if-error=", 15)) {
+                    cc.stale_if_error = seconds_of(d, 15);
                 }
                 return true;
             });
         }
     }
-    return max_age;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FrequencySketch
+void HttpCache::FrequencySketch::resize(size_t size)
+{
+    size_t width = 64;
+    while (width < size) {
+        width <<= 1;
+    }
+    if (width == mask_ + 1) {
+        return;
+    }
+    for (auto &row : counters_) {
+        row.assign(width, 0);
+    }
+    mask_ = width - 1;
+    samples_ = 0;
+    max_samples_ = width * 10;
+}
+
+size_t HttpCache::FrequencySketch::index(size_t hash, int row) const
+{
+    static const uint64_t seeds[4] = {
+        0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL
+    };
+    uint64_t h = (static_cast<uint64_t>(hash) + seeds[row]) * seeds[(row + 1) & 3];
+    return static_cast<size_t>(h ^ (h >> 32)) & mask_;
+}
+
+void HttpCache::FrequencySketch::increment(size_t hash)
+{
+    bool added = false;
+    for (int i = 0; i < 4; ++i) {
+        auto &c = counters_[i][index(hash, i)];
+        if (c < kMaxFrequency) {
+            ++c;
+            added = true;
+        }
+    }
+    if (added && ++samples_ >= max_samples_) {
+        halve();
+    }
+}
+
+uint8_t HttpCache::FrequencySketch::frequency(size_t hash) const
+{
+    uint8_t freq = kMaxFrequency;
+    for (int i = 0; i < 4; ++i) {
+        freq = std::min(freq, counters_[i][index(hash, i)]);
+    }
+    return freq;
+}
+
+void HttpCache::FrequencySketch::halve()
+{
+    for (auto &row : counters_) {
+        for (auto &c : row) {
+            c >>= 1;
+        }
+    }
+    samples_ /= 2;
 }
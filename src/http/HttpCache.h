@@ -22,72 +22,169 @@
 #ifndef __HttpCache_H__
 #define __HttpCache_H__
 
+#include "kmdefs.h"
 #include "httpdefs.h"
 #include "kmbuffer.h"
 
 #include <memory>
-#include <map>
+#include <list>
 #include <vector>
+#include <unordered_map>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 
 using namespace std::chrono;
 
 KUMA_NS_BEGIN
 
+/* HTTP cache shared by all the event loops. it is split into shards by the key hash,
+ * each shard has its own lock, LRU list and frequency sketch. a new response is
+ * admitted unless the LRU entries it evicts are more frequently used (TinyLFU), the
+ * response replacing a cached one is always admitted
+ */
 class HttpCache
 {
 public:
-    bool getCache(const std::string &key, int &status_code, HeaderVector &headers, KMBuffer &body);
-    //void setCache(const std::string &key, int status_code, HeaderVector headers, const uint8_t *body, size_t body_size);
-    void setCache(const std::string &key, int status_code, HeaderVector headers, KMBuffer &body);
+    /* the cached response, it is immutable and shared by all the hits
+     */
+    class Entry
+    {
+    public:
+        int getStatusCode() const { return status_code_; }
+        const HeaderVector& getHeaders() const { return headers_; }
+        const KMBuffer* getBody() const { return body_.get(); }
+        size_t getBodySize() const { return body_size_; }
+        // seconds since the response is stored
+        int getAge() const;
+        
+    protected:
+        friend class HttpCache;
+        std::string                 key_;
+        std::string                 primary_key_;
+        size_t                      hash_ = 0;
+        int                         status_code_ = 0;
+        HeaderVector                headers_;
+        KMBuffer::Ptr               body_;
+        size_t                      body_size_ = 0;
+        size_t                      charge_ = 0;
+        seconds                     stale_while_revalidate_{0};
+        seconds                     stale_if_error_{0};
+        time_point<steady_clock>    receive_time_;
+        time_point<steady_clock>    expire_time_;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+    
+    /* get the fresh response of key, the variant is selected by req_headers if the response
+     * has Vary. in stale-while-revalidate window the stale response is returned, except that
+     * the first caller gets nullptr and is expected to revalidate it
+     */
+    EntryPtr getCache(const std::string &key, const HeaderVector &req_headers);
+    /* get the response allowed by stale-if-error, it is used when the request failed
+     */
+    EntryPtr getStaleCache(const std::string &key, const HeaderVector &req_headers);
+    KMError setCache(const std::string &key, const HeaderVector &req_headers, int status_code,
+                     HeaderVector rsp_headers, const KMBuffer *body);
+    void setLimits(size_t max_bytes, size_t max_entries);
+    // the max body size can be stored
+    size_t getMaxBodySize() const;
+    void getStats(HttpCacheStats &stats);
     
     static HttpCache& instance();
     static bool isCacheable(const std::string &method, const HeaderVector &headers);
+    static bool isCacheableStatus(int status_code);
     static int getMaxAgeOfCache(const HeaderVector &headers);
     
 protected:
-    HttpCache() {}
+    HttpCache();
+    ~HttpCache();
     
-protected:
-    class CacheRecord
+    struct CacheControl
     {
-    public:
-        CacheRecord() = default;
-        CacheRecord(int code, HeaderVector &&h, KMBuffer &b, int max_age)
-            : status_code(code), headers(std::move(h)), body(b.clone()), max_age(max_age)
-        {
-            receive_time = steady_clock::now();
-            expire_time = receive_time + seconds(max_age);
-        }
-        CacheRecord(CacheRecord &&other)
-        {
-            headers = std::move(other.headers);
-            body = std::move(other.body);
-            receive_time = std::move(other.receive_time);
-            expire_time = std::move(other.expire_time);
-        }
-        CacheRecord& operator=(CacheRecord &&other)
-        {
-            if (this != &other) {
-                headers = std::move(other.headers);
-                body = std::move(other.body);
-                receive_time = std::move(other.receive_time);
-                expire_time = std::move(other.expire_time);
-            }
-            return *this;
-        }
-        int status_code = 0;
-        HeaderVector headers;
-        KMBuffer::Ptr body;
         int max_age = 0;
-        time_point<steady_clock> receive_time;
-        time_point<steady_clock> expire_time;
+        int stale_while_revalidate = 0;
+        int stale_if_error = 0;
+        bool no_store = false;
+    };
+    static void parseCacheControl(const HeaderVector &headers, CacheControl &cc);
+    
+    /* count-min sketch of 4 rows, the counters are halved after enough samples so
+     * that the frequency of old keys is decayed
+     */
+    class FrequencySketch
+    {
+    public:
+        void resize(size_t size);
+        void increment(size_t hash);
+        uint8_t frequency(size_t hash) const;
+        
+    protected:
+        size_t index(size_t hash, int row) const;
+        void halve();
+        
+        std::vector<uint8_t>    counters_[4];
+        size_t                  mask_ = 0;
+        size_t                  samples_ = 0;
+        size_t                  max_samples_ = 0;
     };
-    using CacheMap = std::map<std::string, CacheRecord>;
     
-    CacheMap caches_;
-    std::mutex mutex_;
+    struct Node
+    {
+        EntryPtr                                entry;
+        std::list<const std::string*>::iterator lru_it;
+        // the time the stale entry is handed to a caller for revalidation
+        time_point<steady_clock>                revalidate_time;
+    };
+    struct VaryInfo
+    {
+        std::vector<std::string>    names;
+        size_t                      count = 0; // variants cached
+    };
+    struct Shard
+    {
+        std::mutex                                  mutex;
+        std::unordered_map<std::string, Node>       nodes;
+        std::unordered_map<std::string, VaryInfo>   varies;
+        std::list<const std::string*>               lru; // keys, most recently used at front
+        FrequencySketch                             sketch;
+        size_t                                      bytes = 0;
+    };
+    
+    Shard& getShard(const std::string &key);
+    std::string getVariantKey(Shard &shard, const std::string &key, const HeaderVector &req_headers);
+    static std::string getVariantKey(const std::string &key, const std::vector<std::string> &names,
+                                     const HeaderVector &req_headers);
+    /* make room for the candidate of charge, replaced is the node it replaces.
+     * false if it is not admitted, and nothing is evicted
+     */
+    bool evict(Shard &shard, size_t charge, size_t hash, const Node *replaced);
+    void trim(Shard &shard);
+    void removeNode(Shard &shard, std::unordered_map<std::string, Node>::iterator it);
+    void startExpiry();
+    void expire();
+    
+protected:
+    static const size_t kShardCount = 16;
+    Shard                       shards_[kShardCount];
+    std::atomic<size_t>         max_bytes_;
+    std::atomic<size_t>         max_entries_;
+    
+    std::atomic<uint64_t>       hits_{0};
+    std::atomic<uint64_t>       stale_hits_{0};
+    std::atomic<uint64_t>       misses_{0};
+    std::atomic<uint64_t>       stores_{0};
+    std::atomic<uint64_t>       evictions_{0};
+    std::atomic<uint64_t>       expirations_{0};
+    std::atomic<uint64_t>       rejections_{0};
+    
+    // the expired entries are removed by background thread
+    std::once_flag              expiry_once_;
+    std::thread                 expiry_thread_;
+    std::mutex                  expiry_mutex_;
+    std::condition_variable     expiry_cv_;
+    bool                        stopped_ = false;
 };
 
 KUMA_NS_END
@@ -0,0 +1,79 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "HttpDate.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <chrono>
+
+using namespace kuma;
+
+HttpDate::HttpDate(const TimerManagerPtr &mgr)
+: timer_(mgr)
+{
+    
+}
+
+const std::string& HttpDate::get()
+{
+    if (!valid_) {
+        auto now = std::chrono::system_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        date_ = format(static_cast<time_t>(ms / 1000));
+        valid_ = true;
+        // expire at the start of next second
+        timer_.schedule(static_cast<uint32_t>(1000 - ms % 1000), TimerMode::ONE_SHOT, [this] {
+            valid_ = false;
+        });
+    }
+    return date_;
+}
+
+HttpDate* HttpDate::ofLoop(EventLoop::Impl *loop)
+{
+    static const size_t slot = EventLoop::Impl::allocLocalSlot();
+    auto date = static_cast<HttpDate*>(loop->getLocal(slot));
+    if (!date) {
+        date = new HttpDate(loop->getTimerMgr());
+        loop->setLocal(slot, std::unique_ptr<LoopLocal>(date));
+    }
+    return date;
+}
+
+std::string HttpDate::format(time_t t)
+{
+    static const char* kWeekDays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char* kMonths[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+    struct tm tm_gmt;
+#ifdef KUMA_OS_WIN
+    gmtime_s(&tm_gmt, &t);
+#else
+    gmtime_r(&t, &tm_gmt);
+#endif
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+             kWeekDays[tm_gmt.tm_wday], tm_gmt.tm_mday, kMonths[tm_gmt.tm_mon],
+             tm_gmt.tm_year + 1900, tm_gmt.tm_hour, tm_gmt.tm_min, tm_gmt.tm_sec);
+    return buf;
+}
@@ -0,0 +1,55 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __HttpDate_H__
+#define __HttpDate_H__
+
+#include "kmdefs.h"
+#include "EventLoopImpl.h"
+
+#include <string>
+
+KUMA_NS_BEGIN
+
+/* the value of Date header, e.g. "Sun, 06 Nov 1994 08:49:37 GMT". it is formatted
+ * once per second for the loop, the timer is only scheduled while the value is
+ * being used, so the idle loop is not woken up
+ */
+class HttpDate : public LoopLocal
+{
+public:
+    HttpDate(const TimerManagerPtr &mgr);
+    
+    const std::string& get();
+    
+    // the instance of loop, created on first use, should only be accessed in loop thread
+    static HttpDate* ofLoop(EventLoop::Impl *loop);
+    static std::string format(time_t t);
+    
+private:
+    Timer::Impl     timer_;
+    std::string     date_;
+    bool            valid_ = false;
+};
+
+KUMA_NS_END
+
+#endif
@@ -20,23 +20,196 @@
  */
 
 #include "HttpHeader.h"
-#include <sstream>
+#include "HttpTokenizer.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
 
 using namespace kuma;
 
+namespace {
+// the serialized header of most messages fits in one block, the blocks are
+// recycled in a free list of each thread
+const size_t kHeaderBlockSize = 2048;
+const size_t kMaxFreeHeaderBlocks = 64;
+
+struct HeaderBlockList
+{
+    ~HeaderBlockList()
+    {
+        for (auto block : blocks) {
+            delete [] block;
+        }
+    }
+    std::vector<char*> blocks;
+};
+thread_local HeaderBlockList free_header_blocks;
+
+struct HeaderAllocator
+{
+    using value_type = char;
+    
+    char* allocate(size_t n)
+    {
+        if (n > kHeaderBlockSize) {
+            return new char[n];
+        }
+        auto &blocks = free_header_blocks.blocks;
+        if (!blocks.empty()) {
+            auto block = blocks.back();
+            blocks.pop_back();
+            return block;
+        }
+        return new char[kHeaderBlockSize];
+    }
+    
+    void deallocate(char *p, size_t n)
+    {
+        auto &blocks = free_header_blocks.blocks;
+        if (n <= kHeaderBlockSize && blocks.size() < kMaxFreeHeaderBlocks) {
+            blocks.push_back(p);
+        } else {
+            delete [] p;
+        }
+    }
+};
+
+const char* getReasonPhrase(int status_code)
+{
+    switch (status_code) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 203: return "Non-Authoritative Information";
+        case 204: return "No Content";
+        case 205: return "Reset Content";
+        case 206: return "Partial Content";
+        case 300: return "Multiple Choices";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 406: return "Not Acceptable";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 410: return "Gone";
+        case 411: return "Length Required";
+        case 412: return "Precondition Failed";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 415: return "Unsupported Media Type";
+        case 416: return "Range Not Satisfiable";
+        case 417: return "Expectation Failed";
+        case 426: return "Upgrade Required";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        case 505: return "HTTP Version Not Supported";
+        default: return nullptr;
+    }
+}
+
+// "HTTP/1.1 200 OK\r\n", nullptr if status_code is not common
+const std::string* getStatusLine(int status_code)
+{
+    static const std::vector<std::string> status_lines = [] {
+        std::vector<std::string> lines(500);
+        for (int code = 100; code < 600; ++code) {
+            auto reason = getReasonPhrase(code);
+            if (reason) {
+                lines[code - 100] = VersionHTTP1_1 + " " + std::to_string(code) + " " + reason + "\r\n";
+            }
+        }
+        return lines;
+    }();
+    if (status_code < 100 || status_code >= 600 || status_lines[status_code - 100].empty()) {
+        return nullptr;
+    }
+    return &status_lines[status_code - 100];
+}
+
+inline char* writeString(char *ptr, const char *str, size_t len)
+{
+    memcpy(ptr, str, len);
+    return ptr + len;
+}
+
+inline char* writeString(char *ptr, const std::string &str)
+{
+    return writeString(ptr, str.c_str(), str.size());
+}
+
+KMBuffer allocHeaderBuffer(size_t size)
+{
+    HeaderAllocator a;
+    return KMBuffer(size, a);
+}
+} // namespace
+
 void HttpHeader::addHeader(std::string name, std::string value)
 {
     if(!name.empty()) {
-        if (is_equal(name, strContentLength)) {
-            has_content_length_ = true;
-            content_length_ = std::stol(value);
-        } else if (is_equal(name, strTransferEncoding)) {
+        auto id = getHeaderId(name);
+        if (id == HeaderId::CONTENT_LENGTH) {
+            has_content_length_ = parseContentLength(value.c_str(), value.size(), content_length_);
+            if (!has_content_length_) {
+                content_length_ = 0;
+            }
+        } else if (id == HeaderId::TRANSFER_ENCODING) {
             is_chunked_ = is_equal(strChunked, value);
         }
+        slots_.set(id, header_vec_.size());
         header_vec_.emplace_back(std::move(name), std::move(value));
     }
 }
 
+bool HttpHeader::parseContentLength(const char *value, size_t len, size_t &content_length)
+{
+    if (len == 0) {
+        return false;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (value[i] < '0' || value[i] > '9') {
+            return false;
+        }
+        size_t d = value[i] - '0';
+        if (n > (SIZE_MAX - d) / 10) {
+            return false;
+        }
+        n = n * 10 + d;
+    }
+    content_length = n;
+    return true;
+}
+
+bool HttpHeader::isValidField(const std::string &name, const std::string &value)
+{
+    if (name.empty()) {
+        return false;
+    }
+    auto name_end = name.c_str() + name.size();
+    if (findNonTokenChar(name.c_str(), name_end) != name_end) {
+        return false;
+    }
+    return value.find_first_of(std::string("\r\n\0", 3)) == std::string::npos;
+}
+
 void HttpHeader::addHeader(std::string name, uint32_t value)
 {
     addHeader(std::move(name), std::to_string(value));
@@ -44,6 +217,10 @@ void HttpHeader::addHeader(std::string name, uint32_t value)
 
 bool HttpHeader::hasHeader(const std::string &name) const
 {
+    auto id = getHeaderId(name);
+    if (id != HeaderId::UNKNOWN) {
+        return hasHeader(id);
+    }
     for (auto const &kv : header_vec_) {
         if (is_equal(kv.first, name)) {
             return true;
@@ -54,6 +231,10 @@ bool HttpHeader::hasHeader(const std::string &name) const
 
 const std::string& HttpHeader::getHeader(const std::string &name) const
 {
+    auto id = getHeaderId(name);
+    if (id != HeaderId::UNKNOWN) {
+        return getHeader(id);
+    }
     for (auto const &kv : header_vec_) {
         if (is_equal(kv.first, name)) {
             return kv.second;
@@ -62,6 +243,29 @@ const std::string& HttpHeader::getHeader(const std::string &name) const
     return EmptyString;
 }
 
+const std::string& HttpHeader::getHeader(HeaderId id) const
+{
+    auto index = slots_.get(id);
+    return index >= 0 ? header_vec_[index].second : EmptyString;
+}
+
+void HttpHeader::removeHeader(HeaderId id)
+{
+    if (!hasHeader(id)) {
+        return;
+    }
+    header_vec_.erase(std::remove_if(header_vec_.begin(), header_vec_.end(), [id] (const KeyValuePair &kv) {
+        return getHeaderId(kv.first) == id;
+    }), header_vec_.end());
+    slots_.build(header_vec_);
+    if (id == HeaderId::CONTENT_LENGTH) {
+        has_content_length_ = false;
+        content_length_ = 0;
+    } else if (id == HeaderId::TRANSFER_ENCODING) {
+        is_chunked_ = false;
+    }
+}
+
 void HttpHeader::processHeader()
 {
     has_body_ = is_chunked_ || (has_content_length_ && content_length_ > 0);
@@ -74,36 +278,100 @@ void HttpHeader::processHeader(int status_code)
                                204 == status_code || 304 == status_code);
 }
 
-std::string HttpHeader::buildHeader(const std::string &method, const std::string &url, const std::string &ver)
+size_t HttpHeader::headerFieldsSize() const
 {
-    processHeader();
-    std::string req = method + " " + url + " " + (!ver.empty()?ver:VersionHTTP1_1);
-    req += "\r\n";
-    for (auto &kv : header_vec_) {
-        req += kv.first + ": " + kv.second + "\r\n";
+    size_t size = 2; // the blank line
+    for (auto const &kv : header_vec_) {
+        size += kv.first.size() + kv.second.size() + 4;
     }
-    req += "\r\n";
-    return req;
+    return size;
 }
 
-std::string HttpHeader::buildHeader(int status_code, const std::string &desc, const std::string &ver)
+char* HttpHeader::writeHeaderFields(char *ptr) const
+{
+    for (auto const &kv : header_vec_) {
+        ptr = writeString(ptr, kv.first);
+        ptr = writeString(ptr, ": ", 2);
+        ptr = writeString(ptr, kv.second);
+        ptr = writeString(ptr, "\r\n", 2);
+    }
+    return writeString(ptr, "\r\n", 2);
+}
+
+KMBuffer HttpHeader::buildHeader(const std::string &method, const std::string &url, const std::string &ver)
+{
+    processHeader();
+    auto const &version = !ver.empty()?ver:VersionHTTP1_1;
+    size_t size = method.size() + url.size() + version.size() + 4 + headerFieldsSize();
+    auto buf = allocHeaderBuffer(size);
+    auto ptr = static_cast<char*>(buf.writePtr());
+    ptr = writeString(ptr, method);
+    *ptr++ = ' ';
+    ptr = writeString(ptr, url);
+    *ptr++ = ' ';
+    ptr = writeString(ptr, version);
+    ptr = writeString(ptr, "\r\n", 2);
+    writeHeaderFields(ptr);
+    buf.bytesWritten(size);
+    return buf;
+}
+
+KMBuffer HttpHeader::buildHeader(int status_code, const std::string &desc, const std::string &ver, const std::string &date)
 {
     processHeader(status_code);
-    std::string rsp = (!ver.empty()?ver:VersionHTTP1_1) + " " + std::to_string(status_code);
-    if (!desc.empty()) {
-        rsp += " " + desc;
+    auto const &version = !ver.empty()?ver:VersionHTTP1_1;
+    const std::string *status_line = nullptr;
+    if (version == VersionHTTP1_1) {
+        // "HTTP/1.1 200 " is 13 bytes, the reason phrase is followed by CRLF
+        status_line = getStatusLine(status_code);
+        if (status_line && !desc.empty() && status_line->compare(13, status_line->size() - 15, desc) != 0) {
+            status_line = nullptr;
+        }
+    }
+    char code_buf[16];
+    size_t code_len = 0;
+    size_t size = headerFieldsSize();
+    if (status_line) {
+        size += status_line->size();
+    } else {
+        code_len = snprintf(code_buf, sizeof(code_buf), "%d", status_code);
+        size += version.size() + 1 + code_len + 2;
+        if (!desc.empty()) {
+            size += desc.size() + 1;
+        }
+    }
+    bool add_date = !date.empty() && !hasHeader(HeaderId::DATE);
+    if (add_date) {
+        size += date.size() + 8; // "Date: " and CRLF
+    }
+    auto buf = allocHeaderBuffer(size);
+    auto ptr = static_cast<char*>(buf.writePtr());
+    if (status_line) {
+        ptr = writeString(ptr, *status_line);
+    } else {
+        ptr = writeString(ptr, version);
+        *ptr++ = ' ';
+        ptr = writeString(ptr, code_buf, code_len);
+        if (!desc.empty()) {
+            *ptr++ = ' ';
+            ptr = writeString(ptr, desc);
+        }
+        ptr = writeString(ptr, "\r\n", 2);
     }
-    rsp += "\r\n";
-    for (auto &kv : header_vec_) {
-        rsp += kv.first + ": " + kv.second + "\r\n";
+    if (add_date) {
+        ptr = writeString(ptr, "Date: ", 6);
+        ptr = writeString(ptr, date);
+        ptr = writeString(ptr, "\r\n", 2);
     }
-    rsp += "\r\n";
-    return rsp;
+    writeHeaderFields(ptr);
+    buf.bytesWritten(size);
+    return buf;
 }
 
 void HttpHeader::reset()
 {
     header_vec_.clear();
+    slots_.clear();
     has_content_length_ = false;
     content_length_ = 0;
     is_chunked_ = false;
@@ -25,6 +25,7 @@
 #include "kmdefs.h"
 #include "kmapi.h"
 #include "httpdefs.h"
+#include "HeaderId.h"
 
 KUMA_NS_BEGIN
 
@@ -35,19 +36,39 @@ public:
     void addHeader(std::string name, std::string value);
     void addHeader(std::string name, uint32_t value);
     bool hasHeader(const std::string &name) const;
+    bool hasHeader(HeaderId id) const { return slots_.get(id) >= 0; }
     const std::string& getHeader(const std::string &name) const;
-    std::string buildHeader(const std::string &method, const std::string &url, const std::string &ver);
-    std::string buildHeader(int status_code, const std::string &desc, const std::string &ver);
+    const std::string& getHeader(HeaderId id) const;
+    void removeHeader(HeaderId id);
+    /* the header is serialized into a buffer of exact size. the status line of
+     * common status codes is cached, and Date header is added if date is not
+     * empty and the header has no Date
+     */
+    KMBuffer buildHeader(const std::string &method, const std::string &url, const std::string &ver);
+    KMBuffer buildHeader(int status_code, const std::string &desc, const std::string &ver, const std::string &date = EmptyString);
     bool hasBody() const { return has_body_; }
+    bool isChunked() const { return is_chunked_; }
     virtual void reset();
-    HeaderVector& getHeaders() { return header_vec_; }
+    const HeaderVector& getHeaders() const { return header_vec_; }
+    
+    /* Content-Length must be 1*DIGIT and fit in size_t, false if it is empty,
+     * has other chars or overflows
+     */
+    static bool parseContentLength(const char *value, size_t len, size_t &content_length);
+    /* the name must be 1*tchar and the value has no CR, LF or NUL, so that the field
+     * cannot inject other fields into the message
+     */
+    static bool isValidField(const std::string &name, const std::string &value);
     
 protected:
     void processHeader();
     void processHeader(int status_code);
+    size_t headerFieldsSize() const;
+    char* writeHeaderFields(char *ptr) const;
     
 protected:
     HeaderVector            header_vec_;
+    HeaderSlots             slots_;
     bool                    is_chunked_ = false;
     bool                    has_content_length_ = false;
     bool                    has_body_ = false;
@@ -20,7 +20,6 @@
  */
 
 #include "HttpMessage.h"
-#include <sstream>
 
 using namespace kuma;
 
@@ -61,25 +60,85 @@ int HttpMessage::sendData(const KMBuffer &buf)
     return ret;
 }
 
-int HttpMessage::sendChunk(const void* data, size_t len)
+int HttpMessage::sendFile(int file_fd, int64_t offset, size_t len)
 {
-    if(nullptr == data && 0 == len) { // chunk end
-        static const std::string _chunk_end_token_ = "0\r\n\r\n";
-        int ret = sender_(_chunk_end_token_.c_str(), _chunk_end_token_.length());
-        if(ret > 0) {
+    if(is_chunked_ || !fsender_) {
+        return -1;
+    }
+    if(0 == len) {
+        return 0;
+    }
+    int ret = fsender_(file_fd, offset, len);
+    if(ret > 0) {
+        body_bytes_sent_ += ret;
+        if (body_bytes_sent_ >= content_length_) {
             completed_ = true;
-            return 0;
         }
-        return ret;
+    }
+    return ret;
+}
+
+// the size line of chunk, buf should be at least 18 bytes
+static size_t writeChunkSize(char *buf, size_t size)
+{
+    static const char* hex = "0123456789abcdef";
+    char tmp[16];
+    size_t n = 0;
+    do {
+        tmp[n++] = hex[size & 0xF];
+        size >>= 4;
+    } while (size);
+    for (size_t i = 0; i < n; ++i) {
+        buf[i] = tmp[n - i - 1];
+    }
+    buf[n++] = '\r';
+    buf[n++] = '\n';
+    return n;
+}
+
+bool HttpMessage::addTrailer(std::string name, std::string value)
+{
+    if (!isValidField(name, value)) {
+        return false;
+    }
+    trailer_vec_.emplace_back(std::move(name), std::move(value));
+    return true;
+}
+
+int HttpMessage::sendChunkEnd()
+{
+    static const std::string _chunk_end_token_ = "0\r\n\r\n";
+    if (completed_) {
+        return 0;
+    }
+    int ret = 0;
+    if (trailer_vec_.empty()) {
+        ret = sender_(_chunk_end_token_.c_str(), _chunk_end_token_.length());
     } else {
-        std::stringstream ss;
-        ss << std::hex << len;
-        std::string str;
-        ss >> str;
+        // the last chunk carries the trailer fields
+        std::string str = "0\r\n";
+        for (auto const &kv : trailer_vec_) {
+            str += kv.first + ": " + kv.second + "\r\n";
+        }
         str += "\r\n";
+        ret = sender_(str.c_str(), str.size());
+    }
+    if(ret > 0) {
+        completed_ = true;
+        return 0;
+    }
+    return ret;
+}
+
+int HttpMessage::sendChunk(const void* data, size_t len)
+{
+    if(nullptr == data && 0 == len) { // chunk end
+        return sendChunkEnd();
+    } else {
+        char size_line[20];
         iovec iovs[3];
-        iovs[0].iov_base = (char*)str.c_str();
-        iovs[0].iov_len = static_cast<decltype(iovs[0].iov_len)>(str.length());
+        iovs[0].iov_base = size_line;
+        iovs[0].iov_len = static_cast<decltype(iovs[0].iov_len)>(writeChunkSize(size_line, len));
         iovs[1].iov_base = (char*)data;
         iovs[1].iov_len = static_cast<decltype(iovs[1].iov_len)>(len);
         iovs[2].iov_base = (char*)"\r\n";
@@ -97,22 +156,13 @@ int HttpMessage::sendChunk(const KMBuffer &buf)
 {
     auto chain_len = buf.chainLength();
     if(chain_len == 0) { // chunk end
-        static const std::string _chunk_end_token_ = "0\r\n\r\n";
-        int ret = sender_(_chunk_end_token_.c_str(), _chunk_end_token_.length());
-        if(ret > 0) {
-            completed_ = true;
-            return 0;
-        }
-        return ret;
+        return sendChunkEnd();
     } else {
-        std::stringstream ss;
-        ss << std::hex << chain_len;
-        std::string str;
-        ss >> str;
-        str += "\r\n";
-        KMBuffer hdr(str.c_str(), str.size(), str.size());
-        
-        // temporary link to hdr
+        // the framing is linked around buf temporarily, the payload is shared
+        // by send buffer instead of copied if buf is refcounted
+        char size_line[20];
+        auto size_len = writeChunkSize(size_line, chain_len);
+        KMBuffer hdr(size_line, size_len, size_len);
         hdr.append(const_cast<KMBuffer*>(&buf));
         
         KMBuffer tail("\r\n", 2, 2);
@@ -132,6 +182,7 @@ int HttpMessage::sendChunk(const KMBuffer &buf)
 void HttpMessage::reset()
 {
     HttpHeader::reset();
+    trailer_vec_.clear();
     body_bytes_sent_ = 0;
     completed_ = false;
 }
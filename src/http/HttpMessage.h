@@ -35,27 +35,40 @@ public:
     using MessageSender = std::function<int(const void*, size_t)>;
     using MessageVSender = std::function<int(const iovec*, int)>;
     using MessageBSender = std::function<int(const KMBuffer&)>;
+    using MessageFSender = std::function<int(int, int64_t, size_t)>;
     
     int sendData(const void* data, size_t len);
     int sendData(const KMBuffer &buf);
+    // the file data is not framed, so it cannot be sent in chunked message
+    int sendFile(int file_fd, int64_t offset, size_t len);
+    /* the trailer fields are sent with the last chunk, they are dropped if not chunked.
+     * false if the field is invalid
+     */
+    bool addTrailer(std::string name, std::string value);
+    // the response to HEAD request has no body even if it has Content-Length
+    void setNoBody() { has_body_ = false; }
     bool isCompleted() const { return !hasBody() || completed_; }
     void reset() override;
     
     void setSender(MessageSender sender) { sender_ = std::move(sender); }
     void setVSender(MessageVSender sender) { vsender_ = std::move(sender); }
     void setBSender(MessageBSender sender) { bsender_ = std::move(sender); }
+    void setFSender(MessageFSender sender) { fsender_ = std::move(sender); }
     
 protected:
     int sendChunk(const void* data, size_t len);
     int sendChunk(const KMBuffer &buf);
+    int sendChunkEnd();
     
 protected:
+    HeaderVector            trailer_vec_;
     bool                    completed_ = false;
     size_t                  body_bytes_sent_ = 0;
     
     MessageSender           sender_;
     MessageVSender          vsender_;
     MessageBSender          bsender_;
+    MessageFSender          fsender_;
 };
 
 KUMA_NS_END
@@ -23,6 +23,7 @@
 #include "util/kmtrace.h"
 #include "util/util.h"
 #include "Uri.h"
+#include "HttpTokenizer.h"
 
 #include <algorithm>
 
@@ -33,6 +34,7 @@ namespace {
 #define CR  '\r'
 #define LF  '\n'
 #define MAX_HTTP_HEADER_SIZE	2*1024*1024 // 2 MB
+#define MAX_IDLE_HEADER_BUFFER  16*1024
 
 }
 
@@ -69,8 +71,11 @@ HttpParser::Impl& HttpParser::Impl::operator=(const Impl& other)
         method_ = other.method_;
         url_ = other.url_;
         url_path_ = other.url_path_;
-        param_map_ = other.param_map_;
-        header_vec_ = other.header_vec_;
+        version_ = other.version_;
+        hdr_buf_ = other.hdr_buf_;
+        header_fields_ = other.header_fields_;
+        header_slots_ = other.header_slots_;
+        param_fields_ = other.param_fields_;
         status_code_ = other.status_code_;
     }
     return *this;
@@ -98,8 +103,11 @@ HttpParser::Impl& HttpParser::Impl::operator=(Impl&& other)
         method_.swap(other.method_);
         url_.swap(other.url_);
         url_path_.swap(other.url_path_);
-        param_map_.swap(other.param_map_);
-        header_vec_.swap(other.header_vec_);
+        version_.swap(other.version_);
+        hdr_buf_.swap(other.hdr_buf_);
+        header_fields_.swap(other.header_fields_);
+        header_slots_ = other.header_slots_;
+        param_fields_.swap(other.param_fields_);
         status_code_ = other.status_code_;
     }
     return *this;
@@ -107,8 +115,6 @@ HttpParser::Impl& HttpParser::Impl::operator=(Impl&& other)
 
 HttpParser::Impl::~Impl()
 {
-    param_map_.clear();
-    header_vec_.clear();
 }
 
 void HttpParser::Impl::reset()
@@ -133,7 +139,15 @@ void HttpParser::Impl::reset()
     version_ = "";
     url_path_ = "";
     
-    param_map_.clear();
+    if(hdr_buf_.capacity() > MAX_IDLE_HEADER_BUFFER) {
+        // release the buffer grown by a large message
+        std::string().swap(hdr_buf_);
+    } else {
+        hdr_buf_.clear();
+    }
+    header_fields_.clear();
+    header_slots_.clear();
+    param_fields_.clear();
 }
 
 bool HttpParser::Impl::complete() const
@@ -148,15 +162,15 @@ bool HttpParser::Impl::error() const
 
 bool HttpParser::Impl::isUpgradeTo(const std::string& proto) const
 {
-    if (!is_equal(getHeaderValue("Upgrade"), proto) ||
-        !contains_token(getHeaderValue("Connection"), "Upgrade", ',')) {
+    if (!is_equal(getHeaderValue(HeaderId::UPGRADE), proto) ||
+        !contains_token(getHeaderValue(HeaderId::CONNECTION), "Upgrade", ',')) {
         return false;
     }
     if (!isRequest() && 101 != getStatusCode()) {
         return false;
     }
     if (isRequest() && is_equal(proto, "h2c") &&
-        !contains_token(getHeaderValue("Connection"), "HTTP2-Settings", ',')) {
+        !contains_token(getHeaderValue(HeaderId::CONNECTION), "HTTP2-Settings", ',')) {
         return false;
     }
     return true;
@@ -313,7 +327,10 @@ HttpParser::Impl::ParseState HttpParser::Impl::parseHttp(const char*& cur_pos, c
                 }
                 break;
             }
-            parseHeaderLine(line, line_end);
+            if(!parseHeaderLine(line, line_end) || hdr_buf_.size() > MAX_HTTP_HEADER_SIZE) {
+                read_state_ = HTTP_READ_ERROR;
+                return PARSE_STATE_ERROR;
+            }
         }
         if(HTTP_READ_HEAD == read_state_)
         {// need more data
@@ -367,18 +384,16 @@ bool HttpParser::Impl::parseStartLine(const char* line, const char* line_end)
         p_line = str_buf_.c_str();
         p_end = p_line + str_buf_.length();
     }
-    std::string str;
-    const char* p = std::find(p_line, p_end, ' ');
-    if(p != p_end) {
-        str.assign(p_line, p);
-        p_line = p + 1;
-    } else {
-        return false;
-    }
-    is_request_ = !is_equal(str, "HTTP", 4);
+    is_request_ = !(p_end - p_line >= 4 && is_equal(p_line, "HTTP", 4));
     if(is_request_) {// request
-        method_.swap(str);
-        p = std::find(p_line, p_end, ' ');
+        // method is a token
+        const char* p = findNonTokenChar(p_line, p_end);
+        if(p == p_line || p == p_end || *p != ' ') {
+            return false;
+        }
+        method_.assign(p_line, p);
+        p_line = p + 1;
+        p = findChar(p_line, p_end, ' ');
         if(p != p_end) {
             url_.assign(p_line, p);
             p_line = p + 1;
@@ -389,10 +404,23 @@ bool HttpParser::Impl::parseStartLine(const char* line, const char* line_end)
         decodeUrl();
         parseUrl();
     } else {// response
-        version_.swap(str);
-        p = std::find(p_line, p_end, ' ');
-        str.assign(p_line, p);
-        status_code_ = std::stoi(str);
+        const char* p = findChar(p_line, p_end, ' ');
+        if(p == p_end) {
+            return false;
+        }
+        version_.assign(p_line, p);
+        p_line = p + 1;
+        int status_code = 0;
+        for (p = p_line; p < p_end && *p >= '0' && *p <= '9'; ++p) {
+            status_code = status_code * 10 + (*p - '0');
+            if (status_code > 999) {
+                return false;
+            }
+        }
+        if(p == p_line) {
+            return false;
+        }
+        status_code_ = status_code;
     }
     clearBuffer();
     return true;
@@ -408,19 +436,26 @@ bool HttpParser::Impl::parseHeaderLine(const char* line, const char* line_end)
         p_end = p_line + str_buf_.length();
     }
     
-    std::string str_name;
-    std::string str_value;
-    const char* p = std::find(p_line, p_end, ':');
-    if(p == p_end) {
+    // field-name is a token followed by ':' immediately, the whitespace before
+    // ':' and obs-fold line are rejected as RFC 7230 3.2.4
+    const char* p = findNonTokenChar(p_line, p_end);
+    if(p == p_line || p == p_end || *p != ':') {
         clearBuffer();
         return false;
     }
-    str_name.assign(p_line, p);
+    const char* name = p_line;
+    size_t name_len = p - p_line;
     p_line = p + 1;
-    str_value.assign(p_line, p_end);
+    // skip OWS around field-value
+    while(p_line < p_end && (*p_line == ' ' || *p_line == '\t')) {
+        ++p_line;
+    }
+    while(p_end > p_line && (*(p_end - 1) == ' ' || *(p_end - 1) == '\t')) {
+        --p_end;
+    }
+    bool ret = addHeaderField(name, name_len, p_line, p_end - p_line);
     clearBuffer();
-    addHeaderValue(std::move(str_name), std::move(str_value));
-    return true;
+    return ret;
 }
 
 HttpParser::Impl::ParseState HttpParser::Impl::parseChunk(const char*& cur_pos, const char* end)
@@ -451,7 +486,6 @@ HttpParser::Impl::ParseState HttpParser::Impl::parseChunk(const char*& cur_pos,
                 str.append(p_line, p_end);
                 // need not parse chunk extension
                 chunk_size_ = strtol(str.c_str(), NULL, 16);
-                KUMA_INFOTRACE("HttpParser::parseChunk, chunk_size="<<chunk_size_);
                 if(0 == chunk_size_)
                 {// chunk completed
                     chunk_state_ = CHUNK_READ_TRAILER;
@@ -541,14 +575,9 @@ void HttpParser::Impl::onHeaderComplete()
         HttpHeader::processHeader(status_code_);
     }
     header_complete_ = true;
-    if(has_content_length_) {
-        KUMA_INFOTRACE("HttpParser::onHeaderComplete, Content-Length="<<content_length_);
-    }
-    if(is_chunked_) {
-        KUMA_INFOTRACE("HttpParser::onHeaderComplete, Transfer-Encoding=chunked");
-    }
-    auto upgrade_to = HttpHeader::getHeader(strUpgrade);
-    if(!upgrade_to.empty()) {
+    // no trace for each message, it costs more than parsing
+    auto upgrade_to = getHeaderValue(HeaderId::UPGRADE);
+    if(*upgrade_to) {
         upgrade_ = true;
         KUMA_INFOTRACE("HttpParser::onHeaderComplete, Upgrade="<<upgrade_to);
     }
@@ -557,7 +586,6 @@ void HttpParser::Impl::onHeaderComplete()
 
 void HttpParser::Impl::onComplete()
 {
-    KUMA_INFOTRACE("HttpParser::onComplete");
     if(event_cb_) event_cb_(HttpEvent::COMPLETE);
 }
 
@@ -616,27 +644,78 @@ bool HttpParser::Impl::parseUrl()
         if(pos1 == std::string::npos){
             break;
         }
-        std::string name(query.begin()+pos, query.begin()+pos1);
+        const char* name = query.c_str() + pos;
+        size_t name_len = pos1 - pos;
         pos = pos1 + 1;
         pos1 = query.find('&', pos);
         if(pos1 == std::string::npos){
-            std::string value(query.begin()+pos, query.end());
-            addParamValue(std::move(name), std::move(value));
+            addField(param_fields_, name, name_len, query.c_str() + pos, query.size() - pos);
             break;
         }
-        std::string value(query.begin()+pos, query.begin()+pos1);
+        addField(param_fields_, name, name_len, query.c_str() + pos, pos1 - pos);
         pos = pos1 + 1;
-        addParamValue(std::move(name), std::move(value));
     }
     
     return true;
 }
 
-void HttpParser::Impl::addParamValue(std::string name, std::string value)
+void HttpParser::Impl::addField(FieldVector& fields, const char* name, size_t name_len, const char* value, size_t value_len)
 {
-    if(!name.empty()) {
-        param_map_[std::move(name)] = std::move(value);
+    if(name_len == 0) {
+        return;
     }
+    HeaderField field;
+    field.name_offset = static_cast<uint32_t>(hdr_buf_.size());
+    field.name_len = static_cast<uint32_t>(name_len);
+    hdr_buf_.append(name, name_len);
+    hdr_buf_.push_back('\0');
+    field.value_offset = static_cast<uint32_t>(hdr_buf_.size());
+    field.value_len = static_cast<uint32_t>(value_len);
+    hdr_buf_.append(value, value_len);
+    hdr_buf_.push_back('\0');
+    fields.push_back(field);
+}
+
+bool HttpParser::Impl::addHeaderField(const char* name, size_t name_len, const char* value, size_t value_len)
+{
+    auto id = getHeaderId(name, name_len);
+    if(id == HeaderId::CONTENT_LENGTH) {
+        // the message framing is ambiguous if Content-Length is invalid or the
+        // duplicated ones differ, it is rejected to avoid request smuggling
+        size_t content_length = 0;
+        if(!parseContentLength(value, value_len, content_length)) {
+            KUMA_ERRTRACE("HttpParser::addHeaderField, invalid Content-Length: "<<std::string(value, value_len));
+            return false;
+        }
+        if(has_content_length_ && content_length != content_length_) {
+            KUMA_ERRTRACE("HttpParser::addHeaderField, conflicting Content-Length: "<<content_length_<<", "<<content_length);
+            return false;
+        }
+        has_content_length_ = true;
+        content_length_ = content_length;
+    } else if(id == HeaderId::TRANSFER_ENCODING) {
+        is_chunked_ = value_len == strChunked.size() && strncasecmp(value, strChunked.c_str(), value_len) == 0;
+    }
+    header_slots_.set(id, header_fields_.size());
+    addField(header_fields_, name, name_len, value, value_len);
+    return true;
+}
+
+const HttpParser::Impl::HeaderField* HttpParser::Impl::findField(const FieldVector& fields, const char* name) const
+{
+    size_t name_len = strlen(name);
+    // the first one wins if there are duplicated fields
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+        if(it->name_len == name_len && hdrid::equalIgnoreCase(fieldName(*it), name, name_len)) {
+            return &(*it);
+        }
+    }
+    return nullptr;
+}
+
+void HttpParser::Impl::addParamValue(std::string name, std::string value)
+{
+    addField(param_fields_, name.c_str(), name.size(), value.c_str(), value.size());
 }
 
 void HttpParser::Impl::addHeaderValue(std::string name, std::string value)
@@ -645,36 +724,55 @@ void HttpParser::Impl::addHeaderValue(std::string name, std::string value)
     trim_right(name);
     trim_left(value);
     trim_right(value);
-    if(!name.empty()) {
-        HttpHeader::addHeader(std::move(name), std::move(value));
-    }
+    addHeaderField(name.c_str(), name.size(), value.c_str(), value.size());
 }
 
-const std::string& HttpParser::Impl::getParamValue(const std::string& name) const
+const char* HttpParser::Impl::getParamValue(const char* name) const
 {
-    auto it = param_map_.find(name);
-    if (it != param_map_.end()) {
-        return (*it).second;
+    auto field = findField(param_fields_, name);
+    return field ? fieldValue(*field) : EmptyString.c_str();
+}
+
+const char* HttpParser::Impl::getHeaderValue(const char* name) const
+{
+    auto id = getHeaderId(name, strlen(name));
+    if(id != HeaderId::UNKNOWN) {
+        return getHeaderValue(id);
     }
-    return EmptyString;
+    auto field = findField(header_fields_, name);
+    return field ? fieldValue(*field) : EmptyString.c_str();
 }
 
-const std::string& HttpParser::Impl::getHeaderValue(const std::string& name) const
+const char* HttpParser::Impl::getHeaderValue(HeaderId id) const
 {
-    return HttpHeader::getHeader(name);
+    auto index = header_slots_.get(id);
+    return index >= 0 ? fieldValue(header_fields_[index]) : EmptyString.c_str();
+}
+
+bool HttpParser::Impl::getHeader(size_t index, const char*& name, size_t& name_len, const char*& value, size_t& value_len) const
+{
+    if(index >= header_fields_.size()) {
+        return false;
+    }
+    auto &field = header_fields_[index];
+    name = fieldName(field);
+    name_len = field.name_len;
+    value = fieldValue(field);
+    value_len = field.value_len;
+    return true;
 }
 
 void HttpParser::Impl::forEachParam(EnumrateCallback cb)
 {
-    for (auto &kv : param_map_) {
-        cb(kv.first, kv.second);
+    for (auto &field : param_fields_) {
+        cb(fieldName(field), fieldValue(field));
     }
 }
 
 void HttpParser::Impl::forEachHeader(EnumrateCallback cb)
 {
-    for (auto &kv : header_vec_) {
-        cb(kv.first, kv.second);
+    for (auto &field : header_fields_) {
+        cb(fieldName(field), fieldValue(field));
     }
 }
 
@@ -700,12 +798,28 @@ void HttpParser::Impl::setVersion(std::string ver)
 
 void HttpParser::Impl::setHeaders(const HeaderVector & headers)
 {
-    header_vec_ = headers;
+    // the params share hdr_buf_ with headers, they are moved to the new buffer
+    std::string hdr_buf;
+    hdr_buf.swap(hdr_buf_);
+    FieldVector params;
+    params.swap(param_fields_);
+    for (auto &field : params) {
+        addField(param_fields_, hdr_buf.c_str() + field.name_offset, field.name_len,
+                 hdr_buf.c_str() + field.value_offset, field.value_len);
+    }
+    header_fields_.clear();
+    header_slots_.clear();
+    has_content_length_ = false;
+    content_length_ = 0;
+    is_chunked_ = false;
+    for (auto &kv : headers) {
+        addHeaderField(kv.first.c_str(), kv.first.size(), kv.second.c_str(), kv.second.size());
+    }
 }
 
 void HttpParser::Impl::setHeaders(HeaderVector && headers)
 {
-    header_vec_ = std::move(headers);
+    setHeaders(static_cast<const HeaderVector&>(headers));
 }
 
 void HttpParser::Impl::setStatusCode(int status_code)
@@ -715,7 +829,7 @@ void HttpParser::Impl::setStatusCode(int status_code)
 
 bool HttpParser::Impl::getLine(const char*& cur_pos, const char* end, const char*& line, const char*& line_end)
 {
-    const char* lf = std::find(cur_pos, end, LF);
+    const char* lf = findLineFeed(cur_pos, end);
     if(lf == end) {
         return false;
     }
@@ -724,6 +838,9 @@ bool HttpParser::Impl::getLine(const char*& cur_pos, const char* end, const char
     cur_pos = lf + 1;
     if(line != line_end && *(line_end - 1) == CR) {
         --line_end;
+    } else if(line == line_end && !str_buf_.empty() && str_buf_.back() == CR) {
+        // CR was saved with previous data
+        str_buf_.pop_back();
     }
     return true;
 }
@@ -40,7 +40,7 @@ class HttpParser::Impl : public DestroyDetector, public HttpHeader
 public:
     using DataCallback = HttpParser::DataCallback;
     using EventCallback = HttpParser::EventCallback;
-    using EnumrateCallback = std::function<void(const std::string&, const std::string&)>;
+    using EnumrateCallback = HttpParser::EnumrateCallback;
     
     Impl() = default;
     Impl(const Impl& other);
@@ -66,13 +66,18 @@ public:
     bool isUpgradeTo(const std::string& proto) const;
     
     int getStatusCode() const { return status_code_; }
-    const std::string& getLocation() const { return getHeaderValue("Location"); }
+    const char* getLocation() const { return getHeaderValue("Location"); }
     const std::string& getUrl() const { return url_; }
     const std::string& getUrlPath() const { return url_path_; }
     const std::string& getMethod() const { return method_; }
     const std::string& getVersion() const { return version_; }
-    const std::string& getParamValue(const std::string& name) const;
-    const std::string& getHeaderValue(const std::string& name) const;
+    // the returned values are nul terminated and live in the header buffer of
+    // current message, "" if not found
+    const char* getParamValue(const char* name) const;
+    const char* getHeaderValue(const char* name) const;
+    const char* getHeaderValue(HeaderId id) const;
+    size_t getHeaderCount() const { return header_fields_.size(); }
+    bool getHeader(size_t index, const char*& name, size_t& name_len, const char*& value, size_t& value_len) const;
     
     void forEachParam(EnumrateCallback cb);
     void forEachHeader(EnumrateCallback cb);
@@ -92,6 +97,15 @@ public:
     void addHeaderValue(std::string name, std::string value);
     
 private:
+    // offsets of a field in hdr_buf_, they stay valid when hdr_buf_ grows
+    struct HeaderField {
+        uint32_t name_offset;
+        uint32_t name_len;
+        uint32_t value_offset;
+        uint32_t value_len;
+    };
+    using FieldVector = std::vector<HeaderField>;
+
     typedef enum{
         PARSE_STATE_CONTINUE,
         PARSE_STATE_DONE,
@@ -133,6 +147,13 @@ private:
     void onHeaderComplete();
     void onComplete();
     
+    void addField(FieldVector& fields, const char* name, size_t name_len, const char* value, size_t value_len);
+    // false if Content-Length is invalid or conflicts with previous one
+    bool addHeaderField(const char* name, size_t name_len, const char* value, size_t value_len);
+    const HeaderField* findField(const FieldVector& fields, const char* name) const;
+    const char* fieldName(const HeaderField& field) const { return hdr_buf_.c_str() + field.name_offset; }
+    const char* fieldValue(const HeaderField& field) const { return hdr_buf_.c_str() + field.value_offset; }
+    
     KMError saveData(const char* cur_pos, const char* end);
     bool bufferEmpty() { return str_buf_.empty(); };
     void clearBuffer() { str_buf_.clear(); }
@@ -160,7 +181,14 @@ private:
     std::string         url_;
     std::string         version_;
     std::string         url_path_;
-    HeaderMap           param_map_;
+    
+    // the names and values of the headers and params of current message, each
+    // is followed by '\0', the capacity is kept across messages to avoid
+    // allocating for each header
+    std::string         hdr_buf_;
+    FieldVector         header_fields_;
+    HeaderSlots         header_slots_;
+    FieldVector         param_fields_;
     
     // response
     int                 status_code_{ 0 };
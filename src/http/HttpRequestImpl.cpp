@@ -86,5 +86,80 @@ std::string HttpRequest::Impl::getCacheKey()
 
 void HttpRequest::Impl::reset()
 {
-    
+    cache_key_.clear();
+    cache_req_headers_.clear();
+    cache_rsp_headers_.clear();
+    cache_body_.reset();
+    cache_body_size_ = 0;
+    caching_ = false;
+}
+
+HttpCache::EntryPtr HttpRequest::Impl::getCacheEntry(const HeaderVector &req_headers)
+{
+    cache_key_.clear();
+    // the cache key has no method, only GET response is stored
+    if (!is_equal(method_, "GET") || !HttpCache::isCacheable(method_, req_headers)) {
+        return HttpCache::EntryPtr();
+    }
+    cache_key_ = getCacheKey();
+    cache_req_headers_ = req_headers;
+    return HttpCache::instance().getCache(cache_key_, cache_req_headers_);
+}
+
+HttpCache::EntryPtr HttpRequest::Impl::getStaleCacheEntry()
+{
+    if (cache_key_.empty()) {
+        return HttpCache::EntryPtr();
+    }
+    caching_ = false;
+    return HttpCache::instance().getStaleCache(cache_key_, cache_req_headers_);
+}
+
+void HttpRequest::Impl::beginCacheResponse(int status_code, HeaderVector rsp_headers)
+{
+    caching_ = !cache_key_.empty() && HttpCache::isCacheableStatus(status_code);
+    if (!caching_) {
+        return;
+    }
+    cache_status_code_ = status_code;
+    cache_rsp_headers_ = std::move(rsp_headers);
+    cache_body_.reset();
+    cache_body_size_ = 0;
+}
+
+void HttpRequest::Impl::appendCacheResponse(const KMBuffer &buf)
+{
+    if (!caching_) {
+        return;
+    }
+    cache_body_size_ += buf.chainLength();
+    if (cache_body_size_ > HttpCache::instance().getMaxBodySize()) {
+        // too large to be cached
+        caching_ = false;
+        cache_body_.reset();
+        return;
+    }
+    if (cache_body_) {
+        cache_body_->append(buf.clone());
+    } else {
+        cache_body_.reset(buf.clone());
+    }
+}
+
+void HttpRequest::Impl::endCacheResponse()
+{
+    if (!caching_) {
+        return;
+    }
+    caching_ = false;
+    HttpCache::instance().setCache(cache_key_, cache_req_headers_, cache_status_code_,
+                                   std::move(cache_rsp_headers_), cache_body_.get());
+    cache_body_.reset();
+}
+
+HeaderVector HttpRequest::Impl::getCacheHeaders(const HttpCache::Entry &entry)
+{
+    HeaderVector headers = entry.getHeaders();
+    headers.emplace_back("Age", std::to_string(entry.getAge()));
+    return headers;
 }
@@ -27,6 +27,7 @@
 #include "httpdefs.h"
 #include "Uri.h"
 #include "HttpParserImpl.h"
+#include "HttpCache.h"
 #include <map>
 
 KUMA_NS_BEGIN
@@ -50,10 +51,14 @@ public:
     virtual int sendData(const KMBuffer &buf) = 0;
     virtual void reset();
     virtual KMError close() = 0;
+    virtual KMError setSendBufferWatermark(size_t high_mark, size_t low_mark) { return KMError::UNSUPPORT; }
+    virtual size_t getBufferedBytes() const { return 0; }
+    virtual KMError setRateLimit(uint32_t rate, uint32_t burst, const std::string &group) { return KMError::UNSUPPORT; }
+    virtual KMError getRateLimitStats(RateLimitStats &stats) const { return KMError::UNSUPPORT; }
     
     virtual int getStatusCode() const = 0;
     virtual const std::string& getVersion() const = 0;
-    virtual const std::string& getHeaderValue(std::string name) const = 0;
+    virtual const char* getHeaderValue(const char* name) const = 0;
     virtual void forEachHeader(EnumrateCallback cb) = 0;
     
     std::string getCacheKey();
@@ -83,6 +88,18 @@ protected:
     void setState(State state) { state_ = state; }
     State getState() const { return state_; }
     
+    /* look up HttpCache if the request is cacheable, a miss response is stored by
+     * beginCacheResponse, appendCacheResponse and endCacheResponse
+     */
+    HttpCache::EntryPtr getCacheEntry(const HeaderVector &req_headers);
+    // the stale response allowed by stale-if-error when the request failed
+    HttpCache::EntryPtr getStaleCacheEntry();
+    void beginCacheResponse(int status_code, HeaderVector rsp_headers);
+    void appendCacheResponse(const KMBuffer &buf);
+    void endCacheResponse();
+    // the headers of cached response with Age
+    static HeaderVector getCacheHeaders(const HttpCache::Entry &entry);
+    
 protected:
     State                   state_ = State::IDLE;
     
@@ -96,6 +113,15 @@ protected:
     EventCallback           error_cb_;
     HttpEventCallback       header_cb_;
     HttpEventCallback       response_cb_;
+    
+    // the response is stored into HttpCache when it is complete
+    std::string             cache_key_; // empty if the request is not cacheable
+    HeaderVector            cache_req_headers_;
+    int                     cache_status_code_ = 0;
+    HeaderVector            cache_rsp_headers_;
+    KMBuffer::Ptr           cache_body_;
+    size_t                  cache_body_size_ = 0;
+    bool                    caching_ = false;
 };
 
 KUMA_NS_END
@@ -31,6 +31,34 @@ static const std::string str_content_type = "Content-Type";
 static const std::string str_content_length = "Content-Length";
 static const std::string str_transfer_encoding = "Transfer-Encoding";
 static const std::string str_chunked = "chunked";
+static const std::string str_content_encoding = "Content-Encoding";
+static const std::string str_accept_encoding = "Accept-Encoding";
+static const std::string str_vary = "Vary";
+
+// the Vary of application with Accept-Encoding appended, false if it is listed already
+static bool appendVaryAcceptEncoding(const HttpHeader &header, std::string &vary)
+{
+    vary.clear();
+    for (auto &kv : header.getHeaders()) {
+        if (getHeaderId(kv.first) != HeaderId::VARY) {
+            continue;
+        }
+        if (contains_token(kv.second, "*", ',') || contains_token(kv.second, str_accept_encoding, ',')) {
+            return false;
+        }
+        if (!kv.second.empty()) {
+            if (!vary.empty()) {
+                vary += ", ";
+            }
+            vary += kv.second;
+        }
+    }
+    if (!vary.empty()) {
+        vary += ", ";
+    }
+    vary += str_accept_encoding;
+    return true;
+}
 //////////////////////////////////////////////////////////////////////////
 HttpResponse::Impl::Impl(std::string ver)
 : version_(std::move(ver))
@@ -53,9 +81,147 @@ KMError HttpResponse::Impl::sendResponse(int status_code, const std::string& des
     if (getState() != State::WAIT_FOR_RESPONSE) {
         return KMError::INVALID_STATE;
     }
+    if (!encodings_.empty()) {
+        setupEncoder(status_code);
+    }
     checkHeaders();
     return sendResponse(status_code, desc, version_);
 }
+
+KMError HttpResponse::Impl::setContentEncoding(const std::string &encodings, int level)
+{
+    auto types = ContentEncoder::parseEncodings(encodings);
+    if (types.empty()) {
+        return KMError::UNSUPPORT;
+    }
+    encodings_ = std::move(types);
+    encoding_level_ = level;
+    return KMError::NOERR;
+}
+
+void HttpResponse::Impl::setupEncoder(int status_code)
+{
+    if ((status_code >= 100 && status_code <= 199) || 204 == status_code ||
+        206 == status_code || 304 == status_code) {
+        return;
+    }
+    auto &header = getResponseHeader();
+    if (header.hasHeader(HeaderId::CONTENT_ENCODING)) {
+        return; // encoded by application
+    }
+    if (!isVersion2() && !is_equal(getVersion(), VersionHTTP1_1)) {
+        return; // no chunked encoding in HTTP/1.0
+    }
+    std::string vary;
+    if (appendVaryAcceptEncoding(header, vary)) {
+        // the Vary fields of application are merged into one
+        header.removeHeader(HeaderId::VARY);
+        addHeader(str_vary, std::move(vary));
+    }
+    auto type = ContentEncoder::negotiate(encodings_, getHeaderValue(str_accept_encoding.c_str()));
+    if (type == ContentEncoder::Type::IDENTITY) {
+        return;
+    }
+    // the response to HEAD request has same headers but no body
+    if (!is_equal(getMethod(), "HEAD")) {
+        encoder_ = ContentEncoder::create(type, encoding_level_);
+        if (!encoder_) {
+            return;
+        }
+    }
+    header.removeHeader(HeaderId::CONTENT_LENGTH);
+    addHeader(str_content_encoding, ContentEncoder::getName(type));
+    if (!isVersion2() && !header.hasHeader(HeaderId::TRANSFER_ENCODING)) {
+        addHeader(str_transfer_encoding, str_chunked);
+    }
+}
+
+int HttpResponse::Impl::writeBody(const void* data, size_t len)
+{
+    if (!encoder_) {
+        return sendData(data, len);
+    }
+    if (!data || 0 == len) {
+        return encodeBody(nullptr);
+    }
+    KMBuffer buf(data, len, len);
+    return encodeBody(&buf);
+}
+
+int HttpResponse::Impl::writeBody(const KMBuffer &buf)
+{
+    if (!encoder_) {
+        return sendData(buf);
+    }
+    return encodeBody(buf.chainLength() > 0 ? &buf : nullptr);
+}
+
+int HttpResponse::Impl::encodeBody(const KMBuffer *buf)
+{
+    if (getState() != State::SENDING_BODY || end_pending_) {
+        return 0;
+    }
+    auto ret = flushEncoded();
+    if (ret < 0) {
+        return ret;
+    } else if (encoded_) {
+        // the input is taken after the output of last one is sent
+        return 0;
+    }
+    auto err = encoder_->encode(buf, !buf, encoded_);
+    if (err != KMError::NOERR) {
+        KUMA_ERRTRACE("HttpResponse::encodeBody, failed to encode, err=" << int(err));
+        return -1;
+    }
+    end_pending_ = !buf;
+    ret = flushEncoded();
+    if (ret < 0) {
+        return ret;
+    }
+    if (end_pending_ && !encoded_) {
+        sendData(nullptr, 0);
+    }
+    return buf ? static_cast<int>(buf->chainLength()) : 0;
+}
+
+int HttpResponse::Impl::flushEncoded()
+{
+    if (!encoded_) {
+        return 0;
+    }
+    int bytes_sent = 0;
+    if (isVersion2()) {
+        // one DATA frame for each block
+        for (auto it = encoded_->begin(); it != encoded_->end(); ++it) {
+            auto len = it->length();
+            if (len == 0) {
+                continue;
+            }
+            auto ret = sendData(it->readPtr(), len);
+            if (ret < 0) {
+                return ret;
+            }
+            const_cast<KMBuffer&>(*it).bytesRead(ret);
+            bytes_sent += ret;
+            if (static_cast<size_t>(ret) < len) {
+                break;
+            }
+        }
+    } else {
+        // one chunk for all blocks
+        auto ret = sendData(*encoded_);
+        if (ret < 0) {
+            return ret;
+        }
+        encoded_->bytesRead(ret);
+        bytes_sent = ret;
+    }
+    if (encoded_->empty()) {
+        encoded_.reset();
+    }
+    return bytes_sent;
+}
+
 /*
 int HttpResponse::Impl::sendData(const KMBuffer &buf)
 {
@@ -75,10 +241,47 @@ int HttpResponse::Impl::sendData(const KMBuffer &buf)
 */
 void HttpResponse::Impl::reset()
 {
-    
+    body_writer_ = nullptr;
+    encodings_.clear();
+    encoding_level_ = -1;
+    encoder_.reset();
+    encoded_.reset();
+    end_pending_ = false;
 }
 
 void HttpResponse::Impl::notifyComplete()
 {
     if(response_cb_) response_cb_();
 }
+
+void HttpResponse::Impl::notifyRequestComplete()
+{
+    if (route_cb_ && route_cb_()) {
+        return;
+    }
+    if(request_cb_) request_cb_();
+}
+
+void HttpResponse::Impl::notifyWrite()
+{
+    if (encoded_ || end_pending_) {
+        // the encoded data is sent before the application is asked for more
+        if (flushEncoded() < 0 || encoded_) {
+            return;
+        }
+        if (end_pending_) {
+            sendData(nullptr, 0);
+            return;
+        }
+    }
+    if (body_writer_) {
+        auto err = body_writer_();
+        if (err != KMError::NOERR) {
+            KUMA_ERRTRACE("HttpResponse::notifyWrite, failed to write body, err=" << int(err));
+            close();
+            if (error_cb_) error_cb_(err);
+        }
+    } else if (write_cb_) {
+        write_cb_(KMError::NOERR);
+    }
+}
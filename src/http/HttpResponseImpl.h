@@ -25,6 +25,8 @@
 #include "kmdefs.h"
 #include "httpdefs.h"
 #include "HttpParserImpl.h"
+#include "HttpHeader.h"
+#include "ContentEncoder.h"
 #include "TcpConnection.h"
 #include "Uri.h"
 #include "util/kmobject.h"
@@ -38,6 +40,8 @@ public:
     using DataCallback = HttpResponse::DataCallback;
     using EventCallback = HttpResponse::EventCallback;
     using HttpEventCallback = HttpResponse::HttpEventCallback;
+    using BodyWriter = std::function<KMError(void)>;
+    using RouteCallback = std::function<bool(void)>;
     
     Impl(std::string ver);
     virtual ~Impl();
@@ -48,17 +52,30 @@ public:
     virtual KMError attachStream(H2Connection::Impl* conn, uint32_t stream_id) { return KMError::UNSUPPORT; }
     virtual void addHeader(std::string name, std::string value) = 0;
     virtual void addHeader(std::string name, uint32_t value);
+    virtual KMError addTrailer(std::string name, std::string value) { return KMError::UNSUPPORT; }
     KMError sendResponse(int status_code, const std::string& desc);
     virtual int sendData(const void* data, size_t len) = 0;
     virtual int sendData(const KMBuffer &buf) = 0;
+    /* the body of application, it is compressed if content encoding is negotiated,
+     * otherwise same as sendData
+     */
+    int writeBody(const void* data, size_t len);
+    int writeBody(const KMBuffer &buf);
+    /* send file data by sendfile if canSendFile, it counts in Content-Length as sendData */
+    virtual int sendFile(int file_fd, int64_t offset, size_t len) { return -1; }
+    virtual bool canSendFile() const { return false; }
     virtual void reset();
     virtual KMError close() = 0;
+    virtual KMError setSendBufferWatermark(size_t high_mark, size_t low_mark) { return KMError::UNSUPPORT; }
+    virtual size_t getBufferedBytes() const { return 0; }
+    virtual KMError setRateLimit(uint32_t rate, uint32_t burst, const std::string &group) { return KMError::UNSUPPORT; }
+    virtual KMError getRateLimitStats(RateLimitStats &stats) const { return KMError::UNSUPPORT; }
     
     virtual const std::string& getMethod() const = 0;
     virtual const std::string& getPath() const = 0;
     virtual const std::string& getVersion() const = 0;
-    virtual const std::string& getParamValue(std::string name) const = 0;
-    virtual const std::string& getHeaderValue(std::string name) const = 0;
+    virtual const char* getParamValue(const char* name) const = 0;
+    virtual const char* getHeaderValue(const char* name) const = 0;
     virtual void forEachHeader(HttpParser::Impl::EnumrateCallback&& cb) = 0;
     
     void setDataCallback(DataCallback cb) { data_cb_ = std::move(cb); }
@@ -67,11 +84,25 @@ public:
     void setHeaderCompleteCallback(HttpEventCallback cb) { header_cb_ = std::move(cb); }
     void setRequestCompleteCallback(HttpEventCallback cb) { request_cb_ = std::move(cb); }
     void setResponseCompleteCallback(HttpEventCallback cb) { response_cb_ = std::move(cb); }
+    /* the body is written by writer instead of write callback when the response
+     * is writable, e.g. by StaticFileHandler. it is removed on reset, the response
+     * is closed and error callback is called if writer fails
+     */
+    void setBodyWriter(BodyWriter writer) { body_writer_ = std::move(writer); }
+    /* the request is dispatched by route callback when it is complete, request
+     * complete callback is called if it returns false
+     */
+    void setRouteCallback(RouteCallback cb) { route_cb_ = std::move(cb); }
+    /* the encodings the body can be compressed by, it is negotiated from Accept-Encoding
+     * when the response is sent. it is removed on reset
+     */
+    KMError setContentEncoding(const std::string &encodings, int level);
     
 protected:
     virtual KMError sendResponse(int status_code, const std::string& desc, const std::string& ver) = 0;
     virtual void checkHeaders() = 0;
     virtual bool isVersion2() { return true; }
+    virtual HttpHeader& getResponseHeader() = 0;
     
     enum State {
         IDLE,
@@ -87,6 +118,12 @@ protected:
     State getState() const { return state_; }
     
     void notifyComplete();
+    void notifyRequestComplete();
+    void notifyWrite();
+    
+    void setupEncoder(int status_code);
+    int encodeBody(const KMBuffer *buf);
+    int flushEncoded();
     
 protected:
     State                   state_ = State::IDLE;
@@ -99,6 +136,15 @@ protected:
     HttpEventCallback       header_cb_;
     HttpEventCallback       request_cb_;
     HttpEventCallback       response_cb_;
+    BodyWriter              body_writer_;
+    RouteCallback           route_cb_;
+    
+    ContentEncoder::TypeVector encodings_;
+    int                     encoding_level_ = -1;
+    ContentEncoder::Ptr     encoder_;
+    // the output of encoder not sent yet, the encoded body is ended after it is sent if end_pending_
+    KMBuffer::Ptr           encoded_;
+    bool                    end_pending_ = false;
 };
 
 KUMA_NS_END
@@ -0,0 +1,200 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "HttpRouter.h"
+
+#include <string.h>
+
+using namespace kuma;
+
+KMError HttpRouter::Impl::addRoute(const std::string &method, const std::string &pattern, Handler handler)
+{
+    if (method.empty() || pattern.empty() || pattern[0] != '/' || !handler) {
+        return KMError::INVALID_PARAM;
+    }
+    auto *node = &root_;
+    size_t param_count = 0;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        auto next = pattern.find_first_of(":*", pos);
+        if (next == std::string::npos) {
+            next = pattern.size();
+        } else if (pattern[next - 1] != '/') {
+            // the parameter must be a whole segment
+            return KMError::INVALID_PARAM;
+        }
+        if (next > pos) {
+            node = insertStatic(node, pattern.c_str() + pos, next - pos);
+        }
+        if (next == pattern.size()) {
+            break;
+        }
+        if (++param_count > kMaxParams) {
+            return KMError::INVALID_PARAM;
+        }
+        auto end = pattern.find('/', next);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        auto name = pattern.substr(next + 1, end - next - 1);
+        if (name.empty() || name.find_first_of(":*") != std::string::npos) {
+            return KMError::INVALID_PARAM;
+        }
+        if (pattern[next] == '*') {
+            if (end != pattern.size()) {
+                // the wildcard must be the last segment
+                return KMError::INVALID_PARAM;
+            }
+            if (!node->wildcard_name.empty() && node->wildcard_name != name) {
+                return KMError::INVALID_PARAM;
+            }
+            node->wildcard_name = std::move(name);
+            return addHandler(node->wildcard_handlers, method, std::move(handler));
+        }
+        if (!node->param_child) {
+            node->param_child.reset(new Node());
+            node->param_name = std::move(name);
+        } else if (node->param_name != name) {
+            return KMError::INVALID_PARAM;
+        }
+        node = node->param_child.get();
+        pos = end;
+    }
+    return addHandler(node->handlers, method, std::move(handler));
+}
+
+HttpRouter::Impl::Node* HttpRouter::Impl::insertStatic(Node *node, const char *str, size_t len)
+{
+    while (len > 0) {
+        auto idx = node->indices.find(str[0]);
+        if (idx == std::string::npos) {
+            std::unique_ptr<Node> child(new Node());
+            child->prefix.assign(str, len);
+            node->indices.push_back(str[0]);
+            node->children.emplace_back(std::move(child));
+            return node->children.back().get();
+        }
+        auto *child = node->children[idx].get();
+        size_t common = 0;
+        while (common < len && common < child->prefix.size() && child->prefix[common] == str[common]) {
+            ++common;
+        }
+        if (common < child->prefix.size()) {
+            // split the child at the end of common prefix
+            std::unique_ptr<Node> mid(new Node());
+            mid->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            mid->indices.push_back(child->prefix[0]);
+            mid->children.emplace_back(std::move(node->children[idx]));
+            node->children[idx] = std::move(mid);
+            child = node->children[idx].get();
+        }
+        node = child;
+        str += common;
+        len -= common;
+    }
+    return node;
+}
+
+KMError HttpRouter::Impl::addHandler(std::vector<MethodHandler> &handlers, const std::string &method, Handler handler)
+{
+    for (auto &mh : handlers) {
+        if (mh.method == method) {
+            return KMError::ALREADY_EXIST;
+        }
+    }
+    handlers.push_back({method, std::move(handler)});
+    return KMError::NOERR;
+}
+
+const HttpRouter::Handler* HttpRouter::Impl::findHandler(const std::vector<MethodHandler> &handlers, const char *method)
+{
+    const Handler *any = nullptr;
+    for (auto &mh : handlers) {
+        if (mh.method == method) {
+            return &mh.handler;
+        } else if (mh.method == "*") {
+            any = &mh.handler;
+        }
+    }
+    return any;
+}
+
+bool HttpRouter::Impl::addParam(Params &params, const std::string &name, const char *value, size_t value_len)
+{
+    if (params.count_ >= kMaxParams) {
+        return false;
+    }
+    auto &param = params.params_[params.count_++];
+    param.name = name.c_str();
+    param.name_len = name.size();
+    param.value = value;
+    param.value_len = value_len;
+    return true;
+}
+
+const HttpRouter::Handler* HttpRouter::Impl::match(const char* method, const char* path, size_t path_len, Params &params) const
+{
+    params.count_ = 0;
+    return match(&root_, path, path_len, method, params);
+}
+
+const HttpRouter::Handler* HttpRouter::Impl::match(const Node *node, const char *path, size_t len, const char *method, Params &params) const
+{
+    if (len == 0) {
+        auto *handler = findHandler(node->handlers, method);
+        if (handler) {
+            return handler;
+        }
+    } else {
+        // static segments first, then parameter, then wildcard
+        auto *idx = static_cast<const char*>(memchr(node->indices.data(), path[0], node->indices.size()));
+        if (idx) {
+            auto *child = node->children[idx - node->indices.data()].get();
+            auto &prefix = child->prefix;
+            if (len >= prefix.size() && memcmp(path, prefix.data(), prefix.size()) == 0) {
+                auto *handler = match(child, path + prefix.size(), len - prefix.size(), method, params);
+                if (handler) {
+                    return handler;
+                }
+            }
+        }
+        if (node->param_child) {
+            auto *slash = static_cast<const char*>(memchr(path, '/', len));
+            size_t seg_len = slash ? slash - path : len;
+            auto count = params.count_;
+            if (seg_len > 0 && addParam(params, node->param_name, path, seg_len)) {
+                auto *handler = match(node->param_child.get(), path + seg_len, len - seg_len, method, params);
+                if (handler) {
+                    return handler;
+                }
+                params.count_ = count;
+            }
+        }
+    }
+    if (!node->wildcard_name.empty()) {
+        auto *handler = findHandler(node->wildcard_handlers, method);
+        if (handler && addParam(params, node->wildcard_name, path, len)) {
+            return handler;
+        }
+    }
+    return nullptr;
+}
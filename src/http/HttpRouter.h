@@ -0,0 +1,79 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __HttpRouter_H__
+#define __HttpRouter_H__
+
+#include "kmdefs.h"
+#include "kmapi.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+KUMA_NS_BEGIN
+
+/* compressed radix tree of route patterns. a node has the static children indexed by
+ * their first byte, at most one parameter child and one wildcard. the static prefix
+ * of a node may span several path segments
+ */
+class HttpRouter::Impl
+{
+public:
+    using Handler = HttpRouter::Handler;
+    
+    KMError addRoute(const std::string &method, const std::string &pattern, Handler handler);
+    const Handler* match(const char* method, const char* path, size_t path_len, Params &params) const;
+    
+protected:
+    struct MethodHandler
+    {
+        std::string method; // "*" for any method
+        Handler     handler;
+    };
+    struct Node
+    {
+        std::string                         prefix;
+        // the first byte of static children
+        std::string                         indices;
+        std::vector<std::unique_ptr<Node>>  children;
+        // the child of ":name" segment
+        std::unique_ptr<Node>               param_child;
+        std::string                         param_name;
+        // "*name" matches the rest of path
+        std::string                         wildcard_name;
+        std::vector<MethodHandler>          wildcard_handlers;
+        std::vector<MethodHandler>          handlers;
+    };
+    
+    Node* insertStatic(Node *node, const char *str, size_t len);
+    static KMError addHandler(std::vector<MethodHandler> &handlers, const std::string &method, Handler handler);
+    static const Handler* findHandler(const std::vector<MethodHandler> &handlers, const char *method);
+    const Handler* match(const Node *node, const char *path, size_t len, const char *method, Params &params) const;
+    static bool addParam(Params &params, const std::string &name, const char *value, size_t value_len);
+    
+protected:
+    Node    root_;
+};
+
+KUMA_NS_END
+
+#endif
@@ -0,0 +1,210 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "HttpServerImpl.h"
+#include "util/kmtrace.h"
+
+#ifndef KUMA_OS_WIN
+# include <unistd.h>
+#endif
+
+using namespace kuma;
+
+HttpServer::Impl::Impl(EventLoop *loop)
+: loop_(loop)
+, listener_(loop)
+{
+    KM_SetObjKey("HttpServer");
+}
+
+HttpServer::Impl::~Impl()
+{
+    close();
+}
+
+KMError HttpServer::Impl::setSslFlags(uint32_t ssl_flags)
+{
+    ssl_flags_ = ssl_flags;
+    return KMError::NOERR;
+}
+
+KMError HttpServer::Impl::setLoops(EventLoop* const* loops, size_t count)
+{
+    if (listening_) {
+        return KMError::INVALID_STATE;
+    }
+    if (!loops && count > 0) {
+        return KMError::INVALID_PARAM;
+    }
+    std::vector<LoopContextPtr> contexts;
+    for (size_t i = 0; i < count; ++i) {
+        if (!loops[i]) {
+            return KMError::INVALID_PARAM;
+        }
+        contexts.emplace_back(new LoopContext(loops[i]));
+    }
+    loops_ = std::move(contexts);
+    next_loop_ = 0;
+    return KMError::NOERR;
+}
+
+KMError HttpServer::Impl::startListen(const std::string &host, uint16_t port)
+{
+    if (listening_) {
+        return KMError::INVALID_STATE;
+    }
+    if (loops_.empty()) {
+        loops_.emplace_back(new LoopContext(loop_));
+    }
+    listener_.setAcceptCallback([this] (SOCKET_FD fd, const char *ip, uint16_t port) -> bool {
+        return onAccept(fd, ip, port);
+    });
+    listener_.setErrorCallback([this] (KMError err) { onError(err); });
+    auto ret = listener_.startListen(host.c_str(), port);
+    if (ret != KMError::NOERR) {
+        KUMA_ERRXTRACE("startListen, failed, host="<<host<<", port="<<port<<", err="<<int(ret));
+        return ret;
+    }
+    listening_ = true;
+    return KMError::NOERR;
+}
+
+KMError HttpServer::Impl::stopListen()
+{
+    listening_ = false;
+    return listener_.close();
+}
+
+KMError HttpServer::Impl::close()
+{
+    stopListen();
+    for (auto &ctx : loops_) {
+        // the connections posted to the loop are attached before this task
+        auto *c = ctx.get();
+        auto ret = c->loop->sync([c] {
+            for (auto &kv : c->demuxers) {
+                kv.second->close();
+            }
+            c->demuxers.clear();
+        });
+        if (ret != KMError::NOERR) {
+            // loop is stopped, the fds of the canceled tasks are closed here
+            c->loop->cancel(&c->token);
+            for (auto &kv : c->demuxers) {
+                kv.second->close();
+            }
+            c->demuxers.clear();
+            std::lock_guard<std::mutex> g(c->mutex);
+            for (auto fd : c->pending_fds) {
+                closeFd(fd);
+            }
+            c->pending_fds.clear();
+        }
+    }
+    return KMError::NOERR;
+}
+
+bool HttpServer::Impl::onAccept(SOCKET_FD fd, const char *ip, uint16_t port)
+{
+    KUMA_INFOXTRACE("onAccept, fd="<<fd<<", ip="<<ip<<", port="<<port);
+    auto *ctx = loops_[next_loop_].get();
+    if (++next_loop_ >= loops_.size()) {
+        next_loop_ = 0;
+    }
+    if (ctx->loop == loop_) {
+        addFd(ctx, fd);
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> g(ctx->mutex);
+        ctx->pending_fds.insert(fd);
+    }
+    auto ret = ctx->loop->post([this, ctx, fd] {
+        if (ctx->takePendingFd(fd)) {
+            addFd(ctx, fd);
+        }
+    }, &ctx->token);
+    if (ret != KMError::NOERR) {
+        // the fd will be closed by listener
+        ctx->takePendingFd(fd);
+        return false;
+    }
+    return true;
+}
+
+void HttpServer::Impl::onError(KMError err)
+{
+    KUMA_ERRXTRACE("onError, err="<<int(err));
+    if (error_cb_) {
+        error_cb_(err);
+    }
+}
+
+void HttpServer::Impl::addFd(LoopContext *ctx, SOCKET_FD fd)
+{
+    std::unique_ptr<ProtoDemuxer> demuxer(new ProtoDemuxer(ctx->loop));
+    auto demuxer_id = demuxer->getObjId();
+    demuxer->setDemuxCallback([=] (ProtoDemuxer::Proto proto, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        onDemuxed(ctx, demuxer_id, proto, std::move(tcp), std::move(parser), init_buf);
+    });
+    demuxer->setErrorCallback([=] (KMError) { removeDemuxer(ctx, demuxer_id); });
+    auto *d = demuxer.get();
+    ctx->demuxers.emplace(demuxer_id, std::move(demuxer));
+    if (d->attachFd(fd, ssl_flags_) != KMError::NOERR) {
+        removeDemuxer(ctx, demuxer_id);
+    }
+}
+
+void HttpServer::Impl::onDemuxed(LoopContext *ctx, long demuxer_id, ProtoDemuxer::Proto proto,
+                                 TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf)
+{
+    ConnCallback *cb = nullptr;
+    switch (proto) {
+        case ProtoDemuxer::Proto::HTTP2:
+            if (h2_cb_) {
+                cb = &h2_cb_;
+            } else if (parser.headerComplete()) {
+                cb = &http_cb_; // h2c upgrade is ignored
+            }
+            break;
+            
+        case ProtoDemuxer::Proto::WEBSOCKET:
+            cb = ws_cb_ ? &ws_cb_ : &http_cb_;
+            break;
+            
+        default:
+            cb = &http_cb_;
+            break;
+    }
+    if (cb && *cb) {
+        (*cb)(ctx->loop, std::move(tcp), std::move(parser), init_buf);
+    } else {
+        KUMA_WARNXTRACE("onDemuxed, no handler, proto="<<int(proto));
+        tcp.close();
+    }
+    // tcp and parser are owned by demuxer
+    removeDemuxer(ctx, demuxer_id);
+}
+
+void HttpServer::Impl::removeDemuxer(LoopContext *ctx, long demuxer_id)
+{
+    ctx->demuxers.erase(demuxer_id);
+}
@@ -0,0 +1,102 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __HttpServerImpl_H__
+#define __HttpServerImpl_H__
+
+#include "kmdefs.h"
+#include "kmapi.h"
+#include "util/kmobject.h"
+#include "ProtoDemuxer.h"
+
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+KUMA_NS_BEGIN
+
+class HttpServer::Impl : public KMObject
+{
+public:
+    using ConnCallback = HttpServer::ConnCallback;
+    using ErrorCallback = HttpServer::ErrorCallback;
+    
+    Impl(EventLoop *loop);
+    ~Impl();
+    
+    KMError setSslFlags(uint32_t ssl_flags);
+    KMError setLoops(EventLoop* const* loops, size_t count);
+    KMError startListen(const std::string &host, uint16_t port);
+    KMError stopListen();
+    KMError close();
+    
+    void setHttpCallback(ConnCallback cb) { http_cb_ = std::move(cb); }
+    void setHttp2Callback(ConnCallback cb) { h2_cb_ = std::move(cb); }
+    void setWebSocketCallback(ConnCallback cb) { ws_cb_ = std::move(cb); }
+    void setErrorCallback(ErrorCallback cb) { error_cb_ = std::move(cb); }
+    
+private:
+    // the demuxers of a loop are only accessed in that loop
+    struct LoopContext {
+        LoopContext(EventLoop *l) : loop(l), token(l->createToken()) {}
+        
+        // false if the fd is already closed by HttpServer::close
+        bool takePendingFd(SOCKET_FD fd) {
+            std::lock_guard<std::mutex> g(mutex);
+            return pending_fds.erase(fd) > 0;
+        }
+        
+        EventLoop*          loop;
+        EventLoop::Token    token;
+        std::map<long, std::unique_ptr<ProtoDemuxer>> demuxers;
+        
+        // the accepted fds posted to loop
+        std::mutex          mutex;
+        std::set<SOCKET_FD> pending_fds;
+    };
+    using LoopContextPtr = std::unique_ptr<LoopContext>;
+    
+    bool onAccept(SOCKET_FD fd, const char *ip, uint16_t port);
+    void onError(KMError err);
+    void addFd(LoopContext *ctx, SOCKET_FD fd);
+    void onDemuxed(LoopContext *ctx, long demuxer_id, ProtoDemuxer::Proto proto,
+                   TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf);
+    void removeDemuxer(LoopContext *ctx, long demuxer_id);
+    
+private:
+    EventLoop*                  loop_;
+    TcpListener                 listener_;
+    uint32_t                    ssl_flags_ = 0;
+    bool                        listening_ = false;
+    std::vector<LoopContextPtr> loops_;
+    size_t                      next_loop_ = 0;
+    
+    ConnCallback                http_cb_;
+    ConnCallback                h2_cb_;
+    ConnCallback                ws_cb_;
+    ErrorCallback               error_cb_;
+};
+
+KUMA_NS_END
+
+#endif
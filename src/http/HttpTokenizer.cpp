@@ -0,0 +1,210 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "HttpTokenizer.h"
+
+#include <stdint.h>
+
+#if defined(__AVX2__)
+# define KUMA_TOKENIZER_AVX2
+# include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define KUMA_TOKENIZER_SSE2
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define KUMA_TOKENIZER_NEON
+# include <arm_neon.h>
+#endif
+#if defined(__SSE4_2__)
+# define KUMA_TOKENIZER_SSE42
+# include <nmmintrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// not enabled by compiler flags, check CPU at runtime
+# define KUMA_TOKENIZER_SSE42
+# define KUMA_TOKENIZER_SSE42_RUNTIME
+# include <nmmintrin.h>
+#endif
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+using namespace kuma;
+
+namespace {
+
+// tchar of RFC 7230
+const uint8_t kTokenTable[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+#if defined(KUMA_TOKENIZER_SSE2) || defined(KUMA_TOKENIZER_NEON)
+inline unsigned firstSetBit(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward64(&idx, mask);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+#endif
+
+const char* findCharScalar(const char* p, const char* end, char c)
+{
+    while (p < end && *p != c) {
+        ++p;
+    }
+    return p;
+}
+
+const char* findNonTokenCharScalar(const char* p, const char* end)
+{
+    while (p < end && kTokenTable[static_cast<uint8_t>(*p)]) {
+        ++p;
+    }
+    return p;
+}
+
+#ifdef KUMA_TOKENIZER_SSE42
+#ifdef KUMA_TOKENIZER_SSE42_RUNTIME
+__attribute__((target("sse4.2")))
+#endif
+const char* findNonTokenCharSSE42(const char* p, const char* end)
+{
+    // ranges of the bytes which are not tchar, '|' and '~' fall into the last
+    // range to fit in 8 ranges, they are rechecked by table
+    static const char ranges[16] = {
+        '\x00', ' ', '"', '"', '(', ')', ',', ',',
+        '/', '/', ':', '@', '[', ']', '{', '\xff'
+    };
+    const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges));
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(r, 16, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES);
+        if (idx == 16) {
+            p += 16;
+            continue;
+        }
+        p += idx;
+        if (!kTokenTable[static_cast<uint8_t>(*p)]) {
+            return p;
+        }
+        ++p;
+    }
+    return findNonTokenCharScalar(p, end);
+}
+#endif
+
+#ifdef KUMA_TOKENIZER_SSE42_RUNTIME
+bool cpuHasSSE42()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+} // namespace
+
+KUMA_NS_BEGIN
+
+const char* findChar(const char* p, const char* end, char c)
+{
+#ifdef KUMA_TOKENIZER_AVX2
+    const __m256i n32 = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, n32)));
+        if (mask) {
+            return p + firstSetBit(mask);
+        }
+        p += 32;
+    }
+#endif
+#if defined(KUMA_TOKENIZER_SSE2)
+    const __m128i n16 = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, n16)));
+        if (mask) {
+            return p + firstSetBit(mask);
+        }
+        p += 16;
+    }
+#elif defined(KUMA_TOKENIZER_NEON)
+    const uint8x16_t n16 = vdupq_n_u8(static_cast<uint8_t>(c));
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+        uint8x16_t eq = vceqq_u8(v, n16);
+        // narrow each byte of the result to 4 bits
+        uint8x8_t res = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(res), 0);
+        if (mask) {
+            return p + (firstSetBit(mask) >> 2);
+        }
+        p += 16;
+    }
+#endif
+    return findCharScalar(p, end, c);
+}
+
+const char* findLineFeed(const char* p, const char* end)
+{
+    return findChar(p, end, '\n');
+}
+
+const char* findNonTokenChar(const char* p, const char* end)
+{
+#if defined(KUMA_TOKENIZER_SSE42_RUNTIME)
+    static const bool has_sse42 = cpuHasSSE42();
+    if (has_sse42) {
+        return findNonTokenCharSSE42(p, end);
+    }
+    return findNonTokenCharScalar(p, end);
+#elif defined(KUMA_TOKENIZER_SSE42)
+    return findNonTokenCharSSE42(p, end);
+#else
+    return findNonTokenCharScalar(p, end);
+#endif
+}
+
+bool isTokenChar(char c)
+{
+    return kTokenTable[static_cast<uint8_t>(c)] != 0;
+}
+
+KUMA_NS_END
@@ -0,0 +1,48 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __HttpTokenizer_H__
+#define __HttpTokenizer_H__
+
+#include "kmdefs.h"
+
+KUMA_NS_BEGIN
+
+/* scanners of HTTP/1 parser, the data is scanned 16 or 32 bytes at a time
+ * with SSE2/AVX2 or NEON, SSE4.2 is selected at runtime for token validation
+ * if CPU supports it, others fall back to byte by byte scan
+ */
+
+// return the first LF in [p, end), or end if not found
+const char* findLineFeed(const char* p, const char* end);
+
+// return the first c in [p, end), or end if not found
+const char* findChar(const char* p, const char* end, char c);
+
+// return the first byte which is not tchar of RFC 7230 in [p, end), or end if
+// all bytes are tchar
+const char* findNonTokenChar(const char* p, const char* end);
+
+bool isTokenChar(char c);
+
+KUMA_NS_END
+
+#endif /* __HttpTokenizer_H__ */
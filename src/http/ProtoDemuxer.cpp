@@ -0,0 +1,183 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "ProtoDemuxer.h"
+#include "util/kmtrace.h"
+
+#include <string.h>
+#include <algorithm>
+
+using namespace kuma;
+
+namespace {
+    const char kClientPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+    const size_t kClientPrefaceSize = sizeof(kClientPreface) - 1;
+    // big enough for the request header of most clients, the header that
+    // exceeds it is accumulated by parser
+    const size_t kRecvBufferSize = 4096;
+}
+
+ProtoDemuxer::ProtoDemuxer(EventLoop *loop)
+: tcp_(loop)
+, recv_buf_(kRecvBufferSize)
+{
+    KM_SetObjKey("ProtoDemuxer");
+}
+
+ProtoDemuxer::~ProtoDemuxer()
+{
+    
+}
+
+KMError ProtoDemuxer::attachFd(SOCKET_FD fd, uint32_t ssl_flags)
+{
+    // the parser is paused on header complete, the body is passed on as init data
+    http_parser_.setDataCallback([] (KMBuffer &) {});
+    http_parser_.setEventCallback([this] (HttpEvent ev) { onHttpEvent(ev); });
+    
+    tcp_.setWriteCallback([this] (KMError err) { onSend(err); });
+    tcp_.setReadCallback([this] (KMError err) { onReceive(err); });
+    tcp_.setErrorCallback([this] (KMError err) { onClose(err); });
+    tcp_.setSslFlags(ssl_flags);
+    return tcp_.attachFd(fd);
+}
+
+void ProtoDemuxer::close()
+{
+    tcp_.close();
+    http_parser_.reset();
+}
+
+void ProtoDemuxer::onSend(KMError)
+{
+    checkAlpn();
+}
+
+void ProtoDemuxer::onReceive(KMError)
+{
+    if (checkAlpn()) {
+        return;
+    }
+    do {
+        int ret = tcp_.receive(recv_buf_.writePtr(), recv_buf_.space());
+        if (ret < 0) {
+            onError(KMError::SOCK_ERROR);
+            return;
+        } else if (0 == ret) {
+            break;
+        }
+        recv_buf_.bytesWritten(ret);
+        if (demux()) {
+            // this object may be destroyed
+            return;
+        }
+    } while (true);
+}
+
+void ProtoDemuxer::onClose(KMError err)
+{
+    KUMA_INFOXTRACE("onClose, err="<<int(err));
+    onError(err);
+}
+
+void ProtoDemuxer::onHttpEvent(HttpEvent ev)
+{
+    switch (ev) {
+        case HttpEvent::HEADER_COMPLETE:
+            http_parser_.pause();
+            break;
+            
+        case HttpEvent::HTTP_ERROR:
+            KUMA_WARNXTRACE("onHttpEvent, invalid request");
+            onError(KMError::INVALID_PROTO);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+bool ProtoDemuxer::checkAlpn()
+{
+    if (!tcp_.sslEnabled()) {
+        return false;
+    }
+    char proto[16];
+    if (tcp_.getAlpnSelected(proto, sizeof(proto)) == KMError::NOERR && strcmp(proto, "h2") == 0) {
+        onDemuxed(Proto::HTTP2, nullptr);
+        return true;
+    }
+    return false;
+}
+
+bool ProtoDemuxer::demux()
+{
+    if (check_preface_) {
+        // HTTP/2 with prior knowledge
+        auto len = std::min(recv_buf_.length(), kClientPrefaceSize);
+        if (memcmp(recv_buf_.readPtr(), kClientPreface, len) == 0) {
+            if (len < kClientPrefaceSize) {
+                return false; // need more data
+            }
+            onDemuxed(Proto::HTTP2, &recv_buf_);
+            return true;
+        }
+        check_preface_ = false;
+    }
+    
+    DESTROY_DETECTOR_SETUP();
+    int bytes_used = http_parser_.parse(static_cast<const char*>(recv_buf_.readPtr()), recv_buf_.length());
+    DESTROY_DETECTOR_CHECK(true);
+    if (!http_parser_.headerComplete()) {
+        // the incomplete header is saved by parser
+        recv_buf_.clear();
+        return false;
+    }
+    recv_buf_.bytesRead(bytes_used);
+    if (http_parser_.isUpgradeTo("WebSocket")) {
+        onDemuxed(Proto::WEBSOCKET, &recv_buf_);
+    } else if (http_parser_.isUpgradeTo("h2c")) {
+        onDemuxed(Proto::HTTP2, &recv_buf_);
+    } else {
+        onDemuxed(Proto::HTTP1, &recv_buf_);
+    }
+    return true;
+}
+
+void ProtoDemuxer::onDemuxed(Proto proto, const KMBuffer *init_buf)
+{
+    KUMA_INFOXTRACE("onDemuxed, proto="<<int(proto));
+    if (init_buf && init_buf->length() == 0) {
+        init_buf = nullptr;
+    }
+    // this object may be destroyed in callback
+    if (demux_cb_) {
+        demux_cb_(proto, std::move(tcp_), std::move(http_parser_), init_buf);
+    }
+}
+
+void ProtoDemuxer::onError(KMError err)
+{
+    tcp_.close();
+    if (error_cb_) {
+        error_cb_(err);
+    }
+}
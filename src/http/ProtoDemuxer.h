@@ -0,0 +1,80 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __ProtoDemuxer_H__
+#define __ProtoDemuxer_H__
+
+#include "kmdefs.h"
+#include "kmapi.h"
+#include "util/kmobject.h"
+#include "util/DestroyDetector.h"
+
+KUMA_NS_BEGIN
+
+/* detect the protocol of an accepted connection by TLS ALPN, HTTP/2 connection
+ * preface or HTTP Upgrade header. the sniffed bytes are read into a refcounted
+ * buffer, the data that follows the request header is passed on by reference
+ */
+class ProtoDemuxer : public KMObject, public DestroyDetector
+{
+public:
+    enum class Proto {
+        HTTP1,
+        HTTP2,
+        WEBSOCKET
+    };
+    using DemuxCallback = std::function<void(Proto, TcpSocket&&, HttpParser&&, const KMBuffer*)>;
+    using ErrorCallback = std::function<void(KMError)>;
+    
+    ProtoDemuxer(EventLoop *loop);
+    ~ProtoDemuxer();
+    
+    KMError attachFd(SOCKET_FD fd, uint32_t ssl_flags);
+    void close();
+    
+    void setDemuxCallback(DemuxCallback cb) { demux_cb_ = std::move(cb); }
+    void setErrorCallback(ErrorCallback cb) { error_cb_ = std::move(cb); }
+    
+private:
+    void onSend(KMError err);
+    void onReceive(KMError err);
+    void onClose(KMError err);
+    void onHttpEvent(HttpEvent ev);
+    
+    bool checkAlpn();
+    // true if demuxed or failed, this object may be destroyed then
+    bool demux();
+    void onDemuxed(Proto proto, const KMBuffer *init_buf);
+    void onError(KMError err);
+    
+private:
+    TcpSocket       tcp_;
+    HttpParser      http_parser_;
+    KMBuffer        recv_buf_;
+    bool            check_preface_ = true;
+    
+    DemuxCallback   demux_cb_;
+    ErrorCallback   error_cb_;
+};
+
+KUMA_NS_END
+
+#endif
@@ -0,0 +1,535 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "StaticFileHandler.h"
+#include "Uri.h"
+#include "HttpCache.h"
+#include "util/util.h"
+#include "util/kmtrace.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace kuma;
+
+// at most this number of ranges are served in one multipart response
+#define MAX_BYTE_RANGES     16
+// one HTTP/2 DATA frame of default max frame size
+#define FILE_READ_SIZE      16*1024
+// the compressed variant is keyed by ETag, it is expired only to release memory
+#define VARIANT_MAX_AGE     3600
+
+namespace {
+struct MimeType
+{
+    const char* ext;
+    const std::string type;
+};
+
+const MimeType kMimeTypes[] = {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "css", "text/css" },
+    { "js", "application/javascript" },
+    { "mjs", "application/javascript" },
+    { "json", "application/json" },
+    { "map", "application/json" },
+    { "txt", "text/plain" },
+    { "xml", "text/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "webp", "image/webp" },
+    { "ico", "image/x-icon" },
+    { "wasm", "application/wasm" },
+    { "pdf", "application/pdf" },
+    { "mp4", "video/mp4" },
+    { "webm", "video/webm" },
+    { "mp3", "audio/mpeg" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "ttf", "font/ttf" },
+    { "zip", "application/zip" },
+    { "gz", "application/gzip" },
+};
+const std::string kDefaultMimeType = "application/octet-stream";
+
+// a piece of response body, the literal data, a byte range of file or the buffer
+struct BodyPiece
+{
+    std::string     data;
+    int64_t         offset = 0;
+    size_t          length = 0;
+    KMBuffer::Ptr   buf;
+    
+    size_t size() const { return data.empty() ? length : data.size(); }
+};
+using BodyPieces = std::vector<BodyPiece>;
+
+class FileBody
+{
+public:
+    FileBody(HttpResponse::Impl *rsp, FileCache::FilePtr file, BodyPieces pieces)
+    : rsp_(rsp), file_(std::move(file)), pieces_(std::move(pieces))
+    {
+        
+    }
+    
+    // write until the response is blocked
+    KMError write()
+    {
+        while (index_ < pieces_.size()) {
+            auto &piece = pieces_[index_];
+            auto remain = piece.size() - sent_;
+            int ret = 0;
+            if (!piece.data.empty()) {
+                ret = rsp_->sendData(piece.data.c_str() + sent_, remain);
+            } else if (piece.buf) {
+                KMBuffer::Ptr buf(piece.buf->subbuffer(sent_, std::min<size_t>(remain, FILE_READ_SIZE)));
+                ret = rsp_->sendData(*buf);
+            } else if (rsp_->canSendFile()) {
+                ret = rsp_->sendFile(file_->getFd(), piece.offset + sent_, remain);
+            } else {
+                auto buf = file_->read(piece.offset + sent_, std::min<size_t>(remain, FILE_READ_SIZE));
+                if (!buf) {
+                    return KMError::FAILED;
+                }
+                ret = rsp_->sendData(*buf);
+            }
+            if (ret < 0) {
+                return KMError::SOCK_ERROR;
+            } else if (0 == ret) {
+                break; // wait for write event
+            }
+            sent_ += ret;
+            if (sent_ >= piece.size()) {
+                ++index_;
+                sent_ = 0;
+            }
+        }
+        return KMError::NOERR;
+    }
+    
+private:
+    HttpResponse::Impl*     rsp_;
+    FileCache::FilePtr      file_;
+    BodyPieces              pieces_;
+    size_t                  index_ = 0;
+    size_t                  sent_ = 0;
+};
+
+bool matchETag(const std::string &etags, const std::string &etag, bool weak)
+{
+    bool matched = false;
+    for_each_token(etags, ',', [&] (std::string &tag) {
+        if (tag == "*") {
+            matched = true;
+        } else if (weak && tag.compare(0, 2, "W/") == 0) {
+            matched = tag.compare(2, std::string::npos, etag) == 0;
+        } else {
+            matched = tag == etag;
+        }
+        return !matched;
+    });
+    return matched;
+}
+
+bool parseInt64(const std::string &str, size_t begin, size_t end, int64_t &value)
+{
+    if (begin >= end || end - begin > 18) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = begin; i < end; ++i) {
+        if (str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (str[i] - '0');
+    }
+    return true;
+}
+
+std::string contentRange(int64_t first, int64_t last, int64_t size)
+{
+    return "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size);
+}
+
+// the ETag of variant, "5c354c75-6ef" to "5c354c75-6ef-gzip"
+std::string variantETag(const std::string &etag, ContentEncoder::Type type)
+{
+    if (etag.size() < 2 || etag.back() != '"') {
+        return etag;
+    }
+    return etag.substr(0, etag.size() - 1) + "-" + ContentEncoder::getName(type) + "\"";
+}
+} // namespace
+
+StaticFileHandler::Impl::Impl(std::string doc_root, std::string url_prefix)
+: doc_root_(std::move(doc_root)), url_prefix_(std::move(url_prefix))
+{
+    while (!doc_root_.empty() && (doc_root_.back() == '/' || doc_root_.back() == '\\')) {
+        doc_root_.pop_back();
+    }
+    if (url_prefix_.empty() || url_prefix_.back() != '/') {
+        url_prefix_ += '/';
+    }
+    uint64_t seed = 0;
+    generateRandomBytes(reinterpret_cast<uint8_t*>(&seed), sizeof(seed));
+    boundary_seq_ = seed;
+}
+
+KMError StaticFileHandler::Impl::setCacheOptions(uint32_t ttl_ms, size_t max_files)
+{
+    file_cache_.setOptions(ttl_ms, max_files);
+    return KMError::NOERR;
+}
+
+KMError StaticFileHandler::Impl::setContentEncoding(const std::string &encodings, int level, size_t max_size)
+{
+    auto types = ContentEncoder::parseEncodings(encodings);
+    if (types.empty()) {
+        return KMError::UNSUPPORT;
+    }
+    encodings_ = std::move(types);
+    encoding_level_ = level;
+    max_encoding_size_ = max_size;
+    return KMError::NOERR;
+}
+
+KMError StaticFileHandler::Impl::serve(HttpResponse::Impl *rsp)
+{
+    std::string url_path = rsp->getPath();
+    if (is_equal(rsp->getVersion(), VersionHTTP2_0)) {
+        // the path of HTTP/2 request is not decoded and has query
+        auto pos = url_path.find('?');
+        if (pos != std::string::npos) {
+            url_path.resize(pos);
+        }
+        url_path = Uri::decode(url_path);
+    }
+    auto prefix_len = url_prefix_.size() - 1; // "/static/" matches "/static"
+    if (url_path.compare(0, prefix_len, url_prefix_, 0, prefix_len) != 0 ||
+        (url_path.size() > prefix_len && url_path[prefix_len] != '/')) {
+        return KMError::NOT_EXIST;
+    }
+    auto const &method = rsp->getMethod();
+    if (!is_equal(method, "GET") && !is_equal(method, "HEAD")) {
+        rsp->addHeader("Allow", "GET, HEAD");
+        return sendError(rsp, 405);
+    }
+    std::string path;
+    if (!mapPath(url_path.substr(prefix_len), path)) {
+        return sendError(rsp, 404);
+    }
+    FileCache::FilePtr file;
+    auto ret = file_cache_.open(path, file);
+    if (ret == KMError::NOERR && file->isDirectory()) {
+        if (url_path.empty() || url_path.back() != '/') {
+            rsp->addHeader("Location", url_path + "/");
+            return sendError(rsp, 301);
+        }
+        path += PATH_SEPARATOR;
+        path += "index.html";
+        ret = file_cache_.open(path, file);
+        if (ret == KMError::NOERR && file->isDirectory()) {
+            ret = KMError::NOT_EXIST;
+        }
+    }
+    if (ret == KMError::NOT_EXIST) {
+        return sendError(rsp, 404);
+    } else if (ret != KMError::NOERR) {
+        return sendError(rsp, 403);
+    }
+    return sendFile(rsp, path, file);
+}
+
+bool StaticFileHandler::Impl::mapPath(std::string url_path, std::string &file_path) const
+{
+    file_path = doc_root_;
+    size_t pos = 0;
+    while (pos < url_path.size()) {
+        auto end = url_path.find('/', pos);
+        if (end == std::string::npos) {
+            end = url_path.size();
+        }
+        auto len = end - pos;
+        if (len > 0) {
+            auto seg = url_path.c_str() + pos;
+            if ((len == 1 && seg[0] == '.') || (len == 2 && seg[0] == '.' && seg[1] == '.')) {
+                // no way out of document root
+                return false;
+            }
+            if (memchr(seg, '\0', len) || memchr(seg, '\\', len) || memchr(seg, ':', len)) {
+                return false;
+            }
+            file_path += PATH_SEPARATOR;
+            file_path.append(seg, len);
+        }
+        pos = end + 1;
+    }
+    return true;
+}
+
+KMError StaticFileHandler::Impl::sendError(HttpResponse::Impl *rsp, int status_code)
+{
+    rsp->addHeader(strContentLength, (uint32_t)0);
+    return rsp->sendResponse(status_code, EmptyString);
+}
+
+bool StaticFileHandler::Impl::isNotModified(HttpResponse::Impl *rsp, const FileCache::File &file, const std::string &etag) const
+{
+    const char *value = rsp->getHeaderValue("If-None-Match");
+    if (value && *value) {
+        return matchETag(value, etag, true);
+    }
+    // the client sends back the Last-Modified value it got
+    value = rsp->getHeaderValue("If-Modified-Since");
+    return value && file.getLastModified() == value;
+}
+
+KMError StaticFileHandler::Impl::sendFile(HttpResponse::Impl *rsp, const std::string &path, const FileCache::FilePtr &file)
+{
+    auto const &mime_type = getMimeType(path);
+    auto file_size = file->getSize();
+    const char *range = rsp->getHeaderValue("Range");
+    if (!encodings_.empty() && file_size > 0 && static_cast<size_t>(file_size) <= max_encoding_size_ &&
+        isCompressible(mime_type)) {
+        rsp->addHeader("Vary", "Accept-Encoding");
+        auto type = ContentEncoder::negotiate(encodings_, rsp->getHeaderValue("Accept-Encoding"));
+        // the byte ranges are served from the identity
+        if (type != ContentEncoder::Type::IDENTITY && !(range && *range)) {
+            return sendVariant(rsp, path, file, type);
+        }
+    }
+    rsp->addHeader("ETag", file->getETag());
+    rsp->addHeader("Last-Modified", file->getLastModified());
+    if (isNotModified(rsp, *file, file->getETag())) {
+        return rsp->sendResponse(304, EmptyString);
+    }
+    rsp->addHeader("Accept-Ranges", "bytes");
+    
+    int status_code = 200;
+    RangeVector ranges;
+    if (range && *range && is_equal(rsp->getMethod(), "GET")) {
+        const char *if_range = rsp->getHeaderValue("If-Range");
+        bool fresh = !if_range || !*if_range || file->getETag() == if_range || file->getLastModified() == if_range;
+        if (fresh && parseRange(range, file_size, ranges)) {
+            if (ranges.empty()) {
+                rsp->addHeader("Content-Range", "bytes */" + std::to_string(file_size));
+                return sendError(rsp, 416);
+            } else if (ranges.size() > MAX_BYTE_RANGES) {
+                ranges.clear();
+            } else {
+                status_code = 206;
+            }
+        }
+    }
+    
+    BodyPieces pieces;
+    int64_t content_length = 0;
+    if (ranges.empty()) {
+        rsp->addHeader(strContentType, mime_type);
+        if (file_size > 0) {
+            BodyPiece piece;
+            piece.length = static_cast<size_t>(file_size);
+            pieces.push_back(std::move(piece));
+        }
+        content_length = file_size;
+    } else if (ranges.size() == 1) {
+        rsp->addHeader(strContentType, mime_type);
+        rsp->addHeader("Content-Range", contentRange(ranges[0].first, ranges[0].last, file_size));
+        BodyPiece piece;
+        piece.offset = ranges[0].first;
+        piece.length = static_cast<size_t>(ranges[0].last - ranges[0].first + 1);
+        content_length = piece.length;
+        pieces.push_back(std::move(piece));
+    } else {
+        char boundary[24];
+        snprintf(boundary, sizeof(boundary), "%016llx", (unsigned long long)++boundary_seq_);
+        rsp->addHeader(strContentType, std::string("multipart/byteranges; boundary=") + boundary);
+        for (auto const &r : ranges) {
+            BodyPiece hdr;
+            hdr.data = std::string("\r\n--") + boundary + "\r\nContent-Type: " + mime_type +
+                "\r\nContent-Range: " + contentRange(r.first, r.last, file_size) + "\r\n\r\n";
+            content_length += hdr.data.size();
+            pieces.push_back(std::move(hdr));
+            BodyPiece piece;
+            piece.offset = r.first;
+            piece.length = static_cast<size_t>(r.last - r.first + 1);
+            content_length += piece.length;
+            pieces.push_back(std::move(piece));
+        }
+        BodyPiece tail;
+        tail.data = std::string("\r\n--") + boundary + "--\r\n";
+        content_length += tail.data.size();
+        pieces.push_back(std::move(tail));
+    }
+    rsp->addHeader(strContentLength, std::to_string(content_length));
+    if (!pieces.empty() && is_equal(rsp->getMethod(), "GET")) {
+        auto body = std::make_shared<FileBody>(rsp, file, std::move(pieces));
+        rsp->setBodyWriter([body] { return body->write(); });
+    }
+    auto ret = rsp->sendResponse(status_code, EmptyString);
+    if (ret != KMError::NOERR) {
+        rsp->setBodyWriter(nullptr);
+    }
+    return ret;
+}
+
+KMError StaticFileHandler::Impl::sendVariant(HttpResponse::Impl *rsp, const std::string &path,
+                                             const FileCache::FilePtr &file, ContentEncoder::Type type)
+{
+    auto etag = variantETag(file->getETag(), type);
+    rsp->addHeader("ETag", etag);
+    rsp->addHeader("Last-Modified", file->getLastModified());
+    if (isNotModified(rsp, *file, etag)) {
+        return rsp->sendResponse(304, EmptyString);
+    }
+    auto variant = getVariant(path, file, type, etag);
+    if (!variant) {
+        return sendError(rsp, 500);
+    }
+    rsp->addHeader(strContentType, getMimeType(path));
+    rsp->addHeader("Content-Encoding", ContentEncoder::getName(type));
+    BodyPiece piece;
+    piece.length = variant->chainLength();
+    piece.buf = std::move(variant);
+    rsp->addHeader(strContentLength, std::to_string(piece.length));
+    if (is_equal(rsp->getMethod(), "GET")) {
+        BodyPieces pieces;
+        pieces.push_back(std::move(piece));
+        auto body = std::make_shared<FileBody>(rsp, file, std::move(pieces));
+        rsp->setBodyWriter([body] { return body->write(); });
+    }
+    auto ret = rsp->sendResponse(200, EmptyString);
+    if (ret != KMError::NOERR) {
+        rsp->setBodyWriter(nullptr);
+    }
+    return ret;
+}
+
+KMBuffer::Ptr StaticFileHandler::Impl::getVariant(const std::string &path, const FileCache::FilePtr &file,
+                                                  ContentEncoder::Type type, const std::string &etag)
+{
+    // the key is changed with ETag when the file is changed
+    auto key = "variant:" + etag + ":" + path;
+    static const HeaderVector no_headers;
+    auto entry = HttpCache::instance().getCache(key, no_headers);
+    if (entry && entry->getBody()) {
+        // the compressed data is shared with the cache entry
+        return KMBuffer::Ptr(entry->getBody()->clone());
+    }
+    auto data = file->read(0, static_cast<size_t>(file->getSize()));
+    if (!data) {
+        return KMBuffer::Ptr();
+    }
+    KMBuffer::Ptr variant;
+    auto ret = ContentEncoder::encodeAll(type, encoding_level_, *data, variant);
+    if (ret != KMError::NOERR || !variant) {
+        KUMA_ERRTRACE("StaticFileHandler::getVariant, failed to encode, path=" << path << ", err=" << int(ret));
+        return KMBuffer::Ptr();
+    }
+    HeaderVector headers;
+    headers.emplace_back(strCacheControl, "max-age=" + std::to_string(VARIANT_MAX_AGE));
+    HttpCache::instance().setCache(key, no_headers, 200, std::move(headers), variant.get());
+    return variant;
+}
+
+bool StaticFileHandler::Impl::parseRange(const std::string &value, int64_t file_size, RangeVector &ranges)
+{
+    ranges.clear();
+    static const std::string bytes_unit = "bytes=";
+    if (value.size() <= bytes_unit.size() || !is_equal(value, bytes_unit, (int)bytes_unit.size())) {
+        return false;
+    }
+    bool valid = true;
+    std::string specs = value.substr(bytes_unit.size());
+    for_each_token(specs, ',', [&] (std::string &spec) {
+        auto pos = spec.find('-');
+        if (pos == std::string::npos) {
+            valid = false;
+            return false;
+        }
+        int64_t first = 0, last = file_size - 1;
+        if (0 == pos) { // suffix range "-500"
+            int64_t suffix = 0;
+            if (!parseInt64(spec, 1, spec.size(), suffix)) {
+                valid = false;
+                return false;
+            }
+            if (0 == suffix || 0 == file_size) {
+                return true; // unsatisfiable
+            }
+            first = suffix < file_size ? file_size - suffix : 0;
+        } else {
+            if (!parseInt64(spec, 0, pos, first) ||
+                (pos + 1 < spec.size() && !parseInt64(spec, pos + 1, spec.size(), last))) {
+                valid = false;
+                return false;
+            }
+            if (pos + 1 < spec.size() && last < first) {
+                valid = false;
+                return false;
+            }
+            if (first >= file_size) {
+                return true; // unsatisfiable
+            }
+            if (last >= file_size) {
+                last = file_size - 1;
+            }
+        }
+        ByteRange r;
+        r.first = first;
+        r.last = last;
+        ranges.push_back(r);
+        return ranges.size() <= MAX_BYTE_RANGES;
+    });
+    if (!valid) {
+        ranges.clear();
+    }
+    return valid;
+}
+
+bool StaticFileHandler::Impl::isCompressible(const std::string &mime_type)
+{
+    return is_equal(mime_type, "text/", 5) ||
+        is_equal(mime_type, "application/javascript") ||
+        is_equal(mime_type, "application/json") ||
+        is_equal(mime_type, "image/svg+xml") ||
+        is_equal(mime_type, "application/wasm");
+}
+
+const std::string& StaticFileHandler::Impl::getMimeType(const std::string &path)
+{
+    auto pos = path.find_last_of("./\\");
+    if (pos == std::string::npos || path[pos] != '.') {
+        return kDefaultMimeType;
+    }
+    auto ext = path.c_str() + pos + 1;
+    for (auto const &mt : kMimeTypes) {
+        if (is_equal(ext, mt.ext)) {
+            return mt.type;
+        }
+    }
+    return kDefaultMimeType;
+}
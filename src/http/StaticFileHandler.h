@@ -0,0 +1,88 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __StaticFileHandler_H__
+#define __StaticFileHandler_H__
+
+#include "kmdefs.h"
+#include "kmapi.h"
+#include "HttpResponseImpl.h"
+#include "FileCache.h"
+#include "ContentEncoder.h"
+
+#include <string>
+#include <atomic>
+
+KUMA_NS_BEGIN
+
+class StaticFileHandler::Impl
+{
+public:
+    Impl(std::string doc_root, std::string url_prefix);
+    
+    KMError setCacheOptions(uint32_t ttl_ms, size_t max_files);
+    KMError setContentEncoding(const std::string &encodings, int level, size_t max_size);
+    KMError serve(HttpResponse::Impl *rsp);
+    
+    // the byte range of file, the last byte included
+    struct ByteRange
+    {
+        int64_t first = 0;
+        int64_t last = 0;
+    };
+    using RangeVector = std::vector<ByteRange>;
+    /* parse Range header value "bytes=0-99,200-,-50" into satisfiable ranges of
+     * file_size. false if the value is invalid, and the header should be ignored
+     */
+    static bool parseRange(const std::string &value, int64_t file_size, RangeVector &ranges);
+    static const std::string& getMimeType(const std::string &path);
+    static bool isCompressible(const std::string &mime_type);
+    /* map url_path under url prefix to the file in doc root. false if any segment
+     * is "." or "..", or has '\0', '\\' or ':', so the path can't get out of doc root
+     */
+    bool mapPath(std::string url_path, std::string &file_path) const;
+    
+private:
+    KMError sendError(HttpResponse::Impl *rsp, int status_code);
+    KMError sendFile(HttpResponse::Impl *rsp, const std::string &path, const FileCache::FilePtr &file);
+    KMError sendVariant(HttpResponse::Impl *rsp, const std::string &path, const FileCache::FilePtr &file,
+                        ContentEncoder::Type type);
+    /* the compressed file of type, it is compressed once and kept in HttpCache until
+     * the file is changed
+     */
+    KMBuffer::Ptr getVariant(const std::string &path, const FileCache::FilePtr &file,
+                             ContentEncoder::Type type, const std::string &etag);
+    bool isNotModified(HttpResponse::Impl *rsp, const FileCache::File &file, const std::string &etag) const;
+    
+private:
+    std::string                 doc_root_;
+    std::string                 url_prefix_;
+    FileCache                   file_cache_;
+    std::atomic<uint64_t>       boundary_seq_;
+    
+    ContentEncoder::TypeVector  encodings_;
+    int                         encoding_level_ = -1;
+    size_t                      max_encoding_size_ = 0;
+};
+
+KUMA_NS_END
+
+#endif
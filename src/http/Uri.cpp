@@ -23,6 +23,31 @@
 
 using namespace kuma;
 
+namespace {
+    int hex_value(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+    
+    std::string percent_decode(const std::string &str)
+    {
+        std::string out;
+        out.reserve(str.size());
+        for (size_t i = 0; i < str.size(); ++i) {
+            if (str[i] == '%' && i + 2 < str.size() && hex_value(str[i+1]) >= 0 && hex_value(str[i+2]) >= 0) {
+                out.push_back(char(hex_value(str[i+1]) << 4 | hex_value(str[i+2])));
+                i += 2;
+            } else {
+                out.push_back(str[i]);
+            }
+        }
+        return out;
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////
 Uri::Uri()
 {
@@ -56,7 +81,16 @@ bool Uri::parse(const std::string& url)
             hostport.assign(url.begin()+pos, url.begin()+path_pos);
         }
         pos = path_pos;
-        parse_host_port(hostport, host_, port_);
+        static const std::string unix_suffix = "+unix";
+        if (scheme_.size() > unix_suffix.size() &&
+            scheme_.compare(scheme_.size() - unix_suffix.size(), unix_suffix.size(), unix_suffix) == 0) {
+            scheme_.resize(scheme_.size() - unix_suffix.size());
+            unix_path_ = percent_decode(hostport);
+            host_ = "localhost";
+            port_.clear();
+        } else {
+            parse_host_port(hostport, host_, port_);
+        }
     } else {
         pos = 0;
     }
@@ -92,6 +126,19 @@ bool Uri::parse(const std::string& url)
     return true;
 }
 
+std::string Uri::decode(const std::string &str)
+{
+    return percent_decode(str);
+}
+
+std::string Uri::getConnectHost() const
+{
+    if (!unix_path_.empty()) {
+        return "unix:" + unix_path_;
+    }
+    return host_;
+}
+
 bool Uri::parse_host_port(const std::string& hostport, std::string& host, std::string& port)
 {
     host.clear();
@@ -45,6 +45,16 @@ public:
     const std::string& getQuery() const { return query_; }
     const std::string& getFragment() const { return fragment_; }
     
+    /* true if scheme is "http+unix", "ws+unix"... the "+unix" is stripped from
+     * scheme and the decoded socket path is kept in unix path
+     */
+    bool isUnixSocket() const { return !unix_path_.empty(); }
+    const std::string& getUnixPath() const { return unix_path_; }
+    // host for TcpSocket::connect, "unix:<path>" for unix domain socket
+    std::string getConnectHost() const;
+    
+    static std::string decode(const std::string &str);
+    
 private:
     bool parse_host_port(const std::string& hostport, std::string& host, std::string& port);
 
@@ -55,6 +65,7 @@ private:
 	std::string         path_;
     std::string         query_;
     std::string         fragment_;
+    std::string         unix_path_;
 };
 
 KUMA_NS_END
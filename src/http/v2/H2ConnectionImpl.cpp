@@ -145,7 +145,10 @@ KMError H2Connection::Impl::attachSocket(TcpSocket::Impl&& tcp, HttpParser::Impl
     KUMA_ASSERT(parser.isRequest());
     http_parser_ = std::move(parser);
     next_stream_id_ = 2;
-    if (tcp.sslEnabled()) {
+    // no upgrade request is parsed for ALPN h2 or cleartext with prior knowledge,
+    // the client preface is expected then
+    bool wait_preface = tcp.sslEnabled() || !http_parser_.headerComplete();
+    if (wait_preface) {
         setState(State::HANDSHAKE);
     } else {
         setState(State::UPGRADING);
@@ -156,7 +159,7 @@ KMError H2Connection::Impl::attachSocket(TcpSocket::Impl&& tcp, HttpParser::Impl
         return ret;
     }
     
-    if (tcp.sslEnabled()) {
+    if (wait_preface) {
         sendPreface();
         return KMError::NOERR;
     } else {
@@ -186,7 +189,7 @@ KMError H2Connection::Impl::close()
 
 KMError H2Connection::Impl::sendH2Frame(H2Frame *frame)
 {
-    if (!sendBufferEmpty() && !isControlFrame(frame) && 
+    if (sendBufferBlocked() && !isControlFrame(frame) && 
         !(frame->getFlags() & H2_FRAME_FLAG_END_STREAM)) {
         appendBlockedStream(frame->getStreamId());
         return KMError::AGAIN;
@@ -792,12 +795,12 @@ void H2Connection::Impl::appendBlockedStream(uint32_t stream_id)
 
 void H2Connection::Impl::notifyBlockedStreams()
 {
-    if (!sendBufferEmpty() || remoteWindowSize() == 0) {
+    if (sendBufferBlocked() || remoteWindowSize() == 0) {
         return;
     }
     auto streams = std::move(blocked_streams_);
     auto it = streams.begin();
-    while (it != streams.end() && sendBufferEmpty() && remoteWindowSize() > 0) {
+    while (it != streams.end() && !sendBufferBlocked() && remoteWindowSize() > 0) {
         uint32_t stream_id = it->second;
         it = streams.erase(it);
         auto stream = getStream(stream_id);
@@ -876,7 +879,7 @@ std::string H2Connection::Impl::buildUpgradeResponse()
     std::stringstream ss;
     ss << "HTTP/1.1 101 Switching Protocols\r\n";
     ss << "Connection: Upgrade\r\n";
-    ss << "Upgrade: "<< http_parser_.getHeaderValue("Upgrade") <<"\r\n";
+    ss << "Upgrade: "<< http_parser_.getHeaderValue(HeaderId::UPGRADE) <<"\r\n";
     ss << "\r\n";
     return ss.str();
 }
@@ -961,7 +964,7 @@ void H2Connection::Impl::onConnect(KMError err)
 }
 
 void H2Connection::Impl::onWrite()
-{// send_buffer_ must be empty
+{// send_buffer_ is empty or below low watermark
     if(isServer() && getState() == State::UPGRADING) {
         // upgrade response is sent out, waiting for client preface
         setState(State::HANDSHAKE);
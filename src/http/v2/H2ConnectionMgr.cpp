@@ -54,8 +54,10 @@ H2ConnectionPtr H2ConnectionMgr::getConnection(const std::string &host, uint16_t
     std::string key;
     std::string ip;
     sockaddr_storage ss_addr = { 0 };
-    auto ret = DnsResolver::get().resolve(host, port, ss_addr);
-    if (ret == KMError::NOERR && km_get_sock_addr(ss_addr, ip, nullptr) == 0) {
+    if (km_is_unix_address(host)) {
+        key = host;
+    } else if (DnsResolver::get().resolve(host, port, ss_addr) == KMError::NOERR &&
+               km_get_sock_addr(ss_addr, ip, nullptr) == 0) {
         key = ip + ":" + std::to_string(port);
     } else {
         key = host + ":" + std::to_string(port);
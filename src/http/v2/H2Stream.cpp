@@ -189,10 +189,13 @@ KMError H2Stream::sendWindowUpdate(uint32_t delta)
 
 void H2Stream::close()
 {
-    if (getState() == State::CLOSED || getState() == State::IDLE) {
+    if (getState() == State::IDLE) {
         return;
     }
-    streamError(H2Error::CANCEL);
+    if (getState() != State::CLOSED) {
+        streamError(H2Error::CANCEL);
+    }
+    // remove the stream from connection, no frame of it will be dispatched after closed
     if (conn_) {
         conn_->removeStream(getStreamId());
     }
@@ -218,6 +221,15 @@ void H2Stream::endStreamReceived()
     }
 }
 
+void H2Stream::onTailerCompleted()
+{
+    // the tailer is discarded, the stream is ended by it
+    if (end_stream_received_ && data_cb_) {
+        KMBuffer buf;
+        data_cb_(buf, true);
+    }
+}
+
 void H2Stream::onHeaderCompleted(HeaderVector &headers, bool end_stream)
 {
     if (isPromisedStream(getStreamId())) {
@@ -320,6 +332,8 @@ bool H2Stream::handleHeadersFrame(HeadersFrame *frame)
     }
     if (!is_tailer && headers_end_) {
         onHeaderCompleted(frame->getHeaders(), end_stream);
+    } else if (is_tailer && tailers_end_) {
+        onTailerCompleted();
     }
     return true;
 }
@@ -420,6 +434,8 @@ bool H2Stream::handleContinuationFrame(ContinuationFrame *frame)
     }
     if (!is_tailer && headers_end_) {
         onHeaderCompleted(frame->getHeaders(), end_stream);
+    } else if (is_tailer && end_headers) {
+        onTailerCompleted();
     }
     return true;
 }
@@ -479,6 +495,11 @@ bool H2Stream::verifyFrame(H2Frame *frame)
                 return false;
             }
             if (end_stream_received_ && frame->type() != H2FrameType::PRIORITY) {
+                if (end_stream_sent_ && (frame->type() == H2FrameType::RST_STREAM ||
+                                         frame->type() == H2FrameType::WINDOW_UPDATE)) {
+                    // peer may send them before END_STREAM sent is received
+                    break;
+                }
                 connectionError(H2Error::STREAM_CLOSED);
                 return false;
             }
@@ -93,6 +93,7 @@ protected:
     void endStreamSent();
     void endStreamReceived();
     void onHeaderCompleted(HeaderVector &headers, bool end_stream);
+    void onTailerCompleted();
     
     KMError sendRSTStream(H2Error err);
     bool verifyFrame(H2Frame *frame);
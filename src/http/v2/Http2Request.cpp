@@ -95,7 +95,7 @@ KMError Http2Request::sendRequest()
     }
     
     auto &conn_mgr = H2ConnectionMgr::getRequestConnMgr(ssl_flags != SSL_NONE);
-    conn_ = conn_mgr.getConnection(uri_.getHost(), port, ssl_flags, loop);
+    conn_ = conn_mgr.getConnection(uri_.getConnectHost(), port, ssl_flags, loop);
     if (!conn_ || !conn_->eventLoop()) {
         KUMA_ERRXTRACE("sendRequest, failed to get H2Connection");
         return KMError::INVALID_PARAM;
@@ -136,30 +136,49 @@ KMError Http2Request::sendRequest_i()
 
 bool Http2Request::processHttpCache(const EventLoopPtr &loop)
 {
-    if (!HttpCache::isCacheable(method_, header_vec_)) {
+    auto entry = getCacheEntry(header_vec_);
+    if (!entry) {
         return false;
     }
-    std::string cache_key = getCacheKey();
-    
-    int status_code = 0;
-    HeaderVector rsp_headers;
-    KMBuffer rsp_body;
-    if (HttpCache::instance().getCache(cache_key, status_code, rsp_headers, rsp_body)) {
-        // cache hit
-        setState(State::RECVING_RESPONSE);
-        status_code_ = status_code;
-        rsp_headers_.swap(rsp_headers);
-        if (!rsp_body.empty()) {
-            saveResponseData(rsp_body);
-        }
-        header_complete_ = true;
-        response_complete_ = true;
-        loop->post([this] {
-            onCacheComplete();
-        }, &loop_token_);
-        return true;
+    // cache hit
+    applyCacheEntry(*entry, loop);
+    return true;
+}
+
+bool Http2Request::processStaleCache()
+{// on loop_ thread
+    // the stale response cannot be served once the response header is delivered
+    if (getState() > State::RECVING_RESPONSE || header_complete_) {
+        return false;
+    }
+    auto loop = loop_.lock();
+    if (!loop) {
+        return false;
+    }
+    auto entry = getStaleCacheEntry();
+    if (!entry) {
+        return false;
+    }
+    KUMA_INFOXTRACE("processStaleCache, key=" << cache_key_);
+    applyCacheEntry(*entry, loop);
+    return true;
+}
+
+void Http2Request::applyCacheEntry(const HttpCache::Entry &entry, const EventLoopPtr &loop)
+{
+    setState(State::RECVING_RESPONSE);
+    status_code_ = entry.getStatusCode();
+    rsp_headers_ = getCacheHeaders(entry);
+    rsp_slots_.build(rsp_headers_);
+    if (entry.getBody()) {
+        // the body data is shared with the cache entry
+        saveResponseData(*entry.getBody());
     }
-    return false;
+    header_complete_ = true;
+    response_complete_ = true;
+    loop->post([this] {
+        onCacheComplete();
+    }, &loop_token_);
 }
 
 bool Http2Request::processPushPromise()
@@ -187,6 +206,7 @@ bool Http2Request::processPushPromise()
     if (header_complete_ && !processH2ResponseHeaders(h2_headers, status_code_, rsp_headers_)) {
         return false;
     }
+    rsp_slots_.build(rsp_headers_);
     if (!rsp_body.empty()) {
         saveResponseData(rsp_body);
     }
@@ -204,20 +224,25 @@ bool Http2Request::processPushPromise()
     return true;
 }
 
-const std::string& Http2Request::getHeaderValue(std::string name) const
+const char* Http2Request::getHeaderValue(const char* name) const
 {
+    auto id = getHeaderId(name, strlen(name));
+    if (id != HeaderId::UNKNOWN) {
+        auto index = rsp_slots_.get(id);
+        return index >= 0 ? rsp_headers_[index].second.c_str() : EmptyString.c_str();
+    }
     for (auto const &kv : rsp_headers_) {
         if (is_equal(kv.first, name)) {
-            return kv.second;
+            return kv.second.c_str();
         }
     }
-    return EmptyString;
+    return EmptyString.c_str();
 }
 
 void Http2Request::forEachHeader(EnumrateCallback cb)
 {
     for (auto &kv : rsp_headers_) {
-        cb(kv.first, kv.second);
+        cb(kv.first.c_str(), kv.second.c_str());
     }
 }
 
@@ -448,6 +473,7 @@ void Http2Request::onHeaders(const HeaderVector &headers, bool end_stream)
     if (!processH2ResponseHeaders(headers, status_code_, rsp_headers_)) {
         return;
     }
+    rsp_slots_.build(rsp_headers_);
     header_complete_ = true;
     response_complete_ = end_stream;
     auto loop = loop_.lock();
@@ -463,6 +489,7 @@ void Http2Request::onData(KMBuffer &buf, bool end_stream)
     response_complete_ = end_stream;
     auto loop = loop_.lock();
     if (!loop || (loop->inSameThread() && rsp_queue_.empty())) {
+        appendCacheResponse(buf);
         DESTROY_DETECTOR_SETUP();
         if (data_cb_ && buf.chainLength() > 0) data_cb_(buf);
         DESTROY_DETECTOR_CHECK_VOID();
@@ -529,6 +556,9 @@ void Http2Request::onHeaders()
     if (getState() != State::RECVING_RESPONSE) {
         return;
     }
+    if (header_complete_ && !cache_key_.empty()) {
+        beginCacheResponse(status_code_, rsp_headers_);
+    }
     if (header_complete_ && header_cb_) {
         DESTROY_DETECTOR_SETUP();
         header_cb_();
@@ -547,6 +577,7 @@ void Http2Request::onData()
     
     while (!rsp_queue_.empty()) {
         auto &kmb = rsp_queue_.front();
+        if (kmb) appendCacheResponse(*kmb);
         DESTROY_DETECTOR_SETUP();
         if (kmb) data_cb_(*kmb);
         DESTROY_DETECTOR_CHECK_VOID();
@@ -559,6 +590,7 @@ void Http2Request::onData()
 
 void Http2Request::onComplete()
 {// on loop_ thread
+    endCacheResponse();
     setState(State::COMPLETE);
     if (response_cb_) response_cb_();
 }
@@ -593,6 +625,9 @@ void Http2Request::onWrite_i()
 
 void Http2Request::onError_i(KMError err)
 {// on loop_ thread
+    if (processStaleCache()) {
+        return;
+    }
     if(error_cb_) error_cb_(err);
 }
 
@@ -608,6 +643,7 @@ void Http2Request::reset()
     }
     
     rsp_headers_.clear();
+    rsp_slots_.clear();
     stream_->close();
     stream_.reset();
     
@@ -56,7 +56,7 @@ public:
     
     int getStatusCode() const override { return status_code_; }
     const std::string& getVersion() const override { return VersionHTTP2_0; }
-    const std::string& getHeaderValue(std::string name) const override;
+    const char* getHeaderValue(const char* name) const override;
     void forEachHeader(EnumrateCallback cb) override;
     
 protected:
@@ -77,6 +77,11 @@ protected:
      * check if HTTP cache is available
      */
     bool processHttpCache(const EventLoopPtr &loop);
+    /*
+     * serve the stale response allowed by stale-if-error when the request failed
+     */
+    bool processStaleCache();
+    void applyCacheEntry(const HttpCache::Entry &entry, const EventLoopPtr &loop);
     void saveRequestData(const void *data, size_t len);
     void saveRequestData(const KMBuffer &buf);
     void saveResponseData(const void *data, size_t len);
@@ -120,6 +125,7 @@ protected:
     // response
     int status_code_ = 0;
     HeaderVector rsp_headers_;
+    HeaderSlots rsp_slots_;
     KMQueue<KMBuffer::Ptr> rsp_queue_;
     bool header_complete_ = false;
     bool response_complete_ = false;
@@ -20,6 +20,7 @@
  */
 
 #include "Http2Response.h"
+#include "http/HttpDate.h"
 
 #include <algorithm>
 #include <string>
@@ -75,13 +76,24 @@ void Http2Response::addHeader(std::string name, std::string value)
     }
 }
 
+KMError Http2Response::addTrailer(std::string name, std::string value)
+{
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (!HttpHeader::isValidField(name, value)) {
+        return KMError::INVALID_PARAM;
+    }
+    trailers_.emplace_back(std::move(name), std::move(value));
+    return KMError::NOERR;
+}
+
 KMError Http2Response::sendResponse(int status_code, const std::string& desc, const std::string& ver)
 {
     KUMA_INFOXTRACE("sendResponse, status_code="<<status_code);
     setState(State::SENDING_HEADER);
     HeaderVector headers;
     size_t headersSize = buildHeaders(status_code, headers);
-    bool endStream = has_content_length_ && content_length_ == 0;
+    // the response to HEAD request has no body even if it has Content-Length
+    bool endStream = (has_content_length_ && content_length_ == 0) || is_equal(req_method_, "HEAD");
     auto ret = stream_->sendHeaders(headers, headersSize, endStream);
     if (ret == KMError::NOERR) {
         if (endStream) {
@@ -94,7 +106,7 @@ KMError Http2Response::sendResponse(int status_code, const std::string& desc, co
             setState(State::SENDING_BODY);
             auto loop = loop_.lock();
             if (loop) {
-                loop->post([this] { if (write_cb_) write_cb_(KMError::NOERR); }, &loop_token_);
+                loop->post([this] { notifyWrite(); }, &loop_token_);
             }
         }
     }
@@ -120,7 +132,7 @@ int Http2Response::sendData(const void* data, size_t len)
     }
     bool endStream = (!data && !len) || (has_content_length_ && body_bytes_sent_ >= content_length_);
     if (endStream) { // end stream
-        stream_->sendData(nullptr, 0, true);
+        sendEndStream();
         setState(State::COMPLETE);
         auto loop = loop_.lock();
         if (loop) {
@@ -150,7 +162,7 @@ int Http2Response::sendData(const KMBuffer &buf)
     }
     bool endStream = (!chain_len) || (has_content_length_ && body_bytes_sent_ >= content_length_);
     if (endStream) { // end stream
-        stream_->sendData(nullptr, 0, true);
+        sendEndStream();
         setState(State::COMPLETE);
         auto loop = loop_.lock();
         if (loop) {
@@ -160,6 +172,19 @@ int Http2Response::sendData(const KMBuffer &buf)
     return ret;
 }
 
+void Http2Response::sendEndStream()
+{
+    if (trailers_.empty()) {
+        stream_->sendData(nullptr, 0, true);
+        return;
+    }
+    size_t trailers_size = 0;
+    for (auto const &kv : trailers_) {
+        trailers_size += kv.first.size() + kv.second.size();
+    }
+    stream_->sendHeaders(trailers_, trailers_size, true);
+}
+
 void Http2Response::checkHeaders()
 {
     
@@ -172,6 +197,12 @@ size_t Http2Response::buildHeaders(int status_code, HeaderVector &headers)
     std::string str_status_code = std::to_string(status_code);
     headers.emplace_back(std::make_pair(H2HeaderStatus, str_status_code));
     headers_size += H2HeaderStatus.size() + str_status_code.size();
+    auto loop = loop_.lock();
+    if (loop && !hasHeader(HeaderId::DATE)) {
+        auto const &date = HttpDate::ofLoop(loop.get())->get();
+        headers.emplace_back("date", date);
+        headers_size += 4 + date.size();
+    }
     for (auto const &kv : header_vec_) {
         headers.emplace_back(kv.first, kv.second);
         headers_size += kv.first.size() + kv.second.size();
@@ -179,22 +210,27 @@ size_t Http2Response::buildHeaders(int status_code, HeaderVector &headers)
     return headers_size;
 }
 
-const std::string& Http2Response::getParamValue(std::string name) const {
-    return EmptyString;
+const char* Http2Response::getParamValue(const char* name) const {
+    return EmptyString.c_str();
 }
 
-const std::string& Http2Response::getHeaderValue(std::string name) const {
+const char* Http2Response::getHeaderValue(const char* name) const {
+    auto id = getHeaderId(name, strlen(name));
+    if (id != HeaderId::UNKNOWN) {
+        auto index = req_slots_.get(id);
+        return index >= 0 ? req_headers_[index].second.c_str() : EmptyString.c_str();
+    }
     for (auto const &kv : req_headers_) {
         if (is_equal(kv.first, name)) {
-            return kv.second;
+            return kv.second.c_str();
         }
     }
-    return EmptyString;
+    return EmptyString.c_str();
 }
 
 void Http2Response::forEachHeader(HttpParser::Impl::EnumrateCallback&& cb) {
     for (auto &kv : req_headers_) {
-        cb(kv.first, kv.second);
+        cb(kv.first.c_str(), kv.second.c_str());
     }
 }
 
@@ -232,12 +268,13 @@ void Http2Response::onHeaders(const HeaderVector &headers, bool end_stream)
     if (!str_cookie.empty()) {
         req_headers_.emplace_back(strCookie, std::move(str_cookie));
     }
+    req_slots_.build(req_headers_);
     DESTROY_DETECTOR_SETUP();
     if (header_cb_) header_cb_();
     DESTROY_DETECTOR_CHECK_VOID();
     if (end_stream) {
         setState(State::WAIT_FOR_RESPONSE);
-        if (request_cb_) request_cb_();
+        notifyRequestComplete();
     }
 }
 
@@ -249,7 +286,7 @@ void Http2Response::onData(KMBuffer &buf, bool end_stream)
     
     if (end_stream) {
         setState(State::WAIT_FOR_RESPONSE);
-        if (request_cb_) request_cb_();
+        notifyRequestComplete();
     }
 }
 
@@ -263,7 +300,7 @@ void Http2Response::onRSTStream(int err)
 
 void Http2Response::onWrite()
 {
-    if(write_cb_) write_cb_(KMError::NOERR);
+    notifyWrite();
 }
 
 KMError Http2Response::close()
@@ -36,6 +36,7 @@ public:
     
     KMError attachStream(H2Connection::Impl* conn, uint32_t stream_id) override;
     void addHeader(std::string name, std::string value) override;
+    KMError addTrailer(std::string name, std::string value) override;
     KMError sendResponse(int status_code, const std::string& desc, const std::string& ver) override;
     int sendData(const void* data, size_t len) override;
     int sendData(const KMBuffer &buf) override;
@@ -44,8 +45,8 @@ public:
     const std::string& getMethod() const override { return req_method_; }
     const std::string& getPath() const override { return req_path_; }
     const std::string& getVersion() const override { return VersionHTTP2_0; }
-    const std::string& getParamValue(std::string name) const override;
-    const std::string& getHeaderValue(std::string name) const override;
+    const char* getParamValue(const char* name) const override;
+    const char* getHeaderValue(const char* name) const override;
     void forEachHeader(HttpParser::Impl::EnumrateCallback&& cb) override;
     
 protected:
@@ -57,7 +58,9 @@ protected:
 private:
     void cleanup();
     void checkHeaders() override;
+    HttpHeader& getResponseHeader() override { return *this; }
     size_t buildHeaders(int status_code, HeaderVector &headers);
+    void sendEndStream();
     
 private:
     EventLoopWeakPtr        loop_;
@@ -65,9 +68,12 @@ private:
     
     // response
     size_t                  body_bytes_sent_ = 0;
+    // sent in HEADERS frame which ends the stream
+    HeaderVector            trailers_;
     
     // request
     HeaderVector            req_headers_;
+    HeaderSlots             req_slots_;
     std::string             req_method_;
     std::string             req_path_;
     
@@ -56,6 +56,15 @@ void IocpSocket::unregisterFd(SOCKET_FD fd, bool close_fd)
     IocpBase::unregisterFd(loop_.lock(), fd, close_fd);
 }
 
+KMError IocpSocket::connect_i(const DnsResolver::AddressList &addrs, uint32_t timeout_ms)
+{
+    // connection racing is not supported by ConnectEx, try the first address only
+    if (addrs.empty()) {
+        return KMError::INVALID_PARAM;
+    }
+    return connect_i(addrs[0], timeout_ms);
+}
+
 KMError IocpSocket::connect_i(const sockaddr_storage &ss_addr, uint32_t timeout_ms)
 {
     if (!connect_ex) {
@@ -47,6 +47,7 @@ public:
     
 protected:
     KMError connect_i(const sockaddr_storage &ss_addr, uint32_t timeout_ms) override;
+    KMError connect_i(const DnsResolver::AddressList &addrs, uint32_t timeout_ms) override;
     SOCKET_FD createFd(int addr_family) override;
     bool registerFd(SOCKET_FD fd) override;
     void unregisterFd(SOCKET_FD fd, bool close_fd) override;
@@ -22,6 +22,8 @@ LOCAL_SRC_FILES := \
     UdpSocketImpl.cpp \
     TimerManager.cpp \
     TcpListenerImpl.cpp \
+    TcpRelayImpl.cpp \
+    RateLimiter.cpp \
     TcpConnection.cpp \
     poll/EPoll.cpp \
     poll/VPoll.cpp \
@@ -29,13 +31,22 @@ LOCAL_SRC_FILES := \
     poll/Notifier.cpp \
     http/Uri.cpp \
     http/HttpHeader.cpp \
+    http/HttpDate.cpp \
     http/HttpMessage.cpp \
     http/HttpParserImpl.cpp \
+    http/HttpTokenizer.cpp \
     http/HttpRequestImpl.cpp \
     http/Http1xRequest.cpp \
+    http/Http1xConnectionPool.cpp \
     http/HttpResponseImpl.cpp \
     http/Http1xResponse.cpp \
     http/HttpCache.cpp \
+    http/ContentEncoder.cpp \
+    http/HttpRouter.cpp \
+    http/ProtoDemuxer.cpp \
+    http/HttpServerImpl.cpp \
+    http/FileCache.cpp \
+    http/StaticFileHandler.cpp \
     http/v2/H2Frame.cpp \
     http/v2/FrameParser.cpp \
     http/v2/FlowControl.cpp \
@@ -57,7 +68,11 @@ LOCAL_SRC_FILES := \
     ssl/BioHandler.cpp \
     ssl/SioHandler.cpp \
     ssl/OpenSslLib.cpp \
+    ssl/SslSessionCache.cpp \
+    ssl/SslCryptoPool.cpp \
+    ssl/SslContextMap.cpp \
     DnsResolver.cpp \
+    DnsClient.cpp \
     kmapi.cpp
 
 LOCAL_C_INCLUDES := \
@@ -65,8 +80,8 @@ LOCAL_C_INCLUDES := \
 	$(MY_ROOT)/vendor \
 	$(OPENSSL_PATH)/include
 
-LOCAL_LDLIBS := -ldl -llog -l$(OPENSSL_LIB_PATH)/libssl.a -l$(OPENSSL_LIB_PATH)/libcrypto.a
-LOCAL_CFLAGS := -w -O2 -D__ANDROID__ -DKUMA_HAS_OPENSSL
+LOCAL_LDLIBS := -ldl -llog -lz -l$(OPENSSL_LIB_PATH)/libssl.a -l$(OPENSSL_LIB_PATH)/libcrypto.a
+LOCAL_CFLAGS := -w -O2 -D__ANDROID__ -DKUMA_HAS_OPENSSL -DKUMA_HAS_ZLIB
 LOCAL_CPPFLAGS := -std=c++1z
 LOCAL_CPP_FEATURES := rtti exceptions
 
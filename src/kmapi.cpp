@@ -23,11 +23,17 @@
 #include "TcpSocketImpl.h"
 #include "UdpSocketImpl.h"
 #include "TcpListenerImpl.h"
+#include "TcpRelayImpl.h"
 #include "TimerManager.h"
 #include "http/HttpParserImpl.h"
 #include "http/Http1xRequest.h"
 #include "http/Http1xResponse.h"
+#include "http/Http1xConnectionPool.h"
 #include "http/HttpResponseImpl.h"
+#include "http/HttpServerImpl.h"
+#include "http/StaticFileHandler.h"
+#include "http/HttpCache.h"
+#include "http/HttpRouter.h"
 #include "ws/WebSocketImpl.h"
 #include "http/v2/H2ConnectionImpl.h"
 #include "http/v2/Http2Request.h"
@@ -35,11 +41,15 @@
 
 #ifdef KUMA_HAS_OPENSSL
 #include "ssl/OpenSslLib.h"
+#include "ssl/SslCryptoPool.h"
+#include "ssl/SslContextMap.h"
 #endif
 #include "DnsResolver.h"
 
 #include "kmapi.h"
 
+#include <string.h>
+
 KUMA_NS_BEGIN
 
 template <typename Impl>
@@ -139,6 +149,16 @@ bool EventLoop::isPollLT() const
     return  pimpl_->isPollLT();
 }
 
+KMError EventLoop::setRateLimit(const char* group, uint32_t rate, uint32_t burst)
+{
+    return pimpl_->setRateLimit(group ? group : "", rate, burst);
+}
+
+KMError EventLoop::getRateLimitStats(const char* group, RateLimitStats &stats)
+{
+    return pimpl_->getRateLimitStats(group ? group : "", stats);
+}
+
 KMError EventLoop::registerFd(SOCKET_FD fd, uint32_t events, IOCallback cb)
 {
     return pimpl_->registerFd(fd, events, std::move(cb));
@@ -346,6 +366,21 @@ int TcpSocket::receive(void* data, size_t length)
     return pimpl_->receive(data, length);
 }
 
+int TcpSocket::sendFd(SOCKET_FD fd, const void* data, size_t length)
+{
+    return pimpl_->sendFd(fd, data, length);
+}
+
+int TcpSocket::receiveFd(SOCKET_FD &fd, void* data, size_t length)
+{
+    return pimpl_->receiveFd(fd, data, length);
+}
+
+int TcpSocket::sendFile(int file_fd, int64_t offset, size_t length)
+{
+    return pimpl_->sendFile(file_fd, offset, length);
+}
+
 KMError TcpSocket::close()
 {
     return pimpl_->close();
@@ -430,6 +465,68 @@ TcpListener::Impl* TcpListener::pimpl()
     return pimpl_;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+TcpRelay::TcpRelay(EventLoop* loop)
+: pimpl_(new Impl(EventLoopHelper::implPtr(loop->pimpl())))
+{
+    
+}
+
+TcpRelay::~TcpRelay()
+{
+    delete pimpl_;
+}
+
+KMError TcpRelay::setZeroCopy(bool enable)
+{
+    return pimpl_->setZeroCopy(enable);
+}
+
+KMError TcpRelay::attach(TcpSocket &&tcp1, TcpSocket &&tcp2)
+{
+    return pimpl_->attach(std::move(*tcp1.pimpl()), std::move(*tcp2.pimpl()));
+}
+
+KMError TcpRelay::pause()
+{
+    return pimpl_->pause();
+}
+
+KMError TcpRelay::resume()
+{
+    return pimpl_->resume();
+}
+
+KMError TcpRelay::close()
+{
+    return pimpl_->close();
+}
+
+void TcpRelay::setCloseCallback(EventCallback cb)
+{
+    pimpl_->setCloseCallback(std::move(cb));
+}
+
+bool TcpRelay::isZeroCopy() const
+{
+    return pimpl_->isZeroCopy();
+}
+
+uint64_t TcpRelay::bytesForward() const
+{
+    return pimpl_->bytesForward();
+}
+
+uint64_t TcpRelay::bytesBackward() const
+{
+    return pimpl_->bytesBackward();
+}
+
+TcpRelay::Impl* TcpRelay::pimpl()
+{
+    return pimpl_;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 UdpSocket::UdpSocket(EventLoop* loop)
 : pimpl_(new Impl(EventLoopHelper::implPtr(loop->pimpl())))
@@ -491,6 +588,16 @@ KMError UdpSocket::mcastLeave(const char* mcast_addr, uint16_t mcast_port)
     return pimpl_->mcastLeave(mcast_addr, mcast_port);
 }
 
+KMError UdpSocket::setRateLimit(uint32_t rate, uint32_t burst, const char* group)
+{
+    return pimpl_->setRateLimit(rate, burst, group ? group : "");
+}
+
+KMError UdpSocket::getRateLimitStats(RateLimitStats &stats) const
+{
+    return pimpl_->getRateLimitStats(stats);
+}
+
 void UdpSocket::setReadCallback(EventCallback cb)
 {
     pimpl_->setReadCallback(std::move(cb));
@@ -614,7 +721,7 @@ int HttpParser::getStatusCode() const
 
 const char* HttpParser::getUrl() const
 {
-    return pimpl_->getLocation().c_str();
+    return pimpl_->getUrl().c_str();
 }
 
 const char* HttpParser::getUrlPath() const
@@ -634,26 +741,43 @@ const char* HttpParser::getVersion() const
 
 const char* HttpParser::getParamValue(const char* name) const
 {
-    return pimpl_->getParamValue(name).c_str();
+    return pimpl_->getParamValue(name);
 }
 
 const char* HttpParser::getHeaderValue(const char* name) const
 {
-    return pimpl_->getHeaderValue(name).c_str();
+    return pimpl_->getHeaderValue(name);
+}
+
+size_t HttpParser::getHeaderCount() const
+{
+    return pimpl_->getHeaderCount();
+}
+
+bool HttpParser::getHeader(size_t index, const char** name, size_t* name_len, const char** value, size_t* value_len) const
+{
+    const char* n = nullptr;
+    const char* v = nullptr;
+    size_t n_len = 0;
+    size_t v_len = 0;
+    if (!pimpl_->getHeader(index, n, n_len, v, v_len)) {
+        return false;
+    }
+    if (name) *name = n;
+    if (name_len) *name_len = n_len;
+    if (value) *value = v;
+    if (value_len) *value_len = v_len;
+    return true;
 }
 
 void HttpParser::forEachParam(EnumrateCallback cb)
 {
-    pimpl_->forEachParam([&cb](const std::string& name, const std::string& value) {
-        cb(name.c_str(), value.c_str());
-    });
+    pimpl_->forEachParam(std::move(cb));
 }
 
 void HttpParser::forEachHeader(EnumrateCallback cb)
 {
-    pimpl_->forEachHeader([&cb](const std::string& name, const std::string& value) {
-        cb(name.c_str(), value.c_str());
-    });
+    pimpl_->forEachHeader(std::move(cb));
 }
 
 void HttpParser::setDataCallback(DataCallback cb)
@@ -736,6 +860,26 @@ KMError HttpRequest::close()
     return pimpl_->close();
 }
 
+KMError HttpRequest::setSendBufferWatermark(size_t high_mark, size_t low_mark)
+{
+    return pimpl_->setSendBufferWatermark(high_mark, low_mark);
+}
+
+size_t HttpRequest::getBufferedBytes() const
+{
+    return pimpl_->getBufferedBytes();
+}
+
+KMError HttpRequest::setRateLimit(uint32_t rate, uint32_t burst, const char* group)
+{
+    return pimpl_->setRateLimit(rate, burst, group ? group : "");
+}
+
+KMError HttpRequest::getRateLimitStats(RateLimitStats &stats) const
+{
+    return pimpl_->getRateLimitStats(stats);
+}
+
 int HttpRequest::getStatusCode() const
 {
     return pimpl_->getStatusCode();
@@ -748,14 +892,12 @@ const char* HttpRequest::getVersion() const
 
 const char* HttpRequest::getHeaderValue(const char* name) const
 {
-    return pimpl_->getHeaderValue(name).c_str();
+    return pimpl_->getHeaderValue(name);
 }
 
 void HttpRequest::forEachHeader(HttpParser::EnumrateCallback cb)
 {
-    pimpl_->forEachHeader([&cb] (const std::string& name, const std::string& value) {
-        cb(name.c_str(), value.c_str());
-    });
+    pimpl_->forEachHeader(std::move(cb));
 }
 
 void HttpRequest::setDataCallback(DataCallback cb)
@@ -836,19 +978,35 @@ void HttpResponse::addHeader(const char* name, uint32_t value)
     return pimpl_->addHeader(name, value);
 }
 
+KMError HttpResponse::addTrailer(const char* name, const char* value)
+{
+    if (!name || !value) {
+        return KMError::INVALID_PARAM;
+    }
+    return pimpl_->addTrailer(name, value);
+}
+
 KMError HttpResponse::sendResponse(int status_code, const char* desc)
 {
-    return pimpl_->sendResponse(status_code, desc);
+    return pimpl_->sendResponse(status_code, desc ? desc : "");
+}
+
+KMError HttpResponse::setContentEncoding(const char* encodings, int level)
+{
+    if (!encodings) {
+        return KMError::INVALID_PARAM;
+    }
+    return pimpl_->setContentEncoding(encodings, level);
 }
 
 int HttpResponse::sendData(const void* data, size_t len)
 {
-    return pimpl_->sendData(data, len);
+    return pimpl_->writeBody(data, len);
 }
 
 int HttpResponse::sendData(const KMBuffer &buf)
 {
-    return pimpl_->sendData(buf);
+    return pimpl_->writeBody(buf);
 }
 
 void HttpResponse::reset()
@@ -861,6 +1019,26 @@ KMError HttpResponse::close()
     return pimpl_->close();
 }
 
+KMError HttpResponse::setSendBufferWatermark(size_t high_mark, size_t low_mark)
+{
+    return pimpl_->setSendBufferWatermark(high_mark, low_mark);
+}
+
+size_t HttpResponse::getBufferedBytes() const
+{
+    return pimpl_->getBufferedBytes();
+}
+
+KMError HttpResponse::setRateLimit(uint32_t rate, uint32_t burst, const char* group)
+{
+    return pimpl_->setRateLimit(rate, burst, group ? group : "");
+}
+
+KMError HttpResponse::getRateLimitStats(RateLimitStats &stats) const
+{
+    return pimpl_->getRateLimitStats(stats);
+}
+
 const char* HttpResponse::getMethod() const
 {
     return pimpl_->getMethod().c_str();
@@ -878,19 +1056,17 @@ const char* HttpResponse::getVersion() const
 
 const char* HttpResponse::getParamValue(const char* name) const
 {
-    return pimpl_->getParamValue(name).c_str();
+    return pimpl_->getParamValue(name);
 }
 
 const char* HttpResponse::getHeaderValue(const char* name) const
 {
-    return pimpl_->getHeaderValue(name).c_str();
+    return pimpl_->getHeaderValue(name);
 }
 
 void HttpResponse::forEachHeader(HttpParser::EnumrateCallback cb)
 {
-    pimpl_->forEachHeader([&cb] (const std::string& name, const std::string& value) {
-        cb(name.c_str(), value.c_str());
-    });
+    pimpl_->forEachHeader(std::move(cb));
 }
 
 void HttpResponse::setDataCallback(DataCallback cb)
@@ -923,6 +1099,15 @@ void HttpResponse::setResponseCompleteCallback(HttpEventCallback cb)
     pimpl_->setResponseCompleteCallback(std::move(cb));
 }
 
+void HttpResponse::setRouter(const HttpRouter *router)
+{
+    if (router) {
+        pimpl_->setRouteCallback([this, router] { return router->route(*this) == KMError::NOERR; });
+    } else {
+        pimpl_->setRouteCallback(nullptr);
+    }
+}
+
 HttpResponse::Impl* HttpResponse::pimpl()
 {
     return pimpl_;
@@ -1005,6 +1190,26 @@ KMError WebSocket::close()
     return pimpl_->close();
 }
 
+KMError WebSocket::setSendBufferWatermark(size_t high_mark, size_t low_mark)
+{
+    return pimpl_->setSendBufferWatermark(high_mark, low_mark);
+}
+
+size_t WebSocket::getBufferedBytes() const
+{
+    return pimpl_->sendBufferBytes();
+}
+
+KMError WebSocket::setRateLimit(uint32_t rate, uint32_t burst, const char* group)
+{
+    return pimpl_->setRateLimit(rate, burst, group ? group : "");
+}
+
+KMError WebSocket::getRateLimitStats(RateLimitStats &stats) const
+{
+    return pimpl_->getRateLimitStats(stats);
+}
+
 void WebSocket::setDataCallback(DataCallback cb)
 {
     pimpl_->setDataCallback(std::move(cb));
@@ -1085,6 +1290,166 @@ H2Connection::Impl* H2Connection::pimpl()
     return pimpl_;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+HttpServer::HttpServer(EventLoop* loop)
+: pimpl_(new Impl(loop))
+{
+    
+}
+
+HttpServer::~HttpServer()
+{
+    delete pimpl_;
+}
+
+KMError HttpServer::setSslFlags(uint32_t ssl_flags)
+{
+    return pimpl_->setSslFlags(ssl_flags);
+}
+
+KMError HttpServer::setLoops(EventLoop* const* loops, size_t count)
+{
+    return pimpl_->setLoops(loops, count);
+}
+
+KMError HttpServer::startListen(const char* host, uint16_t port)
+{
+    if (!host) {
+        return KMError::INVALID_PARAM;
+    }
+    return pimpl_->startListen(host, port);
+}
+
+KMError HttpServer::stopListen()
+{
+    return pimpl_->stopListen();
+}
+
+KMError HttpServer::close()
+{
+    return pimpl_->close();
+}
+
+void HttpServer::setHttpCallback(ConnCallback cb)
+{
+    pimpl_->setHttpCallback(std::move(cb));
+}
+
+void HttpServer::setHttp2Callback(ConnCallback cb)
+{
+    pimpl_->setHttp2Callback(std::move(cb));
+}
+
+void HttpServer::setWebSocketCallback(ConnCallback cb)
+{
+    pimpl_->setWebSocketCallback(std::move(cb));
+}
+
+void HttpServer::setErrorCallback(ErrorCallback cb)
+{
+    pimpl_->setErrorCallback(std::move(cb));
+}
+
+HttpServer::Impl* HttpServer::pimpl()
+{
+    return pimpl_;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+StaticFileHandler::StaticFileHandler(const char* doc_root, const char* url_prefix)
+: pimpl_(new Impl(doc_root ? doc_root : "", url_prefix ? url_prefix : "/"))
+{
+    
+}
+
+StaticFileHandler::~StaticFileHandler()
+{
+    delete pimpl_;
+}
+
+KMError StaticFileHandler::setCacheOptions(uint32_t ttl_ms, size_t max_files)
+{
+    return pimpl_->setCacheOptions(ttl_ms, max_files);
+}
+
+KMError StaticFileHandler::setContentEncoding(const char* encodings, int level, size_t max_size)
+{
+    if (!encodings) {
+        return KMError::INVALID_PARAM;
+    }
+    return pimpl_->setContentEncoding(encodings, level, max_size);
+}
+
+KMError StaticFileHandler::serve(HttpResponse &rsp)
+{
+    return pimpl_->serve(rsp.pimpl());
+}
+
+StaticFileHandler::Impl* StaticFileHandler::pimpl()
+{
+    return pimpl_;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////
+const char* HttpRouter::Params::get(const char* name, size_t &len) const
+{
+    if (!name) {
+        return nullptr;
+    }
+    auto name_len = strlen(name);
+    for (size_t i = 0; i < count_; ++i) {
+        if (params_[i].name_len == name_len && memcmp(params_[i].name, name, name_len) == 0) {
+            len = params_[i].value_len;
+            return params_[i].value;
+        }
+    }
+    return nullptr;
+}
+
+HttpRouter::HttpRouter()
+: pimpl_(new Impl())
+{
+    
+}
+
+HttpRouter::~HttpRouter()
+{
+    delete pimpl_;
+}
+
+KMError HttpRouter::addRoute(const char* method, const char* pattern, Handler handler)
+{
+    if (!method || !pattern) {
+        return KMError::INVALID_PARAM;
+    }
+    return pimpl_->addRoute(method, pattern, std::move(handler));
+}
+
+const HttpRouter::Handler* HttpRouter::match(const char* method, const char* path, Params &params) const
+{
+    if (!method || !path) {
+        return nullptr;
+    }
+    return pimpl_->match(method, path, strcspn(path, "?"), params);
+}
+
+KMError HttpRouter::route(HttpResponse &rsp) const
+{
+    Params params;
+    auto *handler = match(rsp.getMethod(), rsp.getPath(), params);
+    if (!handler) {
+        return KMError::NOT_EXIST;
+    }
+    (*handler)(rsp, params);
+    return KMError::NOERR;
+}
+
+HttpRouter::Impl* HttpRouter::pimpl()
+{
+    return pimpl_;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 
@@ -1099,9 +1464,67 @@ void init(const char* path)
 void fini()
 {
 #ifdef KUMA_HAS_OPENSSL
+    SslCryptoPool::instance().stop();
     OpenSslLib::fini();
 #endif
     DnsResolver::get().stop();
 }
 
+KMError setDnsServers(const char* servers)
+{
+    return DnsResolver::get().setServers(servers ? servers : "");
+}
+
+KMError getSslSessionStats(SslSessionStats &stats)
+{
+#ifdef KUMA_HAS_OPENSSL
+    OpenSslLib::getSessionStats(stats);
+    return KMError::NOERR;
+#else
+    return KMError::UNSUPPORT;
+#endif
+}
+
+KMError setSslCryptoThreads(int count)
+{
+#ifdef KUMA_HAS_OPENSSL
+    return SslCryptoPool::instance().setThreadCount(count);
+#else
+    return KMError::UNSUPPORT;
+#endif
+}
+
+KMError loadSslCertificates(const SslCertificate *certs, size_t count)
+{
+#ifdef KUMA_HAS_OPENSSL
+    if (!certs && count > 0) {
+        return KMError::INVALID_PARAM;
+    }
+    return SslContextMap::instance().load(certs, count);
+#else
+    return KMError::UNSUPPORT;
+#endif
+}
+
+KMError setHttpCacheLimits(size_t max_bytes, size_t max_entries)
+{
+    if (max_entries == 0) {
+        return KMError::INVALID_PARAM;
+    }
+    HttpCache::instance().setLimits(max_bytes, max_entries);
+    return KMError::NOERR;
+}
+
+KMError getHttpCacheStats(HttpCacheStats &stats)
+{
+    HttpCache::instance().getStats(stats);
+    return KMError::NOERR;
+}
+
+KMError setHttpConnectionPoolLimits(size_t max_idle_per_host, size_t max_conns_per_host, uint32_t idle_timeout_ms)
+{
+    Http1xConnectionPool::setLimits(max_idle_per_host, max_conns_per_host, idle_timeout_ms);
+    return KMError::NOERR;
+}
+
 KUMA_NS_END
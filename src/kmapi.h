@@ -36,6 +36,7 @@
 KUMA_NS_BEGIN
 
 class KMBuffer;
+class HttpRouter;
 
 class KUMA_API EventLoop
 {
@@ -77,6 +78,16 @@ public:
     PollType getPollType() const;
     bool isPollLT() const; // level trigger
     
+    /**
+     * set token bucket limit of the egress traffic of group, in bytes per second. the
+     * group is shared by the rate limited connections with same group name in this
+     * loop. empty group is the loop level limit, which is shared by all the rate limited
+     * connections in this loop. rate 0 means unlimited, burst 0 means 100ms of rate
+     * but not less than 64KB
+     */
+    KMError setRateLimit(const char* group, uint32_t rate, uint32_t burst = 0);
+    KMError getRateLimitStats(const char* group, RateLimitStats &stats);
+    
 public:
     bool inSameThread() const;
     
@@ -146,6 +157,10 @@ public:
     bool sslEnabled() const;
     KMError setSslServerName(const char *server_name);
     KMError bind(const char* bind_host, uint16_t bind_port);
+    /**
+     * host can be unix domain socket address "unix:/path/to/socket", or "unix:@name"
+     * for abstract namespace, port is ignored in this case
+     */
     KMError connect(const char* host, uint16_t port, EventCallback cb, uint32_t timeout_ms = 0);
     KMError attachFd(SOCKET_FD fd);
     KMError detachFd(SOCKET_FD &fd);
@@ -155,6 +170,19 @@ public:
     int send(const iovec* iovs, int count);
     int send(const KMBuffer &buf);
     int receive(void* data, size_t length);
+    /**
+     * Pass file descriptor over unix domain socket (SCM_RIGHTS), the fd is sent along
+     * with the data. receiveFd should be used to read the data that carries fd, fd is
+     * set to INVALID_FD if no fd is received
+     */
+    int sendFd(SOCKET_FD fd, const void* data, size_t length);
+    int receiveFd(SOCKET_FD &fd, void* data, size_t length);
+    /**
+     * Send length bytes of file data from offset. sendfile is used if SSL is not enabled,
+     * otherwise the file data is encrypted in user space. return the bytes sent, the write
+     * callback will be called when the socket is writable again if not all the data is sent
+     */
+    int sendFile(int file_fd, int64_t offset, size_t length);
     
     KMError close();
     
@@ -185,6 +213,10 @@ public:
     TcpListener(EventLoop* loop);
     ~TcpListener();
     
+    /**
+     * host can be unix domain socket address "unix:/path/to/socket", or "unix:@name"
+     * for abstract namespace, the peer address in accept callback is "unix:" as well
+     */
     KMError startListen(const char* host, uint16_t port);
     KMError stopListen(const char* host, uint16_t port);
     KMError close();
@@ -199,6 +231,50 @@ private:
     Impl* pimpl_;
 };
 
+/**
+ * Relay data between two connected TcpSockets, e.g. for L4 proxy. data is moved by
+ * splice on Linux without copying to user space, buffered copy is used if any socket
+ * is SSL or splice is unavailable. the EOF of one side is relayed to other side by
+ * shutdown when zero copy, or closes the relay when buffered copy
+ */
+class KUMA_API TcpRelay
+{
+public:
+    using EventCallback = std::function<void(KMError)>;
+    
+    TcpRelay(EventLoop* loop);
+    ~TcpRelay();
+    
+    /**
+     * zero copy is enabled by default, should be called before attach
+     */
+    KMError setZeroCopy(bool enable);
+    /**
+     * take over the connected sockets, the sockets should have no pending data
+     * and will be invalid after this call
+     */
+    KMError attach(TcpSocket &&tcp1, TcpSocket &&tcp2);
+    KMError pause();
+    KMError resume();
+    KMError close();
+    
+    /**
+     * called when both directions finished with KMError::NOERR, or an error
+     * happened. the relay is closed when called
+     */
+    void setCloseCallback(EventCallback cb);
+    
+    bool isZeroCopy() const;
+    uint64_t bytesForward() const; // bytes relayed from tcp1 to tcp2
+    uint64_t bytesBackward() const; // bytes relayed from tcp2 to tcp1
+    
+    class Impl;
+    Impl* pimpl();
+    
+private:
+    Impl* pimpl_;
+};
+
 class KUMA_API UdpSocket
 {
 public:
@@ -218,6 +294,13 @@ public:
     KMError mcastJoin(const char* mcast_addr, uint16_t mcast_port);
     KMError mcastLeave(const char* mcast_addr, uint16_t mcast_port);
     
+    /* limit the egress rate with token bucket, see HttpRequest::setRateLimit.
+     * the datagram is not sent and send returns 0 if it exceeds the limit, so burst
+     * should not be less than the datagram size
+     */
+    KMError setRateLimit(uint32_t rate, uint32_t burst = 0, const char* group = nullptr);
+    KMError getRateLimitStats(RateLimitStats &stats) const;
+    
     void setReadCallback(EventCallback cb);
     void setErrorCallback(EventCallback cb);
     
@@ -288,6 +371,12 @@ public:
     const char* getParamValue(const char* name) const;
     const char* getHeaderValue(const char* name) const;
     
+    /* header fields in received order without copy, name and value are nul
+     * terminated and valid until the parser is reset or parses next message
+     */
+    size_t getHeaderCount() const;
+    bool getHeader(size_t index, const char** name, size_t* name_len, const char** value, size_t* value_len) const;
+    
     void forEachParam(EnumrateCallback cb);
     void forEachHeader(EnumrateCallback cb);
     
@@ -317,6 +406,9 @@ public:
     KMError setSslFlags(uint32_t ssl_flags);
     void addHeader(const char* name, const char* value);
     void addHeader(const char* name, uint32_t value);
+    /* url scheme "http+unix" or "https+unix" connects to an unix domain socket, the
+     * percent-encoded socket path is the host, e.g. "http+unix://%2Ftmp%2Fkuma.sock/index"
+     */
     KMError sendRequest(const char* method, const char* url);
     int sendData(const void* data, size_t len);
     int sendData(const KMBuffer &buf);
@@ -324,6 +416,23 @@ public:
     
     KMError close();
     
+    /* limit the data buffered in library when socket is blocked.
+     * sendData will return 0 when buffered bytes reach high_mark, and write callback
+     * will be called when buffered bytes drain below low_mark.
+     * high_mark 0 means sendData will return 0 once any data is buffered, it is the default
+     */
+    KMError setSendBufferWatermark(size_t high_mark, size_t low_mark);
+    size_t getBufferedBytes() const;
+    
+    /* limit the egress rate of this connection with token bucket, in bytes per second.
+     * the data exceeds the limit is buffered as when socket is blocked. the limits of
+     * group and loop are applied as well, see EventLoop::setRateLimit.
+     * rate 0 means no connection level limit, burst 0 means 100ms of rate but not
+     * less than 64KB. only HTTP/1.x is supported
+     */
+    KMError setRateLimit(uint32_t rate, uint32_t burst = 0, const char* group = nullptr);
+    KMError getRateLimitStats(RateLimitStats &stats) const;
+    
     int getStatusCode() const;
     const char* getVersion() const;
     const char* getHeaderValue(const char* name) const;
@@ -360,13 +469,42 @@ public:
     KMError attachSocket(TcpSocket&& tcp, HttpParser&& parser, const KMBuffer *init_buf=nullptr);
     void addHeader(const char* name, const char* value);
     void addHeader(const char* name, uint32_t value);
+    /* add the trailer field sent after the body. on HTTP/1.1 it is sent with the last
+     * chunk and dropped if the body is not chunked, on HTTP/2 it is sent in HEADERS
+     * frame that ends the stream. it can be added until the body is ended and is
+     * cleared on reset, the names may be declared in Trailer header.
+     * KMError::INVALID_PARAM if name is not a token or value has CR, LF or NUL
+     */
+    KMError addTrailer(const char* name, const char* value);
+    /* compress the body by the encoding in encodings that Accept-Encoding of request
+     * prefers, encodings is comma separated names in order of preference, e.g.
+     * "br, gzip, deflate". level is the compression level of encoder, -1 for default.
+     * it must be called before sendResponse, and is cleared on reset.
+     * if the body is compressed, Content-Length is removed, and the body is chunked on
+     * HTTP/1.1, it must be ended by sendData(nullptr, 0). the data of each sendData
+     * is flushed to peer, a larger piece is compressed better.
+     * KMError::UNSUPPORT if no encoding in encodings is supported
+     */
+    KMError setContentEncoding(const char* encodings, int level = -1);
     KMError sendResponse(int status_code, const char* desc = nullptr);
     int sendData(const void* data, size_t len);
     int sendData(const KMBuffer &buf);
-    void reset(); // reset for connection reuse
+    /* reset for connection reuse. the requests pipelined by HTTP/1.1 client are
+     * queued and delivered one by one after reset, the response may complete
+     * before it is all sent to socket in this case, and it is sent in order
+     */
+    void reset();
     
     KMError close();
     
+    /* same as HttpRequest::setSendBufferWatermark */
+    KMError setSendBufferWatermark(size_t high_mark, size_t low_mark);
+    size_t getBufferedBytes() const;
+    
+    /* same as HttpRequest::setRateLimit */
+    KMError setRateLimit(uint32_t rate, uint32_t burst = 0, const char* group = nullptr);
+    KMError getRateLimitStats(RateLimitStats &stats) const;
+    
     const char* getMethod() const;
     const char* getPath() const;
     const char* getVersion() const;
@@ -380,6 +518,11 @@ public:
     void setHeaderCompleteCallback(HttpEventCallback cb);
     void setRequestCompleteCallback(HttpEventCallback cb);
     void setResponseCompleteCallback(HttpEventCallback cb);
+    /* dispatch the request to the route of router when the request is complete,
+     * instead of request complete callback, which is still called if no route
+     * matches. the router must outlive this response
+     */
+    void setRouter(const HttpRouter *router);
     
     class Impl;
     Impl* pimpl();
@@ -402,6 +545,9 @@ public:
     const char* getProtocol() const;
     void setOrigin(const char* origin);
     const char* getOrigin() const;
+    /* ws_url scheme "ws+unix" or "wss+unix" connects to an unix domain socket, the
+     * percent-encoded socket path is the host, e.g. "ws+unix://%2Ftmp%2Fkuma.sock/chat"
+     */
     KMError connect(const char* ws_url, EventCallback cb);
     KMError attachFd(SOCKET_FD fd, const KMBuffer *init_buf=nullptr);
     KMError attachSocket(TcpSocket&& tcp, HttpParser&& parser, const KMBuffer *init_buf=nullptr);
@@ -410,6 +556,14 @@ public:
     
     KMError close();
     
+    /* same as HttpRequest::setSendBufferWatermark, applies to send */
+    KMError setSendBufferWatermark(size_t high_mark, size_t low_mark);
+    size_t getBufferedBytes() const;
+    
+    /* same as HttpRequest::setRateLimit, applies to send */
+    KMError setRateLimit(uint32_t rate, uint32_t burst = 0, const char* group = nullptr);
+    KMError getRateLimitStats(RateLimitStats &stats) const;
+    
     void setDataCallback(DataCallback cb);
     void setWriteCallback(EventCallback cb);
     void setErrorCallback(EventCallback cb);
@@ -452,11 +606,197 @@ private:
     Impl* pimpl_;
 };
 
+/**
+ * HTTP server front-end. the protocol of the accepted connection is detected by TLS
+ * ALPN, HTTP/2 connection preface or HTTP Upgrade header, then the socket is passed to
+ * the callback of that protocol along with the parsed request header and the data
+ * that follows it. the callback is called in the loop the connection is distributed
+ * to, the socket can be attached to HttpResponse, WebSocket or H2Connection of that loop
+ */
+class KUMA_API HttpServer
+{
+public:
+    using ConnCallback = std::function<void(EventLoop*, TcpSocket&&, HttpParser&&, const KMBuffer*)>;
+    using ErrorCallback = std::function<void(KMError)>;
+    
+    HttpServer(EventLoop* loop);
+    ~HttpServer();
+    
+    KMError setSslFlags(uint32_t ssl_flags);
+    /* the accepted connections are distributed to the loops in round robin, they are
+     * handled in the listening loop if no loop is set. the loops should be running
+     * and outlive this HttpServer, only can be set before startListen
+     */
+    KMError setLoops(EventLoop* const* loops, size_t count);
+    KMError startListen(const char* host, uint16_t port);
+    KMError stopListen();
+    /* stop listening and close the connections in detecting */
+    KMError close();
+    
+    /* HTTP/1.x, and WebSocket if no WebSocket callback is set */
+    void setHttpCallback(ConnCallback cb);
+    /* ALPN "h2", h2c upgrade, or cleartext HTTP/2 with prior knowledge. the parser
+     * is empty if there is no upgrade request
+     */
+    void setHttp2Callback(ConnCallback cb);
+    void setWebSocketCallback(ConnCallback cb);
+    void setErrorCallback(ErrorCallback cb);
+    
+    class Impl;
+    Impl* pimpl();
+    
+private:
+    Impl* pimpl_;
+};
+
+/**
+ * Serve the files under document root to GET and HEAD requests of HttpResponse, over
+ * HTTP/1.x and HTTP/2. ETag and Last-Modified are generated, If-None-Match,
+ * If-Modified-Since, Range and If-Range are handled. the file data is sent by sendfile
+ * over HTTP/1.x and read into buffers over HTTP/2. it can be shared by the
+ * responses of all the loops
+ */
+class KUMA_API StaticFileHandler
+{
+public:
+    /* the url_prefix of request path is replaced by doc_root, e.g. "/static/a.js" is
+     * mapped to "<doc_root>/a.js" if url_prefix is "/static"
+     */
+    StaticFileHandler(const char* doc_root, const char* url_prefix = "/");
+    ~StaticFileHandler();
+    
+    /* the open files and their stat results are cached for ttl_ms, then revalidated
+     * by stat. at most max_files are kept open, default is 1000 ms and 1024 files,
+     * ttl_ms 0 disables the cache
+     */
+    KMError setCacheOptions(uint32_t ttl_ms, size_t max_files);
+    /* the text files not larger than max_size are compressed by the encoding in
+     * encodings that Accept-Encoding of request prefers, e.g. "br, gzip". a file is
+     * compressed once for each encoding, the compressed variant is kept in HttpCache
+     * until the file is changed. the byte ranges are served from the identity.
+     * it must be called before serving. KMError::UNSUPPORT if no encoding is supported
+     */
+    KMError setContentEncoding(const char* encodings, int level = -1, size_t max_size = 1024*1024);
+    /* send the response to the request of rsp, it should be called when the request
+     * is complete. the body is written by the handler, the write callback of rsp is
+     * not called for this response. KMError::NOT_EXIST is returned and nothing is sent
+     * if the request path doesn't start with url_prefix
+     */
+    KMError serve(HttpResponse &rsp);
+    
+    class Impl;
+    Impl* pimpl();
+    
+private:
+    Impl* pimpl_;
+};
+
+/**
+ * Route the requests of HttpResponse by method and path. the routes are kept in a
+ * radix tree, a route pattern can have parameters, e.g. "/users/:id", ":id" matches
+ * one path segment. the last segment can be a wildcard like "*path", it matches the
+ * rest of path. the static segments take precedence over parameters, which take
+ * precedence over wildcards.
+ * the routes should be added before routing, then the router can be shared by the
+ * responses of all the loops
+ */
+class KUMA_API HttpRouter
+{
+public:
+    static const size_t kMaxParams = 8;
+    // name and value are views of the route pattern and the request path, not null terminated
+    struct Param
+    {
+        const char* name;
+        size_t      name_len;
+        const char* value;
+        size_t      value_len;
+    };
+    class KUMA_API Params
+    {
+    public:
+        size_t size() const { return count_; }
+        const Param& operator[](size_t i) const { return params_[i]; }
+        // the value of param name, nullptr if not found
+        const char* get(const char* name, size_t &len) const;
+        
+    private:
+        friend class HttpRouter;
+        Param   params_[kMaxParams];
+        size_t  count_ = 0;
+    };
+    using Handler = std::function<void(HttpResponse &, const Params &)>;
+    
+    HttpRouter();
+    ~HttpRouter();
+    
+    /* method is "GET", "POST"... or "*" for any method. KMError::ALREADY_EXIST if
+     * the route of same method and pattern is added, KMError::INVALID_PARAM if the
+     * pattern is invalid or its parameter name conflicts with an existing route
+     */
+    KMError addRoute(const char* method, const char* pattern, Handler handler);
+    /* match the route of method and path, the query of path is ignored. the handler
+     * of matched route is returned, it is valid until the route is changed. nothing
+     * is allocated in matching
+     */
+    const Handler* match(const char* method, const char* path, Params &params) const;
+    /* call the handler of the route matched by the request of rsp,
+     * KMError::NOT_EXIST if no route matches
+     */
+    KMError route(HttpResponse &rsp) const;
+    
+    class Impl;
+    Impl* pimpl();
+    
+private:
+    Impl* pimpl_;
+};
+
 using TraceFunc = std::function<void(int, const char*)>; // (level, msg)
 
 KUMA_API void init(const char* path = nullptr);
 KUMA_API void fini();
 KUMA_API void setTraceFunc(TraceFunc func);
+/**
+ * Set the upstream DNS servers, e.g. "8.8.8.8, [2001:4860:4860::8888]:53". the host name
+ * will be resolved by getaddrinfo if no DNS server is set or the DNS query failed
+ */
+KUMA_API KMError setDnsServers(const char* servers);
+/**
+ * Get the TLS session resumption statistics of all the event loops. the client TLS
+ * session is cached by server name and resumed on the next connection with the same
+ * server name set by TcpSocket::setSslServerName or the host name of connect
+ */
+KUMA_API KMError getSslSessionStats(SslSessionStats &stats);
+/**
+ * Set the thread count of SSL crypto pool, the SSL handshakes of all the event loops
+ * are run in the pool so that the private key operations will not block the event
+ * loop. 0 means the handshakes are run in event loop thread, which is the default
+ */
+KUMA_API KMError setSslCryptoThreads(int count);
+/**
+ * Load the server certificates selected by SNI, the server name can be a wildcard
+ * name like "*.example.com". the loaded set is replaced atomically, the handshakes
+ * in flight are not affected. cert/server.pem is used if no server name matches
+ */
+KUMA_API KMError loadSslCertificates(const SslCertificate *certs, size_t count);
+/**
+ * Set the budgets of HTTP cache shared by all the event loops, the least recently used
+ * entries are evicted when either budget is exceeded. default is 64MB and 10000 entries.
+ * the response of HttpRequest is cached only if the request has Cache-Control without
+ * no-cache and the response has max-age, stale-while-revalidate or stale-if-error
+ */
+KUMA_API KMError setHttpCacheLimits(size_t max_bytes, size_t max_entries);
+KUMA_API KMError getHttpCacheStats(HttpCacheStats &stats);
+/**
+ * Set the limits of HTTP/1.x connection pools, the keep-alive connections of HttpRequest
+ * are kept in the pool of its event loop and reused by the requests to the same host.
+ * max_idle_per_host is the idle connections kept for each host, default 6, 0 disables
+ * the pool. max_conns_per_host limits the connections in use of each host, the requests
+ * exceeding the limit wait for a connection to be released, default 0 means no limit.
+ * the idle connection is closed after idle_timeout_ms, default 60000
+ */
+KUMA_API KMError setHttpConnectionPoolLimits(size_t max_idle_per_host, size_t max_conns_per_host, uint32_t idle_timeout_ms);
 
 KUMA_NS_END
 
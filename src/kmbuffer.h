@@ -480,7 +480,7 @@ public:
             if(offset < kmb_len) {
                 size_t copy_len = offset+len <= kmb_len ? len : kmb_len - offset;
                 KMBuffer *dd = nullptr;
-                if(!shared_data_) {
+                if(!kmb->shared_data_) {
                     dd = new KMBuffer();
                     std::allocator<char> a;
                     dd->allocBuffer(copy_len, a);
@@ -94,6 +94,36 @@ enum class TimerMode {
 
 #define UDP_FLAG_MULTICAST  1
 
+struct RateLimitStats {
+    uint64_t bytes_sent = 0;        // bytes passed the rate limiter
+    uint64_t throttled_count = 0;   // times the sending is throttled
+};
+
+struct SslSessionStats {
+    uint64_t client_handshakes = 0; // completed client handshakes
+    uint64_t client_resumed = 0;    // client handshakes resumed by cached session
+    uint64_t server_handshakes = 0; // completed server handshakes
+    uint64_t server_resumed = 0;    // server handshakes resumed by session id or ticket
+};
+
+struct HttpCacheStats {
+    uint64_t hits = 0;              // fresh responses served from cache
+    uint64_t stale_hits = 0;        // stale responses served by stale-while-revalidate or stale-if-error
+    uint64_t misses = 0;
+    uint64_t stores = 0;            // responses stored
+    uint64_t evictions = 0;         // entries evicted by the byte or entry budget
+    uint64_t expirations = 0;       // expired entries removed
+    uint64_t rejections = 0;        // responses not admitted for the size or frequency
+    uint64_t entries = 0;           // entries in cache
+    uint64_t bytes = 0;             // bytes in cache
+};
+
+struct SslCertificate {
+    const char *server_name;        // e.g. "www.example.com" or "*.example.com"
+    const char *cert_file;          // PEM certificate chain
+    const char *key_file;           // PEM private key
+};
+
 #ifdef KUMA_OS_WIN
 struct iovec {
     unsigned long   iov_len;
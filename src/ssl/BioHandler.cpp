@@ -67,6 +67,10 @@
 
 using namespace kuma;
 
+// the encrypted data is sent from the BIO pair buffer directly, it should be
+// able to hold several full TLS records
+static const size_t kBioBufferSize = 64*1024;
+
 BioHandler::BioHandler()
 {
     obj_key_ = "BioHandler";
@@ -94,7 +98,7 @@ KMError BioHandler::init(SslRole ssl_role, SOCKET_FD fd, uint32_t ssl_flags)
     }
     
     BIO *internal_bio = nullptr;
-    BIO_new_bio_pair(&internal_bio, 0, &net_bio_, 0);
+    BIO_new_bio_pair(&internal_bio, kBioBufferSize, &net_bio_, kBioBufferSize);
     SSL_set_bio(ssl_, internal_bio, internal_bio);
     if (isServer()) {
         SSL_set_accept_state(ssl_);
@@ -127,20 +131,20 @@ KMError BioHandler::detachSsl(SSL* &ssl, BIO* &nbio)
     return KMError::NOERR;
 }
 
-int BioHandler::send(const void* data, size_t length)
+int BioHandler::sendAppData(const void* data, size_t length)
 {
     size_t bytes_total = 0;
     const uint8_t *ptr = static_cast<const uint8_t*>(data);
     do {
         auto ret = writeAppData(ptr + bytes_total, length - bytes_total);
         if (ret < 0) {
-            KUMA_ERRXTRACE("send, failed to write app data");
+            KUMA_ERRXTRACE("sendAppData, failed to write app data");
             return ret;
         }
         bytes_total += ret;
         auto err = trySendSslData();
         if (km_is_fatal_error(err)) {
-            KUMA_ERRXTRACE("send, failed to send SSL data, err=" << (int)err);
+            KUMA_ERRXTRACE("sendAppData, failed to send SSL data, err=" << (int)err);
             return -1;
         }
         if (err != KMError::AGAIN) {
@@ -150,39 +154,6 @@ int BioHandler::send(const void* data, size_t length)
     return static_cast<int>(bytes_total);
 }
 
-int BioHandler::send(const iovec* iovs, int count)
-{
-    int bytes_sent = 0;
-    for (int i=0; i < count; ++i) {
-        int ret = send((const uint8_t*)iovs[i].iov_base, uint32_t(iovs[i].iov_len));
-        if(ret < 0) {
-            return ret;
-        } else {
-            bytes_sent += ret;
-            if(static_cast<size_t>(ret) < iovs[i].iov_len) {
-                break;
-            }
-        }
-    }
-    return bytes_sent;
-}
-
-int BioHandler::send(const KMBuffer &buf)
-{
-    int bytes_sent = 0;
-    for (auto it = buf.begin(); it != buf.end(); ++it) {
-        int ret = send((const uint8_t*)it->readPtr(), it->length());
-        if (ret < 0) {
-            return ret;
-        }
-        bytes_sent += ret;
-        if (static_cast<size_t>(ret) < it->length()) {
-            return bytes_sent;
-        }
-    }
-    return bytes_sent;
-}
-
 int BioHandler::receive(void* data, size_t length)
 {
     size_t bytes_total = 0;
@@ -391,57 +362,32 @@ int BioHandler::writeSslData(const void* data, size_t size)
     return ret;
 }
 
-int BioHandler::readSslData(void* data, size_t size)
+KMError BioHandler::trySendSslData()
 {
     if (!net_bio_) {
-        return -1;
+        return KMError::INVALID_STATE;
     }
-    auto ret = BIO_read(net_bio_, data, static_cast<int>(size));
-    if (ret <= 0) {
-        if (BIO_should_retry(net_bio_)) {
-            ret = 0;
-        } else {
-            ret = -1;
+    // send the encrypted data in BIO pair buffer without copying, the data is
+    // consumed from BIO only after it is sent
+    while (true) {
+        char *ptr = nullptr;
+        auto ssl_len = BIO_nread0(net_bio_, &ptr);
+        if (ssl_len <= 0 || !ptr) {
+            break;
         }
-    }
-    return ret;
-}
-
-KMError BioHandler::trySendSslData()
-{
-    if (!send_buf_.empty()) {
-        auto ret = sendData(send_buf_);
-        if (ret < 0) {
+        KMBuffer buf(ptr, ssl_len, ssl_len);
+        auto bytes_sent = send_func_(buf);
+        if (bytes_sent < 0) {
             KUMA_ERRXTRACE("trySendSslData, failed to send data");
             return KMError::SOCK_ERROR;
         }
-        if (!send_buf_.empty()) {
+        if (bytes_sent > 0) {
+            BIO_nread(net_bio_, &ptr, bytes_sent);
+        }
+        if (bytes_sent < ssl_len) {
             return KMError::NOERR; // send blocked
         }
     }
-    int bytes_total = 0;
-    int ssl_read = 0;
-    send_buf_.expand(20 * 1024);
-    do {
-        ssl_read = readSslData(send_buf_);
-        if (ssl_read > 0) {
-            auto bytes_sent = sendData(send_buf_);
-            if (bytes_sent >= 0) {
-                bytes_total += bytes_sent;
-                if (bytes_sent < ssl_read) {
-                    return KMError::NOERR; // send blocked
-                }
-            }
-            else {
-                KUMA_ERRXTRACE("trySendSslData, failed to send data 2");
-                return KMError::SOCK_ERROR;
-            }
-        }
-        else if (ssl_read < 0) {
-            KUMA_ERRXTRACE("trySendSslData, failed to read SSL data, ret=" << ssl_read);
-            return KMError::SSL_FAILED;
-        }
-    } while (ssl_read > 0);
     
     return KMError::AGAIN; // want ssl write
 }
@@ -538,15 +484,6 @@ KMError BioHandler::trySslHandshake()
     return KMError::AGAIN;
 }
 
-int BioHandler::readSslData(SKBuffer &buf)
-{
-    auto ret = readSslData(buf.wr_ptr(), buf.space());
-    if (ret > 0) {
-        buf.bytes_written(ret);
-    }
-    return ret;
-}
-
 int BioHandler::writeSslData(SKBuffer &buf)
 {
     auto ret = writeSslData(buf.ptr(), buf.size());
@@ -556,16 +493,6 @@ int BioHandler::writeSslData(SKBuffer &buf)
     return ret;
 }
 
-int BioHandler::sendData(SKBuffer &buf)
-{
-    KMBuffer kmb(buf.ptr(), buf.size(), buf.size());
-    auto ret = send_func_(kmb);
-    if (ret > 0) {
-        buf.bytes_read(ret);
-    }
-    return ret;
-}
-
 int BioHandler::recvData(SKBuffer &buf)
 {
     auto ret = recv_func_(buf.wr_ptr(), buf.space());
@@ -577,7 +504,14 @@ int BioHandler::recvData(SKBuffer &buf)
 
 KMError BioHandler::sendBufferedData()
 {
-    return trySendSslData();
+    auto err = trySendSslData();
+    if (km_is_fatal_error(err)) {
+        return err;
+    }
+    if (err != KMError::AGAIN) {
+        return KMError::NOERR; // send blocked
+    }
+    return SslHandler::sendBufferedData();
 }
 
 #endif // KUMA_HAS_OPENSSL
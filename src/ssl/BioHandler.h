@@ -53,15 +53,13 @@ public:
     KMError attachSsl(SSL *ssl, BIO *nbio, SOCKET_FD fd) override;
     KMError detachSsl(SSL* &ssl, BIO* &nbio) override;
     SslState handshake() override;
-    int send(const void* data, size_t size) override;
-    int send(const iovec* iovs, int count) override;
-    int send(const KMBuffer &buf) override;
     int receive(void* data, size_t size) override;
     KMError close() override;
     
     KMError sendBufferedData() override;
     
 protected:
+    int sendAppData(const void* data, size_t size) override;
     SslState doHandshake();
     KMError trySendSslData();
     KMError tryRecvSslData();
@@ -69,10 +67,7 @@ protected:
     int writeAppData(const void* data, size_t size);
     int readAppData(void* data, size_t size);
     int writeSslData(const void* data, size_t size);
-    int readSslData(void* data, size_t size);
-    int readSslData(SKBuffer &buf);
     int writeSslData(SKBuffer &buf);
-    int sendData(SKBuffer &buf);
     int recvData(SKBuffer &buf);
     
 protected:
@@ -81,7 +76,6 @@ protected:
 protected:
     BIO*        net_bio_ = nullptr;
     
-    SKBuffer    send_buf_;
     SKBuffer    recv_buf_;
     
     SendFunc    send_func_;
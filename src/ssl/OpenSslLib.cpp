@@ -25,11 +25,18 @@
 #include "util/kmtrace.h"
 #include "util/util.h"
 #include "SslHandler.h"
+#include "SslSessionCache.h"
+#include "SslContextMap.h"
 
 #include <string>
 #include <thread>
 #include <sstream>
 #include <vector>
+#include <atomic>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
 
 using namespace kuma;
 
@@ -53,11 +60,31 @@ std::once_flag OpenSslLib::once_flag_server_;
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 std::mutex* OpenSslLib::ssl_locks_ = nullptr;
 #endif
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+EVP_CIPHER* OpenSslLib::ticket_cipher_ = nullptr;
+#endif
 
 int OpenSslLib::ssl_index_ = -1;
 
 namespace {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    const SSL_METHOD* clientMethod() { return TLS_client_method(); }
+    const SSL_METHOD* serverMethod() { return TLS_server_method(); }
+#else
+    const SSL_METHOD* clientMethod() { return SSLv23_client_method(); }
+    const SSL_METHOD* serverMethod() { return SSLv23_server_method(); }
+#endif
+    
     const AlpnProtos alpnProtos {2, 'h', '2'};
+    const unsigned char sessionIdContext[] = "kuma";
+    // the tickets are decryptable for at least 2 hours with 3 hourly rotated keys
+    const long sessionTimeout = 2*3600;
+    const long sessionCacheSize = 20480;
+    
+    std::atomic<uint64_t> clientHandshakes{0};
+    std::atomic<uint64_t> clientResumed{0};
+    std::atomic<uint64_t> serverHandshakes{0};
+    std::atomic<uint64_t> serverResumed{0};
     
     std::mutex& getOpenSslMutex()
     {
@@ -93,10 +120,21 @@ bool OpenSslLib::doInit(const std::string &cfg_path)
     }
     
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
-    if (OPENSSL_init_ssl(0, NULL) == 0) {
+    // OpenSSL 1.1+ is thread safe without locking callbacks, and the PRNG is
+    // seeded automatically
+    if (OPENSSL_init_ssl(OPENSSL_INIT_LOAD_SSL_STRINGS | OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL) == 0) {
         return false;
     }
     ERR_clear_error();
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    // the implicit fetch of EVP_aes_256_cbc() looks up the provider store on
+    // each ticket, which is contended by the loops
+    ticket_cipher_ = EVP_CIPHER_fetch(NULL, "AES-256-CBC", NULL);
+    if (!ticket_cipher_) {
+        KUMA_ERRTRACE("OpenSslLib::init, failed to fetch ticket cipher");
+        return false;
+    }
+#endif
 #else
     if (CRYPTO_get_locking_callback() == NULL) {
         ssl_locks_ = new std::mutex[CRYPTO_num_locks()];
@@ -113,8 +151,6 @@ bool OpenSslLib::doInit(const std::string &cfg_path)
     }
     //OpenSSL_add_all_algorithms();
     SSL_load_error_strings();
-#endif
-    
     ERR_load_BIO_strings();
     
     // PRNG
@@ -123,6 +159,7 @@ bool OpenSslLib::doInit(const std::string &cfg_path)
         unsigned short rand_ret = rand() % 65536;
         RAND_seed(&rand_ret, sizeof(rand_ret));
     }
+#endif
     ssl_index_ = SSL_get_ex_new_index(0, (void*)"SSL data index", NULL, NULL, NULL);
     return true;
 }
@@ -138,6 +175,13 @@ void OpenSslLib::fini()
 
 void OpenSslLib::doFini()
 {
+    SslContextMap::instance().clear();
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (ticket_cipher_) {
+        EVP_CIPHER_free(ticket_cipher_);
+        ticket_cipher_ = nullptr;
+    }
+#endif
     // will automatically release the resource on openssl 1.1
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
     if (ssl_locks_) {
@@ -231,7 +275,21 @@ SSL_CTX* OpenSslLib::createSSLContext(const SSL_METHOD *method, const std::strin
             //app_verify_arg arg1;
             //SSL_CTX_set_cert_verify_callback(ssl_ctx, appVerifyCallback, &arg1);
         }
-        if (!clientMode) {
+        if (clientMode) {
+            // the sessions are cached by server name in SslSessionCache
+            SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(ssl_ctx, newSessionCallback);
+        } else {
+            SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(ssl_ctx, sessionCacheSize);
+            SSL_CTX_set_timeout(ssl_ctx, sessionTimeout);
+            SSL_CTX_set_session_id_context(ssl_ctx, sessionIdContext, sizeof(sessionIdContext) - 1);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            SSL_CTX_set_tlsext_ticket_key_evp_cb(ssl_ctx, ticketKeyCallback);
+#else
+            SSL_CTX_set_tlsext_ticket_key_cb(ssl_ctx, ticketKeyCallback);
+#endif
+            
 #if OPENSSL_VERSION_NUMBER >= 0x1000200fL && !defined(OPENSSL_NO_TLSEXT)
             SSL_CTX_set_alpn_select_cb(ssl_ctx, alpnCallback, (void*)&alpnProtos);
 #endif
@@ -257,7 +315,7 @@ SSL_CTX* OpenSslLib::defaultClientContext()
             std::string certFile;// = certs_path + "cleint.pem";
             std::string keyFile;// = certs_path + "client.key";
             std::string caFile = certs_path_ + "ca.pem";
-            ssl_ctx_client_ = createSSLContext(SSLv23_client_method(), caFile, certFile, keyFile, true);
+            ssl_ctx_client_ = createSSLContext(clientMethod(), caFile, certFile, keyFile, true);
         });
     }
     return ssl_ctx_client_;
@@ -270,15 +328,21 @@ SSL_CTX* OpenSslLib::defaultServerContext()
             std::string certFile = certs_path_ + "server.pem";
             std::string keyFile = certs_path_ + "server.key";
             std::string caFile;
-            ssl_ctx_server_ = createSSLContext(SSLv23_server_method(), caFile, certFile, keyFile, false);
+            ssl_ctx_server_ = createSSLContext(serverMethod(), caFile, certFile, keyFile, false);
+            if (!ssl_ctx_server_) {
+                // the certificate will be selected by SNI from SslContextMap
+                KUMA_WARNTRACE("defaultServerContext, no default certificate");
+                ssl_ctx_server_ = createSSLContext(serverMethod(), caFile, "", "", false);
+            }
         });
     }
     return ssl_ctx_server_;
 }
 
-SSL_CTX* OpenSslLib::getSSLContext(const char *hostName)
+SSL_CTX* OpenSslLib::createServerContext(const std::string &cert_file, const std::string &key_file)
 {
-    return defaultServerContext();
+    std::string ca_file;
+    return createSSLContext(serverMethod(), ca_file, cert_file, key_file, false);
 }
 
 int OpenSslLib::setSSLData(SSL* ssl, void *data)
@@ -468,20 +532,26 @@ int OpenSslLib::alpnCallback(SSL *ssl, const unsigned char **out, unsigned char
 int OpenSslLib::serverNameCallback(SSL *ssl, int *ad, void *arg)
 {
     UNUSED(ad);
+    UNUSED(arg);
     
     if (!ssl) {
         return SSL_TLSEXT_ERR_NOACK;
     }
     
     const char *serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
-    if (serverName) {
-        SSL_CTX *ssl_ctx_old = reinterpret_cast<SSL_CTX*>(arg);
-        SSL_CTX *ssl_ctx_new = getSSLContext(serverName);
-        if (ssl_ctx_new != ssl_ctx_old) {
-            SSL_set_SSL_CTX(ssl, ssl_ctx_new);
-        }
+    if (!serverName) {
+        return SSL_TLSEXT_ERR_NOACK;
     }
-    return SSL_TLSEXT_ERR_NOACK;
+    // the default server context is used if no certificate matches
+    SSL_CTX *ssl_ctx = SslContextMap::instance().get(serverName);
+    if (!ssl_ctx) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    if (ssl_ctx != SSL_get_SSL_CTX(ssl)) {
+        SSL_set_SSL_CTX(ssl, ssl_ctx);
+    }
+    SSL_CTX_free(ssl_ctx); // SSL holds its own reference
+    return SSL_TLSEXT_ERR_OK;
 }
 #endif
 
@@ -490,4 +560,88 @@ int OpenSslLib::passwdCallback(char *buf, int size, int rwflag, void *userdata)
     return 0;
 }
 
+int OpenSslLib::newSessionCallback(SSL *ssl, SSL_SESSION *session)
+{
+    // the session of TLS 1.3 is received after handshake
+    const char *serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!serverName || !*serverName) {
+        return 0;
+    }
+    SslSessionCache::instance().put(serverName, session);
+    return 1; // the session is taken by cache
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int OpenSslLib::ticketKeyCallback(SSL *ssl, unsigned char key_name[16], unsigned char *iv, EVP_CIPHER_CTX *ctx, EVP_MAC_CTX *hctx, int enc)
+#else
+int OpenSslLib::ticketKeyCallback(SSL *ssl, unsigned char key_name[16], unsigned char *iv, EVP_CIPHER_CTX *ctx, HMAC_CTX *hctx, int enc)
+#endif
+{
+    SslTicketKeys::Key key;
+    bool is_current = true;
+    if (enc) {
+        if (!SslTicketKeys::instance().getEncryptKey(key)) {
+            return -1;
+        }
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+            return -1;
+        }
+        memcpy(key_name, key.name, sizeof(key.name));
+        if (EVP_EncryptInit_ex(ctx, ticketCipher(), NULL, key.aes_key, iv) != 1) {
+            return -1;
+        }
+    } else {
+        if (!SslTicketKeys::instance().getDecryptKey(key_name, key, is_current)) {
+            return 0; // full handshake
+        }
+        if (EVP_DecryptInit_ex(ctx, ticketCipher(), NULL, key.aes_key, iv) != 1) {
+            return -1;
+        }
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM params[2];
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*)"SHA256", 0);
+    params[1] = OSSL_PARAM_construct_end();
+    if (EVP_MAC_init(hctx, key.hmac_key, sizeof(key.hmac_key), params) != 1) {
+        return -1;
+    }
+#else
+    if (HMAC_Init_ex(hctx, key.hmac_key, sizeof(key.hmac_key), EVP_sha256(), NULL) != 1) {
+        return -1;
+    }
+#endif
+#ifdef TLS1_3_VERSION
+    // the TLS 1.3 client uses a ticket only once, a new ticket is issued on
+    // resumption only if the ticket is renewed
+    if (SSL_version(ssl) >= TLS1_3_VERSION) {
+        is_current = false;
+    }
+#endif
+    // 2 means the ticket should be renewed
+    return is_current ? 1 : 2;
+}
+
+void OpenSslLib::onHandshakeComplete(bool is_server, bool resumed)
+{
+    if (is_server) {
+        ++serverHandshakes;
+        if (resumed) {
+            ++serverResumed;
+        }
+    } else {
+        ++clientHandshakes;
+        if (resumed) {
+            ++clientResumed;
+        }
+    }
+}
+
+void OpenSslLib::getSessionStats(SslSessionStats &stats)
+{
+    stats.client_handshakes = clientHandshakes;
+    stats.client_resumed = clientResumed;
+    stats.server_handshakes = serverHandshakes;
+    stats.server_resumed = serverResumed;
+}
+
 #endif // KUMA_HAS_OPENSSL
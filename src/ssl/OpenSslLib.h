@@ -34,6 +34,8 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
 
 KUMA_NS_BEGIN
 
@@ -67,15 +69,32 @@ public:
     
     static int passwdCallback(char *buf, int size, int rwflag, void *userdata);
     
+    static int newSessionCallback(SSL *ssl, SSL_SESSION *session);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static int ticketKeyCallback(SSL *ssl, unsigned char key_name[16], unsigned char *iv, EVP_CIPHER_CTX *ctx, EVP_MAC_CTX *hctx, int enc);
+#else
+    static int ticketKeyCallback(SSL *ssl, unsigned char key_name[16], unsigned char *iv, EVP_CIPHER_CTX *ctx, HMAC_CTX *hctx, int enc);
+#endif
+    
+    // session resumption statistics
+    static void onHandshakeComplete(bool is_server, bool resumed);
+    static void getSessionStats(SslSessionStats &stats);
+    
     static SSL_CTX* defaultClientContext();
     static SSL_CTX* defaultServerContext();
-    static SSL_CTX* getSSLContext(const char *hostName);
+    // the server context of certificate loaded by SslContextMap
+    static SSL_CTX* createServerContext(const std::string &cert_file, const std::string &key_file);
     
     static int setSSLData(SSL* ssl, void *data);
     static void* getSSLData(SSL* ssl);
     
 private:
     static bool doInit(const std::string &path);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static const EVP_CIPHER* ticketCipher() { return ticket_cipher_; }
+#else
+    static const EVP_CIPHER* ticketCipher() { return EVP_aes_256_cbc(); }
+#endif
     static void doFini();
     static SSL_CTX* createSSLContext(const SSL_METHOD *method, const std::string &ca, const std::string &cert, const std::string &key, bool clientMode);
     
@@ -93,6 +112,9 @@ protected:
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
     static std::mutex*          ssl_locks_;
 #endif
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static EVP_CIPHER*          ticket_cipher_; // fetched once and shared by the loops
+#endif
     
     static int                  ssl_index_;
 };
@@ -184,10 +184,10 @@ SioHandler::SslState SioHandler::sslAccept()
     return SslState::SSL_HANDSHAKE;
 }
 
-int SioHandler::send(const void* data, size_t size)
+int SioHandler::sendAppData(const void* data, size_t size)
 {
     if(!ssl_) {
-        KUMA_ERRXTRACE("send, ssl is NULL");
+        KUMA_ERRXTRACE("sendAppData, ssl is NULL");
         return -1;
     }
     ERR_clear_error();
@@ -214,7 +214,7 @@ int SioHandler::send(const void* data, size_t size)
             default:
             {
                 const char* err_str = ERR_reason_error_string(ERR_get_error());
-                KUMA_ERRXTRACE("send, SSL_write failed, fd="<<fd_
+                KUMA_ERRXTRACE("sendAppData, SSL_write failed, fd="<<fd_
                                <<", ssl_status="<<ret
                                <<", ssl_err="<<ssl_err
                                <<", errno="<<getLastError()
@@ -233,43 +233,10 @@ int SioHandler::send(const void* data, size_t size)
             break;
         }
     }
-    //KUMA_INFOXTRACE("send, ret: "<<ret<<", len: "<<len);
+    //KUMA_INFOXTRACE("sendAppData, ret: "<<ret<<", len: "<<len);
     return int(offset);
 }
 
-int SioHandler::send(const iovec* iovs, int count)
-{
-    uint32_t bytes_sent = 0;
-    for (int i=0; i < count; ++i) {
-        int ret = SioHandler::send((const uint8_t*)iovs[i].iov_base, uint32_t(iovs[i].iov_len));
-        if(ret < 0) {
-            return ret;
-        } else {
-            bytes_sent += ret;
-            if(static_cast<size_t>(ret) < iovs[i].iov_len) {
-                break;
-            }
-        }
-    }
-    return bytes_sent;
-}
-
-int SioHandler::send(const KMBuffer &buf)
-{
-    int bytes_sent = 0;
-    for (auto it = buf.begin(); it != buf.end(); ++it) {
-        int ret = SioHandler::send((const uint8_t*)it->readPtr(), it->length());
-        if (ret < 0) {
-            return ret;
-        }
-        bytes_sent += ret;
-        if (static_cast<size_t>(ret) < it->length()) {
-            return bytes_sent;
-        }
-    }
-    return bytes_sent;
-}
-
 int SioHandler::receive(void* data, size_t size)
 {
     if(!ssl_) {
@@ -46,13 +46,11 @@ public:
     KMError attachSsl(SSL *ssl, BIO *nbio, SOCKET_FD fd) override;
     KMError detachSsl(SSL* &ssl, BIO* &nbio) override;
     SslState handshake() override;
-    int send(const void* data, size_t size) override;
-    int send(const iovec* iovs, int count) override;
-    int send(const KMBuffer &buf) override;
     int receive(void* data, size_t size) override;
     KMError close() override;
     
 protected:
+    int sendAppData(const void* data, size_t size) override;
     SslState sslConnect();
     SslState sslAccept();
 };
@@ -0,0 +1,141 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef KUMA_HAS_OPENSSL
+
+#include "SslContextMap.h"
+#include "OpenSslLib.h"
+#include "util/kmtrace.h"
+
+#include <algorithm>
+#include <ctype.h>
+
+using namespace kuma;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+# define SSL_CTX_up_ref(ctx) CRYPTO_add(&(ctx)->references, 1, CRYPTO_LOCK_SSL_CTX)
+#endif
+
+namespace {
+    std::string toLower(const char *str)
+    {
+        std::string s(str);
+        std::transform(s.begin(), s.end(), s.begin(), [] (unsigned char c) {
+            return static_cast<char>(tolower(c));
+        });
+        return s;
+    }
+}
+
+KMError SslContextMap::load(const SslCertificate *certs, size_t count)
+{
+    std::lock_guard<std::mutex> g(load_mutex_);
+    // the contexts are created without holding mutex_, the current snapshot
+    // is still used by the handshakes until the new one is ready
+    auto snapshot = std::make_shared<Snapshot>();
+    for (size_t i = 0; i < count; ++i) {
+        auto &cert = certs[i];
+        if (!cert.server_name || !*cert.server_name || !cert.cert_file || !cert.key_file) {
+            KUMA_ERRTRACE("SslContextMap::load, invalid certificate, index=" << i);
+            return KMError::INVALID_PARAM;
+        }
+        auto server_name = toLower(cert.server_name);
+        bool is_wildcard = server_name.size() > 2 && server_name.compare(0, 2, "*.") == 0;
+        if (server_name.find('*') != std::string::npos && !is_wildcard) {
+            KUMA_ERRTRACE("SslContextMap::load, invalid server name, name=" << cert.server_name);
+            return KMError::INVALID_PARAM;
+        }
+        auto *ssl_ctx = OpenSslLib::createServerContext(cert.cert_file, cert.key_file);
+        if (!ssl_ctx) {
+            KUMA_ERRTRACE("SslContextMap::load, failed to load certificate, name=" << cert.server_name
+                          << ", cert=" << cert.cert_file << ", key=" << cert.key_file);
+            return KMError::SSL_FAILED;
+        }
+        std::shared_ptr<SSL_CTX> ctx(ssl_ctx, SSL_CTX_free);
+        if (is_wildcard) {
+            snapshot->wildcard[server_name.substr(2)] = std::move(ctx);
+        } else {
+            snapshot->exact[server_name] = std::move(ctx);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        snapshot_ = std::move(snapshot);
+    }
+    KUMA_INFOTRACE("SslContextMap::load, certificates=" << count);
+    return KMError::NOERR;
+}
+
+void SslContextMap::clear()
+{
+    std::lock_guard<std::mutex> g(load_mutex_);
+    SnapshotPtr snapshot;
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        snapshot_.swap(snapshot);
+    }
+    // the contexts are released out of mutex_
+}
+
+SslContextMap::SnapshotPtr SslContextMap::snapshot()
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    return snapshot_;
+}
+
+SSL_CTX* SslContextMap::get(const char *server_name)
+{
+    if (!server_name || !*server_name) {
+        return nullptr;
+    }
+    auto snapshot = this->snapshot();
+    if (!snapshot) {
+        return nullptr;
+    }
+    auto name = toLower(server_name);
+    SSL_CTX *ssl_ctx = nullptr;
+    auto it = snapshot->exact.find(name);
+    if (it != snapshot->exact.end()) {
+        ssl_ctx = it->second.get();
+    } else {
+        // the wildcard matches one label only
+        auto pos = name.find('.');
+        if (pos != std::string::npos && pos > 0) {
+            it = snapshot->wildcard.find(name.substr(pos + 1));
+            if (it != snapshot->wildcard.end()) {
+                ssl_ctx = it->second.get();
+            }
+        }
+    }
+    if (ssl_ctx) {
+        // the snapshot may be released by reloading once returned
+        SSL_CTX_up_ref(ssl_ctx);
+    }
+    return ssl_ctx;
+}
+
+SslContextMap& SslContextMap::instance()
+{
+    static SslContextMap s_map;
+    return s_map;
+}
+
+#endif // KUMA_HAS_OPENSSL
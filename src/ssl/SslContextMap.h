@@ -0,0 +1,74 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SslContextMap_H__
+#define __SslContextMap_H__
+
+#ifdef KUMA_HAS_OPENSSL
+
+#include "kmdefs.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <openssl/ssl.h>
+
+KUMA_NS_BEGIN
+
+/* server SSL contexts keyed by host name, selected by SNI callback. the name
+ * "*.example.com" matches the names with one more label, e.g. "www.example.com",
+ * the exact name takes precedence. a certificate set is loaded into a new
+ * snapshot and swapped atomically, the handshakes in flight keep the SSL_CTX
+ * they are using
+ */
+class SslContextMap
+{
+public:
+    KMError load(const SslCertificate *certs, size_t count);
+    void clear();
+    // the returned SSL_CTX should be released by SSL_CTX_free
+    SSL_CTX* get(const char *server_name);
+    
+    static SslContextMap& instance();
+    
+private:
+    using ContextMap = std::unordered_map<std::string, std::shared_ptr<SSL_CTX>>;
+    struct Snapshot
+    {
+        ContextMap exact;
+        ContextMap wildcard; // keyed by the name without "*."
+    };
+    using SnapshotPtr = std::shared_ptr<const Snapshot>;
+    
+    SnapshotPtr snapshot();
+    
+    std::mutex      load_mutex_; // serialize the loading
+    std::mutex      mutex_; // guard snapshot_ only
+    SnapshotPtr     snapshot_;
+};
+
+KUMA_NS_END
+
+#endif // KUMA_HAS_OPENSSL
+
+#endif
@@ -0,0 +1,127 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef KUMA_HAS_OPENSSL
+
+#include "SslCryptoPool.h"
+#include "util/kmtrace.h"
+
+using namespace kuma;
+
+SslCryptoPool::SslCryptoPool()
+{
+    
+}
+
+SslCryptoPool::~SslCryptoPool()
+{
+    stop();
+}
+
+KMError SslCryptoPool::setThreadCount(int count)
+{
+    if (count < 0) {
+        return KMError::INVALID_PARAM;
+    }
+    std::lock_guard<std::mutex> g(config_mutex_);
+    if (count == static_cast<int>(threads_.size())) {
+        return KMError::NOERR;
+    }
+    stopThreads();
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        stop_flag_ = false;
+        thread_count_ = count;
+    }
+    for (int i = 0; i < count; ++i) {
+        threads_.emplace_back([this] { workerProc(); });
+    }
+    KUMA_INFOTRACE("SslCryptoPool::setThreadCount, count=" << count);
+    return KMError::NOERR;
+}
+
+int SslCryptoPool::getThreadCount()
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    return thread_count_;
+}
+
+bool SslCryptoPool::post(Task task)
+{
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        if (thread_count_ == 0 || stop_flag_) {
+            return false;
+        }
+        tasks_.emplace_back(std::move(task));
+    }
+    cond_.notify_one();
+    return true;
+}
+
+void SslCryptoPool::stop()
+{
+    std::lock_guard<std::mutex> g(config_mutex_);
+    stopThreads();
+}
+
+void SslCryptoPool::stopThreads()
+{
+    {
+        std::lock_guard<std::mutex> g(mutex_);
+        stop_flag_ = true;
+        thread_count_ = 0;
+    }
+    cond_.notify_all();
+    for (auto &thr : threads_) {
+        if (thr.joinable()) {
+            thr.join();
+        }
+    }
+    threads_.clear();
+}
+
+void SslCryptoPool::workerProc()
+{
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            cond_.wait(lk, [this] { return stop_flag_ || !tasks_.empty(); });
+            // drain the queue before exit, the handshakes waiting for result
+            // will never complete otherwise
+            if (tasks_.empty()) {
+                break;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+SslCryptoPool& SslCryptoPool::instance()
+{
+    static SslCryptoPool s_pool;
+    return s_pool;
+}
+
+#endif // KUMA_HAS_OPENSSL
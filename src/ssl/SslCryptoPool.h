@@ -0,0 +1,77 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SslCryptoPool_H__
+#define __SslCryptoPool_H__
+
+#ifdef KUMA_HAS_OPENSSL
+
+#include "kmdefs.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+KUMA_NS_BEGIN
+
+/* worker threads to run the SSL handshake steps, the private key operations of
+ * handshake (RSA/ECDSA signing, ECDHE) take milliseconds and will stall all the
+ * other connections of the event loop if they are run in loop thread. the pool
+ * is disabled if thread count is 0, it is shared by all the event loops
+ */
+class SslCryptoPool
+{
+public:
+    using Task = std::function<void(void)>;
+    
+    SslCryptoPool();
+    ~SslCryptoPool();
+    
+    // the queued tasks are run before the threads exit when count is decreased
+    KMError setThreadCount(int count);
+    int getThreadCount();
+    // return false if the pool is disabled
+    bool post(Task task);
+    void stop();
+    
+    static SslCryptoPool& instance();
+    
+private:
+    void workerProc();
+    void stopThreads();
+    
+    std::mutex                  config_mutex_; // serialize setThreadCount and stop
+    std::mutex                  mutex_;
+    std::condition_variable     cond_;
+    std::deque<Task>            tasks_;
+    std::vector<std::thread>    threads_;
+    int                         thread_count_ = 0;
+    bool                        stop_flag_ = false;
+};
+
+KUMA_NS_END
+
+#endif // KUMA_HAS_OPENSSL
+
+#endif
@@ -22,12 +22,23 @@
 #ifdef KUMA_HAS_OPENSSL
 
 #include "SslHandler.h"
+#include "SslSessionCache.h"
 #include "util/kmtrace.h"
 
 #include <openssl/x509v3.h>
 
+#include <algorithm>
+
 using namespace kuma;
 
+// small records fit in one TCP segment and can be decrypted as soon as the
+// segment arrives, full records are used after kRampUpBytes sent
+static const size_t kSmallRecordSize = 1360;
+static const size_t kFullRecordSize = 16*1024;
+static const size_t kRampUpBytes = 1024*1024;
+// back to small records after idle
+static const TICK_COUNT_TYPE kRecordSizeResetMs = 1000;
+
 void SslHandler::cleanup()
 {
     if(ssl_) {
@@ -36,6 +47,123 @@ void SslHandler::cleanup()
         ssl_ = NULL;
     }
     setState(SslState::SSL_NONE);
+    record_buf_.reset();
+    record_size_ = 0;
+    bytes_since_idle_ = 0;
+}
+
+int SslHandler::send(const void* data, size_t size)
+{
+    iovec iov;
+    iov.iov_base = (char*)data;
+    iov.iov_len = size;
+    return send(&iov, 1);
+}
+
+int SslHandler::send(const iovec* iovs, int count)
+{
+    // the buffered record should be sent first
+    if (flushRecordBuffer() != KMError::NOERR) {
+        return -1;
+    }
+    if (!record_buf_.empty()) {
+        return 0;
+    }
+    auto record_size = updateRecordSize();
+    size_t bytes_sent = 0;
+    for (int i = 0; i < count; ++i) {
+        auto *ptr = static_cast<const uint8_t*>(iovs[i].iov_base);
+        size_t len = iovs[i].iov_len;
+        while (len > 0) {
+            if (record_buf_.empty() && len >= record_size) {
+                // the full records are written directly
+                auto full_len = len - len % record_size;
+                auto ret = writeRecords(ptr, full_len);
+                if (ret < 0) {
+                    return ret;
+                }
+                bytes_sent += ret;
+                if (static_cast<size_t>(ret) < full_len) {
+                    return static_cast<int>(bytes_sent); // send blocked
+                }
+                ptr += ret;
+                len -= ret;
+                continue;
+            }
+            auto copy_len = std::min(record_size - record_buf_.size(), len);
+            record_buf_.write(ptr, copy_len);
+            bytes_sent += copy_len;
+            ptr += copy_len;
+            len -= copy_len;
+            if (record_buf_.size() >= record_size) {
+                if (flushRecordBuffer() != KMError::NOERR) {
+                    return -1;
+                }
+                if (!record_buf_.empty()) {
+                    return static_cast<int>(bytes_sent); // send blocked
+                }
+            }
+        }
+    }
+    // the last partial record
+    if (flushRecordBuffer() != KMError::NOERR) {
+        return -1;
+    }
+    return static_cast<int>(bytes_sent);
+}
+
+int SslHandler::send(const KMBuffer &buf)
+{
+    IOVEC iovs;
+    buf.fillIov(iovs);
+    if (iovs.empty()) {
+        return 0;
+    }
+    return send(&iovs[0], static_cast<int>(iovs.size()));
+}
+
+KMError SslHandler::sendBufferedData()
+{
+    return flushRecordBuffer();
+}
+
+int SslHandler::writeRecords(const void* data, size_t size)
+{
+    auto ret = sendAppData(data, size);
+    if (ret > 0) {
+        bytes_since_idle_ += ret;
+    }
+    return ret;
+}
+
+KMError SslHandler::flushRecordBuffer()
+{
+    while (!record_buf_.empty()) {
+        auto ret = writeRecords(record_buf_.ptr(), record_buf_.size());
+        if (ret < 0) {
+            return KMError::SSL_FAILED;
+        }
+        if (ret == 0) {
+            break;
+        }
+        record_buf_.bytes_read(ret);
+    }
+    return KMError::NOERR;
+}
+
+size_t SslHandler::updateRecordSize()
+{
+    auto now_ms = get_tick_count_ms();
+    if (now_ms - last_send_time_ >= kRecordSizeResetMs) {
+        bytes_since_idle_ = 0;
+    }
+    last_send_time_ = now_ms;
+    auto record_size = bytes_since_idle_ < kRampUpBytes ? kSmallRecordSize : kFullRecordSize;
+    if (record_size != record_size_ && ssl_) {
+        SSL_set_max_send_fragment(ssl_, static_cast<long>(record_size));
+        record_size_ = record_size;
+    }
+    return record_size;
 }
 
 KMError SslHandler::init(SslRole ssl_role, SOCKET_FD fd, uint32_t ssl_flags)
@@ -103,6 +231,14 @@ KMError SslHandler::setServerName(const std::string &serverName)
 {
 #if OPENSSL_VERSION_NUMBER >= 0x1000105fL && !defined(OPENSSL_NO_TLSEXT)
     if (ssl_ && SSL_set_tlsext_host_name(ssl_, serverName.c_str())) {
+        if (!is_server_) {
+            // try to resume the session of previous connection to the same server
+            auto *session = SslSessionCache::instance().get(serverName);
+            if (session) {
+                SSL_set_session(ssl_, session);
+                SSL_SESSION_free(session);
+            }
+        }
         return KMError::NOERR;
     }
     return KMError::SSL_FAILED;
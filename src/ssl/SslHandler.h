@@ -28,6 +28,8 @@
 #include "evdefs.h"
 #include "kmbuffer.h"
 #include "OpenSslLib.h"
+#include "util/skbuffer.h"
+#include "util/util.h"
 
 #include <string>
 
@@ -53,22 +55,35 @@ public:
     virtual KMError setHostName(const std::string &hostName);
     
     virtual SslState handshake() = 0;
-    virtual int send(const void* data, size_t size) = 0;
-    virtual int send(const iovec* iovs, int count) = 0;
-    virtual int send(const KMBuffer &buf) = 0;
+    /* the small fragments are gathered into one TLS record, the bytes buffered in
+     * record buffer are counted as sent and will be sent by sendBufferedData,
+     * hasPendingData is true if they are blocked by socket
+     */
+    virtual int send(const void* data, size_t size);
+    virtual int send(const iovec* iovs, int count);
+    virtual int send(const KMBuffer &buf);
     virtual int receive(void* data, size_t size) = 0;
     virtual KMError close() = 0;
     
-    virtual KMError sendBufferedData() { return KMError::NOERR; }
+    virtual KMError sendBufferedData();
+    bool hasPendingData() const { return !record_buf_.empty(); }
     SslState getState() const { return state_; }
     bool isServer() const { return is_server_; }
+    bool isSessionReused() const { return ssl_ && SSL_session_reused(ssl_); }
     uint32_t getSslFlags() const { return ssl_flags_; }
     
 protected:
+    // write app data to SSL, return the bytes written
+    virtual int sendAppData(const void* data, size_t size) = 0;
     void setState(SslState state) { state_ = state; }
     const std::string& getObjKey() const { return obj_key_; }
     virtual void cleanup();
     
+private:
+    int writeRecords(const void* data, size_t size);
+    KMError flushRecordBuffer();
+    size_t updateRecordSize();
+    
 protected:
     SSL*        ssl_ = nullptr;
     SOCKET_FD   fd_ = INVALID_FD;
@@ -76,6 +91,12 @@ protected:
     bool        is_server_ = false;
     uint32_t    ssl_flags_ = 0;
     std::string obj_key_{ "SslHandler" };
+    
+private:
+    SKBuffer        record_buf_;
+    size_t          record_size_ = 0;
+    size_t          bytes_since_idle_ = 0;
+    TICK_COUNT_TYPE last_send_time_ = 0;
 };
 
 KUMA_NS_END
@@ -0,0 +1,196 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef KUMA_HAS_OPENSSL
+
+#include "SslSessionCache.h"
+#include "util/kmtrace.h"
+
+#include <string.h>
+
+#include <openssl/rand.h>
+
+using namespace kuma;
+
+//////////////////////////////////////////////////////////////////////////
+// SslSessionCache
+SslSessionCache::SslSessionCache(size_t max_servers, size_t max_sessions_per_server)
+: max_servers_(max_servers)
+, max_sessions_per_server_(max_sessions_per_server)
+{
+    
+}
+
+SslSessionCache::~SslSessionCache()
+{
+    clear();
+}
+
+void SslSessionCache::freeSessions(SessionStack &sessions)
+{
+    for (auto *session : sessions) {
+        SSL_SESSION_free(session);
+    }
+    sessions.clear();
+}
+
+void SslSessionCache::put(const std::string &server_name, SSL_SESSION *session)
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    auto it = server_map_.find(server_name);
+    if (it != server_map_.end()) {
+        servers_.splice(servers_.begin(), servers_, it->second);
+    } else {
+        servers_.emplace_front(server_name, SessionStack());
+        server_map_.emplace(server_name, servers_.begin());
+        while (servers_.size() > max_servers_) {
+            auto &last = servers_.back();
+            freeSessions(last.second);
+            server_map_.erase(last.first);
+            servers_.pop_back();
+        }
+    }
+    auto &sessions = servers_.front().second;
+    sessions.push_back(session);
+    if (sessions.size() > max_sessions_per_server_) {
+        SSL_SESSION_free(sessions.front());
+        sessions.erase(sessions.begin());
+    }
+}
+
+SSL_SESSION* SslSessionCache::get(const std::string &server_name)
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    auto it = server_map_.find(server_name);
+    if (it == server_map_.end()) {
+        return nullptr;
+    }
+    servers_.splice(servers_.begin(), servers_, it->second);
+    auto &sessions = it->second->second;
+    while (!sessions.empty()) {
+        auto *session = sessions.back();
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+        if (!SSL_SESSION_is_resumable(session)) {
+            SSL_SESSION_free(session);
+            sessions.pop_back();
+            continue;
+        }
+#endif
+#ifdef TLS1_3_VERSION
+        if (SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION) {
+            // TLS 1.3 ticket should be used only once
+            sessions.pop_back();
+            return session;
+        }
+#endif
+        SSL_SESSION_up_ref(session);
+        return session;
+    }
+    return nullptr;
+}
+
+void SslSessionCache::remove(const std::string &server_name)
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    auto it = server_map_.find(server_name);
+    if (it != server_map_.end()) {
+        freeSessions(it->second->second);
+        servers_.erase(it->second);
+        server_map_.erase(it);
+    }
+}
+
+void SslSessionCache::clear()
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    for (auto &kv : servers_) {
+        freeSessions(kv.second);
+    }
+    servers_.clear();
+    server_map_.clear();
+}
+
+SslSessionCache& SslSessionCache::instance()
+{
+    static SslSessionCache s_cache;
+    return s_cache;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SslTicketKeys
+SslTicketKeys::SslTicketKeys(uint32_t rotate_interval_ms, size_t max_keys)
+: rotate_interval_ms_(rotate_interval_ms)
+, max_keys_(max_keys)
+{
+    
+}
+
+void SslTicketKeys::rotate(TICK_COUNT_TYPE now_ms)
+{
+    Key key;
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+        RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1 ||
+        RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1) {
+        KUMA_WARNTRACE("SslTicketKeys::rotate, RAND_bytes failed");
+        return;
+    }
+    key.create_time = now_ms;
+    keys_.insert(keys_.begin(), key);
+    if (keys_.size() > max_keys_) {
+        keys_.resize(max_keys_);
+    }
+}
+
+bool SslTicketKeys::getEncryptKey(Key &key)
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    auto now_ms = get_tick_count_ms();
+    if (keys_.empty() || now_ms - keys_.front().create_time >= rotate_interval_ms_) {
+        rotate(now_ms);
+    }
+    if (keys_.empty()) {
+        return false;
+    }
+    key = keys_.front();
+    return true;
+}
+
+bool SslTicketKeys::getDecryptKey(const uint8_t name[16], Key &key, bool &is_current)
+{
+    std::lock_guard<std::mutex> g(mutex_);
+    for (size_t i = 0; i < keys_.size(); ++i) {
+        if (memcmp(keys_[i].name, name, sizeof(keys_[i].name)) == 0) {
+            key = keys_[i];
+            // the ticket should be renewed if the key is going to be expired
+            is_current = i == 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+SslTicketKeys& SslTicketKeys::instance()
+{
+    static SslTicketKeys s_keys;
+    return s_keys;
+}
+
+#endif // KUMA_HAS_OPENSSL
@@ -0,0 +1,110 @@
+/* Copyright (c) 2017, Fengping Bao <jamol@live.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SslSessionCache_H__
+#define __SslSessionCache_H__
+
+#ifdef KUMA_HAS_OPENSSL
+
+#include "kmdefs.h"
+#include "util/util.h"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+KUMA_NS_BEGIN
+
+/* client side TLS sessions keyed by server name, the session is set to the new
+ * connection with the same server name to do an abbreviated handshake. a few
+ * sessions are kept for each server since the TLS 1.3 session is used only once
+ * and the concurrent connections to the same server need different sessions.
+ * it is shared by all the event loops
+ */
+class SslSessionCache
+{
+public:
+    SslSessionCache(size_t max_servers = 512, size_t max_sessions_per_server = 16);
+    ~SslSessionCache();
+    
+    // the ownership of session is taken
+    void put(const std::string &server_name, SSL_SESSION *session);
+    // the returned session should be released by SSL_SESSION_free
+    SSL_SESSION* get(const std::string &server_name);
+    void remove(const std::string &server_name);
+    void clear();
+    
+    static SslSessionCache& instance();
+    
+private:
+    using SessionStack = std::vector<SSL_SESSION*>; // newest last
+    using ServerList = std::list<std::pair<std::string, SessionStack>>;
+    
+    void freeSessions(SessionStack &sessions);
+    
+    std::mutex      mutex_;
+    size_t          max_servers_;
+    size_t          max_sessions_per_server_;
+    ServerList      servers_; // most recently used first
+    std::unordered_map<std::string, ServerList::iterator> server_map_;
+};
+
+/* server side session ticket keys, a new key is generated every rotate interval
+ * and the tickets encrypted by the previous keys are still accepted and renewed.
+ * the keys are shared by all the event loops since they use the same SSL_CTX
+ */
+class SslTicketKeys
+{
+public:
+    struct Key {
+        uint8_t     name[16];
+        uint8_t     aes_key[32];
+        uint8_t     hmac_key[32];
+        TICK_COUNT_TYPE create_time;
+    };
+    
+    SslTicketKeys(uint32_t rotate_interval_ms = 3600*1000, size_t max_keys = 3);
+    
+    bool getEncryptKey(Key &key);
+    // is_current is false if key is found in previous keys
+    bool getDecryptKey(const uint8_t name[16], Key &key, bool &is_current);
+    
+    static SslTicketKeys& instance();
+    
+private:
+    void rotate(TICK_COUNT_TYPE now_ms);
+    
+private:
+    std::mutex          mutex_;
+    uint32_t            rotate_interval_ms_;
+    size_t              max_keys_;
+    std::vector<Key>    keys_; // current key first
+};
+
+KUMA_NS_END
+
+#endif // KUMA_HAS_OPENSSL
+
+#endif
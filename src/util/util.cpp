@@ -40,6 +40,8 @@
 # include <dlfcn.h>
 # include <unistd.h>
 # include <netinet/tcp.h>
+# include <sys/un.h>
+# include <stddef.h>
 # ifdef KUMA_OS_MAC
 #  include "CoreFoundation/CoreFoundation.h"
 #  include <mach-o/dyld.h>
@@ -327,6 +329,18 @@ extern "C" int km_get_sock_addr(const sockaddr *sk_addr, unsigned int sk_addr_le
     }
 #endif
     
+#ifndef KUMA_OS_WIN
+    if (AF_UNIX == sk_addr->sa_family) {
+        std::string str;
+        if (km_get_unix_addr(*(const sockaddr_storage*)sk_addr, str) != 0 || str.size() >= addr_len) {
+            return -1;
+        }
+        memcpy(addr, str.c_str(), str.size() + 1);
+        if(port)
+            *port = 0;
+        return 0;
+    }
+#endif
     char service[16] = {0};
     if(km_getnameinfo(sk_addr, sk_addr_len, addr, addr_len, service, sizeof(service), NI_NUMERICHOST|NI_NUMERICSERV) != 0)
         return -1;
@@ -370,6 +384,48 @@ int km_set_addr_port(uint16_t port, sockaddr_storage &addr)
     return 0;
 }
 
+int km_get_sock_addrs(const char* addr, uint16_t port, addrinfo* hints, std::vector<sockaddr_storage> &addrs)
+{
+#ifdef KUMA_OS_WIN
+    if(!ipv6_api_init()) {
+        sockaddr_storage ss_addr = { 0 };
+        auto ret = km_set_sock_addr(addr, port, hints, (struct sockaddr*)&ss_addr, sizeof(ss_addr));
+        if (ret == 0) {
+            addrs.push_back(ss_addr);
+        }
+        return ret;
+    }
+#endif
+    char service[128] = {0};
+    struct addrinfo* ai = nullptr;
+    SNPRINTF(service, sizeof(service)-1, "%d", port);
+    auto ret = km_getaddrinfo(addr, service, hints, &ai);
+    if(ret != 0 || !ai) {
+        if(ai) km_freeaddrinfo(ai);
+        return ret != 0 ? ret : -1;
+    }
+    for (auto p = ai; p; p = p->ai_next) {
+        if ((p->ai_family != AF_INET && p->ai_family != AF_INET6) ||
+            p->ai_addrlen > sizeof(sockaddr_storage)) {
+            continue;
+        }
+        sockaddr_storage ss_addr = { 0 };
+        memcpy(&ss_addr, p->ai_addr, p->ai_addrlen);
+        bool duplicated = false;
+        for (auto &a : addrs) {
+            if (memcmp(&a, &ss_addr, sizeof(ss_addr)) == 0) {
+                duplicated = true;
+                break;
+            }
+        }
+        if (!duplicated) {
+            addrs.push_back(ss_addr);
+        }
+    }
+    km_freeaddrinfo(ai);
+    return addrs.empty() ? -1 : 0;
+}
+
 int km_get_addr_length(const sockaddr_storage &addr)
 {
     int addr_len = sizeof(addr);
@@ -379,9 +435,71 @@ int km_get_addr_length(const sockaddr_storage &addr)
     else if (AF_INET6 == addr.ss_family) {
         addr_len = sizeof(sockaddr_in6);
     }
+#ifndef KUMA_OS_WIN
+    else if (AF_UNIX == addr.ss_family) {
+        auto *sa = (const sockaddr_un*)&addr;
+        if (sa->sun_path[0] == '\0') { // abstract name is not NUL terminated
+            addr_len = int(offsetof(sockaddr_un, sun_path) + 1 + strnlen(sa->sun_path + 1, sizeof(sa->sun_path) - 1));
+        } else {
+            addr_len = int(offsetof(sockaddr_un, sun_path) + strnlen(sa->sun_path, sizeof(sa->sun_path)) + 1);
+        }
+    }
+#endif
     return addr_len;
 }
 
+bool km_is_unix_address(const std::string &addr)
+{
+    return addr.compare(0, 5, "unix:") == 0;
+}
+
+int km_set_unix_addr(const std::string &addr, sockaddr_storage &ss_addr)
+{
+#ifdef KUMA_OS_WIN
+    return -1;
+#else
+    if (!km_is_unix_address(addr)) {
+        return -1;
+    }
+    auto path = addr.substr(5);
+    auto *sa = (sockaddr_un*)&ss_addr;
+    if (path.empty() || path.size() >= sizeof(sa->sun_path)) {
+        return -1;
+    }
+    memset(&ss_addr, 0, sizeof(ss_addr));
+    sa->sun_family = AF_UNIX;
+    memcpy(sa->sun_path, path.c_str(), path.size());
+    if (path[0] == '@') { // abstract namespace
+#ifdef KUMA_OS_LINUX
+        sa->sun_path[0] = '\0';
+#else
+        return -1;
+#endif
+    }
+    return 0;
+#endif
+}
+
+int km_get_unix_addr(const sockaddr_storage &ss_addr, std::string &addr)
+{
+#ifdef KUMA_OS_WIN
+    return -1;
+#else
+    if (AF_UNIX != ss_addr.ss_family) {
+        return -1;
+    }
+    auto *sa = (const sockaddr_un*)&ss_addr;
+    addr = "unix:";
+    if (sa->sun_path[0] == '\0' && sa->sun_path[1] != '\0') {
+        addr.push_back('@');
+        addr.append(sa->sun_path + 1, strnlen(sa->sun_path + 1, sizeof(sa->sun_path) - 1));
+    } else {
+        addr.append(sa->sun_path, strnlen(sa->sun_path, sizeof(sa->sun_path)));
+    }
+    return 0;
+#endif
+}
+
 extern "C" bool km_is_ipv6_address(const char* addr)
 {
     sockaddr_storage ss_addr = {0};
@@ -36,6 +36,7 @@
 #include <string>
 #include <sstream>
 #include <memory>
+#include <vector>
 
 struct addrinfo;
 struct sockaddr;
@@ -207,7 +208,13 @@ extern "C" {
 int km_get_sock_addr(const sockaddr *addr, size_t addr_len, std::string &ip, uint16_t *port);
 int km_get_sock_addr(const sockaddr_storage &addr, std::string &ip, uint16_t *port);
 int km_set_addr_port(uint16_t port, sockaddr_storage &addr);
+// get all the addresses of host, in the order returned by getaddrinfo
+int km_get_sock_addrs(const char* addr, uint16_t port, addrinfo* hints, std::vector<sockaddr_storage> &addrs);
 int km_get_addr_length(const sockaddr_storage &addr);
+// unix domain socket address, "unix:/path/to/socket" or "unix:@name" for abstract namespace
+bool km_is_unix_address(const std::string &addr);
+int km_set_unix_addr(const std::string &addr, sockaddr_storage &ss_addr);
+int km_get_unix_addr(const sockaddr_storage &ss_addr, std::string &addr);
 
 inline bool km_is_fatal_error(KMError err)
 {
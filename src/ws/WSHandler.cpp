@@ -103,8 +103,8 @@ std::string WSHandler::buildUpgradeRequest(const std::string& path, const std::s
 
 std::string WSHandler::buildUpgradeResponse()
 {
-    std::string sec_ws_key = http_parser_.getHeaderValue("Sec-WebSocket-Key");
-    std::string protos = http_parser_.getHeaderValue("Sec-WebSocket-Protocol");
+    std::string sec_ws_key = http_parser_.getHeaderValue(HeaderId::SEC_WEBSOCKET_KEY);
+    std::string protos = http_parser_.getHeaderValue(HeaderId::SEC_WEBSOCKET_PROTOCOL);
     
     std::stringstream ss;
     ss << "HTTP/1.1 101 Switching Protocols\r\n";
@@ -120,12 +120,12 @@ std::string WSHandler::buildUpgradeResponse()
 
 const std::string WSHandler::getProtocol()
 {
-    return http_parser_.getHeaderValue("Sec-WebSocket-Protocol");
+    return http_parser_.getHeaderValue(HeaderId::SEC_WEBSOCKET_PROTOCOL);
 }
 
 const std::string WSHandler::getOrigin()
 {
-    return http_parser_.getHeaderValue("Origin");
+    return http_parser_.getHeaderValue(HeaderId::ORIGIN);
 }
 
 void WSHandler::onHttpData(KMBuffer &buf)
@@ -165,7 +165,7 @@ void WSHandler::handleRequest()
         if(handshake_cb_) handshake_cb_(KMError::INVALID_PROTO);
         return;
     }
-    std::string sec_ws_key = http_parser_.getHeaderValue("Sec-WebSocket-Key");
+    std::string sec_ws_key = http_parser_.getHeaderValue(HeaderId::SEC_WEBSOCKET_KEY);
     if(sec_ws_key.empty()) {
         state_ = STATE_ERROR;
         KUMA_INFOTRACE("WSHandler::handleRequest, no Sec-WebSocket-Key");
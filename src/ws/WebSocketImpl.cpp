@@ -93,7 +93,7 @@ KMError WebSocket::Impl::connect_i(const std::string& ws_url)
         port = std::stoi(str_port);
     }
     setSslFlags(ssl_flags);
-    return TcpConnection::connect(uri_.getHost().c_str(), port);
+    return TcpConnection::connect(uri_.getConnectHost(), port);
 }
 
 KMError WebSocket::Impl::attachFd(SOCKET_FD fd, const KMBuffer *init_buf)
@@ -119,7 +119,7 @@ int WebSocket::Impl::send(const void* data, size_t len, bool is_text, bool fin)
     if(getState() != State::OPEN) {
         return -1;
     }
-    if(!sendBufferEmpty()) {
+    if(sendBufferBlocked()) {
         return 0;
     }
     WSHandler::WSOpcode opcode = WSHandler::WSOpcode::WS_OPCODE_BINARY;
@@ -146,7 +146,7 @@ int WebSocket::Impl::send(const KMBuffer &buf, bool is_text, bool fin)
     if(getState() != State::OPEN) {
         return -1;
     }
-    if(!sendBufferEmpty()) {
+    if(sendBufferBlocked()) {
         return 0;
     }
     WSHandler::WSOpcode opcode = WSHandler::WSOpcode::WS_OPCODE_BINARY;
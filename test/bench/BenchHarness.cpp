@@ -0,0 +1,305 @@
+#include "BenchHarness.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <future>
+#include <map>
+
+using namespace kuma;
+
+double getCpuTime()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+bool startLoop(EventLoop &loop, std::thread &thread)
+{
+    std::promise<bool> ready;
+    auto ready_future = ready.get_future();
+    thread = std::thread([&loop, &ready] {
+        bool ok = loop.init();
+        ready.set_value(ok);
+        if (ok) {
+            loop.loop();
+        }
+    });
+    if (!ready_future.get()) {
+        thread.join();
+        return false;
+    }
+    return true;
+}
+
+class BenchServerConn
+{
+public:
+    virtual ~BenchServerConn() {}
+    virtual KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) = 0;
+    virtual void close() = 0;
+};
+
+class BenchHttpConn : public BenchServerConn
+{
+public:
+    BenchHttpConn(EventLoop *loop, const BenchResponderFactory &factory)
+    : rsp_(loop, "HTTP/1.1")
+    , responder_(factory(rsp_))
+    {
+
+    }
+
+    KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) override
+    {
+        rsp_.setRequestCompleteCallback([this] { responder_->onRequest(); });
+        rsp_.setWriteCallback([this] (KMError) { responder_->onSend(); });
+        rsp_.setResponseCompleteCallback([this] { rsp_.reset(); });
+        rsp_.setErrorCallback([this] (KMError) { rsp_.close(); });
+        return rsp_.attachSocket(std::move(tcp), std::move(parser), init_buf);
+    }
+
+    void close() override
+    {
+        rsp_.close();
+    }
+
+private:
+    HttpResponse                    rsp_;
+    std::unique_ptr<BenchResponder> responder_;
+};
+
+class BenchH2Conn : public BenchServerConn
+{
+public:
+    BenchH2Conn(EventLoop *loop, const BenchResponderFactory &factory)
+    : loop_(loop)
+    , token_(loop->createToken())
+    , conn_(loop)
+    , factory_(factory)
+    {
+
+    }
+
+    KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) override
+    {
+        conn_.setAcceptCallback([this] (uint32_t stream_id) -> bool { return onAccept(stream_id); });
+        conn_.setErrorCallback([this] (int) { close(); });
+        return conn_.attachSocket(std::move(tcp), std::move(parser), init_buf);
+    }
+
+    void close() override
+    {
+        token_.reset();
+        for (auto &kv : streams_) {
+            kv.second->rsp.close();
+        }
+        streams_.clear();
+        conn_.close();
+    }
+
+private:
+    struct Stream
+    {
+        Stream(EventLoop *loop, const BenchResponderFactory &factory)
+        : rsp(loop, "HTTP/2.0"), responder(factory(rsp)) {}
+        HttpResponse                    rsp;
+        std::unique_ptr<BenchResponder> responder;
+    };
+
+    bool onAccept(uint32_t stream_id)
+    {
+        std::unique_ptr<Stream> stream(new Stream(loop_, factory_));
+        auto *s = stream.get();
+        s->rsp.setRequestCompleteCallback([s] { s->responder->onRequest(); });
+        s->rsp.setWriteCallback([s] (KMError) { s->responder->onSend(); });
+        s->rsp.setResponseCompleteCallback([this, stream_id] {
+            // cannot destroy the response in its callback
+            loop_->post([this, stream_id] { streams_.erase(stream_id); }, &token_);
+        });
+        s->rsp.setErrorCallback([this, stream_id] (KMError) {
+            loop_->post([this, stream_id] { streams_.erase(stream_id); }, &token_);
+        });
+        streams_[stream_id] = std::move(stream);
+        return conn_.attachStream(stream_id, &s->rsp) == KMError::NOERR;
+    }
+
+private:
+    EventLoop*                      loop_;
+    EventLoop::Token                token_;
+    H2Connection                    conn_;
+    const BenchResponderFactory&    factory_;
+    std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+};
+
+BenchClient::BenchClient(EventLoop *loop, std::atomic<uint64_t> &completed, std::atomic<uint64_t> &bytes,
+                         const char *ver, const BenchHeaders &headers)
+: loop_(loop)
+, token_(loop->createToken())
+, completed_(completed)
+, bytes_(bytes)
+, ver_(ver)
+, headers_(headers)
+{
+
+}
+
+void BenchClient::start(const std::string &url)
+{
+    url_ = url;
+    sendRequest();
+}
+
+void BenchClient::stop()
+{
+    stopped_ = true;
+    token_.reset();
+    if (req_) {
+        req_->close();
+    }
+}
+
+void BenchClient::createRequest()
+{
+    if (req_) {
+        req_->close();
+    }
+    req_.reset(new HttpRequest(loop_, ver_));
+    req_->setDataCallback([this] (KMBuffer &buf) { bytes_ += buf.chainLength(); });
+    req_->setErrorCallback([this] (KMError err) {
+        printf("BenchClient::onError, err=%d\n", int(err));
+        req_->close();
+    });
+    req_->setResponseCompleteCallback([this] {
+        int status = req_->getStatusCode();
+        if (status < 200 || status >= 300) {
+            printf("BenchClient, unexpected status %d\n", status);
+            stopped_ = true;
+            return;
+        }
+        ++completed_;
+        loop_->post([this] { sendRequest(); }, &token_);
+    });
+}
+
+void BenchClient::sendRequest()
+{
+    if (stopped_) {
+        return;
+    }
+    // the streams of h2 are multiplexed over one connection
+    if (!req_ || strcmp(ver_, "HTTP/2.0") == 0) {
+        createRequest();
+    } else {
+        req_->reset();
+    }
+    for (auto const &kv : headers_) {
+        req_->addHeader(kv.first.c_str(), kv.second.c_str());
+    }
+    req_->sendRequest("GET", url_.c_str());
+}
+
+BenchHarness::BenchHarness(BenchResponderFactory factory)
+: factory_(std::move(factory))
+, server_(&server_loop_)
+{
+
+}
+
+BenchHarness::~BenchHarness()
+{
+    stop();
+}
+
+bool BenchHarness::start(uint16_t port)
+{
+    if (!startLoop(server_loop_, server_thread_)) {
+        printf("failed to init EventLoop\n");
+        return false;
+    }
+    if (!startLoop(client_loop_, client_thread_)) {
+        printf("failed to init EventLoop\n");
+        server_loop_.stop();
+        server_thread_.join();
+        return false;
+    }
+    started_ = true;
+
+    auto add_conn = [this] (BenchServerConn *conn, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        server_conns_.emplace_back(conn);
+        conn->attachSocket(std::move(tcp), std::move(parser), init_buf);
+    };
+    server_.setHttpCallback([=] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        add_conn(new BenchHttpConn(loop, factory_), std::move(tcp), std::move(parser), init_buf);
+    });
+    server_.setHttp2Callback([=] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        add_conn(new BenchH2Conn(loop, factory_), std::move(tcp), std::move(parser), init_buf);
+    });
+    KMError err = KMError::NOERR;
+    server_loop_.sync([&] { err = server_.startListen("127.0.0.1", port); });
+    if (err != KMError::NOERR) {
+        printf("failed to listen on 127.0.0.1:%u\n", port);
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void BenchHarness::startClients(int concurrent, const std::string &url, const char *ver, const BenchHeaders &headers)
+{
+    headers_ = headers;
+    client_loop_.sync([&] {
+        for (int i=0; i<concurrent; ++i) {
+            std::unique_ptr<BenchClient> client(new BenchClient(&client_loop_, completed_, bytes_, ver, headers_));
+            client->start(url);
+            clients_.emplace_back(std::move(client));
+        }
+    });
+}
+
+int64_t BenchHarness::report(int duration, const char *bytes_desc)
+{
+    uint64_t last_count = 0;
+    uint64_t last_bytes = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i=0; i<duration; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t count = completed_;
+        uint64_t total_bytes = bytes_;
+        printf("  %ds: %llu req/s, %.1f MB/s%s\n", i + 1, (unsigned long long)(count - last_count),
+               (total_bytes - last_bytes) / 1048576.0, bytes_desc);
+        last_count = count;
+        last_bytes = total_bytes;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+void BenchHarness::stop()
+{
+    if (!started_) {
+        return;
+    }
+    started_ = false;
+    client_loop_.sync([&] {
+        for (auto &client : clients_) {
+            client->stop();
+        }
+    });
+    // the tasks posted in same loop iteration may be still pending
+    client_loop_.sync([&] { clients_.clear(); });
+    client_loop_.stop();
+    client_thread_.join();
+
+    server_loop_.sync([&] {
+        server_.close();
+        for (auto &conn : server_conns_) {
+            conn->close();
+        }
+    });
+    server_loop_.sync([&] { server_conns_.clear(); });
+    server_loop_.stop();
+    server_thread_.join();
+}
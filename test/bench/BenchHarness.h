@@ -0,0 +1,106 @@
+#ifndef __BenchHarness_H__
+#define __BenchHarness_H__
+
+#include "kmapi.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* the server and clients of the HTTP benchmarks, they run in separate loop threads
+ * of this process. the bench serves each HttpResponse of HTTP/1.1 or HTTP/2 by its
+ * BenchResponder, and the clients send GET requests one after another
+ */
+
+// the CPU time of this process in seconds
+double getCpuTime();
+
+// EventLoop must be initialized in the thread it runs on
+bool startLoop(kuma::EventLoop &loop, std::thread &thread);
+
+// serves the requests of one HttpResponse, it is reused by the requests of HTTP/1.1
+class BenchResponder
+{
+public:
+    virtual ~BenchResponder() {}
+    // the request is complete, send the response
+    virtual void onRequest() = 0;
+    // the response is writable again
+    virtual void onSend() {}
+};
+using BenchResponderFactory = std::function<BenchResponder*(kuma::HttpResponse &rsp)>;
+using BenchHeaders = std::vector<std::pair<std::string, std::string>>;
+
+// sends GET requests one after another, on one connection or one h2 stream each
+class BenchClient
+{
+public:
+    BenchClient(kuma::EventLoop *loop, std::atomic<uint64_t> &completed, std::atomic<uint64_t> &bytes,
+                const char *ver, const BenchHeaders &headers);
+
+    void start(const std::string &url);
+    void stop();
+
+private:
+    void createRequest();
+    void sendRequest();
+
+private:
+    kuma::EventLoop*                    loop_;
+    std::unique_ptr<kuma::HttpRequest>  req_;
+    kuma::EventLoop::Token              token_;
+    std::atomic<uint64_t>&              completed_;
+    std::atomic<uint64_t>&              bytes_;
+    std::string                         url_;
+    const char*                         ver_;
+    const BenchHeaders&                 headers_;
+    bool                                stopped_ = false;
+};
+
+class BenchServerConn;
+
+class BenchHarness
+{
+public:
+    BenchHarness(BenchResponderFactory factory);
+    ~BenchHarness();
+
+    // start the loops and listen on 127.0.0.1:port, the error is printed
+    bool start(uint16_t port);
+    /* start the BenchClients in client loop, the bytes on wire are counted,
+     * the headers are added to each request
+     */
+    void startClients(int concurrent, const std::string &url, const char *ver, const BenchHeaders &headers);
+    /* print the requests and bytes of each second, bytes_desc follows "MB/s",
+     * return the elapsed milliseconds
+     */
+    int64_t report(int duration, const char *bytes_desc);
+    // the requests of client loop other than BenchClients should be closed before stop
+    void stop();
+
+    kuma::EventLoop& clientLoop() { return client_loop_; }
+    uint64_t completed() const { return completed_; }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    BenchResponderFactory       factory_;
+    kuma::EventLoop             server_loop_;
+    kuma::EventLoop             client_loop_;
+    std::thread                 server_thread_;
+    std::thread                 client_thread_;
+    kuma::HttpServer            server_;
+    std::vector<std::unique_ptr<BenchServerConn>> server_conns_;
+
+    BenchHeaders                headers_;
+    std::vector<std::unique_ptr<BenchClient>> clients_;
+    std::atomic<uint64_t>       completed_{0};
+    std::atomic<uint64_t>       bytes_{0};
+    bool                        started_ = false;
+};
+
+#endif
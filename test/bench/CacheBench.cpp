@@ -0,0 +1,433 @@
+#include "CacheBench.h"
+#include "BenchHarness.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kuma;
+
+static const std::string g_cache_usage =
+"   bench cache [option]\n"
+"   -c number       concurrent requests, default 16\n"
+"   -d seconds      test duration, default 10\n"
+"   -p port         local port of the test server, default 52421\n"
+"   -n number       distinct paths, default 100000\n"
+"   -s bytes        response body size, default 4096\n"
+"   -m MB           byte budget of HTTP cache, default 64\n"
+"   -e number       entry budget of HTTP cache, default 10000\n"
+"   -z exponent     Zipf exponent of path popularity, default 0.9\n"
+"   -a seconds      max-age of response, default 3600\n"
+"   -w seconds      stale-while-revalidate of response, default 0\n"
+"   -t proto        http or h2, default http\n"
+;
+
+struct CacheOptions
+{
+    size_t  body_size = 4096;
+    int     max_age = 3600;
+    int     stale_while_revalidate = 0;
+};
+
+static void sendCacheableResponse(HttpResponse &rsp, const std::string &body, const CacheOptions &opts,
+                                  std::atomic<uint64_t> &served)
+{
+    ++served;
+    std::string cache_control = "max-age=" + std::to_string(opts.max_age);
+    if (opts.stale_while_revalidate > 0) {
+        cache_control += ", stale-while-revalidate=" + std::to_string(opts.stale_while_revalidate);
+    }
+    rsp.addHeader("Content-Type", "application/octet-stream");
+    rsp.addHeader("Content-Length", (uint32_t)body.size());
+    rsp.addHeader("Cache-Control", cache_control.c_str());
+    rsp.sendResponse(200, "OK");
+    rsp.sendData(body.c_str(), body.size());
+}
+
+class CacheServerConn
+{
+public:
+    virtual ~CacheServerConn() {}
+    virtual KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) = 0;
+    virtual void close() = 0;
+};
+
+class CacheHttpConn : public CacheServerConn
+{
+public:
+    CacheHttpConn(EventLoop *loop, const std::string &body, const CacheOptions &opts, std::atomic<uint64_t> &served)
+    : rsp_(loop, "HTTP/1.1"), body_(body), opts_(opts), served_(served)
+    {
+        
+    }
+    
+    KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) override
+    {
+        rsp_.setRequestCompleteCallback([this] { sendCacheableResponse(rsp_, body_, opts_, served_); });
+        rsp_.setResponseCompleteCallback([this] { rsp_.reset(); });
+        rsp_.setErrorCallback([this] (KMError) { rsp_.close(); });
+        return rsp_.attachSocket(std::move(tcp), std::move(parser), init_buf);
+    }
+    
+    void close() override
+    {
+        rsp_.close();
+    }
+    
+private:
+    HttpResponse            rsp_;
+    const std::string&      body_;
+    const CacheOptions&     opts_;
+    std::atomic<uint64_t>&  served_;
+};
+
+class CacheH2Conn : public CacheServerConn
+{
+public:
+    CacheH2Conn(EventLoop *loop, const std::string &body, const CacheOptions &opts, std::atomic<uint64_t> &served)
+    : loop_(loop), token_(loop->createToken()), conn_(loop), body_(body), opts_(opts), served_(served)
+    {
+        
+    }
+    
+    KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) override
+    {
+        conn_.setAcceptCallback([this] (uint32_t stream_id) -> bool { return onAccept(stream_id); });
+        conn_.setErrorCallback([this] (int) { close(); });
+        return conn_.attachSocket(std::move(tcp), std::move(parser), init_buf);
+    }
+    
+    void close() override
+    {
+        token_.reset();
+        for (auto &kv : streams_) {
+            kv.second->close();
+        }
+        streams_.clear();
+        conn_.close();
+    }
+    
+private:
+    bool onAccept(uint32_t stream_id)
+    {
+        std::unique_ptr<HttpResponse> rsp(new HttpResponse(loop_, "HTTP/2.0"));
+        auto *r = rsp.get();
+        r->setRequestCompleteCallback([this, r] { sendCacheableResponse(*r, body_, opts_, served_); });
+        r->setResponseCompleteCallback([this, stream_id] {
+            // cannot destroy the response in its callback
+            loop_->post([this, stream_id] { streams_.erase(stream_id); }, &token_);
+        });
+        r->setErrorCallback([this, stream_id] (KMError) {
+            loop_->post([this, stream_id] { streams_.erase(stream_id); }, &token_);
+        });
+        streams_[stream_id] = std::move(rsp);
+        return conn_.attachStream(stream_id, r) == KMError::NOERR;
+    }
+    
+private:
+    EventLoop*              loop_;
+    EventLoop::Token        token_;
+    H2Connection            conn_;
+    const std::string&      body_;
+    const CacheOptions&     opts_;
+    std::atomic<uint64_t>&  served_;
+    std::map<uint32_t, std::unique_ptr<HttpResponse>> streams_;
+};
+
+// the path of rank i is requested with the probability proportional to 1/i^s
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(size_t n, double s, uint32_t seed) : rng_(seed)
+    {
+        cdf_.resize(n);
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += 1.0 / pow(double(i + 1), s);
+            cdf_[i] = sum;
+        }
+        for (auto &c : cdf_) {
+            c /= sum;
+        }
+    }
+    
+    size_t next()
+    {
+        auto r = dist_(rng_);
+        auto it = std::lower_bound(cdf_.begin(), cdf_.end(), r);
+        return it == cdf_.end() ? cdf_.size() - 1 : it - cdf_.begin();
+    }
+    
+private:
+    std::vector<double>                     cdf_;
+    std::mt19937                            rng_;
+    std::uniform_real_distribution<double>  dist_{0.0, 1.0};
+};
+
+class CacheClient
+{
+public:
+    CacheClient(EventLoop *loop, std::atomic<uint64_t> &completed, const char *ver, ZipfGenerator &zipf)
+    : loop_(loop), token_(loop->createToken()), completed_(completed), ver_(ver), zipf_(zipf)
+    {
+        
+    }
+    
+    void start(const std::string &base_url)
+    {
+        base_url_ = base_url;
+        sendRequest();
+    }
+    
+    void stop()
+    {
+        stopped_ = true;
+        token_.reset();
+        if (req_) {
+            req_->close();
+        }
+    }
+    
+private:
+    void createRequest()
+    {
+        if (req_) {
+            req_->close();
+        }
+        req_.reset(new HttpRequest(loop_, ver_));
+        req_->setDataCallback([] (KMBuffer &) {});
+        req_->setErrorCallback([this] (KMError err) {
+            printf("CacheClient::onError, err=%d\n", int(err));
+            stopped_ = true;
+            req_->close();
+        });
+        req_->setResponseCompleteCallback([this] {
+            if (req_->getStatusCode() != 200) {
+                printf("CacheClient, unexpected status %d\n", req_->getStatusCode());
+                stopped_ = true;
+                return;
+            }
+            ++completed_;
+            loop_->post([this] { sendRequest(); }, &token_);
+        });
+    }
+    
+    void sendRequest()
+    {
+        if (stopped_) {
+            return;
+        }
+        // the streams of h2 are multiplexed over one connection
+        if (!req_ || strcmp(ver_, "HTTP/2.0") == 0) {
+            createRequest();
+        } else {
+            req_->reset();
+        }
+        // the response is not cached if the request has no Cache-Control
+        req_->addHeader("Cache-Control", "max-stale=0");
+        auto url = base_url_ + std::to_string(zipf_.next());
+        req_->sendRequest("GET", url.c_str());
+    }
+    
+private:
+    EventLoop*                      loop_;
+    std::unique_ptr<HttpRequest>    req_;
+    EventLoop::Token                token_;
+    std::atomic<uint64_t>&          completed_;
+    std::string                     base_url_;
+    const char*                     ver_;
+    ZipfGenerator&                  zipf_;
+    bool                            stopped_ = false;
+};
+
+int runCacheBench(int argc, char *argv[])
+{
+    int concurrent = 16;
+    int duration = 10;
+    uint16_t port = 52421;
+    size_t paths = 100000;
+    size_t max_mb = 64;
+    size_t max_entries = 10000;
+    double zipf_s = 0.9;
+    std::string proto = "http";
+    CacheOptions opts;
+    for (int i=0; i<argc; ++i) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'c':
+                    concurrent = atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                case 'n':
+                    paths = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 's':
+                    opts.body_size = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 'm':
+                    max_mb = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 'e':
+                    max_entries = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 'z':
+                    zipf_s = atof(argv[++i]);
+                    break;
+                case 'a':
+                    opts.max_age = atoi(argv[++i]);
+                    break;
+                case 'w':
+                    opts.stale_while_revalidate = atoi(argv[++i]);
+                    break;
+                case 't':
+                    proto = argv[++i];
+                    break;
+                default:
+                    printf("%s\n", g_cache_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_cache_usage.c_str());
+            return -1;
+        }
+    }
+    if ((proto != "http" && proto != "h2") || paths == 0 || max_entries == 0) {
+        printf("%s\n", g_cache_usage.c_str());
+        return -1;
+    }
+    if (concurrent <= 0) {
+        concurrent = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    setHttpCacheLimits(max_mb * 1024 * 1024, max_entries);
+    
+    EventLoop server_loop;
+    EventLoop client_loop;
+    std::thread server_thread;
+    std::thread client_thread;
+    if (!startLoop(server_loop, server_thread)) {
+        printf("failed to init EventLoop\n");
+        return -1;
+    }
+    if (!startLoop(client_loop, client_thread)) {
+        printf("failed to init EventLoop\n");
+        server_loop.stop();
+        server_thread.join();
+        return -1;
+    }
+    
+    std::string body(opts.body_size, 'c');
+    std::atomic<uint64_t> served{0};
+    std::vector<std::unique_ptr<CacheServerConn>> server_conns;
+    auto add_conn = [&] (CacheServerConn *conn, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        server_conns.emplace_back(conn);
+        conn->attachSocket(std::move(tcp), std::move(parser), init_buf);
+    };
+    HttpServer server(&server_loop);
+    server.setHttpCallback([&] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        add_conn(new CacheHttpConn(loop, body, opts, served), std::move(tcp), std::move(parser), init_buf);
+    });
+    server.setHttp2Callback([&] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        add_conn(new CacheH2Conn(loop, body, opts, served), std::move(tcp), std::move(parser), init_buf);
+    });
+    KMError err = KMError::NOERR;
+    server_loop.sync([&] { err = server.startListen("127.0.0.1", port); });
+    if (err != KMError::NOERR) {
+        printf("failed to listen on 127.0.0.1:%u\n", port);
+        client_loop.stop();
+        client_thread.join();
+        server_loop.stop();
+        server_thread.join();
+        return -1;
+    }
+    
+    std::atomic<uint64_t> completed{0};
+    ZipfGenerator zipf(paths, zipf_s, 20170101);
+    std::vector<std::unique_ptr<CacheClient>> clients;
+    std::string base_url = "http://127.0.0.1:" + std::to_string(port) + "/item/";
+    client_loop.sync([&] {
+        for (int i=0; i<concurrent; ++i) {
+            std::unique_ptr<CacheClient> client(new CacheClient(&client_loop, completed,
+                                                                proto == "h2" ? "HTTP/2.0" : "HTTP/1.1",
+                                                                zipf));
+            client->start(base_url);
+            clients.emplace_back(std::move(client));
+        }
+    });
+    
+    printf("cache: %s, %d requests, %d seconds, %zu paths of %zu bytes, zipf %.2f, budget %zu MB / %zu entries\n",
+           proto.c_str(), concurrent, duration, paths, opts.body_size, zipf_s, max_mb, max_entries);
+    uint64_t last_count = 0;
+    HttpCacheStats last_stats;
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i=0; i<duration; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t count = completed;
+        HttpCacheStats stats;
+        getHttpCacheStats(stats);
+        auto hits = stats.hits + stats.stale_hits - last_stats.hits - last_stats.stale_hits;
+        auto lookups = hits + stats.misses - last_stats.misses;
+        printf("  %ds: %llu req/s, hit ratio %.1f%%, %llu evictions, %llu entries, %.1f MB\n", i + 1,
+               (unsigned long long)(count - last_count), lookups > 0 ? hits * 100.0 / lookups : 0.0,
+               (unsigned long long)(stats.evictions - last_stats.evictions),
+               (unsigned long long)stats.entries, stats.bytes / 1048576.0);
+        last_count = count;
+        last_stats = stats;
+    }
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    
+    client_loop.sync([&] {
+        for (auto &client : clients) {
+            client->stop();
+        }
+    });
+    // the tasks posted in same loop iteration may be still pending
+    client_loop.sync([&] { clients.clear(); });
+    client_loop.stop();
+    client_thread.join();
+    
+    server_loop.sync([&] {
+        server.close();
+        for (auto &conn : server_conns) {
+            conn->close();
+        }
+    });
+    server_loop.sync([&] { server_conns.clear(); });
+    server_loop.stop();
+    server_thread.join();
+    
+    uint64_t total = completed;
+    HttpCacheStats stats;
+    getHttpCacheStats(stats);
+    auto hits = stats.hits + stats.stale_hits;
+    auto lookups = hits + stats.misses;
+    printf("cache: total %llu requests, average %.0f req/s, %llu served by server\n",
+           (unsigned long long)total, elapsed_ms > 0 ? total * 1000.0 / elapsed_ms : 0.0,
+           (unsigned long long)served.load());
+    printf("cache: %llu hits, %llu stale hits, %llu misses, hit ratio %.1f%%\n",
+           (unsigned long long)stats.hits, (unsigned long long)stats.stale_hits,
+           (unsigned long long)stats.misses, lookups > 0 ? hits * 100.0 / lookups : 0.0);
+    printf("cache: %llu stores, %llu evictions, %llu rejections, %llu expirations, %llu entries, %.1f MB\n",
+           (unsigned long long)stats.stores, (unsigned long long)stats.evictions,
+           (unsigned long long)stats.rejections, (unsigned long long)stats.expirations,
+           (unsigned long long)stats.entries, stats.bytes / 1048576.0);
+    return 0;
+}
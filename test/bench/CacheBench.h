@@ -0,0 +1,10 @@
+#ifndef __CacheBench_H__
+#define __CacheBench_H__
+
+/* HTTP cache benchmark, HttpRequest gets Zipf distributed paths from local HttpServer,
+ * the responses are stored in HttpCache within the byte and entry budgets. hit ratio
+ * and evictions are reported by getHttpCacheStats
+ */
+int runCacheBench(int argc, char *argv[]);
+
+#endif
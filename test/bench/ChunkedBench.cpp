@@ -0,0 +1,218 @@
+#include "ChunkedBench.h"
+#include "BenchHarness.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+
+using namespace kuma;
+
+static const std::string g_chunked_usage =
+"   bench chunked [option]\n"
+"   -n number       responses streamed one after another, default 1\n"
+"   -p port         local port of the test server, default 52421\n"
+"   -s bytes        response body size, default 1073741824\n"
+"   -k bytes        bytes of each chunk, default 16384\n"
+"   -m mode         buffer or raw, chunks of refcounted KMBuffer or raw data, default buffer\n"
+"   -r number       trailer fields of response, default 0\n"
+"   -t proto        http or h2, default http\n"
+;
+
+struct ChunkedOptions
+{
+    size_t      body_size = 1073741824;
+    size_t      chunk_size = 16384;
+    bool        raw = false;
+    int         trailers = 0;
+};
+
+// the body sent by chunks on write callback, and ended by sendData(nullptr, 0)
+class ChunkedResponder : public BenchResponder
+{
+public:
+    ChunkedResponder(HttpResponse &rsp, const KMBuffer &chunk, const ChunkedOptions &opts)
+    : rsp_(rsp), chunk_(chunk), opts_(opts)
+    {
+        
+    }
+    
+    void onRequest() override
+    {
+        rsp_.addHeader("Content-Type", "application/octet-stream");
+        rsp_.addHeader("Transfer-Encoding", "chunked");
+        for (int i = 0; i < opts_.trailers; ++i) {
+            auto name = "X-Trailer-" + std::to_string(i);
+            rsp_.addTrailer(name.c_str(), "0123456789abcdef");
+        }
+        offset_ = 0;
+        ended_ = false;
+        rsp_.sendResponse(200, "OK");
+    }
+    
+    void onSend() override
+    {
+        while (offset_ < opts_.body_size) {
+            auto len = std::min(opts_.chunk_size, opts_.body_size - offset_);
+            int ret = 0;
+            if (opts_.raw) {
+                ret = rsp_.sendData(chunk_.readPtr(), len);
+            } else if (len == chunk_.length()) {
+                // the chunk is shared with send buffer, not copied
+                ret = rsp_.sendData(chunk_);
+            } else {
+                std::unique_ptr<KMBuffer> last(chunk_.subbuffer(0, len));
+                ret = rsp_.sendData(*last);
+            }
+            if (ret <= 0) {
+                return;
+            }
+            offset_ += ret;
+        }
+        if (!ended_) {
+            ended_ = true;
+            rsp_.sendData(nullptr, 0);
+        }
+    }
+    
+private:
+    HttpResponse&           rsp_;
+    const KMBuffer&         chunk_;
+    const ChunkedOptions&   opts_;
+    size_t                  offset_ = 0;
+    bool                    ended_ = false;
+};
+
+int runChunkedBench(int argc, char *argv[])
+{
+    int count = 1;
+    uint16_t port = 52421;
+    std::string mode = "buffer";
+    std::string proto = "http";
+    ChunkedOptions opts;
+    for (int i=0; i<argc; ++i) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'n':
+                    count = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                case 's':
+                    opts.body_size = strtoull(argv[++i], nullptr, 10);
+                    break;
+                case 'k':
+                    opts.chunk_size = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 'm':
+                    mode = argv[++i];
+                    break;
+                case 'r':
+                    opts.trailers = atoi(argv[++i]);
+                    break;
+                case 't':
+                    proto = argv[++i];
+                    break;
+                default:
+                    printf("%s\n", g_chunked_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_chunked_usage.c_str());
+            return -1;
+        }
+    }
+    if ((proto != "http" && proto != "h2") || (mode != "buffer" && mode != "raw") ||
+        opts.body_size == 0 || opts.chunk_size == 0) {
+        printf("%s\n", g_chunked_usage.c_str());
+        return -1;
+    }
+    opts.raw = mode == "raw";
+    if (count <= 0) {
+        count = 1;
+    }
+    
+    // all the chunks are sent from one refcounted buffer
+    KMBuffer chunk(opts.chunk_size);
+    memset(chunk.writePtr(), 'x', opts.chunk_size);
+    chunk.bytesWritten(opts.chunk_size);
+    
+    BenchHarness harness([&] (HttpResponse &rsp) -> BenchResponder* {
+        return new ChunkedResponder(rsp, chunk, opts);
+    });
+    if (!harness.start(port)) {
+        return -1;
+    }
+    auto &client_loop = harness.clientLoop();
+    
+    printf("chunked: %s, %d responses of %llu bytes, %zu bytes chunks of %s, %d trailers\n",
+           proto.c_str(), count, (unsigned long long)opts.body_size, opts.chunk_size,
+           mode.c_str(), opts.trailers);
+    const char *ver = proto == "h2" ? "HTTP/2.0" : "HTTP/1.1";
+    std::string url = "http://127.0.0.1:" + std::to_string(port) + "/stream";
+    std::unique_ptr<HttpRequest> req;
+    bool failed = false;
+    uint64_t total_bytes = 0;
+    double total_ms = 0;
+    double total_cpu = 0;
+    for (int i = 0; i < count && !failed; ++i) {
+        std::promise<bool> done;
+        auto done_future = done.get_future();
+        uint64_t bytes = 0;
+        bool finished = false;
+        auto start_cpu = getCpuTime();
+        auto start_time = std::chrono::steady_clock::now();
+        client_loop.sync([&] {
+            req.reset(new HttpRequest(&client_loop, ver));
+            req->setDataCallback([&bytes] (KMBuffer &buf) { bytes += buf.chainLength(); });
+            req->setErrorCallback([&] (KMError err) {
+                printf("chunked: request error, err=%d\n", int(err));
+                if (!finished) {
+                    finished = true;
+                    done.set_value(false);
+                }
+            });
+            req->setResponseCompleteCallback([&] {
+                if (!finished) {
+                    finished = true;
+                    done.set_value(req->getStatusCode() == 200);
+                }
+            });
+            req->sendRequest("GET", url.c_str());
+        });
+        failed = !done_future.get();
+        auto elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+        auto cpu_seconds = getCpuTime() - start_cpu;
+        client_loop.sync([&] { req->close(); req.reset(); });
+        if (!failed && bytes != opts.body_size) {
+            printf("chunked: received %llu bytes, expected %llu\n",
+                   (unsigned long long)bytes, (unsigned long long)opts.body_size);
+            failed = true;
+        }
+        if (!failed) {
+            printf("  %d: %.0f ms, %.1f MB/s, %.2f CPU seconds per GB\n", i + 1, elapsed_ms,
+                   elapsed_ms > 0 ? bytes * 1000.0 / elapsed_ms / 1048576.0 : 0.0,
+                   cpu_seconds * 1073741824.0 / bytes);
+            total_bytes += bytes;
+            total_ms += elapsed_ms;
+            total_cpu += cpu_seconds;
+        }
+    }
+    
+    harness.stop();
+    
+    if (failed) {
+        return -1;
+    }
+    printf("chunked: total %llu bytes, average %.1f MB/s, %.2f CPU seconds per GB\n",
+           (unsigned long long)total_bytes,
+           total_ms > 0 ? total_bytes * 1000.0 / total_ms / 1048576.0 : 0.0,
+           total_bytes > 0 ? total_cpu * 1073741824.0 / total_bytes : 0.0);
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef __ChunkedBench_H__
+#define __ChunkedBench_H__
+
+/* chunked response benchmark of HttpServer over HTTP/1.1 or HTTP/2, a large body is
+ * streamed in chunks of refcounted KMBuffer or raw data, the throughput and CPU time
+ * per GB are reported
+ */
+int runChunkedBench(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,189 @@
+#include "EncodingBench.h"
+#include "BenchHarness.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+
+using namespace kuma;
+
+static const std::string g_encoding_usage =
+"   bench encoding [option]\n"
+"   -c number       concurrent connections, or h2 streams, default 16\n"
+"   -d seconds      test duration, default 10\n"
+"   -p port         local port of the test server, default 52421\n"
+"   -s bytes        response body size, default 262144\n"
+"   -k bytes        bytes of each sendData, default 16384\n"
+"   -e encoding     identity, gzip, deflate or br, default gzip\n"
+"   -l level        compression level, default -1 for the default of encoder\n"
+"   -t proto        http or h2, default http\n"
+;
+
+// JSON records of an API response, it is compressible like usual text content
+static std::string createBody(size_t size)
+{
+    static const char* kNames[] = { "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi" };
+    static const char* kTags[] = { "admin", "staff", "guest", "beta", "vip" };
+    std::mt19937 rng(20170101);
+    std::string body = "[";
+    for (int id = 1; body.size() < size; ++id) {
+        auto name = kNames[rng() % 8];
+        char record[256];
+        snprintf(record, sizeof(record),
+                 "{\"id\":%d,\"name\":\"%s%u\",\"email\":\"%s%u@example.com\",\"score\":%.4f,"
+                 "\"tags\":[\"%s\",\"%s\"],\"active\":%s},\n",
+                 id, name, (unsigned)(rng() % 10000), name, (unsigned)(rng() % 10000),
+                 (rng() % 100000) / 100000.0, kTags[rng() % 5], kTags[rng() % 5],
+                 rng() % 2 ? "true" : "false");
+        body += record;
+    }
+    body.resize(size);
+    return body;
+}
+
+struct EncodingOptions
+{
+    std::string encoding = "gzip";
+    int         level = -1;
+    size_t      piece_size = 16384;
+};
+
+// the body sent by pieces on write callback, and ended by sendData(nullptr, 0)
+class EncodingResponder : public BenchResponder
+{
+public:
+    EncodingResponder(HttpResponse &rsp, const std::string &data, const EncodingOptions &opts)
+    : rsp_(rsp), data_(data), opts_(opts)
+    {
+        
+    }
+    
+    void onRequest() override
+    {
+        rsp_.addHeader("Content-Type", "application/json");
+        // it is removed if the body is compressed
+        rsp_.addHeader("Content-Length", (uint32_t)data_.size());
+        if (opts_.encoding != "identity") {
+            rsp_.setContentEncoding(opts_.encoding.c_str(), opts_.level);
+        }
+        offset_ = 0;
+        ended_ = false;
+        rsp_.sendResponse(200, "OK");
+    }
+    
+    void onSend() override
+    {
+        while (offset_ < data_.size()) {
+            auto len = std::min(opts_.piece_size, data_.size() - offset_);
+            int ret = rsp_.sendData(data_.c_str() + offset_, len);
+            if (ret <= 0) {
+                return;
+            }
+            offset_ += ret;
+        }
+        if (!ended_) {
+            ended_ = true;
+            rsp_.sendData(nullptr, 0);
+        }
+    }
+    
+private:
+    HttpResponse&           rsp_;
+    const std::string&      data_;
+    const EncodingOptions&  opts_;
+    size_t                  offset_ = 0;
+    bool                    ended_ = false;
+};
+
+int runEncodingBench(int argc, char *argv[])
+{
+    int concurrent = 16;
+    int duration = 10;
+    uint16_t port = 52421;
+    size_t body_size = 262144;
+    std::string proto = "http";
+    EncodingOptions opts;
+    for (int i=0; i<argc; ++i) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'c':
+                    concurrent = atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                case 's':
+                    body_size = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 'k':
+                    opts.piece_size = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 'e':
+                    opts.encoding = argv[++i];
+                    break;
+                case 'l':
+                    opts.level = atoi(argv[++i]);
+                    break;
+                case 't':
+                    proto = argv[++i];
+                    break;
+                default:
+                    printf("%s\n", g_encoding_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_encoding_usage.c_str());
+            return -1;
+        }
+    }
+    if ((proto != "http" && proto != "h2") || body_size == 0 || opts.piece_size == 0) {
+        printf("%s\n", g_encoding_usage.c_str());
+        return -1;
+    }
+    if (concurrent <= 0) {
+        concurrent = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    
+    std::string data = createBody(body_size);
+    BenchHarness harness([&] (HttpResponse &rsp) -> BenchResponder* {
+        return new EncodingResponder(rsp, data, opts);
+    });
+    if (!harness.start(port)) {
+        return -1;
+    }
+    // the body is not decoded, the bytes on wire are counted
+    std::string url = "http://127.0.0.1:" + std::to_string(port) + "/data.json";
+    BenchHeaders headers{ { "Accept-Encoding", opts.encoding } };
+    harness.startClients(concurrent, url, proto == "h2" ? "HTTP/2.0" : "HTTP/1.1", headers);
+    
+    printf("encoding: %s, %d %s, %d seconds, %zu bytes body by %zu bytes pieces, %s level %d\n",
+           proto.c_str(), concurrent, proto == "h2" ? "streams" : "connections", duration,
+           body_size, opts.piece_size, opts.encoding.c_str(), opts.level);
+    auto start_cpu = getCpuTime();
+    auto elapsed_ms = harness.report(duration, " on wire");
+    auto cpu_seconds = getCpuTime() - start_cpu;
+    harness.stop();
+    
+    uint64_t total = harness.completed();
+    uint64_t wire_bytes = harness.bytes();
+    double body_bytes = double(total) * body_size;
+    double rps = elapsed_ms > 0 ? total * 1000.0 / elapsed_ms : 0.0;
+    printf("encoding: total %llu requests, average %.0f req/s, %.1f MB/s body, %.1f MB/s on wire\n",
+           (unsigned long long)total, rps,
+           elapsed_ms > 0 ? body_bytes * 1000.0 / elapsed_ms / 1048576.0 : 0.0,
+           elapsed_ms > 0 ? wire_bytes * 1000.0 / elapsed_ms / 1048576.0 : 0.0);
+    printf("encoding: %.1f%% of body bytes on wire, %.2f CPU seconds per GB of body\n",
+           body_bytes > 0 ? wire_bytes * 100.0 / body_bytes : 0.0,
+           body_bytes > 0 ? cpu_seconds * 1073741824.0 / body_bytes : 0.0);
+    return 0;
+}
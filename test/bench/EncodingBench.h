@@ -0,0 +1,10 @@
+#ifndef __EncodingBench_H__
+#define __EncodingBench_H__
+
+/* content encoding benchmark of HttpServer over HTTP/1.1 or HTTP/2, the response
+ * body is compressed by HttpResponse::setContentEncoding chunk by chunk, CPU time
+ * is compared with the bytes on wire
+ */
+int runEncodingBench(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,198 @@
+#include "FileBench.h"
+#include "BenchHarness.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+
+using namespace kuma;
+
+static const std::string g_file_usage =
+"   bench file [option]\n"
+"   -c number       concurrent connections, or h2 streams, default 16\n"
+"   -d seconds      test duration, default 10\n"
+"   -p port         local port of the test server, default 52420\n"
+"   -s bytes        file size, default 65536\n"
+"   -m mode         file or memory, default file. memory sends the same bytes\n"
+"                   from memory by HttpResponse::sendData\n"
+"   -t proto        http or h2, default http\n"
+"   -r              request the second half of the file by Range header\n"
+;
+
+static const char* kFileName = "bench.bin";
+
+// serves the request by StaticFileHandler, or from memory by sendData on write callback
+class FileResponder : public BenchResponder
+{
+public:
+    FileResponder(HttpResponse &rsp, StaticFileHandler *handler, const std::string &data)
+    : rsp_(rsp), handler_(handler), data_(data)
+    {
+        
+    }
+    
+    void onRequest() override
+    {
+        if (handler_) {
+            handler_->serve(rsp_);
+            return;
+        }
+        size_t offset = 0;
+        size_t length = data_.size();
+        const char *range = rsp_.getHeaderValue("Range");
+        if (range && *range) {
+            // only "bytes=N-" is requested by the clients
+            offset = strtoul(range + 6, nullptr, 10);
+            length = data_.size() - offset;
+            std::string content_range = "bytes " + std::to_string(offset) + "-" +
+                std::to_string(data_.size() - 1) + "/" + std::to_string(data_.size());
+            rsp_.addHeader("Content-Range", content_range.c_str());
+        }
+        rsp_.addHeader("Content-Type", "application/octet-stream");
+        rsp_.addHeader("Content-Length", (uint32_t)length);
+        offset_ = offset;
+        end_ = offset + length;
+        rsp_.sendResponse(range && *range ? 206 : 200, range && *range ? "Partial Content" : "OK");
+    }
+    
+    void onSend() override
+    {
+        while (offset_ < end_) {
+            int ret = rsp_.sendData(data_.c_str() + offset_, end_ - offset_);
+            if (ret <= 0) {
+                break;
+            }
+            offset_ += ret;
+        }
+    }
+    
+private:
+    HttpResponse&       rsp_;
+    StaticFileHandler*  handler_;
+    const std::string&  data_;
+    size_t              offset_ = 0;
+    size_t              end_ = 0;
+};
+
+static bool createTempFile(const std::string &dir, const std::string &data)
+{
+    std::string path = dir + "/" + kFileName;
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fwrite(data.c_str(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+int runFileBench(int argc, char *argv[])
+{
+    int concurrent = 16;
+    int duration = 10;
+    uint16_t port = 52420;
+    size_t file_size = 65536;
+    std::string mode = "file";
+    std::string proto = "http";
+    bool range = false;
+    for (int i=0; i<argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0) {
+            range = true;
+        } else if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'c':
+                    concurrent = atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                case 's':
+                    file_size = strtoul(argv[++i], nullptr, 10);
+                    break;
+                case 'm':
+                    mode = argv[++i];
+                    break;
+                case 't':
+                    proto = argv[++i];
+                    break;
+                default:
+                    printf("%s\n", g_file_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_file_usage.c_str());
+            return -1;
+        }
+    }
+    if ((mode != "file" && mode != "memory") || (proto != "http" && proto != "h2") || file_size < 2) {
+        printf("%s\n", g_file_usage.c_str());
+        return -1;
+    }
+    if (concurrent <= 0) {
+        concurrent = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    
+    std::string data(file_size, 'k');
+    char dir[] = "/tmp/kuma_file_XXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("failed to create temporary directory\n");
+        return -1;
+    }
+    std::string file_path = std::string(dir) + "/" + kFileName;
+    if (!createTempFile(dir, data)) {
+        printf("failed to create %s\n", file_path.c_str());
+        rmdir(dir);
+        return -1;
+    }
+    std::unique_ptr<StaticFileHandler> handler;
+    if (mode == "file") {
+        handler.reset(new StaticFileHandler(dir));
+    }
+    
+    BenchHarness harness([&] (HttpResponse &rsp) -> BenchResponder* {
+        return new FileResponder(rsp, handler.get(), data);
+    });
+    if (!harness.start(port)) {
+        handler.reset();
+        unlink(file_path.c_str());
+        rmdir(dir);
+        return -1;
+    }
+    std::string url = "http://127.0.0.1:" + std::to_string(port) + "/" + kFileName;
+    BenchHeaders headers;
+    if (range) {
+        headers.emplace_back("Range", "bytes=" + std::to_string(file_size / 2) + "-");
+    }
+    harness.startClients(concurrent, url, proto == "h2" ? "HTTP/2.0" : "HTTP/1.1", headers);
+    
+    printf("file: %s, %d %s, %d seconds, %zu bytes from %s%s\n",
+           proto.c_str(), concurrent, proto == "h2" ? "streams" : "connections", duration,
+           file_size, mode.c_str(), range ? ", second half by Range" : "");
+    auto start_cpu = getCpuTime();
+    auto elapsed_ms = harness.report(duration, "");
+    auto cpu_seconds = getCpuTime() - start_cpu;
+    harness.stop();
+    
+    handler.reset();
+    unlink(file_path.c_str());
+    rmdir(dir);
+    
+    uint64_t total = harness.completed();
+    uint64_t total_bytes = harness.bytes();
+    double rps = elapsed_ms > 0 ? total * 1000.0 / elapsed_ms : 0.0;
+    double mbps = elapsed_ms > 0 ? total_bytes * 1000.0 / elapsed_ms / 1048576.0 : 0.0;
+    printf("file: total %llu requests, average %.0f req/s, %.1f MB/s, %.2f CPU seconds per GB\n",
+           (unsigned long long)total, rps, mbps,
+           total_bytes > 0 ? cpu_seconds * 1073741824.0 / total_bytes : 0.0);
+    return 0;
+}
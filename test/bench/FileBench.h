@@ -0,0 +1,10 @@
+#ifndef __FileBench_H__
+#define __FileBench_H__
+
+/* static file benchmark of HttpServer over HTTP/1.1 or HTTP/2, the response body
+ * is served by StaticFileHandler from a temporary file, or from memory by sendData,
+ * the server and clients run in separate loop threads of this process
+ */
+int runFileBench(int argc, char *argv[]);
+
+#endif
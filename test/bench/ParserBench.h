@@ -0,0 +1,9 @@
+#ifndef __ParserBench_H__
+#define __ParserBench_H__
+
+/* HTTP/1 parser throughput on browser and API request corpora, the requests
+ * are parsed in memory without any socket, and header lookup cost per request
+ */
+int runParserBench(int argc, char *argv[]);
+
+#endif
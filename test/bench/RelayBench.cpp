@@ -0,0 +1,312 @@
+#include "RelayBench.h"
+#include "BenchHarness.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kuma;
+
+static const std::string g_relay_usage =
+"   bench relay [option]\n"
+"   -c number       concurrent connections, default 1\n"
+"   -d seconds      test duration, default 10\n"
+"   -p port         local port of the sink server, the relay listens on port+1,\n"
+"                   default 52390\n"
+"   -b              use buffered copy instead of splice\n"
+;
+
+static const size_t kChunkSize = 64*1024;
+
+// receive and discard the data
+class SinkConn
+{
+public:
+    SinkConn(EventLoop *loop, std::atomic<uint64_t> &received)
+    : tcp_(loop)
+    , received_(received)
+    , buf_(256*1024)
+    {
+        
+    }
+    
+    KMError attachFd(SOCKET_FD fd)
+    {
+        tcp_.setReadCallback([this] (KMError) { onReceive(); });
+        tcp_.setErrorCallback([this] (KMError) { tcp_.close(); });
+        return tcp_.attachFd(fd);
+    }
+    
+    void close()
+    {
+        tcp_.close();
+    }
+    
+private:
+    void onReceive()
+    {
+        while (true) {
+            int ret = tcp_.receive(&buf_[0], buf_.size());
+            if (ret > 0) {
+                received_ += ret;
+            } else {
+                if (ret < 0) {
+                    tcp_.close();
+                }
+                break;
+            }
+        }
+    }
+    
+private:
+    TcpSocket               tcp_;
+    std::atomic<uint64_t>&  received_;
+    std::vector<uint8_t>    buf_;
+};
+
+// send data as fast as possible
+class PushClient
+{
+public:
+    PushClient(EventLoop *loop)
+    : tcp_(loop)
+    , buf_(kChunkSize, 'k')
+    {
+        
+    }
+    
+    KMError start(uint16_t port)
+    {
+        tcp_.setWriteCallback([this] (KMError) { sendData(); });
+        tcp_.setErrorCallback([this] (KMError) { tcp_.close(); });
+        return tcp_.connect("127.0.0.1", port, [this] (KMError err) {
+            if (err == KMError::NOERR) {
+                sendData();
+            } else {
+                printf("PushClient, failed to connect, err=%d\n", int(err));
+            }
+        });
+    }
+    
+    void close()
+    {
+        tcp_.close();
+    }
+    
+private:
+    void sendData()
+    {
+        while (tcp_.send(&buf_[0], buf_.size()) > 0) {
+            
+        }
+    }
+    
+private:
+    TcpSocket               tcp_;
+    std::vector<uint8_t>    buf_;
+};
+
+// accepted connection and its upstream connection to sink
+class RelaySession
+{
+public:
+    RelaySession(EventLoop *loop, bool zero_copy)
+    : client_(loop)
+    , upstream_(loop)
+    , relay_(loop)
+    {
+        relay_.setZeroCopy(zero_copy);
+    }
+    
+    KMError start(SOCKET_FD fd, uint16_t sink_port)
+    {
+        auto ret = client_.attachFd(fd);
+        if (ret != KMError::NOERR) {
+            return ret;
+        }
+        // the client data arrived before relay attached will be taken by relay
+        client_.setReadCallback([] (KMError) {});
+        return upstream_.connect("127.0.0.1", sink_port, [this] (KMError err) {
+            if (err != KMError::NOERR ||
+                relay_.attach(std::move(client_), std::move(upstream_)) != KMError::NOERR) {
+                printf("RelaySession, failed to start relay\n");
+                close();
+            }
+        });
+    }
+    
+    bool isZeroCopy() const
+    {
+        return relay_.isZeroCopy();
+    }
+    
+    void close()
+    {
+        client_.close();
+        upstream_.close();
+        relay_.close();
+    }
+    
+private:
+    TcpSocket   client_;
+    TcpSocket   upstream_;
+    TcpRelay    relay_;
+};
+
+int runRelayBench(int argc, char *argv[])
+{
+    int concurrent = 1;
+    int duration = 10;
+    uint16_t port = 52390;
+    bool zero_copy = true;
+    for (int i=0; i<argc; ++i) {
+        if (strcmp(argv[i], "-b") == 0) {
+            zero_copy = false;
+        } else if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'c':
+                    concurrent = atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                default:
+                    printf("%s\n", g_relay_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_relay_usage.c_str());
+            return -1;
+        }
+    }
+    if (concurrent <= 0) {
+        concurrent = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    
+    // sink server and clients run in peer loop
+    EventLoop peer_loop;
+    EventLoop relay_loop;
+    std::thread peer_thread;
+    std::thread relay_thread;
+    if (!startLoop(peer_loop, peer_thread)) {
+        printf("failed to init EventLoop\n");
+        return -1;
+    }
+    if (!startLoop(relay_loop, relay_thread)) {
+        printf("failed to init EventLoop\n");
+        peer_loop.stop();
+        peer_thread.join();
+        return -1;
+    }
+    
+    std::atomic<uint64_t> received{0};
+    std::vector<std::unique_ptr<SinkConn>> sink_conns;
+    TcpListener sink_listener(&peer_loop);
+    sink_listener.setAcceptCallback([&] (SOCKET_FD fd, const char*, uint16_t) -> bool {
+        std::unique_ptr<SinkConn> conn(new SinkConn(&peer_loop, received));
+        if (conn->attachFd(fd) != KMError::NOERR) {
+            return false;
+        }
+        sink_conns.emplace_back(std::move(conn));
+        return true;
+    });
+    
+    uint16_t sink_port = port;
+    uint16_t relay_port = port + 1;
+    std::vector<std::unique_ptr<RelaySession>> sessions;
+    TcpListener relay_listener(&relay_loop);
+    relay_listener.setAcceptCallback([&] (SOCKET_FD fd, const char*, uint16_t) -> bool {
+        std::unique_ptr<RelaySession> session(new RelaySession(&relay_loop, zero_copy));
+        if (session->start(fd, sink_port) != KMError::NOERR) {
+            return false;
+        }
+        sessions.emplace_back(std::move(session));
+        return true;
+    });
+    
+    KMError err = KMError::NOERR;
+    peer_loop.sync([&] { err = sink_listener.startListen("127.0.0.1", sink_port); });
+    if (err == KMError::NOERR) {
+        relay_loop.sync([&] { err = relay_listener.startListen("127.0.0.1", relay_port); });
+    }
+    if (err != KMError::NOERR) {
+        printf("failed to listen on port %u or %u\n", sink_port, relay_port);
+        peer_loop.sync([&] { sink_listener.close(); });
+        relay_loop.stop();
+        relay_thread.join();
+        peer_loop.stop();
+        peer_thread.join();
+        return -1;
+    }
+    
+    std::vector<std::unique_ptr<PushClient>> clients;
+    peer_loop.sync([&] {
+        for (int i=0; i<concurrent; ++i) {
+            std::unique_ptr<PushClient> client(new PushClient(&peer_loop));
+            client->start(relay_port);
+            clients.emplace_back(std::move(client));
+        }
+    });
+    
+    // skip the connecting time
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    bool is_zero_copy = false;
+    relay_loop.sync([&] { is_zero_copy = !sessions.empty() && sessions[0]->isZeroCopy(); });
+    printf("relay: %d connections, %d seconds, %s\n",
+           concurrent, duration, is_zero_copy ? "splice" : "buffered copy");
+    uint64_t start_count = received;
+    uint64_t last_count = start_count;
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i=0; i<duration; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t count = received;
+        printf("  %ds: %.1f MB/s\n", i + 1, (count - last_count) / 1048576.0);
+        last_count = count;
+    }
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    uint64_t total = received - start_count;
+    
+    relay_loop.sync([&] {
+        relay_listener.close();
+        for (auto &session : sessions) {
+            session->close();
+        }
+    });
+    relay_loop.sync([&] { sessions.clear(); });
+    relay_loop.stop();
+    relay_thread.join();
+    
+    peer_loop.sync([&] {
+        sink_listener.close();
+        for (auto &client : clients) {
+            client->close();
+        }
+        for (auto &conn : sink_conns) {
+            conn->close();
+        }
+    });
+    peer_loop.sync([&] {
+        clients.clear();
+        sink_conns.clear();
+    });
+    peer_loop.stop();
+    peer_thread.join();
+    
+    double mbps = elapsed_ms > 0 ? total * 1000.0 / elapsed_ms / 1048576.0 : 0.0;
+    printf("relay: total %.1f MB, average %.1f MB/s (%.2f Gbit/s)\n",
+           total / 1048576.0, mbps, mbps * 8 * 1.048576 / 1000);
+    return 0;
+}
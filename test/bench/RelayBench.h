@@ -0,0 +1,9 @@
+#ifndef __RelayBench_H__
+#define __RelayBench_H__
+
+/* TcpRelay throughput benchmark, the clients push data through the relay to a
+ * sink server over loopback, the relay runs in its own loop thread
+ */
+int runRelayBench(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,229 @@
+#include "RouterBench.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace kuma;
+
+static const std::string g_router_usage =
+"   bench router [option]\n"
+"   -n number       routes, default 10000\n"
+"   -d seconds      test duration of each router, default 5\n"
+"   -l              also run the linear scan of route patterns\n"
+;
+
+struct Route
+{
+    std::string method;
+    std::string pattern;
+    std::vector<std::string> segments;
+    size_t params = 0;
+};
+
+struct Request
+{
+    std::string method;
+    std::string path;
+    size_t params = 0;
+};
+
+// the routes of a large API gateway, mixing static, param and wildcard routes
+static void buildRoutes(size_t count, std::vector<Route> &routes, std::vector<Request> &reqs)
+{
+    std::mt19937 rng(20171018);
+    char buf[256];
+    for (size_t i = 0; i < count; ++i) {
+        Route route;
+        Request req;
+        auto svc = i / 4;
+        auto id = rng() % 1000000;
+        switch (i % 4) {
+            case 0:
+                route.method = "GET";
+                snprintf(buf, sizeof(buf), "/api/v1/svc%zu/items/:id", svc);
+                route.pattern = buf;
+                snprintf(buf, sizeof(buf), "/api/v1/svc%zu/items/%u?fields=name", svc, (unsigned)id);
+                req.params = route.params = 1;
+                break;
+            case 1:
+                route.method = "POST";
+                snprintf(buf, sizeof(buf), "/api/v1/svc%zu/items/:id/tags/:tag", svc);
+                route.pattern = buf;
+                snprintf(buf, sizeof(buf), "/api/v1/svc%zu/items/%u/tags/t%u", svc, (unsigned)id, (unsigned)(id % 97));
+                req.params = route.params = 2;
+                break;
+            case 2:
+                route.method = "GET";
+                snprintf(buf, sizeof(buf), "/static/bundle%zu/app.js", svc);
+                route.pattern = buf;
+                break;
+            default:
+                route.method = "GET";
+                snprintf(buf, sizeof(buf), "/files/svc%zu/*path", svc);
+                route.pattern = buf;
+                snprintf(buf, sizeof(buf), "/files/svc%zu/docs/%u/readme.md", svc, (unsigned)id);
+                req.params = route.params = 1;
+                break;
+        }
+        req.method = route.method;
+        req.path = route.params ? std::string(buf) : route.pattern;
+        size_t pos = 1;
+        while (pos <= route.pattern.size()) {
+            auto end = route.pattern.find('/', pos);
+            if (end == std::string::npos) {
+                end = route.pattern.size();
+            }
+            route.segments.emplace_back(route.pattern.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        routes.emplace_back(std::move(route));
+        reqs.emplace_back(std::move(req));
+    }
+    std::shuffle(reqs.begin(), reqs.end(), rng);
+}
+
+// the naive router, compare the path with every route segment by segment
+static const Route* linearMatch(const std::vector<Route> &routes, const char *method, const char *path, size_t &params)
+{
+    size_t path_len = strcspn(path, "?");
+    for (auto const &route : routes) {
+        if (route.method != method) {
+            continue;
+        }
+        params = 0;
+        size_t pos = 1;
+        bool matched = true;
+        for (auto const &seg : route.segments) {
+            if (pos > path_len) {
+                matched = false;
+                break;
+            }
+            if (seg[0] == '*') {
+                ++params;
+                pos = path_len + 1;
+                break;
+            }
+            auto end = pos;
+            while (end < path_len && path[end] != '/') ++end;
+            if (seg[0] == ':') {
+                ++params;
+            } else if (seg.size() != end - pos || memcmp(seg.c_str(), path + pos, seg.size()) != 0) {
+                matched = false;
+                break;
+            }
+            pos = end + 1;
+        }
+        if (matched && pos > path_len) {
+            return &route;
+        }
+    }
+    return nullptr;
+}
+
+template<typename Matcher>
+static bool runMatch(const char *name, const std::vector<Request> &reqs, int duration, Matcher &&matcher)
+{
+    for (auto const &req : reqs) {
+        size_t params = 0;
+        if (!matcher(req, params) || params != req.params) {
+            printf("%s: failed to match %s %s\n", name, req.method.c_str(), req.path.c_str());
+            return false;
+        }
+    }
+    
+    uint64_t matches = 0;
+    size_t params = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::seconds(duration);
+    auto now = start;
+    while (now < deadline) {
+        // check the clock every 1024 matches
+        for (int i = 0; i < 1024; ++i) {
+            auto const &req = reqs[matches % reqs.size()];
+            size_t n = 0;
+            matcher(req, n);
+            params += n;
+            ++matches;
+        }
+        now = std::chrono::steady_clock::now();
+    }
+    double secs = std::chrono::duration<double>(now - start).count();
+    printf("%-8s matches: %llu, %.1f ns/match, %.0f matches/s, %.2f params/match\n",
+           name, (unsigned long long)matches, secs * 1e9 / matches, matches / secs,
+           (double)params / matches);
+    return true;
+}
+
+int runRouterBench(int argc, char *argv[])
+{
+    size_t count = 10000;
+    int duration = 5;
+    bool linear = false;
+    for (int i=0; i<argc; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] == 'l') {
+            linear = true;
+        } else if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'n':
+                    count = (size_t)atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                default:
+                    printf("%s\n", g_router_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_router_usage.c_str());
+            return -1;
+        }
+    }
+    if (count == 0) {
+        count = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    
+    std::vector<Route> routes;
+    std::vector<Request> reqs;
+    buildRoutes(count, routes, reqs);
+    
+    HttpRouter router;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const &route : routes) {
+        auto ret = router.addRoute(route.method.c_str(), route.pattern.c_str(),
+                                   [] (HttpResponse &, const HttpRouter::Params &) {});
+        if (ret != KMError::NOERR) {
+            printf("failed to add route %s %s, err=%d\n", route.method.c_str(), route.pattern.c_str(), (int)ret);
+            return -1;
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("routes: %zu, build: %.1f ms\n", routes.size(), ms);
+    
+    if (!runMatch("radix", reqs, duration, [&router] (const Request &req, size_t &params) {
+        HttpRouter::Params p;
+        if (!router.match(req.method.c_str(), req.path.c_str(), p)) {
+            return false;
+        }
+        params = p.size();
+        return true;
+    })) {
+        return -1;
+    }
+    if (linear && !runMatch("linear", reqs, duration, [&routes] (const Request &req, size_t &params) {
+        return linearMatch(routes, req.method.c_str(), req.path.c_str(), params) != nullptr;
+    })) {
+        return -1;
+    }
+    return 0;
+}
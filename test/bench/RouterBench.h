@@ -0,0 +1,9 @@
+#ifndef __RouterBench_H__
+#define __RouterBench_H__
+
+/* request routing benchmark, paths are matched against many routes by HttpRouter
+ * and by a linear scan of route patterns
+ */
+int runRouterBench(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,572 @@
+#include "RpsBench.h"
+#include "BenchHarness.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kuma;
+
+static const char kResponseBody[] = "hello kuma";
+
+static const std::string g_rps_usage =
+"   bench rps [option]\n"
+"   -c number       concurrent connections, default 16\n"
+"   -d seconds      test duration, default 10\n"
+"   -p port         local port of the test server, default 52380\n"
+"   -n              use a new HttpRequest for each request, the connections are\n"
+"                   reused through connection pool\n"
+"   -u path         talk over unix domain socket at path instead of loopback TCP,\n"
+"                   not for h2\n"
+"   -t proto        http, h2 or ws, default http. h2 is h2c upgrade, ws echoes\n"
+"                   small messages\n"
+"   -q depth        pipeline depth requests on each connection, http only\n"
+;
+
+// percent-encode the socket path as the host of "http+unix" url
+static std::string encodeUnixPath(const std::string &path)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : path) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out.push_back(c);
+        } else {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0x0F]);
+        }
+    }
+    return out;
+}
+
+class RpsServerConn
+{
+public:
+    virtual ~RpsServerConn() {}
+    virtual KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) = 0;
+    virtual void close() = 0;
+};
+
+static void sendSmallResponse(HttpResponse &rsp)
+{
+    // header and body are sent separately, they are coalesced by the library
+    rsp.addHeader("Content-Type", "text/plain");
+    rsp.addHeader("Content-Length", (uint32_t)(sizeof(kResponseBody) - 1));
+    rsp.sendResponse(200, "OK");
+    rsp.sendData(kResponseBody, sizeof(kResponseBody) - 1);
+}
+
+class RpsHttpConn : public RpsServerConn
+{
+public:
+    RpsHttpConn(EventLoop *loop)
+    : rsp_(loop, "HTTP/1.1")
+    {
+        
+    }
+    
+    KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) override
+    {
+        rsp_.setRequestCompleteCallback([this] { sendSmallResponse(rsp_); });
+        rsp_.setResponseCompleteCallback([this] { rsp_.reset(); });
+        rsp_.setErrorCallback([this] (KMError) { rsp_.close(); });
+        return rsp_.attachSocket(std::move(tcp), std::move(parser), init_buf);
+    }
+    
+    void close() override
+    {
+        rsp_.close();
+    }
+    
+private:
+    HttpResponse rsp_;
+};
+
+class RpsH2Conn : public RpsServerConn
+{
+public:
+    RpsH2Conn(EventLoop *loop)
+    : loop_(loop)
+    , token_(loop->createToken())
+    , conn_(loop)
+    {
+        
+    }
+    
+    KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) override
+    {
+        conn_.setAcceptCallback([this] (uint32_t stream_id) -> bool { return onAccept(stream_id); });
+        conn_.setErrorCallback([this] (int) { close(); });
+        return conn_.attachSocket(std::move(tcp), std::move(parser), init_buf);
+    }
+    
+    void close() override
+    {
+        token_.reset();
+        for (auto &kv : streams_) {
+            kv.second->close();
+        }
+        streams_.clear();
+        conn_.close();
+    }
+    
+private:
+    bool onAccept(uint32_t stream_id)
+    {
+        std::unique_ptr<HttpResponse> rsp(new HttpResponse(loop_, "HTTP/2.0"));
+        auto *r = rsp.get();
+        r->setRequestCompleteCallback([r] { sendSmallResponse(*r); });
+        r->setResponseCompleteCallback([this, stream_id] {
+            // cannot destroy the response in its callback
+            loop_->post([this, stream_id] { streams_.erase(stream_id); }, &token_);
+        });
+        r->setErrorCallback([this, stream_id] (KMError) {
+            loop_->post([this, stream_id] { streams_.erase(stream_id); }, &token_);
+        });
+        streams_[stream_id] = std::move(rsp);
+        return conn_.attachStream(stream_id, r) == KMError::NOERR;
+    }
+    
+private:
+    EventLoop*          loop_;
+    EventLoop::Token    token_;
+    H2Connection        conn_;
+    std::map<uint32_t, std::unique_ptr<HttpResponse>> streams_;
+};
+
+class RpsWsConn : public RpsServerConn
+{
+public:
+    RpsWsConn(EventLoop *loop)
+    : ws_(loop)
+    {
+        
+    }
+    
+    KMError attachSocket(TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) override
+    {
+        ws_.setDataCallback([this] (KMBuffer &buf, bool is_text, bool fin) {
+            ws_.send(buf, is_text, fin);
+        });
+        ws_.setErrorCallback([this] (KMError) { ws_.close(); });
+        return ws_.attachSocket(std::move(tcp), std::move(parser), init_buf);
+    }
+    
+    void close() override
+    {
+        ws_.close();
+    }
+    
+private:
+    WebSocket ws_;
+};
+
+class RpsClientBase
+{
+public:
+    virtual ~RpsClientBase() {}
+    virtual void start(const std::string &url) = 0;
+    virtual void stop() = 0;
+};
+
+class RpsClient : public RpsClientBase
+{
+public:
+    RpsClient(EventLoop *loop, std::atomic<uint64_t> &completed, bool new_request, const char *ver)
+    : loop_(loop)
+    , token_(loop->createToken())
+    , completed_(completed)
+    , new_request_(new_request)
+    , ver_(ver)
+    {
+        
+    }
+    
+    void start(const std::string &url) override
+    {
+        url_ = url;
+        sendRequest();
+    }
+    
+    void stop() override
+    {
+        stopped_ = true;
+        token_.reset();
+        if (req_) {
+            req_->close();
+        }
+    }
+    
+private:
+    void createRequest()
+    {
+        if (req_) {
+            // the idle connection will be returned to connection pool
+            req_->close();
+        }
+        req_.reset(new HttpRequest(loop_, ver_));
+        req_->setDataCallback([] (KMBuffer &) {});
+        req_->setErrorCallback([this] (KMError err) {
+            printf("RpsClient::onError, err=%d\n", int(err));
+            req_->close();
+        });
+        req_->setResponseCompleteCallback([this] {
+            ++completed_;
+            loop_->post([this] { sendRequest(); }, &token_);
+        });
+    }
+    
+    void sendRequest()
+    {
+        if (stopped_) {
+            return;
+        }
+        if (!req_ || new_request_) {
+            createRequest();
+        }
+        req_->sendRequest("GET", url_.c_str());
+    }
+    
+private:
+    EventLoop*                      loop_;
+    std::unique_ptr<HttpRequest>    req_;
+    EventLoop::Token                token_;
+    std::atomic<uint64_t>&          completed_;
+    std::string                     url_;
+    bool                            new_request_ = false;
+    const char*                     ver_;
+    bool                            stopped_ = false;
+};
+
+// HttpRequest sends one request at a time, the pipelined requests are written
+// to TcpSocket directly and the responses are parsed by HttpParser
+class RpsPipelineClient : public RpsClientBase
+{
+public:
+    RpsPipelineClient(EventLoop *loop, std::atomic<uint64_t> &completed, int depth, std::string host, uint16_t port)
+    : tcp_(loop)
+    , completed_(completed)
+    , depth_(depth)
+    , host_(std::move(host))
+    , port_(port)
+    {
+        
+    }
+    
+    void start(const std::string &) override
+    {
+        request_ = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nUser-Agent: kuma-bench\r\n\r\n";
+        tcp_.setReadCallback([this] (KMError) { onReceive(); });
+        tcp_.setWriteCallback([this] (KMError) { sendPending(); });
+        tcp_.setErrorCallback([this] (KMError err) {
+            printf("RpsPipelineClient::onError, err=%d\n", int(err));
+            tcp_.close();
+        });
+        tcp_.connect(host_.c_str(), port_, [this] (KMError err) {
+            if (err == KMError::NOERR) {
+                sendRequests(depth_);
+            } else {
+                printf("RpsPipelineClient::onConnect, err=%d\n", int(err));
+            }
+        });
+    }
+    
+    void stop() override
+    {
+        stopped_ = true;
+        tcp_.close();
+    }
+    
+private:
+    void sendRequests(int count)
+    {
+        for (int i=0; i<count; ++i) {
+            send_buf_.append(request_);
+        }
+        sendPending();
+    }
+    
+    void sendPending()
+    {
+        if (stopped_ || send_buf_.empty()) {
+            return;
+        }
+        int ret = tcp_.send(send_buf_.c_str(), send_buf_.size());
+        if (ret > 0) {
+            send_buf_.erase(0, ret);
+        } else if (ret < 0) {
+            printf("RpsPipelineClient::sendPending, failed to send\n");
+            tcp_.close();
+        }
+    }
+    
+    void onReceive()
+    {
+        char buf[64*1024];
+        int responses = 0;
+        while (!stopped_) {
+            int ret = tcp_.receive(buf, sizeof(buf));
+            if (ret <= 0) {
+                break;
+            }
+            const char *ptr = buf;
+            size_t len = ret;
+            while (len > 0) {
+                int bytes_used = parser_.parse(ptr, len);
+                if (parser_.error()) {
+                    printf("RpsPipelineClient::onReceive, invalid response\n");
+                    tcp_.close();
+                    return;
+                }
+                ptr += bytes_used;
+                len -= bytes_used;
+                if (parser_.complete()) {
+                    ++responses;
+                    parser_.reset();
+                }
+            }
+        }
+        if (responses > 0) {
+            completed_ += responses;
+            // keep depth requests in flight
+            sendRequests(responses);
+        }
+    }
+    
+private:
+    TcpSocket                       tcp_;
+    HttpParser                      parser_;
+    std::atomic<uint64_t>&          completed_;
+    int                             depth_;
+    std::string                     host_;
+    uint16_t                        port_;
+    std::string                     request_;
+    std::string                     send_buf_;
+    bool                            stopped_ = false;
+};
+
+class RpsWsClient : public RpsClientBase
+{
+public:
+    RpsWsClient(EventLoop *loop, std::atomic<uint64_t> &completed)
+    : ws_(loop)
+    , completed_(completed)
+    {
+        
+    }
+    
+    void start(const std::string &url) override
+    {
+        ws_.setDataCallback([this] (KMBuffer &, bool, bool) {
+            ++completed_;
+            sendMessage();
+        });
+        ws_.setErrorCallback([this] (KMError err) {
+            printf("RpsWsClient::onError, err=%d\n", int(err));
+            ws_.close();
+        });
+        ws_.connect(url.c_str(), [this] (KMError err) {
+            if (err == KMError::NOERR) {
+                sendMessage();
+            }
+        });
+    }
+    
+    void stop() override
+    {
+        stopped_ = true;
+        ws_.close();
+    }
+    
+private:
+    void sendMessage()
+    {
+        if (!stopped_) {
+            // the client masks the payload in place
+            char msg[sizeof(kResponseBody)];
+            memcpy(msg, kResponseBody, sizeof(msg));
+            ws_.send(msg, sizeof(msg) - 1, true);
+        }
+    }
+    
+private:
+    WebSocket                       ws_;
+    std::atomic<uint64_t>&          completed_;
+    bool                            stopped_ = false;
+};
+
+int runRpsBench(int argc, char *argv[])
+{
+    int concurrent = 16;
+    int duration = 10;
+    uint16_t port = 52380;
+    bool new_request = false;
+    std::string unix_path;
+    std::string proto = "http";
+    int depth = 0;
+    for (int i=0; i<argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0) {
+            new_request = true;
+        } else if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'c':
+                    concurrent = atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                case 'u':
+                    unix_path = argv[++i];
+                    break;
+                case 't':
+                    proto = argv[++i];
+                    break;
+                case 'q':
+                    depth = atoi(argv[++i]);
+                    break;
+                default:
+                    printf("%s\n", g_rps_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_rps_usage.c_str());
+            return -1;
+        }
+    }
+    if ((proto != "http" && proto != "h2" && proto != "ws") || (proto == "h2" && !unix_path.empty()) ||
+        (depth > 0 && (proto != "http" || new_request))) {
+        printf("%s\n", g_rps_usage.c_str());
+        return -1;
+    }
+    if (concurrent <= 0) {
+        concurrent = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    
+    EventLoop server_loop;
+    EventLoop client_loop;
+    std::thread server_thread;
+    std::thread client_thread;
+    if (!startLoop(server_loop, server_thread)) {
+        printf("failed to init EventLoop\n");
+        return -1;
+    }
+    if (!startLoop(client_loop, client_thread)) {
+        printf("failed to init EventLoop\n");
+        server_loop.stop();
+        server_thread.join();
+        return -1;
+    }
+    
+    // the protocol of connection is detected by HttpServer
+    std::vector<std::unique_ptr<RpsServerConn>> server_conns;
+    auto add_conn = [&] (RpsServerConn *conn, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        server_conns.emplace_back(conn);
+        conn->attachSocket(std::move(tcp), std::move(parser), init_buf);
+    };
+    HttpServer server(&server_loop);
+    server.setHttpCallback([&] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        add_conn(new RpsHttpConn(loop), std::move(tcp), std::move(parser), init_buf);
+    });
+    server.setHttp2Callback([&] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        add_conn(new RpsH2Conn(loop), std::move(tcp), std::move(parser), init_buf);
+    });
+    server.setWebSocketCallback([&] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        add_conn(new RpsWsConn(loop), std::move(tcp), std::move(parser), init_buf);
+    });
+    KMError err = KMError::NOERR;
+    std::string listen_host = unix_path.empty() ? "127.0.0.1" : "unix:" + unix_path;
+    server_loop.sync([&] { err = server.startListen(listen_host.c_str(), port); });
+    if (err != KMError::NOERR) {
+        printf("failed to listen on %s:%u\n", listen_host.c_str(), port);
+        client_loop.stop();
+        client_thread.join();
+        server_loop.stop();
+        server_thread.join();
+        return -1;
+    }
+    
+    std::atomic<uint64_t> completed{0};
+    std::vector<std::unique_ptr<RpsClientBase>> clients;
+    std::string scheme = proto == "ws" ? "ws" : "http";
+    std::string url = scheme + "://127.0.0.1:" + std::to_string(port) + "/";
+    if (!unix_path.empty()) {
+        url = scheme + "+unix://" + encodeUnixPath(unix_path) + "/";
+    }
+    client_loop.sync([&] {
+        for (int i=0; i<concurrent; ++i) {
+            std::unique_ptr<RpsClientBase> client;
+            if (proto == "ws") {
+                client.reset(new RpsWsClient(&client_loop, completed));
+            } else if (depth > 0) {
+                std::string host = unix_path.empty() ? "127.0.0.1" : "unix:" + unix_path;
+                client.reset(new RpsPipelineClient(&client_loop, completed, depth, host, port));
+            } else if (proto == "h2") {
+                // the streams are multiplexed over one connection
+                client.reset(new RpsClient(&client_loop, completed, true, "HTTP/2.0"));
+            } else {
+                client.reset(new RpsClient(&client_loop, completed, new_request, "HTTP/1.1"));
+            }
+            client->start(url);
+            clients.emplace_back(std::move(client));
+        }
+    });
+    
+    std::string pipeline = depth > 0 ? ", pipeline depth " + std::to_string(depth) : "";
+    printf("rps: %s, %d %s, %d seconds, response body %zu bytes, %s%s%s\n",
+           proto.c_str(), concurrent, proto == "h2" ? "streams" : "connections", duration,
+           sizeof(kResponseBody) - 1, unix_path.empty() ? "loopback TCP" : "unix socket",
+           new_request ? ", new request each time" : "", pipeline.c_str());
+    uint64_t last_count = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i=0; i<duration; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t count = completed;
+        printf("  %ds: %llu req/s\n", i + 1, (unsigned long long)(count - last_count));
+        last_count = count;
+    }
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    
+    client_loop.sync([&] {
+        for (auto &client : clients) {
+            client->stop();
+        }
+    });
+    // the tasks posted in same loop iteration may be still pending
+    client_loop.sync([&] { clients.clear(); });
+    client_loop.stop();
+    client_thread.join();
+    
+    server_loop.sync([&] {
+        server.close();
+        for (auto &conn : server_conns) {
+            conn->close();
+        }
+    });
+    server_loop.sync([&] { server_conns.clear(); });
+    server_loop.stop();
+    server_thread.join();
+    
+    uint64_t total = completed;
+    double rps = elapsed_ms > 0 ? total * 1000.0 / elapsed_ms : 0.0;
+    // each connection has one request or depth requests in flight, so latency = in flight / rps
+    int in_flight = concurrent * (depth > 0 ? depth : 1);
+    printf("rps: total %llu requests, average %.0f req/s, average latency %.1f us\n",
+           (unsigned long long)total, rps, rps > 0 ? in_flight * 1000000.0 / rps : 0.0);
+    return 0;
+}
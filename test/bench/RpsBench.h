@@ -0,0 +1,10 @@
+#ifndef __RpsBench_H__
+#define __RpsBench_H__
+
+/* small response benchmark of HttpServer over HTTP/1.1, HTTP/2 or WebSocket, the
+ * server and clients run in separate loop threads of this process and talk over
+ * loopback keep-alive connections
+ */
+int runRpsBench(int argc, char *argv[]);
+
+#endif
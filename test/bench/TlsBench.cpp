@@ -0,0 +1,665 @@
+#include "TlsBench.h"
+#include "BenchHarness.h"
+#include "kmapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kuma;
+
+static const std::string g_tls_usage =
+"   bench tls [option]\n"
+"   -c number       concurrent connections, default 16\n"
+"   -d seconds      test duration, default 10\n"
+"   -p port         local port of the test server, default 52400\n"
+"   -f              full handshake for each connection, a unique server name is\n"
+"                   used for each connection so that no session is resumed\n"
+"   -o threads      run the handshakes in SSL crypto pool of threads, default 0\n"
+;
+
+static const std::string g_tlsput_usage =
+"   bench tlsput [option]\n"
+"   -c number       concurrent connections, default 1\n"
+"   -d seconds      test duration, default 10\n"
+"   -p port         local port of the test server, default 52410\n"
+"   -s              send from file by TcpSocket::sendFile\n"
+"   -b bytes        bytes of each piece in the gather list of send, default 65536\n"
+"   -l loops        number of server loops, each has a client loop, default 1\n"
+;
+
+static const char* kServerName = "kuma.bench";
+static const size_t kChunkSize = 64*1024;
+static const size_t kFileSize = 16*1024*1024;
+// the push and pull loops may never block when both loops share one CPU,
+// they are broken by this flag so that the loops can be stopped
+static std::atomic<bool> s_tlsput_stopped{false};
+
+// send one byte after handshake and close, so the client will receive the session
+// tickets of TLS 1.3 before it reconnects
+class TlsServerConn
+{
+public:
+    TlsServerConn(EventLoop *loop)
+    : tcp_(loop)
+    {
+        
+    }
+    
+    KMError attachFd(SOCKET_FD fd, std::function<void()> close_cb)
+    {
+        close_cb_ = std::move(close_cb);
+        tcp_.setSslFlags(SSL_ENABLE);
+        tcp_.setReadCallback([this] (KMError) { onReceive(); });
+        tcp_.setWriteCallback([this] (KMError) { sendReply(); });
+        tcp_.setErrorCallback([this] (KMError) { onClose(); });
+        return tcp_.attachFd(fd);
+    }
+    
+    void close()
+    {
+        tcp_.close();
+    }
+    
+private:
+    void onReceive()
+    {
+        sendReply();
+    }
+    
+    void sendReply()
+    {
+        if (!replied_ && tcp_.send("k", 1) == 1) {
+            replied_ = true;
+            onClose();
+        }
+    }
+    
+    void onClose()
+    {
+        tcp_.close();
+        close_cb_();
+    }
+    
+private:
+    TcpSocket               tcp_;
+    std::function<void()>   close_cb_;
+    bool                    replied_ = false;
+};
+
+// reconnect after the reply of server is received
+class TlsClient
+{
+public:
+    TlsClient(EventLoop *loop, uint16_t port, bool full_handshake, std::atomic<uint64_t> &handshakes)
+    : loop_(loop)
+    , port_(port)
+    , full_handshake_(full_handshake)
+    , handshakes_(handshakes)
+    {
+        
+    }
+    
+    void start()
+    {
+        tcp_.reset(new TcpSocket(loop_));
+        tcp_->setSslFlags(SSL_ENABLE | SSL_ALLOW_SELF_SIGNED_CERT);
+        if (full_handshake_) {
+            static std::atomic<uint32_t> s_seq{0};
+            tcp_->setSslServerName((std::to_string(++s_seq) + "." + kServerName).c_str());
+        } else {
+            tcp_->setSslServerName(kServerName);
+        }
+        tcp_->setReadCallback([this] (KMError) { onReceive(); });
+        tcp_->setErrorCallback([this] (KMError) { restart(); });
+        auto ret = tcp_->connect("127.0.0.1", port_, [this] (KMError err) {
+            if (err != KMError::NOERR) {
+                printf("TlsClient, failed to connect, err=%d\n", int(err));
+                stopped_ = true;
+            }
+        });
+        if (ret != KMError::NOERR) {
+            printf("TlsClient, failed to connect, err=%d\n", int(ret));
+            stopped_ = true;
+        }
+    }
+    
+    void stop()
+    {
+        stopped_ = true;
+        if (tcp_) {
+            tcp_->close();
+        }
+    }
+    
+private:
+    void onReceive()
+    {
+        uint8_t buf[16];
+        int ret = tcp_->receive(buf, sizeof(buf));
+        if (ret > 0) {
+            ++handshakes_;
+            restart();
+        } else if (ret < 0) {
+            restart();
+        }
+    }
+    
+    void restart()
+    {
+        tcp_->close();
+        // the socket cannot be destroyed in its callback
+        loop_->post([this] {
+            if (!stopped_) {
+                start();
+            }
+        });
+    }
+    
+private:
+    EventLoop*                  loop_;
+    uint16_t                    port_;
+    bool                        full_handshake_;
+    std::atomic<uint64_t>&      handshakes_;
+    std::unique_ptr<TcpSocket>  tcp_;
+    bool                        stopped_ = false;
+};
+
+// push data as fast as possible after handshake
+class PushServerConn
+{
+public:
+    PushServerConn(EventLoop *loop, uint32_t ssl_flags, int file_fd, size_t chunk_size)
+    : tcp_(loop)
+    , ssl_flags_(ssl_flags)
+    , file_fd_(file_fd)
+    , buf_(kChunkSize, 'k')
+    {
+        // the chunk is sent as a gather list of chunk_size pieces
+        for (size_t offset = 0; offset < buf_.size(); offset += chunk_size) {
+            iovec iov;
+            iov.iov_base = (char*)&buf_[offset];
+            iov.iov_len = std::min(chunk_size, buf_.size() - offset);
+            iovs_.push_back(iov);
+        }
+    }
+    
+    KMError attachFd(SOCKET_FD fd)
+    {
+        tcp_.setSslFlags(ssl_flags_);
+        // the handshake completes on read event
+        tcp_.setReadCallback([this] (KMError) { sendData(); });
+        tcp_.setWriteCallback([this] (KMError) { sendData(); });
+        tcp_.setErrorCallback([this] (KMError) { tcp_.close(); });
+        return tcp_.attachFd(fd);
+    }
+    
+    void close()
+    {
+        tcp_.close();
+    }
+    
+private:
+    void sendData()
+    {
+        while (true) {
+            int ret = 0;
+            if (file_fd_ >= 0) {
+                ret = tcp_.sendFile(file_fd_, file_offset_, kFileSize - file_offset_);
+                if (ret > 0) {
+                    file_offset_ = (file_offset_ + ret) % kFileSize;
+                }
+            } else {
+                ret = tcp_.send(&iovs_[0], static_cast<int>(iovs_.size()));
+            }
+            if (ret <= 0 || s_tlsput_stopped) {
+                break;
+            }
+        }
+    }
+    
+private:
+    TcpSocket               tcp_;
+    uint32_t                ssl_flags_;
+    int                     file_fd_;
+    int64_t                 file_offset_ = 0;
+    std::vector<uint8_t>    buf_;
+    std::vector<iovec>      iovs_;
+};
+
+// receive and discard the data
+class PullClient
+{
+public:
+    PullClient(EventLoop *loop, std::atomic<uint64_t> &received)
+    : tcp_(loop)
+    , received_(received)
+    , buf_(256*1024)
+    {
+        
+    }
+    
+    KMError start(uint16_t port, uint32_t ssl_flags)
+    {
+        tcp_.setSslFlags(ssl_flags);
+        tcp_.setSslServerName(kServerName);
+        tcp_.setReadCallback([this] (KMError) { onReceive(); });
+        tcp_.setErrorCallback([this] (KMError) { tcp_.close(); });
+        return tcp_.connect("127.0.0.1", port, [this] (KMError err) {
+            if (err != KMError::NOERR) {
+                printf("PullClient, failed to connect, err=%d\n", int(err));
+            }
+        });
+    }
+    
+    void close()
+    {
+        tcp_.close();
+    }
+    
+private:
+    void onReceive()
+    {
+        while (true) {
+            int ret = tcp_.receive(&buf_[0], buf_.size());
+            if (ret > 0) {
+                received_ += ret;
+                if (s_tlsput_stopped) {
+                    break;
+                }
+            } else {
+                if (ret < 0) {
+                    tcp_.close();
+                }
+                break;
+            }
+        }
+    }
+    
+private:
+    TcpSocket               tcp_;
+    std::atomic<uint64_t>&  received_;
+    std::vector<uint8_t>    buf_;
+};
+
+// the file is removed immediately and deleted when fd closed
+static int createTempFile()
+{
+    char path[] = "/tmp/kuma_tlsput_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    std::vector<uint8_t> buf(kChunkSize, 'k');
+    for (size_t i = 0; i < kFileSize; i += buf.size()) {
+        if (write(fd, &buf[0], buf.size()) != (ssize_t)buf.size()) {
+            ::close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+int runTlsBench(int argc, char *argv[])
+{
+    int concurrent = 16;
+    int duration = 10;
+    uint16_t port = 52400;
+    bool full_handshake = false;
+    int crypto_threads = 0;
+    for (int i=0; i<argc; ++i) {
+        if (strcmp(argv[i], "-f") == 0) {
+            full_handshake = true;
+        } else if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'c':
+                    concurrent = atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                case 'o':
+                    crypto_threads = atoi(argv[++i]);
+                    break;
+                default:
+                    printf("%s\n", g_tls_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_tls_usage.c_str());
+            return -1;
+        }
+    }
+    if (concurrent <= 0) {
+        concurrent = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    SslSessionStats stats;
+    if (getSslSessionStats(stats) != KMError::NOERR) {
+        printf("kuma is built without OpenSSL\n");
+        return -1;
+    }
+    if (setSslCryptoThreads(crypto_threads) != KMError::NOERR) {
+        printf("failed to set SSL crypto threads\n");
+        return -1;
+    }
+    
+    EventLoop server_loop;
+    EventLoop client_loop;
+    std::thread server_thread;
+    std::thread client_thread;
+    if (!startLoop(server_loop, server_thread)) {
+        printf("failed to init EventLoop\n");
+        return -1;
+    }
+    if (!startLoop(client_loop, client_thread)) {
+        printf("failed to init EventLoop\n");
+        server_loop.stop();
+        server_thread.join();
+        return -1;
+    }
+    
+    using ConnList = std::list<std::unique_ptr<TlsServerConn>>;
+    ConnList conns;
+    TcpListener listener(&server_loop);
+    listener.setAcceptCallback([&] (SOCKET_FD fd, const char*, uint16_t) -> bool {
+        auto it = conns.emplace(conns.end(), new TlsServerConn(&server_loop));
+        auto ret = (*it)->attachFd(fd, [&server_loop, &conns, it] {
+            server_loop.post([&conns, it] { conns.erase(it); });
+        });
+        if (ret != KMError::NOERR) {
+            conns.erase(it);
+            return false;
+        }
+        return true;
+    });
+    KMError err = KMError::NOERR;
+    server_loop.sync([&] { err = listener.startListen("127.0.0.1", port); });
+    if (err != KMError::NOERR) {
+        printf("failed to listen on port %u\n", port);
+        client_loop.stop();
+        client_thread.join();
+        server_loop.stop();
+        server_thread.join();
+        return -1;
+    }
+    
+    std::atomic<uint64_t> handshakes{0};
+    std::vector<std::unique_ptr<TlsClient>> clients;
+    client_loop.sync([&] {
+        for (int i=0; i<concurrent; ++i) {
+            std::unique_ptr<TlsClient> client(new TlsClient(&client_loop, port, full_handshake, handshakes));
+            client->start();
+            clients.emplace_back(std::move(client));
+        }
+    });
+    
+    printf("tls: %d connections, %d seconds, %s, %d crypto threads\n",
+           concurrent, duration, full_handshake ? "full handshake" : "session resumption", crypto_threads);
+    // the latency of server loop, which is the time of a task waiting for the
+    // running handshakes
+    std::atomic<bool> probe_stopped{false};
+    std::vector<uint32_t> latencies;
+    std::thread probe_thread([&] {
+        while (!probe_stopped) {
+            auto t0 = std::chrono::steady_clock::now();
+            server_loop.sync([] {});
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+            latencies.push_back(static_cast<uint32_t>(us));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    SslSessionStats start_stats;
+    getSslSessionStats(start_stats);
+    uint64_t start_count = handshakes;
+    uint64_t last_count = start_count;
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i=0; i<duration; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t count = handshakes;
+        printf("  %ds: %llu handshakes/s\n", i + 1, (unsigned long long)(count - last_count));
+        last_count = count;
+    }
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    uint64_t total = handshakes - start_count;
+    getSslSessionStats(stats);
+    probe_stopped = true;
+    probe_thread.join();
+    
+    client_loop.sync([&] {
+        for (auto &client : clients) {
+            client->stop();
+        }
+    });
+    client_loop.sync([&] { clients.clear(); });
+    client_loop.stop();
+    client_thread.join();
+    
+    server_loop.sync([&] {
+        listener.close();
+        for (auto &conn : conns) {
+            conn->close();
+        }
+    });
+    server_loop.sync([&] { conns.clear(); });
+    server_loop.stop();
+    server_thread.join();
+    
+    auto client_total = stats.client_handshakes - start_stats.client_handshakes;
+    auto client_resumed = stats.client_resumed - start_stats.client_resumed;
+    auto server_total = stats.server_handshakes - start_stats.server_handshakes;
+    auto server_resumed = stats.server_resumed - start_stats.server_resumed;
+    printf("tls: total %llu handshakes, average %.0f handshakes/s\n",
+           (unsigned long long)total, elapsed_ms > 0 ? total * 1000.0 / elapsed_ms : 0.0);
+    printf("tls: resumption hit rate, client %.1f%%, server %.1f%%\n",
+           client_total > 0 ? client_resumed * 100.0 / client_total : 0.0,
+           server_total > 0 ? server_resumed * 100.0 / server_total : 0.0);
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies] (double p) {
+            return latencies[std::min(latencies.size() - 1, size_t(latencies.size() * p))];
+        };
+        printf("tls: server loop latency, p50 %u us, p99 %u us, max %u us\n",
+               percentile(0.5), percentile(0.99), latencies.back());
+    }
+    setSslCryptoThreads(0);
+    return 0;
+}
+
+int runTlsThroughputBench(int argc, char *argv[])
+{
+    int concurrent = 1;
+    int duration = 10;
+    uint16_t port = 52410;
+    bool send_file = false;
+    size_t chunk_size = kChunkSize;
+    int loops = 1;
+    for (int i=0; i<argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0) {
+            send_file = true;
+        } else if (argv[i][0] == '-' && i + 1 < argc) {
+            switch (argv[i][1]) {
+                case 'c':
+                    concurrent = atoi(argv[++i]);
+                    break;
+                case 'd':
+                    duration = atoi(argv[++i]);
+                    break;
+                case 'p':
+                    port = (uint16_t)atoi(argv[++i]);
+                    break;
+                case 'b':
+                    chunk_size = (size_t)atoi(argv[++i]);
+                    break;
+                case 'l':
+                    loops = atoi(argv[++i]);
+                    break;
+                default:
+                    printf("%s\n", g_tlsput_usage.c_str());
+                    return -1;
+            }
+        } else {
+            printf("%s\n", g_tlsput_usage.c_str());
+            return -1;
+        }
+    }
+    if (concurrent <= 0) {
+        concurrent = 1;
+    }
+    if (duration <= 0) {
+        duration = 1;
+    }
+    if (chunk_size == 0) {
+        chunk_size = kChunkSize;
+    }
+    if (loops <= 0) {
+        loops = 1;
+    }
+    if (concurrent < loops) {
+        concurrent = loops;
+    }
+    int file_fd = -1;
+    if (send_file) {
+        file_fd = createTempFile();
+        if (file_fd < 0) {
+            printf("failed to create temp file\n");
+            return -1;
+        }
+    }
+    
+    // each server loop has a client loop, the connections are distributed
+    // evenly over the loops
+    struct LoopContext
+    {
+        EventLoop server_loop;
+        EventLoop client_loop;
+        std::thread server_thread;
+        std::thread client_thread;
+        std::vector<std::unique_ptr<PushServerConn>> conns;
+        std::vector<std::unique_ptr<PullClient>> clients;
+    };
+    std::vector<std::unique_ptr<LoopContext>> contexts;
+    auto stopLoops = [&contexts] {
+        for (auto &ctx : contexts) {
+            ctx->client_loop.sync([&ctx] {
+                for (auto &client : ctx->clients) {
+                    client->close();
+                }
+                ctx->clients.clear();
+            });
+            ctx->client_loop.stop();
+            ctx->client_thread.join();
+        }
+        for (auto &ctx : contexts) {
+            ctx->server_loop.sync([&ctx] {
+                for (auto &conn : ctx->conns) {
+                    conn->close();
+                }
+                ctx->conns.clear();
+            });
+            ctx->server_loop.stop();
+            ctx->server_thread.join();
+        }
+        contexts.clear();
+    };
+    for (int i=0; i<loops; ++i) {
+        std::unique_ptr<LoopContext> ctx(new LoopContext);
+        if (!startLoop(ctx->server_loop, ctx->server_thread)) {
+            printf("failed to init EventLoop\n");
+            stopLoops();
+            return -1;
+        }
+        if (!startLoop(ctx->client_loop, ctx->client_thread)) {
+            printf("failed to init EventLoop\n");
+            ctx->server_loop.stop();
+            ctx->server_thread.join();
+            stopLoops();
+            return -1;
+        }
+        contexts.emplace_back(std::move(ctx));
+    }
+    
+    // the listener runs in first server loop and dispatches the fd to the loops
+    // in turn, the connection is created in the loop it runs on
+    auto &listen_loop = contexts[0]->server_loop;
+    size_t accept_seq = 0;
+    TcpListener listener(&listen_loop);
+    listener.setAcceptCallback([&] (SOCKET_FD fd, const char*, uint16_t) -> bool {
+        auto *ctx = contexts[accept_seq++ % contexts.size()].get();
+        auto ret = ctx->server_loop.post([=] {
+            std::unique_ptr<PushServerConn> conn(new PushServerConn(&ctx->server_loop, SSL_ENABLE, file_fd, chunk_size));
+            if (conn->attachFd(fd) == KMError::NOERR) {
+                ctx->conns.emplace_back(std::move(conn));
+            }
+        });
+        return ret == KMError::NOERR;
+    });
+    KMError err = KMError::NOERR;
+    listen_loop.sync([&] { err = listener.startListen("127.0.0.1", port); });
+    if (err != KMError::NOERR) {
+        printf("failed to listen on port %u\n", port);
+        stopLoops();
+        return -1;
+    }
+    
+    // the clients of a loop are started in one task, the loop may be too busy
+    // to run the next task once the data is flowing
+    std::atomic<uint64_t> received{0};
+    for (int i=0; i<loops; ++i) {
+        auto *ctx = contexts[i].get();
+        int count = concurrent / loops + (i < concurrent % loops ? 1 : 0);
+        ctx->client_loop.sync([&] {
+            for (int j=0; j<count; ++j) {
+                std::unique_ptr<PullClient> client(new PullClient(&ctx->client_loop, received));
+                client->start(port, SSL_ENABLE | SSL_ALLOW_SELF_SIGNED_CERT);
+                ctx->clients.emplace_back(std::move(client));
+            }
+        });
+    }
+    
+    // skip the handshake time
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    printf("tlsput: %d connections, %d loops, %d seconds, %s\n", concurrent, loops, duration,
+           send_file ? "sendFile" : "send");
+    uint64_t start_count = received;
+    uint64_t last_count = start_count;
+    double start_cpu = getCpuTime();
+    auto start_time = std::chrono::steady_clock::now();
+    for (int i=0; i<duration; ++i) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t count = received;
+        printf("  %ds: %.1f MB/s\n", i + 1, (count - last_count) / 1048576.0);
+        last_count = count;
+    }
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    double cpu = getCpuTime() - start_cpu;
+    uint64_t total = received - start_count;
+    s_tlsput_stopped = true;
+    
+    listen_loop.sync([&] { listener.close(); });
+    stopLoops();
+    if (file_fd >= 0) {
+        ::close(file_fd);
+    }
+    
+    double gb = total / 1073741824.0;
+    printf("tlsput: total %.1f MB, average %.1f MB/s, %.2f CPU seconds per GB\n",
+           total / 1048576.0, elapsed_ms > 0 ? total * 1000.0 / elapsed_ms / 1048576.0 : 0.0,
+           gb > 0 ? cpu / gb : 0.0);
+    return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef __TlsBench_H__
+#define __TlsBench_H__
+
+/* TLS handshakes per second benchmark, the clients connect to the server over
+ * loopback and reconnect after handshake, the server runs in its own loop thread
+ */
+int runTlsBench(int argc, char *argv[]);
+
+/* TLS bulk throughput and CPU cost per GB
+ */
+int runTlsThroughputBench(int argc, char *argv[]);
+
+#endif
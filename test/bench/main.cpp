@@ -0,0 +1,90 @@
+#include "kmapi.h"
+#include "util/defer.h"
+#include "util/kmtrace.h"
+#include "RpsBench.h"
+#include "RelayBench.h"
+#include "TlsBench.h"
+#include "ParserBench.h"
+#include "FileBench.h"
+#include "EncodingBench.h"
+#include "CacheBench.h"
+#include "RouterBench.h"
+#include "ChunkedBench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifndef KUMA_OS_WIN
+#include <signal.h>
+#endif
+
+using namespace kuma;
+
+static const std::string g_usage =
+"   bench rps [option]      HTTP/1.1, HTTP/2 or WebSocket requests per second\n"
+"   bench relay [option]    TcpRelay throughput over loopback\n"
+"   bench tls [option]      TLS handshakes per second over loopback\n"
+"   bench tlsput [option]   TLS throughput and CPU per GB\n"
+"   bench parser [option]   HTTP/1 parser throughput on request corpora\n"
+"   bench file [option]     static file serving, from file or from memory\n"
+"   bench encoding [option] CPU versus bytes of compressed response body\n"
+"   bench cache [option]    hit ratio and evictions of HTTP cache\n"
+"   bench router [option]   request routing over many routes\n"
+"   bench chunked [option]  streaming throughput of chunked response\n"
+"   bench -v                print version\n"
+;
+
+void printUsage()
+{
+    printf("%s\n", g_usage.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+#ifndef KUMA_OS_WIN
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    
+    if(argc < 2) {
+        printUsage();
+        return -1;
+    }
+    if (strcmp(argv[1], "-v") == 0) {
+        printf("kuma bench v1.0\n");
+        return 0;
+    }
+    
+    kuma::init();
+    DEFER([]{ kuma::fini(); });
+    // the info traces would dominate the result
+    kuma::setTraceFunc([] (int level, const char* msg) {
+        if (level <= KUMA_TRACE_LEVEL_WARN) {
+            printf("%s\n", msg);
+        }
+    });
+    
+    if (strcmp(argv[1], "rps") == 0) {
+        return runRpsBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "relay") == 0) {
+        return runRelayBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "tls") == 0) {
+        return runTlsBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "tlsput") == 0) {
+        return runTlsThroughputBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "parser") == 0) {
+        return runParserBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "file") == 0) {
+        return runFileBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "encoding") == 0) {
+        return runEncodingBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "cache") == 0) {
+        return runCacheBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "router") == 0) {
+        return runRouterBench(argc - 2, argv + 2);
+    } else if (strcmp(argv[1], "chunked") == 0) {
+        return runChunkedBench(argc - 2, argv + 2);
+    }
+    printUsage();
+    return -1;
+}
@@ -8,6 +8,18 @@
 
 extern std::string www_path;
 
+// the files of www are shared by all the connections
+static StaticFileHandler& getFileHandler()
+{
+    static StaticFileHandler file_handler(www_path.c_str());
+    static bool init_once = [] {
+        file_handler.setContentEncoding("br, gzip, deflate");
+        return true;
+    }();
+    (void)init_once;
+    return file_handler;
+}
+
 HttpTest::HttpTest(ObjectManager* obj_mgr, long conn_id, const std::string &ver)
 : obj_mgr_(obj_mgr)
 , http_(obj_mgr->eventLoop(), ver.c_str())
@@ -54,9 +66,7 @@ int HttpTest::close()
 
 void HttpTest::onSend(KMError err)
 {
-    if (state_ == State::SENDING_FILE) {
-        sendTestFile();
-    } else if (state_ == State::SENDING_TEST_DATA) {
+    if (state_ == State::SENDING_TEST_DATA) {
         sendTestData();
     }
 }
@@ -100,12 +110,7 @@ void HttpTest::onRequestComplete()
     int status = 200;
     std::string desc("OK");
     if (!is_options_) {
-        std::string file = www_path;
-        if (strcasecmp(http_.getPath(), "/") == 0) {
-            file += PATH_SEPARATOR;
-            file += "index.html";
-            state_ = State::SENDING_FILE;
-        } else if (strcasecmp(http_.getPath(), "/testdata") == 0) {
+        if (strcasecmp(http_.getPath(), "/testdata") == 0) {
             state_ = State::SENDING_TEST_DATA;
             size_t contentLength = 256*1024*1024;
             if (http_.getHeaderValue("User-Agent")) {
@@ -117,22 +122,9 @@ void HttpTest::onRequestComplete()
             }
             http_.addHeader("Content-Length", (uint32_t)contentLength);
         } else {
-            file += http_.getPath();
             state_ = State::SENDING_FILE;
-        }
-        if (State::SENDING_FILE == state_) {
-            if (fileExist(file)) {
-                file_name_ = std::move(file);
-                std::string path, name, ext;
-                splitPath(file_name_, path, name, ext);
-                http_.addHeader("Content-Type", getMime(ext).c_str());
-            } else {
-                file_name_.clear();
-                status = 404;
-                desc = "Not Found";
-                http_.addHeader("Content-Type", "text/html");
-            }
-            http_.addHeader("Transfer-Encoding", "chunked");
+            getFileHandler().serve(http_);
+            return;
         }
     }
     http_.sendResponse(status, desc.c_str());
@@ -144,49 +136,6 @@ void HttpTest::onResponseComplete()
     http_.reset();
 }
 
-void HttpTest::sendTestFile()
-{
-    FILE *fp = nullptr;
-#ifdef KUMA_OS_WIN
-    auto err = fopen_s(&fp, file_name_.c_str(), "rb");
-#else
-    fp = fopen(file_name_.c_str(), "rb");
-#endif
-    if (!fp) {
-        printf("failed to open file %s\n", file_name_.c_str());
-        file_name_.clear();
-    }
-    if (file_name_.empty()) {
-        static const std::string not_found("<html><body>404 Not Found!</body></html>");
-        //http_.sendData((const uint8_t*)(not_found.c_str()), not_found.size());
-        //http_.sendData(nullptr, 0);
-        KMBuffer buf(not_found.c_str(), not_found.size(), not_found.size());
-        http_.sendData(buf);
-        buf.reset();
-        http_.sendData(buf);
-        return;
-    }
-    //uint8_t buf[4096];
-    //auto nread = fread(buf, 1, sizeof(buf), fp);
-    KMBuffer buf(4096);
-    auto nread = fread(buf.writePtr(), 1, buf.space(), fp);
-    buf.bytesWritten(nread);
-    fclose(fp);
-    if (nread > 0) {
-        //int ret = http_.sendData(buf, nread);
-        int ret = http_.sendData(buf);
-        if (ret < 0) {
-            return;
-        } else if (ret < nread) {
-            // should buffer remain data
-            return;
-        } else {
-            // end response
-            http_.sendData(nullptr, 0);
-        }
-    }
-}
-
 void HttpTest::sendTestData()
 {
     if (is_options_) {
@@ -36,7 +36,6 @@ private:
     };
     void setupCallbacks();
     void cleanup();
-    void sendTestFile();
     void sendTestData();
     void sendNormal();
     
@@ -47,7 +46,6 @@ private:
     State           state_ = State::NONE;
     bool            is_options_ = false;
     size_t          total_bytes_read_ = 0;
-    std::string     file_name_;
 };
 
 #endif
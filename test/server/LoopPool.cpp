@@ -22,6 +22,23 @@ TestLoop* LoopPool::getNextLoop()
     return loop;
 }
 
+TestLoop* LoopPool::getLoop(EventLoop* loop)
+{
+    for (auto l : loops_) {
+        if (l->eventLoop() == loop) {
+            return l;
+        }
+    }
+    return nullptr;
+}
+
+void LoopPool::getEventLoops(std::vector<EventLoop*> &loops)
+{
+    for (auto l : loops_) {
+        loops.push_back(l->eventLoop());
+    }
+}
+
 bool LoopPool::init(int count, PollType poll_type)
 {
     for (int i=0; i < count; ++i) {
@@ -21,6 +21,8 @@ public:
     
     long getConnId() { return ++id_seed_; }
     TestLoop* getNextLoop();
+    TestLoop* getLoop(EventLoop* loop);
+    void getEventLoops(std::vector<EventLoop*> &loops);
     
 private:
     void cleanup();
@@ -7,6 +7,7 @@
 TcpServer::TcpServer(EventLoop* loop, int count)
 : loop_(loop)
 , server_(loop_)
+, http_server_(loop_)
 , proto_(PROTO_TCP)
 , thr_count_(count)
 , loop_pool_()
@@ -42,6 +43,9 @@ KMError TcpServer::startListen(const std::string &proto, const std::string &host
         proto_ = PROTO_AUTOS;
     }
     loop_pool_.init(thr_count_, loop_->getPollType());
+    if (proto_ == PROTO_AUTO || proto_ == PROTO_AUTOS) {
+        return startHttpServer(host, port);
+    }
     server_.setAcceptCallback([this] (SOCKET_FD fd, const char* ip, uint16_t port) -> bool { return onAccept(fd, ip, port); });
     server_.setErrorCallback([this] (KMError err) { onError(err); });
     return server_.startListen(host.c_str(), port);
@@ -50,6 +54,7 @@ KMError TcpServer::startListen(const std::string &proto, const std::string &host
 KMError TcpServer::stopListen()
 {
     server_.stopListen(nullptr, 0);
+    http_server_.close();
     loop_pool_.stop();
     return KMError::NOERR;
 }
@@ -64,6 +69,25 @@ bool TcpServer::onAccept(SOCKET_FD fd, const std::string &ip, uint16_t port)
     return true;
 }
 
+KMError TcpServer::startHttpServer(const std::string &host, uint16_t port)
+{
+    std::vector<EventLoop*> loops;
+    loop_pool_.getEventLoops(loops);
+    http_server_.setLoops(loops.data(), loops.size());
+    http_server_.setSslFlags(proto_ == PROTO_AUTOS ? SSL_ENABLE : 0);
+    http_server_.setHttpCallback([this] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        loop_pool_.getLoop(loop)->addHttp(std::move(tcp), std::move(parser), init_buf);
+    });
+    http_server_.setHttp2Callback([this] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        loop_pool_.getLoop(loop)->addH2Conn(std::move(tcp), std::move(parser), init_buf);
+    });
+    http_server_.setWebSocketCallback([this] (EventLoop *loop, TcpSocket &&tcp, HttpParser &&parser, const KMBuffer *init_buf) {
+        loop_pool_.getLoop(loop)->addWebSocket(std::move(tcp), std::move(parser), init_buf);
+    });
+    http_server_.setErrorCallback([this] (KMError err) { onError(err); });
+    return http_server_.startListen(host.c_str(), port);
+}
+
 void TcpServer::onError(KMError err)
 {
     printf("TcpServer::onError, err=%d\n", err);
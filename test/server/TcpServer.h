@@ -25,10 +25,12 @@ public:
     
 private:
     void cleanup();
+    KMError startHttpServer(const std::string &host, uint16_t port);
     
 private:
     EventLoop*      loop_;
     TcpListener     server_;
+    HttpServer      http_server_;
     Proto           proto_;
     int             thr_count_;
     LoopPool        loop_pool_;
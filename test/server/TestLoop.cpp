@@ -4,7 +4,6 @@
 #include "HttpTest.h"
 #include "WsTest.h"
 #include "H2ConnTest.h"
-#include "ProtoDemuxer.h"
 
 #include <string.h>
 
@@ -95,16 +94,6 @@ void TestLoop::addFd(SOCKET_FD fd, Proto proto)
                 ws->attachFd(fd, proto==PROTO_WSS?SSL_ENABLE:0, nullptr);
                 break;
             }
-            case PROTO_AUTO:
-            case PROTO_AUTOS:
-            {
-                long conn_id = loopPool_->getConnId();
-                ProtoDemuxer* demuxer = new ProtoDemuxer(this, conn_id);
-                addObject(conn_id, demuxer);
-                demuxer->attachFd(fd, proto==PROTO_AUTOS?SSL_ENABLE:0);
-                break;
-            }
-                
             default:
                 break;
         }
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "AcceptorBase.h"
+#include "EventLoopImpl.h"
+
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace kuma;
+
+class AcceptorBaseTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        loop_ = std::make_shared<EventLoop::Impl>();
+        ASSERT_TRUE(loop_->init());
+        path_ = "/tmp/kuma_ut_" + std::to_string(::getpid()) + ".sock";
+        ::unlink(path_.c_str());
+    }
+
+    void TearDown() override
+    {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        ::unlink(path_.c_str());
+    }
+
+    // the socket file of a listener not managed by kuma
+    int bindPath(bool listening)
+    {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+        if (fd < 0 || ::bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+            (listening && ::listen(fd, 8) != 0)) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool pathExists() const
+    {
+        struct stat st;
+        return ::stat(path_.c_str(), &st) == 0;
+    }
+
+protected:
+    EventLoopPtr    loop_;
+    std::string     path_;
+    int             fd_ = -1;
+};
+
+TEST_F(AcceptorBaseTest, Unix_Listen_Removes_Stale_Socket)
+{
+    // the socket file is left when the process exited without closing listener
+    fd_ = bindPath(true);
+    ASSERT_GE(fd_, 0);
+    ::close(fd_);
+    fd_ = -1;
+    ASSERT_TRUE(pathExists());
+
+    AcceptorBase acceptor(loop_);
+    EXPECT_EQ(KMError::NOERR, acceptor.listen("unix:" + path_, 0));
+    acceptor.close();
+    EXPECT_FALSE(pathExists());
+}
+
+TEST_F(AcceptorBaseTest, Unix_Listen_Keeps_Live_Socket)
+{
+    fd_ = bindPath(true);
+    ASSERT_GE(fd_, 0);
+
+    AcceptorBase acceptor(loop_);
+    EXPECT_EQ(KMError::ALREADY_EXIST, acceptor.listen("unix:" + path_, 0));
+    // the file of live listener is not removed
+    EXPECT_TRUE(pathExists());
+}
@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+#include "http/ContentEncoder.h"
+
+#ifdef KUMA_HAS_ZLIB
+# include <zlib.h>
+#endif
+#ifdef KUMA_HAS_BROTLI
+# include <brotli/decode.h>
+#endif
+
+#include <random>
+#include <string>
+
+using namespace kuma;
+
+namespace {
+
+using Type = ContentEncoder::Type;
+
+std::string toString(const KMBuffer *buf)
+{
+    std::string str;
+    if (buf) {
+        for (auto it = buf->begin(); it != buf->end(); ++it) {
+            str.append(static_cast<const char*>(it->readPtr()), it->length());
+        }
+    }
+    return str;
+}
+
+// the streaming decoder of the encoded body
+class Decoder
+{
+public:
+    Decoder(Type type) : type_(type)
+    {
+#ifdef KUMA_HAS_ZLIB
+        if (type == Type::GZIP || type == Type::DEFLATE) {
+            ok_ = inflateInit2(&strm_, type == Type::GZIP ? 15 + 16 : 15) == Z_OK;
+        }
+#endif
+#ifdef KUMA_HAS_BROTLI
+        if (type == Type::BROTLI) {
+            state_ = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+            ok_ = state_ != nullptr;
+        }
+#endif
+    }
+    
+    ~Decoder()
+    {
+#ifdef KUMA_HAS_ZLIB
+        if (ok_ && (type_ == Type::GZIP || type_ == Type::DEFLATE)) {
+            inflateEnd(&strm_);
+        }
+#endif
+#ifdef KUMA_HAS_BROTLI
+        if (state_) {
+            BrotliDecoderDestroyInstance(state_);
+        }
+#endif
+    }
+    
+    // all the output of data is decoded, false on error
+    bool decode(const std::string &data, std::string &out)
+    {
+        if (!ok_) {
+            return false;
+        }
+        uint8_t buf[4096];
+#ifdef KUMA_HAS_ZLIB
+        if (type_ == Type::GZIP || type_ == Type::DEFLATE) {
+            strm_.next_in = (Bytef*)data.c_str();
+            strm_.avail_in = static_cast<uInt>(data.size());
+            do {
+                strm_.next_out = buf;
+                strm_.avail_out = sizeof(buf);
+                int ret = inflate(&strm_, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                    return false;
+                }
+                out.append((char*)buf, sizeof(buf) - strm_.avail_out);
+                if (ret == Z_STREAM_END) {
+                    finished_ = true;
+                    break;
+                }
+            } while (strm_.avail_in > 0 || strm_.avail_out == 0);
+            return strm_.avail_in == 0;
+        }
+#endif
+#ifdef KUMA_HAS_BROTLI
+        if (type_ == Type::BROTLI) {
+            size_t avail_in = data.size();
+            auto *next_in = (const uint8_t*)data.c_str();
+            BrotliDecoderResult ret;
+            do {
+                size_t avail_out = sizeof(buf);
+                uint8_t *next_out = buf;
+                ret = BrotliDecoderDecompressStream(state_, &avail_in, &next_in, &avail_out, &next_out, nullptr);
+                if (ret == BROTLI_DECODER_RESULT_ERROR) {
+                    return false;
+                }
+                out.append((char*)buf, sizeof(buf) - avail_out);
+            } while (ret == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT || BrotliDecoderHasMoreOutput(state_));
+            finished_ = ret == BROTLI_DECODER_RESULT_SUCCESS;
+            return avail_in == 0;
+        }
+#endif
+        return false;
+    }
+    
+    bool finished() const { return finished_; }
+    
+private:
+    Type    type_;
+    bool    ok_ = false;
+    bool    finished_ = false;
+#ifdef KUMA_HAS_ZLIB
+    z_stream strm_{};
+#endif
+#ifdef KUMA_HAS_BROTLI
+    BrotliDecoderState *state_ = nullptr;
+#endif
+};
+
+// the text of a web page with incompressible random bytes between
+std::string createInput(size_t size)
+{
+    std::mt19937 rng(20170101);
+    std::string input;
+    while (input.size() < size) {
+        input += "<li class=\"item\"><a href=\"/items/" + std::to_string(rng() % 1000) + "\">item</a></li>\n";
+        if (rng() % 8 == 0) {
+            for (int i = 0; i < 64; ++i) {
+                input.push_back(static_cast<char>(rng()));
+            }
+        }
+    }
+    input.resize(size);
+    return input;
+}
+
+/* feed input to encoder chunk by chunk, the output of each chunk must be decodable
+ * without more data since it is flushed, and the decoded is the input fed so far
+ */
+void roundTrip(Type type, int level)
+{
+    if (!ContentEncoder::isSupported(type)) {
+        return;
+    }
+    auto encoder = ContentEncoder::create(type, level);
+    ASSERT_TRUE(encoder);
+    Decoder decoder(type);
+    auto input = createInput(300*1000);
+    const size_t chunk_sizes[] = { 1, 0, 7, 100, 4096, 16384, 65536, 100000 };
+    size_t offset = 0;
+    size_t encoded_size = 0;
+    std::string decoded;
+    for (size_t i = 0; offset < input.size(); ++i) {
+        auto len = std::min(chunk_sizes[i % 8], input.size() - offset);
+        KMBuffer buf(input.c_str() + offset, len, len);
+        KMBuffer::Ptr out;
+        ASSERT_EQ(KMError::NOERR, encoder->encode(&buf, false, out));
+        offset += len;
+        auto encoded = toString(out.get());
+        encoded_size += encoded.size();
+        ASSERT_TRUE(decoder.decode(encoded, decoded));
+        ASSERT_EQ(offset, decoded.size()) << "type=" << int(type);
+    }
+    KMBuffer::Ptr out;
+    ASSERT_EQ(KMError::NOERR, encoder->encode(nullptr, true, out));
+    auto encoded = toString(out.get());
+    encoded_size += encoded.size();
+    ASSERT_TRUE(decoder.decode(encoded, decoded));
+    EXPECT_TRUE(decoder.finished());
+    EXPECT_TRUE(input == decoded) << "type=" << int(type);
+    EXPECT_LT(encoded_size, input.size());
+    // the stream is ended
+    out.reset();
+    EXPECT_EQ(KMError::INVALID_STATE, encoder->encode(nullptr, true, out));
+}
+
+}
+
+TEST(ContentEncoderTest, Negotiate_Empty)
+{
+    ContentEncoder::TypeVector types{ Type::BROTLI, Type::GZIP };
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, nullptr));
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, ""));
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate({}, "gzip, br"));
+    // not acceptable or not supported
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, "identity"));
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, "compress, zstd"));
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, "deflate"));
+}
+
+TEST(ContentEncoderTest, Negotiate_Preference)
+{
+    // the order of types wins if the qvalues are same
+    EXPECT_EQ(Type::BROTLI, ContentEncoder::negotiate({ Type::BROTLI, Type::GZIP }, "gzip, deflate, br"));
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate({ Type::GZIP, Type::BROTLI }, "gzip, deflate, br"));
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate({ Type::BROTLI, Type::GZIP }, "gzip"));
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate({ Type::GZIP }, "x-gzip"));
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate({ Type::GZIP }, "GZIP"));
+}
+
+TEST(ContentEncoderTest, Negotiate_QValue)
+{
+    ContentEncoder::TypeVector types{ Type::BROTLI, Type::GZIP, Type::DEFLATE };
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate(types, "gzip;q=1.0, br;q=0.5"));
+    EXPECT_EQ(Type::DEFLATE, ContentEncoder::negotiate(types, "br;q=0.2, gzip;q=0.4, deflate;q=0.6"));
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate(types, "br;q=0.5, gzip;q=0.500001"));
+    // whitespaces and case around the parameter
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate(types, "br ; q=0.5, gzip ;  Q=0.8"));
+    // qvalue follows other parameters
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate(types, "gzip;level=1;q=0.3, br;q=0.2"));
+    EXPECT_EQ(Type::DEFLATE, ContentEncoder::negotiate(types, "deflate;q=0.001"));
+}
+
+TEST(ContentEncoderTest, Negotiate_Not_Acceptable)
+{
+    ContentEncoder::TypeVector types{ Type::BROTLI, Type::GZIP };
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, "br;q=0"));
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, "br;q=0, gzip;q=0.000"));
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate(types, "br;q=0, gzip"));
+    // empty or invalid qvalue is 0
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, "br;q=, gzip;q=abc"));
+}
+
+TEST(ContentEncoderTest, Negotiate_Any)
+{
+    ContentEncoder::TypeVector types{ Type::GZIP, Type::BROTLI };
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate(types, "*"));
+    // the listed type is not overridden by "*"
+    EXPECT_EQ(Type::BROTLI, ContentEncoder::negotiate(types, "*;q=0.5, gzip;q=0"));
+    EXPECT_EQ(Type::BROTLI, ContentEncoder::negotiate(types, "gzip;q=0.8, *;q=0.9"));
+    EXPECT_EQ(Type::GZIP, ContentEncoder::negotiate(types, "gzip;q=0.9, *;q=0.8"));
+    EXPECT_EQ(Type::IDENTITY, ContentEncoder::negotiate(types, "*;q=0"));
+    EXPECT_EQ(Type::BROTLI, ContentEncoder::negotiate(types, "*;q=0, br"));
+}
+
+TEST(ContentEncoderTest, Parse_Encodings)
+{
+    auto types = ContentEncoder::parseEncodings("br, gzip, deflate, gzip, compress");
+    ContentEncoder::TypeVector expected;
+    if (ContentEncoder::isSupported(Type::BROTLI)) {
+        expected.push_back(Type::BROTLI);
+    }
+    if (ContentEncoder::isSupported(Type::GZIP)) {
+        expected.push_back(Type::GZIP);
+        expected.push_back(Type::DEFLATE);
+    }
+    EXPECT_EQ(expected, types);
+    EXPECT_TRUE(ContentEncoder::parseEncodings("").empty());
+    EXPECT_TRUE(ContentEncoder::parseEncodings("identity").empty());
+}
+
+TEST(ContentEncoderTest, Round_Trip_Gzip)
+{
+    roundTrip(Type::GZIP, -1);
+    roundTrip(Type::GZIP, 1);
+    roundTrip(Type::GZIP, 9);
+}
+
+TEST(ContentEncoderTest, Round_Trip_Deflate)
+{
+    roundTrip(Type::DEFLATE, -1);
+    roundTrip(Type::DEFLATE, 1);
+}
+
+TEST(ContentEncoderTest, Round_Trip_Brotli)
+{
+    roundTrip(Type::BROTLI, -1);
+    roundTrip(Type::BROTLI, 0);
+    roundTrip(Type::BROTLI, 9);
+}
+
+TEST(ContentEncoderTest, Encode_All)
+{
+    auto input = createInput(100*1000);
+    KMBuffer buf(input.c_str(), input.size(), input.size());
+    for (auto type : { Type::GZIP, Type::DEFLATE, Type::BROTLI }) {
+        if (!ContentEncoder::isSupported(type)) {
+            continue;
+        }
+        KMBuffer::Ptr out;
+        ASSERT_EQ(KMError::NOERR, ContentEncoder::encodeAll(type, -1, buf, out));
+        Decoder decoder(type);
+        std::string decoded;
+        ASSERT_TRUE(decoder.decode(toString(out.get()), decoded));
+        EXPECT_TRUE(decoder.finished());
+        EXPECT_TRUE(input == decoded) << "type=" << int(type);
+    }
+}
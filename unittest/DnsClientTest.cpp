@@ -0,0 +1,341 @@
+#include <gtest/gtest.h>
+#include "DnsClient.h"
+#include "EventLoopImpl.h"
+#include "util/util.h"
+
+#include <string.h>
+#include <vector>
+#include <functional>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace kuma;
+
+namespace {
+
+const uint16_t kTypeA = 1;
+const uint16_t kTypeSOA = 6;
+const uint16_t kTypeAAAA = 28;
+const uint16_t kRcodeNXDomain = 3;
+
+struct ResourceRecord
+{
+    uint16_t type;
+    uint32_t ttl;
+    std::vector<uint8_t> rdata;
+};
+
+void appendU16(std::vector<uint8_t> &buf, uint16_t u)
+{
+    buf.push_back(static_cast<uint8_t>(u >> 8));
+    buf.push_back(static_cast<uint8_t>(u));
+}
+
+void appendU32(std::vector<uint8_t> &buf, uint32_t u)
+{
+    appendU16(buf, static_cast<uint16_t>(u >> 16));
+    appendU16(buf, static_cast<uint16_t>(u));
+}
+
+ResourceRecord makeA(const char *ip, uint32_t ttl)
+{
+    ResourceRecord rr{ kTypeA, ttl, std::vector<uint8_t>(4) };
+    inet_pton(AF_INET, ip, &rr.rdata[0]);
+    return rr;
+}
+
+ResourceRecord makeAAAA(const char *ip, uint32_t ttl)
+{
+    ResourceRecord rr{ kTypeAAAA, ttl, std::vector<uint8_t>(16) };
+    inet_pton(AF_INET6, ip, &rr.rdata[0]);
+    return rr;
+}
+
+ResourceRecord makeSOA(uint32_t ttl, uint32_t minimum)
+{
+    ResourceRecord rr{ kTypeSOA, ttl, {} };
+    DnsClient::encodeName("ns.test", rr.rdata);
+    DnsClient::encodeName("admin.test", rr.rdata);
+    for (uint32_t v : { 1u, 3600u, 600u, 86400u }) { // serial, refresh, retry, expire
+        appendU32(rr.rdata, v);
+    }
+    appendU32(rr.rdata, minimum);
+    return rr;
+}
+
+// the names of resource records point to the question name
+std::vector<uint8_t> buildResponse(uint16_t id, uint16_t qtype, const std::string &name, uint16_t rcode,
+                                   const std::vector<ResourceRecord> &answers,
+                                   const std::vector<ResourceRecord> &authorities)
+{
+    std::vector<uint8_t> buf;
+    appendU16(buf, id);
+    appendU16(buf, 0x8180 | rcode); // response, RD, RA
+    appendU16(buf, 1);
+    appendU16(buf, static_cast<uint16_t>(answers.size()));
+    appendU16(buf, static_cast<uint16_t>(authorities.size()));
+    appendU16(buf, 0);
+    DnsClient::encodeName(name, buf);
+    appendU16(buf, qtype);
+    appendU16(buf, 1);
+    for (auto const *rrs : { &answers, &authorities }) {
+        for (auto const &rr : *rrs) {
+            appendU16(buf, 0xC00C);
+            appendU16(buf, rr.type);
+            appendU16(buf, 1);
+            appendU32(buf, rr.ttl);
+            appendU16(buf, static_cast<uint16_t>(rr.rdata.size()));
+            buf.insert(buf.end(), rr.rdata.begin(), rr.rdata.end());
+        }
+    }
+    return buf;
+}
+
+}
+
+TEST(DnsNameTest, Encode_Name)
+{
+    std::vector<uint8_t> buf;
+    ASSERT_TRUE(DnsClient::encodeName("www.example.com", buf));
+    const uint8_t expected[] = { 3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0 };
+    EXPECT_EQ(std::vector<uint8_t>(expected, expected + sizeof(expected)), buf);
+
+    // the trailing dot of fully qualified name
+    std::vector<uint8_t> buf2;
+    ASSERT_TRUE(DnsClient::encodeName("www.example.com.", buf2));
+    EXPECT_EQ(buf, buf2);
+}
+
+TEST(DnsNameTest, Encode_Invalid_Name)
+{
+    std::vector<uint8_t> buf;
+    EXPECT_FALSE(DnsClient::encodeName("", buf));
+    EXPECT_FALSE(DnsClient::encodeName(".example.com", buf));
+    EXPECT_FALSE(DnsClient::encodeName("www..example.com", buf));
+    EXPECT_FALSE(DnsClient::encodeName(std::string(64, 'a') + ".com", buf));
+    EXPECT_TRUE(DnsClient::encodeName(std::string(63, 'a') + ".com", buf));
+    std::string long_name;
+    while (long_name.size() <= 254) {
+        long_name += "abcdefghi.";
+    }
+    EXPECT_FALSE(DnsClient::encodeName(long_name, buf));
+}
+
+TEST(DnsNameTest, Read_Name)
+{
+    std::vector<uint8_t> buf(12, 0); // header
+    DnsClient::encodeName("www.example.com", buf);
+    size_t offset = 12;
+    std::string name;
+    ASSERT_TRUE(DnsClient::readName(&buf[0], buf.size(), offset, name));
+    EXPECT_EQ("www.example.com", name);
+    EXPECT_EQ(buf.size(), offset);
+}
+
+TEST(DnsNameTest, Read_Compressed_Name)
+{
+    std::vector<uint8_t> buf(12, 0);
+    DnsClient::encodeName("example.com", buf);
+    // "mail" + pointer to "example.com", and a bare pointer
+    size_t mail_offset = buf.size();
+    const uint8_t mail[] = { 4, 'm', 'a', 'i', 'l', 0xC0, 12 };
+    buf.insert(buf.end(), mail, mail + sizeof(mail));
+    size_t ptr_offset = buf.size();
+    buf.push_back(0xC0);
+    buf.push_back(static_cast<uint8_t>(mail_offset));
+    buf.push_back(0xFF); // the data after name
+
+    size_t offset = mail_offset;
+    std::string name;
+    ASSERT_TRUE(DnsClient::readName(&buf[0], buf.size(), offset, name));
+    EXPECT_EQ("mail.example.com", name);
+    EXPECT_EQ(ptr_offset, offset);
+
+    offset = ptr_offset;
+    ASSERT_TRUE(DnsClient::readName(&buf[0], buf.size(), offset, name));
+    EXPECT_EQ("mail.example.com", name);
+    // the offset is moved past the pointer only
+    EXPECT_EQ(ptr_offset + 2, offset);
+}
+
+TEST(DnsNameTest, Read_Compression_Loop)
+{
+    std::string name;
+    // the pointer points to itself
+    const uint8_t self_loop[] = { 0, 0, 0xC0, 2 };
+    size_t offset = 2;
+    EXPECT_FALSE(DnsClient::readName(self_loop, sizeof(self_loop), offset, name));
+
+    // two labels point to each other
+    const uint8_t mutual_loop[] = { 1, 'a', 0xC0, 4, 1, 'b', 0xC0, 0 };
+    offset = 0;
+    EXPECT_FALSE(DnsClient::readName(mutual_loop, sizeof(mutual_loop), offset, name));
+}
+
+TEST(DnsNameTest, Read_Truncated_Name)
+{
+    std::vector<uint8_t> buf;
+    DnsClient::encodeName("www.example.com", buf);
+    std::string name;
+    // truncated in label, or before the terminating zero
+    for (size_t len : { size_t(0), size_t(2), size_t(4), buf.size() - 1 }) {
+        size_t offset = 0;
+        EXPECT_FALSE(DnsClient::readName(&buf[0], len, offset, name)) << "len=" << len;
+    }
+    // truncated pointer
+    const uint8_t ptr[] = { 0xC0 };
+    size_t offset = 0;
+    EXPECT_FALSE(DnsClient::readName(ptr, sizeof(ptr), offset, name));
+    // pointer beyond the packet
+    const uint8_t far_ptr[] = { 0xC0, 0x40 };
+    offset = 0;
+    EXPECT_FALSE(DnsClient::readName(far_ptr, sizeof(far_ptr), offset, name));
+    // reserved label type
+    const uint8_t bad_label[] = { 0x40, 'a', 0 };
+    offset = 0;
+    EXPECT_FALSE(DnsClient::readName(bad_label, sizeof(bad_label), offset, name));
+}
+
+class DnsClientTest : public ::testing::Test
+{
+protected:
+    using Responder = std::function<std::vector<uint8_t>(uint16_t id, uint16_t qtype, const std::string &name)>;
+
+    void SetUp() override
+    {
+        loop_ = std::make_shared<EventLoop::Impl>();
+        ASSERT_TRUE(loop_->init());
+        server_fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_GE(server_fd_, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ASSERT_EQ(0, ::bind(server_fd_, (sockaddr*)&addr, sizeof(addr)));
+        socklen_t len = sizeof(addr);
+        ASSERT_EQ(0, ::getsockname(server_fd_, (sockaddr*)&addr, &len));
+        ::fcntl(server_fd_, F_SETFL, ::fcntl(server_fd_, F_GETFL) | O_NONBLOCK);
+        client_.reset(new DnsClient(loop_));
+        ASSERT_EQ(KMError::NOERR, client_->setServers({ { "127.0.0.1", ntohs(addr.sin_port) } }));
+    }
+
+    void TearDown() override
+    {
+        client_.reset();
+        if (server_fd_ >= 0) {
+            ::close(server_fd_);
+        }
+    }
+
+    // answer the A and AAAA questions of host by responder
+    KMError query(const std::string &host, const Responder &responder)
+    {
+        bool done = false;
+        KMError result = KMError::FAILED;
+        auto ret = client_->query(host, [&] (KMError err, const DnsResolver::AddressList &addrs, uint32_t ttl_ms) {
+            result = err;
+            addrs_ = addrs;
+            ttl_ms_ = ttl_ms;
+            done = true;
+        });
+        if (ret != KMError::NOERR) {
+            return ret;
+        }
+        auto start_tick = get_tick_count_ms();
+        while (!done && calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < 3000) {
+            uint8_t buf[512];
+            sockaddr_storage from;
+            socklen_t from_len = sizeof(from);
+            auto n = ::recvfrom(server_fd_, buf, sizeof(buf), 0, (sockaddr*)&from, &from_len);
+            if (n > 12) {
+                size_t offset = 12;
+                std::string name;
+                if (DnsClient::readName(buf, n, offset, name) && offset + 4 <= size_t(n)) {
+                    auto rsp = responder(decode_u16(buf), decode_u16(buf + offset), name);
+                    ::sendto(server_fd_, &rsp[0], rsp.size(), 0, (sockaddr*)&from, from_len);
+                }
+            }
+            loop_->loopOnce(10);
+        }
+        return done ? result : KMError::TIMEOUT;
+    }
+
+protected:
+    EventLoopPtr                loop_;
+    std::unique_ptr<DnsClient>  client_;
+    int                         server_fd_ = -1;
+    DnsResolver::AddressList    addrs_;
+    uint32_t                    ttl_ms_ = 0;
+};
+
+TEST_F(DnsClientTest, Minimum_TTL_Of_Answers)
+{
+    auto ret = query("www.test", [] (uint16_t id, uint16_t qtype, const std::string &name) {
+        if (qtype == kTypeAAAA) {
+            return buildResponse(id, qtype, name, 0, { makeAAAA("2001:db8::1", 600) }, {});
+        }
+        return buildResponse(id, qtype, name, 0, { makeA("192.0.2.1", 300), makeA("192.0.2.2", 120) }, {});
+    });
+    ASSERT_EQ(KMError::NOERR, ret);
+    ASSERT_EQ(3u, addrs_.size());
+    // IPv6 addresses go first
+    EXPECT_EQ(AF_INET6, addrs_[0].ss_family);
+    EXPECT_EQ(AF_INET, addrs_[1].ss_family);
+    EXPECT_EQ(AF_INET, addrs_[2].ss_family);
+    EXPECT_EQ(120u * 1000, ttl_ms_);
+}
+
+TEST_F(DnsClientTest, TTL_Is_Capped)
+{
+    auto ret = query("www.test", [] (uint16_t id, uint16_t qtype, const std::string &name) {
+        if (qtype == kTypeAAAA) {
+            return buildResponse(id, qtype, name, 0, {}, {});
+        }
+        return buildResponse(id, qtype, name, 0, { makeA("192.0.2.1", 10*86400) }, {});
+    });
+    ASSERT_EQ(KMError::NOERR, ret);
+    ASSERT_EQ(1u, addrs_.size());
+    EXPECT_EQ(86400u * 1000, ttl_ms_);
+}
+
+TEST_F(DnsClientTest, Negative_TTL_From_SOA)
+{
+    // RFC 2308, the minimum of SOA TTL and SOA MINIMUM
+    auto ret = query("nx.test", [] (uint16_t id, uint16_t qtype, const std::string &name) {
+        return buildResponse(id, qtype, name, kRcodeNXDomain, {}, { makeSOA(qtype == kTypeA ? 600 : 900, 60) });
+    });
+    EXPECT_EQ(KMError::NOT_EXIST, ret);
+    EXPECT_TRUE(addrs_.empty());
+    EXPECT_EQ(60u * 1000, ttl_ms_);
+
+    ret = query("nx2.test", [] (uint16_t id, uint16_t qtype, const std::string &name) {
+        return buildResponse(id, qtype, name, kRcodeNXDomain, {}, { makeSOA(45, 3600) });
+    });
+    EXPECT_EQ(KMError::NOT_EXIST, ret);
+    EXPECT_EQ(45u * 1000, ttl_ms_);
+}
+
+TEST_F(DnsClientTest, Default_Negative_TTL)
+{
+    // no SOA in authority section
+    auto ret = query("nx.test", [] (uint16_t id, uint16_t qtype, const std::string &name) {
+        return buildResponse(id, qtype, name, kRcodeNXDomain, {}, {});
+    });
+    EXPECT_EQ(KMError::NOT_EXIST, ret);
+    EXPECT_EQ(30u * 1000, ttl_ms_);
+}
+
+TEST_F(DnsClientTest, Truncated_Response_Is_Failed)
+{
+    auto ret = query("www.test", [] (uint16_t id, uint16_t qtype, const std::string &name) {
+        auto rsp = buildResponse(id, qtype, name, 0, { makeA("192.0.2.1", 300) }, {});
+        rsp.resize(rsp.size() - 2); // cut in the rdata
+        return rsp;
+    });
+    // the malformed response is retried on the server until the tries are used up
+    EXPECT_EQ(KMError::FAILED, ret);
+    EXPECT_TRUE(addrs_.empty());
+}
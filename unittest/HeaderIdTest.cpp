@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include "http/HeaderId.h"
+
+#include <string>
+#include <set>
+
+using namespace kuma;
+
+namespace {
+
+std::string toUpper(std::string s)
+{
+    for (auto &c : s) {
+        if (c >= 'a' && c <= 'z') {
+            c = static_cast<char>(c - ('a' - 'A'));
+        }
+    }
+    return s;
+}
+
+std::string toLower(std::string s)
+{
+    for (auto &c : s) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c + ('a' - 'A'));
+        }
+    }
+    return s;
+}
+
+}
+
+TEST(HeaderIdTest, All_Known_Names)
+{
+    std::set<size_t> slots;
+    for (size_t i = 1; i < hdrid::kIdCount; ++i) {
+        auto id = static_cast<HeaderId>(i);
+        std::string name = getHeaderName(id);
+        ASSERT_FALSE(name.empty());
+        EXPECT_EQ(id, getHeaderId(name)) << name;
+        EXPECT_EQ(id, getHeaderId(name.c_str(), name.size())) << name;
+        // the hash is perfect, no two names share a slot
+        EXPECT_TRUE(slots.insert(hdrid::slotOf(name.c_str(), name.size(), hdrid::kSeed)).second) << name;
+    }
+    EXPECT_EQ(HeaderId::CONTENT_LENGTH, getHeaderId("Content-Length"));
+    EXPECT_STREQ("Content-Length", getHeaderName(HeaderId::CONTENT_LENGTH));
+    EXPECT_STREQ("", getHeaderName(HeaderId::UNKNOWN));
+    EXPECT_STREQ("", getHeaderName(HeaderId::MAX));
+}
+
+TEST(HeaderIdTest, Ignore_Case)
+{
+    for (size_t i = 1; i < hdrid::kIdCount; ++i) {
+        auto id = static_cast<HeaderId>(i);
+        std::string name = getHeaderName(id);
+        EXPECT_EQ(id, getHeaderId(toLower(name))) << name;
+        EXPECT_EQ(id, getHeaderId(toUpper(name))) << name;
+    }
+    EXPECT_EQ(HeaderId::CONTENT_LENGTH, getHeaderId("cOnTeNt-LeNgTh"));
+    EXPECT_EQ(HeaderId::WWW_AUTHENTICATE, getHeaderId("www-authenticate"));
+}
+
+TEST(HeaderIdTest, Unknown_Names)
+{
+    const char* names[] = {
+        "", "X", "X-Custom", "Content-Lengthx", "Content-Lengt", "Content_Length",
+        "Content Length", "Hosts", "Hos", "Kontent-Length",
+        // same length, first, middle and last chars as known names, so the hash
+        // may hit their slots
+        "Content-Lxxgth", "Cxxxxxx-Length", "Hxst", "Date ", " Date",
+        // case folding is ASCII only
+        "Content-Length\xc0", "\xc3" "ontent-Length",
+        "X-Very-Long-Header-Name-Exceeding-The-Limit-Of-Known-Names",
+    };
+    for (auto const *name : names) {
+        EXPECT_EQ(HeaderId::UNKNOWN, getHeaderId(name)) << name;
+    }
+    // nul inside the name
+    std::string name("Host", 4);
+    name[2] = '\0';
+    EXPECT_EQ(HeaderId::UNKNOWN, getHeaderId(name));
+    // only len bytes are compared
+    EXPECT_EQ(HeaderId::HOST, getHeaderId("Host: www.example.com", 4));
+    EXPECT_EQ(HeaderId::UNKNOWN, getHeaderId("Host", 3));
+}
+
+TEST(HeaderIdTest, Every_Name_Of_Slot_Misses)
+{
+    // a name is resolved only if it equals the name in its slot, so any
+    // single-char change of a known name is a miss
+    for (size_t i = 1; i < hdrid::kIdCount; ++i) {
+        std::string name = getHeaderName(static_cast<HeaderId>(i));
+        for (size_t pos = 0; pos < name.size(); ++pos) {
+            std::string changed = name;
+            changed[pos] = changed[pos] == '#' ? '$' : '#';
+            EXPECT_EQ(HeaderId::UNKNOWN, getHeaderId(changed)) << changed;
+        }
+    }
+}
+
+TEST(HeaderIdTest, Header_Slots)
+{
+    HeaderVector headers{
+        { "Host", "a.example.com" },
+        { "X-Custom", "1" },
+        { "host", "b.example.com" },
+        { "Content-Length", "5" },
+    };
+    HeaderSlots slots;
+    slots.build(headers);
+    EXPECT_EQ(0, slots.get(HeaderId::HOST));
+    EXPECT_EQ(3, slots.get(HeaderId::CONTENT_LENGTH));
+    EXPECT_EQ(-1, slots.get(HeaderId::DATE));
+    EXPECT_EQ(-1, slots.get(HeaderId::UNKNOWN));
+    slots.clear();
+    EXPECT_EQ(-1, slots.get(HeaderId::HOST));
+}
@@ -0,0 +1,296 @@
+#include <gtest/gtest.h>
+#include "http/Http1xConnectionPool.h"
+#include "http/Http1xRequest.h"
+#include "EventLoopImpl.h"
+#include "util/util.h"
+
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace kuma;
+
+class Http1xConnectionPoolTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        loop_ = std::make_shared<EventLoop::Impl>();
+        ASSERT_TRUE(loop_->init());
+        pool_ = Http1xConnectionPool::get(loop_);
+        ASSERT_TRUE(pool_ != nullptr);
+    }
+
+    void TearDown() override
+    {
+        for (auto fd : peer_fds_) {
+            ::close(fd);
+        }
+        if (listen_fd_ != -1) {
+            ::close(listen_fd_);
+        }
+        pool_.reset();
+        loop_.reset();
+        Http1xConnectionPool::setLimits(6, 0, 60*1000);
+    }
+
+    // a connected socket, the peer fd is closed in TearDown
+    Http1xConnectionPool::TcpSocketPtr createConnection(int *peer_fd = nullptr)
+    {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return Http1xConnectionPool::TcpSocketPtr();
+        }
+        peer_fds_.push_back(fds[1]);
+        if (peer_fd) {
+            *peer_fd = fds[1];
+        }
+        Http1xConnectionPool::TcpSocketPtr tcp(new TcpSocket::Impl(loop_));
+        if (tcp->attachFd(fds[0]) != KMError::NOERR) {
+            return Http1xConnectionPool::TcpSocketPtr();
+        }
+        return tcp;
+    }
+
+    void runLoop(uint32_t ms)
+    {
+        auto start_tick = get_tick_count_ms();
+        while (calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < ms) {
+            loop_->loopOnce(5);
+        }
+    }
+
+    uint16_t startServer()
+    {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        if (::bind(listen_fd_, (sockaddr*)&addr, addr_len) != 0 ||
+            ::listen(listen_fd_, 8) != 0 ||
+            ::getsockname(listen_fd_, (sockaddr*)&addr, &addr_len) != 0) {
+            return 0;
+        }
+        ::fcntl(listen_fd_, F_SETFL, ::fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+        return ntohs(addr.sin_port);
+    }
+
+    /* the test server accepts connections and reads requests, a request is answered
+     * unless its connection is in close_on_request_
+     */
+    void serve()
+    {
+        int fd;
+        while ((fd = ::accept(listen_fd_, nullptr, nullptr)) >= 0) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            server_fds_.push_back(fd);
+            server_data_.emplace_back();
+            peer_fds_.push_back(fd);
+        }
+        for (size_t i = 0; i < server_fds_.size(); ++i) {
+            if (server_fds_[i] == -1) {
+                continue;
+            }
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(server_fds_[i], buf, sizeof(buf))) > 0) {
+                server_data_[i].append(buf, n);
+            }
+            size_t pos;
+            while ((pos = server_data_[i].find("\r\n\r\n")) != std::string::npos) {
+                server_data_[i].erase(0, pos + 4);
+                ++server_requests_;
+                if (i < close_on_request_.size() && close_on_request_[i]) {
+                    // the connection is closed by peer while it is idle in pool
+                    ::shutdown(server_fds_[i], SHUT_RDWR);
+                    server_fds_[i] = -1;
+                    break;
+                }
+                std::string rsp = "HTTP/1.1 200 OK\r\nCache-Control: no-store\r\nContent-Length: 2\r\n\r\nok";
+                ::write(server_fds_[i], rsp.c_str(), rsp.size());
+            }
+        }
+    }
+
+    // send GET request and wait for it to complete or fail
+    bool request(const std::string &url, KMError &err)
+    {
+        Http1xRequest req(loop_, "HTTP/1.1");
+        bool completed = false;
+        err = KMError::NOERR;
+        std::string body;
+        req.setDataCallback([&body] (KMBuffer &buf) {
+            for (auto it = buf.begin(); it != buf.end(); ++it) {
+                body.append(static_cast<const char*>(it->readPtr()), it->length());
+            }
+        });
+        req.setResponseCompleteCallback([&completed] { completed = true; });
+        req.setErrorCallback([&err] (KMError e) { err = e; });
+        HttpRequest::Impl &impl = req;
+        if (impl.sendRequest("GET", url) != KMError::NOERR) {
+            return false;
+        }
+        auto start_tick = get_tick_count_ms();
+        while (!completed && err == KMError::NOERR &&
+               calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < 3000) {
+            loop_->loopOnce(5);
+            serve();
+        }
+        // the connection is put back to pool
+        req.close();
+        return completed && body == "ok";
+    }
+
+protected:
+    EventLoopPtr                    loop_;
+    Http1xConnectionPool::Ptr       pool_;
+    std::vector<int>                peer_fds_;
+
+    int                             listen_fd_ = -1;
+    std::vector<int>                server_fds_;
+    std::vector<std::string>        server_data_;
+    std::vector<bool>               close_on_request_;
+    size_t                          server_requests_ = 0;
+};
+
+TEST_F(Http1xConnectionPoolTest, Checkout_Checkin)
+{
+    auto key = Http1xConnectionPool::getKey("127.0.0.1", 80, 0);
+    EXPECT_TRUE(pool_->checkout(key) == nullptr);
+
+    auto tcp1 = createConnection();
+    auto tcp2 = createConnection();
+    ASSERT_TRUE(tcp1 && tcp2);
+    auto *ptr1 = tcp1.get();
+    auto *ptr2 = tcp2.get();
+    pool_->checkin(key, std::move(tcp1));
+    pool_->checkin(key, std::move(tcp2));
+    EXPECT_EQ(2u, pool_->idleCount());
+
+    // the connection of another host is not used
+    EXPECT_TRUE(pool_->checkout(Http1xConnectionPool::getKey("127.0.0.1", 81, 0)) == nullptr);
+    EXPECT_TRUE(pool_->checkout(Http1xConnectionPool::getKey("127.0.0.1", 80, 1)) == nullptr);
+
+    // the most recently used first
+    auto tcp = pool_->checkout(key);
+    EXPECT_EQ(ptr2, tcp.get());
+    tcp = pool_->checkout(key);
+    EXPECT_EQ(ptr1, tcp.get());
+    EXPECT_TRUE(pool_->checkout(key) == nullptr);
+    EXPECT_EQ(0u, pool_->idleCount());
+}
+
+TEST_F(Http1xConnectionPoolTest, Max_Idle_Per_Host)
+{
+    Http1xConnectionPool::setLimits(2, 0, 60*1000);
+    auto key = Http1xConnectionPool::getKey("127.0.0.1", 80, 0);
+    std::vector<TcpSocket::Impl*> ptrs;
+    for (int i = 0; i < 3; ++i) {
+        auto tcp = createConnection();
+        ASSERT_TRUE(tcp != nullptr);
+        ptrs.push_back(tcp.get());
+        pool_->checkin(key, std::move(tcp));
+    }
+    // the least recently used is closed
+    EXPECT_EQ(2u, pool_->idleCount());
+    EXPECT_EQ(ptrs[2], pool_->checkout(key).get());
+    EXPECT_EQ(ptrs[1], pool_->checkout(key).get());
+    EXPECT_TRUE(pool_->checkout(key) == nullptr);
+
+    // nothing is pooled
+    Http1xConnectionPool::setLimits(0, 0, 60*1000);
+    pool_->checkin(key, createConnection());
+    EXPECT_EQ(0u, pool_->idleCount());
+    EXPECT_TRUE(pool_->checkout(key) == nullptr);
+}
+
+TEST_F(Http1xConnectionPoolTest, Idle_Expire)
+{
+    Http1xConnectionPool::setLimits(6, 0, 50);
+    auto key1 = Http1xConnectionPool::getKey("127.0.0.1", 80, 0);
+    auto key2 = Http1xConnectionPool::getKey("127.0.0.1", 81, 0);
+    pool_->checkin(key1, createConnection());
+    runLoop(30);
+    pool_->checkin(key2, createConnection());
+    EXPECT_EQ(2u, pool_->idleCount());
+    runLoop(40);
+    // the first one is expired
+    EXPECT_EQ(1u, pool_->idleCount());
+    EXPECT_TRUE(pool_->checkout(key1) == nullptr);
+    runLoop(40);
+    EXPECT_EQ(0u, pool_->idleCount());
+    EXPECT_TRUE(pool_->checkout(key2) == nullptr);
+}
+
+TEST_F(Http1xConnectionPoolTest, Drop_Closed_Connection)
+{
+    auto key = Http1xConnectionPool::getKey("127.0.0.1", 80, 0);
+    int peer_fd1 = -1, peer_fd2 = -1;
+    pool_->checkin(key, createConnection(&peer_fd1));
+    pool_->checkin(key, createConnection(&peer_fd2));
+    EXPECT_EQ(2u, pool_->idleCount());
+
+    // closed by peer while idle, it is removed on read event
+    ::shutdown(peer_fd1, SHUT_RDWR);
+    runLoop(20);
+    EXPECT_EQ(1u, pool_->idleCount());
+
+    // the unexpected data makes it unusable, it is dropped on checkout
+    ::write(peer_fd2, "x", 1);
+    EXPECT_TRUE(pool_->checkout(key) == nullptr);
+    EXPECT_EQ(0u, pool_->idleCount());
+}
+
+TEST_F(Http1xConnectionPoolTest, Max_Conns_Per_Host)
+{
+    Http1xConnectionPool::setLimits(6, 2, 60*1000);
+    auto key = Http1xConnectionPool::getKey("127.0.0.1", 80, 0);
+    int owners[4];
+    std::vector<int> resumed;
+    EXPECT_TRUE(pool_->acquireSlot(key, &owners[0], [] {}));
+    EXPECT_TRUE(pool_->acquireSlot(key, &owners[1], [] {}));
+    EXPECT_FALSE(pool_->acquireSlot(key, &owners[2], [&resumed] { resumed.push_back(2); }));
+    EXPECT_FALSE(pool_->acquireSlot(key, &owners[3], [&resumed] { resumed.push_back(3); }));
+    // other host is not limited
+    EXPECT_TRUE(pool_->acquireSlot(Http1xConnectionPool::getKey("127.0.0.1", 81, 0), &owners[0], [] {}));
+
+    // the waiter is resumed in next loop
+    pool_->releaseSlot(key);
+    EXPECT_TRUE(resumed.empty());
+    runLoop(10);
+    ASSERT_EQ(1u, resumed.size());
+    EXPECT_EQ(2, resumed[0]);
+
+    // the cancelled waiter is not resumed
+    pool_->cancelSlot(key, &owners[3]);
+    pool_->releaseSlot(key);
+    runLoop(10);
+    EXPECT_EQ(1u, resumed.size());
+    // the slot is free
+    EXPECT_TRUE(pool_->acquireSlot(key, &owners[3], [] {}));
+}
+
+TEST_F(Http1xConnectionPoolTest, Retry_Stale_Connection)
+{
+    auto port = startServer();
+    ASSERT_NE(0, port);
+    auto url = "http://127.0.0.1:" + std::to_string(port) + "/a";
+    KMError err;
+    ASSERT_TRUE(request(url, err));
+    EXPECT_EQ(1u, pool_->idleCount());
+    EXPECT_EQ(1u, server_fds_.size());
+
+    // the pooled connection is closed by server after reading next request
+    close_on_request_ = { true };
+    EXPECT_TRUE(request(url, err));
+    EXPECT_EQ(KMError::NOERR, err);
+    // the request is sent on pooled connection, then on a new one
+    EXPECT_EQ(3u, server_requests_);
+    EXPECT_EQ(2u, server_fds_.size());
+    EXPECT_EQ(1u, pool_->idleCount());
+}
@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+#include "http/Http1xResponse.h"
+#include "http/HttpParserImpl.h"
+#include "EventLoopImpl.h"
+#include "util/util.h"
+
+#include <string>
+#include <strings.h>
+#include <vector>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace kuma;
+
+namespace {
+
+class TestResponse : public Http1xResponse
+{
+public:
+    using Http1xResponse::Http1xResponse;
+    using Http1xResponse::readPaused;
+};
+
+}
+
+class Http1xResponseTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        loop_ = std::make_shared<EventLoop::Impl>();
+        ASSERT_TRUE(loop_->init());
+        int fds[2];
+        ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        peer_fd_ = fds[1];
+        ::fcntl(peer_fd_, F_SETFL, ::fcntl(peer_fd_, F_GETFL) | O_NONBLOCK);
+
+        rsp_.reset(new TestResponse(loop_, "HTTP/1.1"));
+        rsp_->setDataCallback([this] (KMBuffer &buf) { req_body_bytes_ += buf.chainLength(); });
+        rsp_->setRequestCompleteCallback([this] { onRequest(); });
+        rsp_->setWriteCallback([this] (KMError) { sendBody(); });
+        rsp_->setResponseCompleteCallback([this] { rsp_->reset(); });
+        ASSERT_EQ(KMError::NOERR, rsp_->attachFd(fds[0], nullptr));
+
+        parser_.setDataCallback([this] (KMBuffer &buf) {
+            for (auto it = buf.begin(); it != buf.end(); ++it) {
+                rsp_body_.append(static_cast<const char*>(it->readPtr()), it->length());
+            }
+        });
+        parser_.setEventCallback([this] (HttpEvent ev) {
+            if (ev == HttpEvent::HEADER_COMPLETE) {
+                std::string vary;
+                parser_.forEachHeader([&vary] (const char *name, const char *value) {
+                    if (strcasecmp(name, "Vary") == 0) {
+                        vary += vary.empty() ? value : std::string("|") + value;
+                    }
+                });
+                varies_.push_back(vary);
+            } else if (ev == HttpEvent::COMPLETE) {
+                responses_.push_back(std::move(rsp_body_));
+                rsp_body_.clear();
+            }
+        });
+    }
+
+    void TearDown() override
+    {
+        rsp_->close();
+        rsp_.reset();
+        ::close(peer_fd_);
+    }
+
+    // the response body is "<path>:<request body bytes>\n", padded to rsp_body_size_
+    void onRequest()
+    {
+        if (rsp_->readPaused()) {
+            paused_seen_ = true;
+        }
+        body_ = rsp_->getPath() + ":" + std::to_string(req_body_bytes_) + "\n";
+        if (body_.size() < rsp_body_size_) {
+            body_.append(rsp_body_size_ - body_.size(), char('a' + requests_ % 26));
+        }
+        req_body_bytes_ = 0;
+        offset_ = 0;
+        ended_ = false;
+        HttpResponse::Impl &impl = *rsp_;
+        impl.addHeader("Content-Length", (uint32_t)body_.size());
+        if (requests_ < app_headers_.size()) {
+            for (auto &kv : app_headers_[requests_]) {
+                impl.addHeader(kv.first, kv.second);
+            }
+        }
+        ++requests_;
+        if (!encodings_.empty()) {
+            impl.setContentEncoding(encodings_, -1);
+        }
+        EXPECT_EQ(KMError::NOERR, impl.sendResponse(200, "OK"));
+    }
+
+    void sendBody()
+    {
+        HttpResponse::Impl &impl = *rsp_;
+        while (offset_ < body_.size()) {
+            int ret = impl.writeBody(body_.c_str() + offset_, body_.size() - offset_);
+            if (ret <= 0) {
+                return;
+            }
+            offset_ += ret;
+        }
+        // the compressed body is ended explicitly
+        if (!encodings_.empty() && !ended_) {
+            ended_ = true;
+            impl.writeBody(nullptr, 0);
+        }
+    }
+
+    // write the requests to server, and parse the responses until count of them are received
+    void run(const std::string &requests, size_t count)
+    {
+        size_t written = 0;
+        auto start_tick = get_tick_count_ms();
+        while (responses_.size() < count && calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < 10000) {
+            if (written < requests.size()) {
+                auto n = ::write(peer_fd_, requests.c_str() + written, requests.size() - written);
+                if (n > 0) {
+                    written += n;
+                }
+            }
+            loop_->loopOnce(1);
+            char buf[16*1024];
+            ssize_t n;
+            while ((n = ::read(peer_fd_, buf, sizeof(buf))) > 0) {
+                size_t used = 0;
+                while (used < static_cast<size_t>(n)) {
+                    int ret = parser_.parse(buf + used, n - used);
+                    used += ret;
+                    if (parser_.complete()) {
+                        parser_.reset();
+                    } else if (ret <= 0) {
+                        break;
+                    }
+                }
+                ASSERT_FALSE(parser_.error());
+            }
+        }
+        EXPECT_EQ(requests.size(), written);
+    }
+
+    // the body of i-th response
+    std::string expectedBody(size_t i, const std::string &path, size_t req_body_bytes) const
+    {
+        auto body = path + ":" + std::to_string(req_body_bytes) + "\n";
+        if (body.size() < rsp_body_size_) {
+            body.append(rsp_body_size_ - body.size(), char('a' + i % 26));
+        }
+        return body;
+    }
+
+protected:
+    EventLoopPtr                    loop_;
+    std::unique_ptr<TestResponse>   rsp_;
+    int                             peer_fd_ = -1;
+
+    size_t                          rsp_body_size_ = 0;
+    size_t                          req_body_bytes_ = 0;
+    size_t                          requests_ = 0;
+    bool                            paused_seen_ = false;
+    std::string                     body_;
+    size_t                          offset_ = 0;
+    bool                            ended_ = false;
+    // the headers added to each response, and the encodings it can be compressed by
+    std::vector<HeaderVector>       app_headers_;
+    std::string                     encodings_;
+
+    HttpParser::Impl                parser_;
+    std::string                     rsp_body_;
+    std::vector<std::string>        responses_;
+    // the Vary fields of each response joined by '|'
+    std::vector<std::string>        varies_;
+};
+
+TEST_F(Http1xResponseTest, Pipeline_Over_Request_Limit)
+{
+    // more than the 32 requests can be parsed ahead
+    const size_t count = 100;
+    std::string requests;
+    for (size_t i = 0; i < count; ++i) {
+        requests += "GET /r" + std::to_string(i) + " HTTP/1.1\r\nHost: test\r\n\r\n";
+    }
+    run(requests, count);
+    ASSERT_EQ(count, responses_.size());
+    for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(expectedBody(i, "/r" + std::to_string(i), 0), responses_[i]) << "i=" << i;
+    }
+    EXPECT_TRUE(paused_seen_);
+    EXPECT_FALSE(rsp_->readPaused());
+}
+
+TEST_F(Http1xResponseTest, Pipeline_Over_Byte_Limit)
+{
+    // more than the 1MB can be parsed ahead, in less than 32 requests
+    const size_t count = 24;
+    const size_t body_size = 100*1024;
+    std::string requests;
+    for (size_t i = 0; i < count; ++i) {
+        requests += "POST /p" + std::to_string(i) + " HTTP/1.1\r\nHost: test\r\nContent-Length: " +
+            std::to_string(body_size) + "\r\n\r\n";
+        requests.append(body_size, char('0' + i % 10));
+    }
+    run(requests, count);
+    ASSERT_EQ(count, responses_.size());
+    for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(expectedBody(i, "/p" + std::to_string(i), body_size), responses_[i]) << "i=" << i;
+    }
+    EXPECT_TRUE(paused_seen_);
+    EXPECT_FALSE(rsp_->readPaused());
+}
+
+TEST_F(Http1xResponseTest, Pipeline_Large_Responses)
+{
+    /* the response completes while its tail is still in send buffer if next request
+     * is waiting, the buffered data is kept by reset
+     */
+    rsp_body_size_ = 256*1024;
+    const size_t count = 8;
+    std::string requests;
+    for (size_t i = 0; i < count; ++i) {
+        requests += "GET /l" + std::to_string(i) + " HTTP/1.1\r\nHost: test\r\n\r\n";
+    }
+    run(requests, count);
+    ASSERT_EQ(count, responses_.size());
+    for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(expectedBody(i, "/l" + std::to_string(i), 0), responses_[i]) << "i=" << i;
+    }
+    EXPECT_EQ(0u, rsp_->getBufferedBytes());
+}
+
+TEST_F(Http1xResponseTest, Vary_Appends_Accept_Encoding)
+{
+    if (!ContentEncoder::isSupported(ContentEncoder::Type::GZIP)) {
+        return;
+    }
+    encodings_ = "gzip";
+    rsp_body_size_ = 4096;
+    app_headers_ = {
+        {},
+        { { "Vary", "Origin" } },
+        { { "Vary", "Origin" }, { "Vary", "Cookie" } },
+        { { "Vary", "origin, accept-encoding" } },
+        { { "Vary", "*" } },
+    };
+    const size_t count = app_headers_.size();
+    std::string requests;
+    for (size_t i = 0; i < count; ++i) {
+        requests += "GET /v" + std::to_string(i) + " HTTP/1.1\r\nHost: test\r\nAccept-Encoding: gzip\r\n\r\n";
+    }
+    run(requests, count);
+    ASSERT_EQ(count, varies_.size());
+    EXPECT_EQ("Accept-Encoding", varies_[0]);
+    // the Vary of application is kept, and the compressed body still varies by Accept-Encoding
+    EXPECT_EQ("Origin, Accept-Encoding", varies_[1]);
+    EXPECT_EQ("Origin, Cookie, Accept-Encoding", varies_[2]);
+    EXPECT_EQ("origin, accept-encoding", varies_[3]);
+    EXPECT_EQ("*", varies_[4]);
+    ASSERT_EQ(count, responses_.size());
+    for (size_t i = 0; i < count; ++i) {
+        // compressed
+        EXPECT_LT(responses_[i].size(), rsp_body_size_) << "i=" << i;
+    }
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "http/HttpCache.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace kuma;
+
+namespace {
+
+// the per-shard entry overhead of HttpCache
+const size_t kEntryOverhead = 256;
+const size_t kShardCount = 16;
+
+// the keys of prefix falling into same shard
+std::vector<std::string> keysOfShard(const std::string &prefix, size_t count)
+{
+    std::vector<std::string> keys;
+    size_t shard = std::hash<std::string>()(prefix + "0") % kShardCount;
+    for (int i = 0; keys.size() < count; ++i) {
+        auto key = prefix + std::to_string(i);
+        if (std::hash<std::string>()(key) % kShardCount == shard) {
+            keys.push_back(key);
+        }
+    }
+    return keys;
+}
+
+KMError store(const std::string &key, const std::string &body, const HeaderVector &req_headers = {},
+              const std::string &vary = "")
+{
+    HeaderVector rsp_headers{ { "Cache-Control", "max-age=60" } };
+    if (!vary.empty()) {
+        rsp_headers.emplace_back("Vary", vary);
+    }
+    KMBuffer buf(body.c_str(), body.size(), body.size());
+    return HttpCache::instance().setCache(key, req_headers, 200, std::move(rsp_headers), &buf);
+}
+
+std::string getBody(const std::string &key, const HeaderVector &req_headers = {})
+{
+    auto entry = HttpCache::instance().getCache(key, req_headers);
+    if (!entry) {
+        return "";
+    }
+    std::string body;
+    if (entry->getBody()) {
+        for (auto it = entry->getBody()->begin(); it != entry->getBody()->end(); ++it) {
+            body.append(static_cast<const char*>(it->readPtr()), it->length());
+        }
+    }
+    return body;
+}
+
+}
+
+class HttpCacheTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        // drop the entries of this test
+        HttpCache::instance().setLimits(0, 0);
+        HttpCache::instance().setLimits(64*1024*1024, 10000);
+    }
+};
+
+TEST_F(HttpCacheTest, Admit_Under_Uniform_Frequency)
+{
+    // 2 entries in each shard
+    HttpCache::instance().setLimits(64*1024*1024, 2 * kShardCount);
+    auto keys = keysOfShard("/uniform/", 3);
+    ASSERT_EQ(KMError::NOERR, store(keys[0], "a"));
+    ASSERT_EQ(KMError::NOERR, store(keys[1], "b"));
+    // none of them is used, the LRU one is evicted
+    EXPECT_EQ(KMError::NOERR, store(keys[2], "c"));
+    EXPECT_EQ("c", getBody(keys[2]));
+    EXPECT_EQ("b", getBody(keys[1]));
+    EXPECT_EQ("", getBody(keys[0]));
+}
+
+TEST_F(HttpCacheTest, Reject_Less_Frequent)
+{
+    HttpCache::instance().setLimits(64*1024*1024, 2 * kShardCount);
+    auto keys = keysOfShard("/frequent/", 3);
+    ASSERT_EQ(KMError::NOERR, store(keys[0], "a"));
+    ASSERT_EQ(KMError::NOERR, store(keys[1], "b"));
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ("a", getBody(keys[0]));
+        EXPECT_EQ("b", getBody(keys[1]));
+    }
+    EXPECT_EQ(KMError::FAILED, store(keys[2], "c"));
+    EXPECT_EQ("a", getBody(keys[0]));
+    EXPECT_EQ("b", getBody(keys[1]));
+}
+
+TEST_F(HttpCacheTest, Replacement_Always_Admitted)
+{
+    // the replacement needs the room of the more frequently used entry
+    HttpCache::instance().setLimits((2 * kEntryOverhead + 4000) * kShardCount, 10000);
+    auto keys = keysOfShard("/replace/", 2);
+    HeaderVector req_headers{ { "Accept-Encoding", "gzip" } };
+    ASSERT_EQ(KMError::NOERR, store(keys[0], std::string(1000, 'a'), req_headers, "Accept-Encoding"));
+    ASSERT_EQ(KMError::NOERR, store(keys[1], std::string(1000, 'b')));
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(1000u, getBody(keys[1]).size());
+    }
+    EXPECT_EQ(KMError::NOERR, store(keys[0], std::string(3000, 'x'), req_headers, "Accept-Encoding"));
+    // the variant is still selected by Vary
+    EXPECT_EQ(std::string(3000, 'x'), getBody(keys[0], req_headers));
+    EXPECT_EQ("", getBody(keys[0], { { "Accept-Encoding", "br" } }));
+    EXPECT_EQ("", getBody(keys[1]));
+}
+
+TEST_F(HttpCacheTest, Too_Large_Replacement_Keeps_Old)
+{
+    HttpCache::instance().setLimits((kEntryOverhead + 2000) * kShardCount, 10000);
+    auto keys = keysOfShard("/large/", 1);
+    ASSERT_EQ(KMError::NOERR, store(keys[0], "old"));
+    EXPECT_EQ(KMError::FAILED, store(keys[0], std::string(4000, 'x')));
+    EXPECT_EQ("old", getBody(keys[0]));
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include "http/HttpMessage.h"
+#include "http/HttpParserImpl.h"
+
+#include <string>
+
+using namespace kuma;
+
+namespace {
+
+std::string toString(const KMBuffer &buf)
+{
+    std::string str;
+    for (auto it = buf.begin(); it != buf.end(); ++it) {
+        str.append(static_cast<const char*>(it->readPtr()), it->length());
+    }
+    return str;
+}
+
+// the message writes everything to out
+class MessageWriter
+{
+public:
+    MessageWriter(HttpMessage &msg, std::string &out)
+    {
+        msg.setSender([&out] (const void *data, size_t len) {
+            out.append(static_cast<const char*>(data), len);
+            return static_cast<int>(len);
+        });
+        msg.setVSender([&out] (const iovec *iovs, int count) {
+            size_t len = 0;
+            for (int i = 0; i < count; ++i) {
+                out.append(static_cast<const char*>(iovs[i].iov_base), iovs[i].iov_len);
+                len += iovs[i].iov_len;
+            }
+            return static_cast<int>(len);
+        });
+        msg.setBSender([&out] (const KMBuffer &buf) {
+            auto str = toString(buf);
+            out += str;
+            return static_cast<int>(str.size());
+        });
+    }
+};
+
+}
+
+TEST(HttpMessageTest, Chunk_Framing_With_Trailers)
+{
+    HttpMessage msg;
+    std::string out;
+    MessageWriter writer(msg, out);
+    msg.addHeader("Content-Type", "text/plain");
+    msg.addHeader("Transfer-Encoding", "chunked");
+    msg.addHeader("Trailer", "X-Checksum, X-Count");
+    auto hdr = msg.buildHeader(200, "OK", "HTTP/1.1");
+    ASSERT_TRUE(msg.isChunked());
+    std::string header = toString(hdr);
+
+    EXPECT_EQ(5, msg.sendData("hello", 5));
+    EXPECT_EQ("5\r\nhello\r\n", out);
+    out.clear();
+
+    // the chunk of a KMBuffer chain is framed as one chunk
+    std::string part1(16, 'a');
+    std::string part2(10, 'b');
+    KMBuffer buf1(part1.c_str(), part1.size(), part1.size());
+    KMBuffer buf2(part2.c_str(), part2.size(), part2.size());
+    buf1.append(&buf2);
+    EXPECT_EQ(26, msg.sendData(buf1));
+    buf1.unlink();
+    EXPECT_EQ("1a\r\n" + part1 + part2 + "\r\n", out);
+    out.clear();
+
+    EXPECT_TRUE(msg.addTrailer("X-Checksum", "abc123"));
+    EXPECT_TRUE(msg.addTrailer("X-Count", ""));
+    EXPECT_FALSE(msg.isCompleted());
+    EXPECT_EQ(0, msg.sendData(nullptr, 0));
+    EXPECT_EQ("0\r\nX-Checksum: abc123\r\nX-Count: \r\n\r\n", out);
+    EXPECT_TRUE(msg.isCompleted());
+
+    // the last chunk is sent once
+    std::string last = out;
+    out.clear();
+    KMBuffer empty;
+    EXPECT_EQ(0, msg.sendData(empty));
+    EXPECT_TRUE(out.empty());
+
+    // the parser gets the same body
+    std::string body;
+    bool complete = false;
+    HttpParser::Impl parser;
+    parser.setDataCallback([&body] (KMBuffer &buf) { body += toString(buf); });
+    parser.setEventCallback([&complete] (HttpEvent ev) {
+        if (ev == HttpEvent::COMPLETE) {
+            complete = true;
+        }
+    });
+    std::string wire = header + "5\r\nhello\r\n" + "1a\r\n" + part1 + part2 + "\r\n" + last;
+    parser.parse(wire.c_str(), wire.size());
+    EXPECT_TRUE(complete);
+    EXPECT_FALSE(parser.error());
+    EXPECT_EQ("hello" + part1 + part2, body);
+}
+
+TEST(HttpMessageTest, Chunk_End_Without_Trailers)
+{
+    HttpMessage msg;
+    std::string out;
+    MessageWriter writer(msg, out);
+    msg.addHeader("Transfer-Encoding", "chunked");
+    msg.buildHeader(200, "OK", "HTTP/1.1");
+    EXPECT_EQ(0, msg.sendData(nullptr, 0));
+    EXPECT_EQ("0\r\n\r\n", out);
+    EXPECT_TRUE(msg.isCompleted());
+
+    // the trailers are cleared on reset
+    msg.reset();
+    out.clear();
+    EXPECT_TRUE(msg.addTrailer("X-Checksum", "abc"));
+    msg.reset();
+    msg.addHeader("Transfer-Encoding", "chunked");
+    msg.buildHeader(200, "OK", "HTTP/1.1");
+    EXPECT_EQ(0, msg.sendData(nullptr, 0));
+    EXPECT_EQ("0\r\n\r\n", out);
+}
+
+TEST(HttpMessageTest, Reject_Invalid_Trailer)
+{
+    HttpMessage msg;
+    EXPECT_FALSE(msg.addTrailer("", "value"));
+    EXPECT_FALSE(msg.addTrailer("X-Bad\r\nInjected", "value"));
+    EXPECT_FALSE(msg.addTrailer("X-Bad: Injected", "value"));
+    EXPECT_FALSE(msg.addTrailer("X Bad", "value"));
+    EXPECT_FALSE(msg.addTrailer("X-Name", "value\r\nInjected: 1"));
+    EXPECT_FALSE(msg.addTrailer("X-Name", "value\nInjected: 1"));
+    EXPECT_FALSE(msg.addTrailer("X-Name", "value\r"));
+    EXPECT_FALSE(msg.addTrailer("X-Name", std::string("val\0ue", 6)));
+    EXPECT_TRUE(msg.addTrailer("X-Name", "value with spaces\tand tab"));
+
+    EXPECT_FALSE(HttpHeader::isValidField("X-Name\n", "value"));
+    EXPECT_TRUE(HttpHeader::isValidField("!#$%&'*+-.^_`|~09azAZ", ""));
+}
+
+TEST(HttpMessageTest, Trailer_Dropped_If_Not_Chunked)
+{
+    HttpMessage msg;
+    std::string out;
+    MessageWriter writer(msg, out);
+    msg.addHeader("Content-Length", (uint32_t)5);
+    msg.buildHeader(200, "OK", "HTTP/1.1");
+    ASSERT_FALSE(msg.isChunked());
+    EXPECT_TRUE(msg.addTrailer("X-Checksum", "abc"));
+    EXPECT_EQ(5, msg.sendData("hello", 5));
+    EXPECT_TRUE(msg.isCompleted());
+    EXPECT_EQ(0, msg.sendData(nullptr, 0));
+    EXPECT_EQ("hello", out);
+}
@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include "http/HttpParserImpl.h"
+#include "http/HttpTokenizer.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace kuma;
+
+namespace {
+
+// tchar of RFC 7230, byte by byte
+bool isTchar(uint8_t c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c != 0 && strchr("!#$%&'*+-.^_`|~", c) != nullptr);
+}
+
+const char* findNonTokenCharRef(const char* p, const char* end)
+{
+    while (p < end && isTchar(static_cast<uint8_t>(*p))) {
+        ++p;
+    }
+    return p;
+}
+
+struct ParseResult
+{
+    bool header_complete = false;
+    bool complete = false;
+    bool error = false;
+    std::string body;
+};
+
+ParseResult parseMessage(HttpParser::Impl &parser, const std::string &msg)
+{
+    ParseResult result;
+    parser.setEventCallback([&result] (HttpEvent ev) {
+        if (ev == HttpEvent::HEADER_COMPLETE) {
+            result.header_complete = true;
+        } else if (ev == HttpEvent::COMPLETE) {
+            result.complete = true;
+        } else if (ev == HttpEvent::HTTP_ERROR) {
+            result.error = true;
+        }
+    });
+    parser.setDataCallback([&result] (KMBuffer &buf) {
+        for (auto it = buf.begin(); it != buf.end(); ++it) {
+            result.body.append(static_cast<const char*>(it->readPtr()), it->length());
+        }
+    });
+    parser.parse(msg.c_str(), msg.size());
+    return result;
+}
+
+}
+
+TEST(HttpTokenizerTest, Token_Table)
+{
+    for (int c = 0; c < 256; ++c) {
+        EXPECT_EQ(isTchar(static_cast<uint8_t>(c)), isTokenChar(static_cast<char>(c))) << "c=" << c;
+    }
+}
+
+TEST(HttpTokenizerTest, Find_Non_Token_Char)
+{
+    // every byte value at every position of the SIMD blocks and the scalar tail
+    std::vector<char> buf(80, 'a');
+    for (size_t len : { 1, 15, 16, 17, 31, 32, 33, 47, 64, 80 }) {
+        for (int c = 0; c < 256; ++c) {
+            for (size_t pos = 0; pos < len; ++pos) {
+                std::fill(buf.begin(), buf.end(), 'a');
+                buf[pos] = static_cast<char>(c);
+                const char* begin = &buf[0];
+                const char* end = begin + len;
+                ASSERT_EQ(findNonTokenCharRef(begin, end), findNonTokenChar(begin, end))
+                    << "len=" << len << ", c=" << c << ", pos=" << pos;
+            }
+        }
+    }
+    // mixed token chars, including the ones next to the SSE4.2 ranges
+    std::string token = "!#$%&'*+-.^_`|~0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    const char* end = token.c_str() + token.size();
+    EXPECT_EQ(end, findNonTokenChar(token.c_str(), end));
+    std::string field = "X-Custom-Header-Name-Long-Enough:value";
+    EXPECT_EQ(field.c_str() + field.find(':'), findNonTokenChar(field.c_str(), field.c_str() + field.size()));
+}
+
+TEST(HttpTokenizerTest, Find_Char)
+{
+    std::vector<char> buf(80, 'a');
+    for (size_t len : { 0, 1, 15, 16, 17, 31, 32, 33, 64, 80 }) {
+        for (size_t pos = 0; pos <= len; ++pos) {
+            std::fill(buf.begin(), buf.end(), 'a');
+            if (pos < len) {
+                buf[pos] = '\n';
+            }
+            // the byte after end is not scanned
+            if (len < buf.size()) {
+                buf[len] = '\n';
+            }
+            const char* begin = &buf[0];
+            ASSERT_EQ(begin + pos, findLineFeed(begin, begin + len)) << "len=" << len << ", pos=" << pos;
+            ASSERT_EQ(begin + pos, findChar(begin, begin + len, '\n')) << "len=" << len << ", pos=" << pos;
+        }
+    }
+    // the first one is found
+    std::string line = "0123456789abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789";
+    EXPECT_EQ(line.c_str() + line.find(' '), findChar(line.c_str(), line.c_str() + line.size(), ' '));
+}
+
+TEST(HttpParserTest, Parse_Request)
+{
+    HttpParser::Impl parser;
+    auto result = parseMessage(parser,
+        "POST /upload?id=1 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "X-Empty:\r\n"
+        "X-Spaces: \t value with spaces \t\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello");
+    EXPECT_FALSE(result.error);
+    EXPECT_TRUE(result.complete);
+    EXPECT_EQ("POST", parser.getMethod());
+    EXPECT_EQ("/upload", parser.getUrlPath());
+    EXPECT_STREQ("www.example.com", parser.getHeaderValue("Host"));
+    EXPECT_STREQ("", parser.getHeaderValue("X-Empty"));
+    EXPECT_STREQ("value with spaces", parser.getHeaderValue("X-Spaces"));
+    EXPECT_EQ("hello", result.body);
+}
+
+TEST(HttpParserTest, Reject_Invalid_Header_Name)
+{
+    const char* lines[] = {
+        "Content-Length : 5\r\n",   // whitespace before colon
+        "Content-Length\t: 5\r\n",
+        " Content-Length: 5\r\n",   // obs-fold
+        "\tX-Folded: value\r\n",
+        ": no-name\r\n",
+        "No-Colon\r\n",
+        "Bad\"Name: value\r\n",
+        "Bad/Name: value\r\n",
+        "Bad@Name: value\r\n",
+    };
+    for (auto const *line : lines) {
+        HttpParser::Impl parser;
+        auto result = parseMessage(parser, std::string("POST / HTTP/1.1\r\nHost: a\r\n") + line + "\r\nhello");
+        EXPECT_TRUE(result.error) << line;
+        EXPECT_FALSE(result.header_complete) << line;
+        EXPECT_TRUE(parser.error()) << line;
+    }
+}
+
+TEST(HttpParserTest, Reject_Invalid_Header_Name_In_Pieces)
+{
+    // the header line is split across reads
+    HttpParser::Impl parser;
+    auto result = parseMessage(parser, "GET / HTTP/1.1\r\nHost: a\r\nX-Na");
+    EXPECT_FALSE(result.error);
+    result = parseMessage(parser, "me : value\r\n\r\n");
+    EXPECT_TRUE(result.error);
+    EXPECT_FALSE(result.header_complete);
+}
+
+TEST(HttpParserTest, Parse_Content_Length)
+{
+    size_t content_length = 0;
+    EXPECT_TRUE(HttpHeader::parseContentLength("0", 1, content_length));
+    EXPECT_EQ(0u, content_length);
+    EXPECT_TRUE(HttpHeader::parseContentLength("1234", 4, content_length));
+    EXPECT_EQ(1234u, content_length);
+    auto max_str = std::to_string(SIZE_MAX);
+    EXPECT_TRUE(HttpHeader::parseContentLength(max_str.c_str(), max_str.size(), content_length));
+    EXPECT_EQ(SIZE_MAX, content_length);
+    
+    const char* invalid[] = { "", "abc", "12abc", "-1", "+1", "1 2", "0x10", "1,1",
+        "18446744073709551616", "99999999999999999999999" };
+    for (auto const *value : invalid) {
+        content_length = 7;
+        EXPECT_FALSE(HttpHeader::parseContentLength(value, strlen(value), content_length)) << value;
+        EXPECT_EQ(7u, content_length) << value;
+    }
+}
+
+TEST(HttpParserTest, Reject_Invalid_Content_Length)
+{
+    const char* values[] = { "abc", "12abc", "", "-5", "5 5", "18446744073709551621" };
+    for (auto const *value : values) {
+        HttpParser::Impl parser;
+        auto result = parseMessage(parser, std::string("POST / HTTP/1.1\r\nContent-Length: ") + value + "\r\n\r\nhello");
+        EXPECT_TRUE(result.error) << value;
+        EXPECT_FALSE(result.header_complete) << value;
+        EXPECT_TRUE(result.body.empty()) << value;
+    }
+}
+
+TEST(HttpParserTest, Duplicated_Content_Length)
+{
+    {
+        HttpParser::Impl parser;
+        auto result = parseMessage(parser, "POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 10\r\n\r\nhello");
+        EXPECT_TRUE(result.error);
+        EXPECT_FALSE(result.header_complete);
+    }
+    {
+        // the same value is allowed
+        HttpParser::Impl parser;
+        auto result = parseMessage(parser, "POST / HTTP/1.1\r\nContent-Length: 5\r\ncontent-length: 5\r\n\r\nhello");
+        EXPECT_FALSE(result.error);
+        EXPECT_TRUE(result.complete);
+        EXPECT_EQ("hello", result.body);
+    }
+}
+
+TEST(HttpParserTest, Duplicated_Header_First_Wins)
+{
+    HttpParser::Impl parser;
+    auto result = parseMessage(parser,
+        "GET /?a=1&a=2 HTTP/1.1\r\n"
+        "Host: first.example.com\r\n"
+        "X-Custom: first\r\n"
+        "host: second.example.com\r\n"
+        "x-custom: second\r\n"
+        "\r\n");
+    EXPECT_TRUE(result.complete);
+    // the known header by slot and the unknown one by search
+    EXPECT_STREQ("first.example.com", parser.getHeaderValue("Host"));
+    EXPECT_STREQ("first.example.com", parser.getHeaderValue(HeaderId::HOST));
+    EXPECT_STREQ("first", parser.getHeaderValue("X-Custom"));
+    EXPECT_STREQ("1", parser.getParamValue("a"));
+    EXPECT_EQ(4u, parser.getHeaderCount());
+}
+
+TEST(HttpParserTest, Set_Headers)
+{
+    HttpParser::Impl parser;
+    auto result = parseMessage(parser,
+        "POST /upload?id=1&name=kuma HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello");
+    ASSERT_TRUE(result.complete);
+    
+    // the header buffer does not keep the replaced headers
+    std::string value(4096, 'v');
+    for (int i = 0; i < 100; ++i) {
+        parser.setHeaders(HeaderVector{ { "Host", "other.example.com" }, { "X-Large", value }, { "Content-Length", "10" } });
+    }
+    EXPECT_EQ(3u, parser.getHeaderCount());
+    EXPECT_STREQ("other.example.com", parser.getHeaderValue("Host"));
+    EXPECT_STREQ(value.c_str(), parser.getHeaderValue("X-Large"));
+    EXPECT_STREQ("10", parser.getHeaderValue(HeaderId::CONTENT_LENGTH));
+    // the params are kept
+    EXPECT_STREQ("1", parser.getParamValue("id"));
+    EXPECT_STREQ("kuma", parser.getParamValue("name"));
+}
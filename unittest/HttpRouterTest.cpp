@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+#include "kmapi.h"
+
+#include <string>
+
+using namespace kuma;
+
+namespace {
+
+// the handler identified by id
+struct IdHandler
+{
+    int id;
+    void operator()(HttpResponse &, const HttpRouter::Params &) const {}
+};
+
+// the id of matched handler, 0 if no route matches
+int matchId(const HttpRouter &router, const char *method, const char *path, HttpRouter::Params &params)
+{
+    auto *handler = router.match(method, path, params);
+    if (!handler) {
+        return 0;
+    }
+    auto *h = handler->target<IdHandler>();
+    return h ? h->id : -1;
+}
+
+int matchId(const HttpRouter &router, const char *method, const char *path)
+{
+    HttpRouter::Params params;
+    return matchId(router, method, path, params);
+}
+
+std::string getParam(const HttpRouter::Params &params, const char *name)
+{
+    size_t len = 0;
+    auto *value = params.get(name, len);
+    return value ? std::string(value, len) : std::string("<none>");
+}
+
+}
+
+TEST(HttpRouterTest, Add_Route)
+{
+    HttpRouter router;
+    EXPECT_EQ(KMError::NOERR, router.addRoute("GET", "/users/:id", IdHandler{1}));
+    EXPECT_EQ(KMError::ALREADY_EXIST, router.addRoute("GET", "/users/:id", IdHandler{2}));
+    EXPECT_EQ(KMError::NOERR, router.addRoute("POST", "/users/:id", IdHandler{3}));
+    // the parameter name of a node is unique
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("PUT", "/users/:uid", IdHandler{4}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "users", IdHandler{5}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "", IdHandler{5}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("", "/a", IdHandler{5}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "/a", HttpRouter::Handler()));
+    // the parameter must be a whole segment, and the wildcard the last one
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "/a:b", IdHandler{5}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "/a/:", IdHandler{5}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "/a/*", IdHandler{5}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "/a/*rest/b", IdHandler{5}));
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", "/a/:b:c", IdHandler{5}));
+    std::string too_many;
+    for (size_t i = 0; i <= HttpRouter::kMaxParams; ++i) {
+        too_many += "/:p" + std::to_string(i);
+    }
+    EXPECT_EQ(KMError::INVALID_PARAM, router.addRoute("GET", too_many.c_str(), IdHandler{5}));
+}
+
+TEST(HttpRouterTest, Path_Splitting)
+{
+    HttpRouter router;
+    // the static prefixes are split in various orders
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/users/list", IdHandler{1}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/users", IdHandler{2}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/user", IdHandler{3}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/", IdHandler{4}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/users/:id/files", IdHandler{5}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/users/:id", IdHandler{6}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/u", IdHandler{7}));
+
+    EXPECT_EQ(1, matchId(router, "GET", "/users/list"));
+    EXPECT_EQ(2, matchId(router, "GET", "/users"));
+    EXPECT_EQ(3, matchId(router, "GET", "/user"));
+    EXPECT_EQ(4, matchId(router, "GET", "/"));
+    EXPECT_EQ(7, matchId(router, "GET", "/u"));
+    HttpRouter::Params params;
+    EXPECT_EQ(5, matchId(router, "GET", "/users/42/files", params));
+    ASSERT_EQ(1u, params.size());
+    EXPECT_EQ("42", getParam(params, "id"));
+    EXPECT_EQ(6, matchId(router, "GET", "/users/42", params));
+    EXPECT_EQ("42", getParam(params, "id"));
+    // the query is ignored
+    EXPECT_EQ(6, matchId(router, "GET", "/users/42?a=/b", params));
+    EXPECT_EQ("42", getParam(params, "id"));
+
+    // the prefixes of nodes are not routes
+    EXPECT_EQ(0, matchId(router, "GET", "/us"));
+    EXPECT_EQ(0, matchId(router, "GET", "/users/"));
+    EXPECT_EQ(0, matchId(router, "GET", "/users/list/"));
+    EXPECT_EQ(0, matchId(router, "GET", "/users/42/"));
+    EXPECT_EQ(0, matchId(router, "GET", "/users/42/file"));
+    EXPECT_EQ(0, matchId(router, "GET", "/userss"));
+    EXPECT_EQ(0, matchId(router, "GET", ""));
+}
+
+TEST(HttpRouterTest, Precedence)
+{
+    HttpRouter router;
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/files/*path", IdHandler{1}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/files/:name", IdHandler{2}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/files/readme", IdHandler{3}));
+
+    HttpRouter::Params params;
+    EXPECT_EQ(3, matchId(router, "GET", "/files/readme", params));
+    EXPECT_EQ(0u, params.size());
+    EXPECT_EQ(2, matchId(router, "GET", "/files/readm", params));
+    EXPECT_EQ("readm", getParam(params, "name"));
+    EXPECT_EQ(2, matchId(router, "GET", "/files/readme2", params));
+    EXPECT_EQ("readme2", getParam(params, "name"));
+    EXPECT_EQ(1, matchId(router, "GET", "/files/a/b/c", params));
+    ASSERT_EQ(1u, params.size());
+    EXPECT_EQ("a/b/c", getParam(params, "path"));
+    EXPECT_EQ("<none>", getParam(params, "name"));
+    // neither static nor parameter matches the rest of path
+    EXPECT_EQ(1, matchId(router, "GET", "/files/readme/x", params));
+    EXPECT_EQ("readme/x", getParam(params, "path"));
+    // empty segment is not a parameter, but the wildcard matches empty rest
+    EXPECT_EQ(1, matchId(router, "GET", "/files/", params));
+    EXPECT_EQ("", getParam(params, "path"));
+    EXPECT_EQ(0, matchId(router, "GET", "/files"));
+}
+
+TEST(HttpRouterTest, Backtracking)
+{
+    HttpRouter router;
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/a/b/d", IdHandler{1}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/a/:x/c", IdHandler{2}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/a/:x/:y/e", IdHandler{3}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/a/:x/:y/*rest", IdHandler{4}));
+
+    HttpRouter::Params params;
+    EXPECT_EQ(1, matchId(router, "GET", "/a/b/d", params));
+    EXPECT_EQ(0u, params.size());
+    // the static "b" fails at "c", the parameter matches
+    EXPECT_EQ(2, matchId(router, "GET", "/a/b/c", params));
+    ASSERT_EQ(1u, params.size());
+    EXPECT_EQ("b", getParam(params, "x"));
+    EXPECT_EQ(3, matchId(router, "GET", "/a/b/c/e", params));
+    ASSERT_EQ(2u, params.size());
+    EXPECT_EQ("b", getParam(params, "x"));
+    EXPECT_EQ("c", getParam(params, "y"));
+    // the params of failed branches are dropped
+    EXPECT_EQ(4, matchId(router, "GET", "/a/b/c/f/g", params));
+    ASSERT_EQ(3u, params.size());
+    EXPECT_EQ("b", getParam(params, "x"));
+    EXPECT_EQ("c", getParam(params, "y"));
+    EXPECT_EQ("f/g", getParam(params, "rest"));
+}
+
+TEST(HttpRouterTest, Method_Fallback)
+{
+    HttpRouter router;
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/item", IdHandler{1}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("*", "/item", IdHandler{2}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("POST", "/only-post", IdHandler{3}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("POST", "/m/static", IdHandler{4}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", "/m/:p", IdHandler{5}));
+    ASSERT_EQ(KMError::NOERR, router.addRoute("DELETE", "/m/*rest", IdHandler{6}));
+
+    // the exact method first, then "*"
+    EXPECT_EQ(1, matchId(router, "GET", "/item"));
+    EXPECT_EQ(2, matchId(router, "POST", "/item"));
+    EXPECT_EQ(2, matchId(router, "DELETE", "/item"));
+    // method is case sensitive
+    EXPECT_EQ(2, matchId(router, "get", "/item"));
+    EXPECT_EQ(3, matchId(router, "POST", "/only-post"));
+    EXPECT_EQ(0, matchId(router, "GET", "/only-post"));
+    // the route of other method falls back to the next precedence
+    EXPECT_EQ(4, matchId(router, "POST", "/m/static"));
+    EXPECT_EQ(5, matchId(router, "GET", "/m/static"));
+    EXPECT_EQ(6, matchId(router, "DELETE", "/m/static"));
+    EXPECT_EQ(0, matchId(router, "PUT", "/m/static"));
+}
+
+TEST(HttpRouterTest, Max_Params)
+{
+    HttpRouter router;
+    std::string pattern;
+    std::string path;
+    for (size_t i = 0; i < HttpRouter::kMaxParams; ++i) {
+        pattern += "/:p" + std::to_string(i);
+        path += "/v" + std::to_string(i);
+    }
+    ASSERT_EQ(KMError::NOERR, router.addRoute("GET", pattern.c_str(), IdHandler{1}));
+    HttpRouter::Params params;
+    EXPECT_EQ(1, matchId(router, "GET", path.c_str(), params));
+    ASSERT_EQ(size_t(HttpRouter::kMaxParams), params.size());
+    EXPECT_EQ("v0", getParam(params, "p0"));
+    EXPECT_EQ("v7", getParam(params, "p7"));
+}
@@ -2,6 +2,9 @@
 #include <gtest/gtest.h>
 #include "kmbuffer.h"
 
+#include <string>
+#include <vector>
+
 using namespace kuma;
 
 TEST(KMBufferTest, allocBuffer)
@@ -176,6 +179,58 @@ TEST(KMBufferTest, Verify_Sub_Buffer)
     delete [] read_buf;
 }
 
+TEST(KMBufferTest, Sub_Buffer_Shares_Refcounted_Data)
+{
+    // the head holds user data, the refcounted node follows it
+    char str1[1024];
+    memset(str1, 'A', sizeof(str1));
+    KMBuffer buf1(str1, sizeof(str1), sizeof(str1));
+
+    auto deleter = [](void *buf, size_t) {
+        char* ptr = static_cast<char*>(buf);
+        delete [] ptr;
+    };
+    size_t str2_size = 2048;
+    auto *str2 = new char[str2_size];
+    memset(str2, 'B', str2_size);
+    auto *buf2 = new KMBuffer(str2, str2_size, str2_size, 0, deleter);
+
+    char str3[512];
+    memset(str3, 'C', sizeof(str3));
+    KMBuffer buf3(str3, sizeof(str3), sizeof(str3));
+
+    buf1.append(buf2);
+    buf1.append(&buf3);
+
+    // 24 bytes of buf1, all of buf2 and 100 bytes of buf3
+    size_t sub_offset = 1000;
+    size_t sub_size = 24 + str2_size + 100;
+    auto *sub_buf = buf1.subbuffer(sub_offset, sub_size);
+    ASSERT_NE(nullptr, sub_buf);
+    EXPECT_EQ(sub_size, sub_buf->chainLength());
+
+    std::vector<const KMBuffer*> nodes;
+    for (auto it = sub_buf->begin(); it != sub_buf->end(); ++it) {
+        nodes.push_back(&*it);
+    }
+    ASSERT_EQ(3, nodes.size());
+    // the user data is copied, the refcounted data is shared even if the head is not refcounted
+    EXPECT_NE(str1 + sub_offset, nodes[0]->readPtr());
+    EXPECT_EQ(24, nodes[0]->length());
+    EXPECT_EQ(str2, nodes[1]->readPtr());
+    EXPECT_EQ(str2_size, nodes[1]->length());
+    EXPECT_NE(str3, nodes[2]->readPtr());
+    EXPECT_EQ(100, nodes[2]->length());
+
+    // the shared data outlives the original chain
+    buf1.destroy();
+    std::string data(sub_size, 0);
+    sub_buf->readChained(&data[0], sub_size);
+    EXPECT_EQ(std::string(24, 'A') + std::string(str2_size, 'B') + std::string(100, 'C'), data);
+
+    delete sub_buf;
+}
+
 TEST(KMBufferTest, Test_Read_and_Const_Read)
 {
     KMBuffer buf1(KMBuffer::StorageType::AUTO);
@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+#include "SocketBase.h"
+#include "EventLoopImpl.h"
+#include "util/util.h"
+
+#include <string.h>
+#include <vector>
+#include <functional>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace kuma;
+
+namespace {
+
+class TestSocket : public SocketBase
+{
+public:
+    using SocketBase::SocketBase;
+
+    KMError connectAddrs(const DnsResolver::AddressList &addrs, EventCallback cb)
+    {
+        connect_cb_ = std::move(cb);
+        return connect_i(addrs, 0);
+    }
+};
+
+sockaddr_storage makeAddr(int family, uint16_t port)
+{
+    sockaddr_storage ss_addr;
+    memset(&ss_addr, 0, sizeof(ss_addr));
+    if (family == AF_INET6) {
+        auto *addr = reinterpret_cast<sockaddr_in6*>(&ss_addr);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = htons(port);
+        addr->sin6_addr = in6addr_loopback;
+    } else {
+        auto *addr = reinterpret_cast<sockaddr_in*>(&ss_addr);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port);
+        addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    return ss_addr;
+}
+
+int listenOn(int family, uint16_t port, int backlog)
+{
+    int fd = ::socket(family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int opt = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (family == AF_INET6) {
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt));
+    }
+    auto ss_addr = makeAddr(family, port);
+    if (::bind(fd, (sockaddr*)&ss_addr, km_get_addr_length(ss_addr)) != 0 ||
+        ::listen(fd, backlog) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+uint16_t localPort(int fd)
+{
+    sockaddr_storage ss_addr;
+    socklen_t len = sizeof(ss_addr);
+    if (::getsockname(fd, (sockaddr*)&ss_addr, &len) != 0) {
+        return 0;
+    }
+    std::string ip;
+    uint16_t port = 0;
+    km_get_sock_addr(ss_addr, ip, &port);
+    return port;
+}
+
+int connectNonblock(const sockaddr_storage &ss_addr)
+{
+    int fd = ::socket(ss_addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    ::connect(fd, (sockaddr*)&ss_addr, km_get_addr_length(ss_addr));
+    return fd;
+}
+
+bool connectPending(int fd, int wait_ms)
+{
+    pollfd pfd = { fd, POLLOUT, 0 };
+    return ::poll(&pfd, 1, wait_ms) == 0;
+}
+
+}
+
+class SocketBaseTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        loop_ = std::make_shared<EventLoop::Impl>();
+        ASSERT_TRUE(loop_->init());
+        // the same port on ::1 and 127.0.0.1
+        for (int i = 0; i < 10 && port_ == 0; ++i) {
+            fd4_ = listenOn(AF_INET, 0, 16);
+            ASSERT_GE(fd4_, 0);
+            auto port = localPort(fd4_);
+            fd6_ = listenOn(AF_INET6, port, 16);
+            if (fd6_ >= 0) {
+                port_ = port;
+            } else {
+                ::close(fd4_);
+                fd4_ = -1;
+            }
+        }
+        if (port_ == 0) {
+            GTEST_SKIP() << "IPv6 loopback is not available";
+        }
+    }
+
+    void TearDown() override
+    {
+        for (auto fd : fds_) {
+            ::close(fd);
+        }
+        closeListener(fd4_);
+        closeListener(fd6_);
+    }
+
+    void closeListener(int &fd)
+    {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    // the SYN to a listener with full accept queue is dropped, so the connection
+    // attempt hangs as if the address is black-holed
+    bool blackHole(int &fd, int family)
+    {
+        closeListener(fd);
+        fd = listenOn(family, port_, 0);
+        if (fd < 0) {
+            return false;
+        }
+        auto ss_addr = makeAddr(family, port_);
+        for (int i = 0; i < 16; ++i) {
+            int cfd = connectNonblock(ss_addr);
+            if (cfd < 0) {
+                return false;
+            }
+            fds_.push_back(cfd);
+            if (connectPending(cfd, 100)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    KMError connect(TestSocket &sock, const DnsResolver::AddressList &addrs, uint32_t &elapsed_ms)
+    {
+        bool done = false;
+        KMError result = KMError::FAILED;
+        auto start_tick = get_tick_count_ms();
+        auto ret = sock.connectAddrs(addrs, [&] (KMError err) {
+            elapsed_ms = static_cast<uint32_t>(calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick));
+            result = err;
+            done = true;
+        });
+        if (ret != KMError::NOERR) {
+            return ret;
+        }
+        while (!done && calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < 5000) {
+            loop_->loopOnce(10);
+        }
+        return done ? result : KMError::TIMEOUT;
+    }
+
+    static int peerFamily(const TestSocket &sock)
+    {
+        sockaddr_storage ss_addr;
+        socklen_t len = sizeof(ss_addr);
+        if (::getpeername(sock.getFd(), (sockaddr*)&ss_addr, &len) != 0) {
+            return AF_UNSPEC;
+        }
+        return ss_addr.ss_family;
+    }
+
+protected:
+    EventLoopPtr        loop_;
+    uint16_t            port_ = 0;
+    int                 fd4_ = -1;
+    int                 fd6_ = -1;
+    std::vector<int>    fds_;
+};
+
+TEST_F(SocketBaseTest, HappyEyeballs_First_Address_Wins)
+{
+    DnsResolver::AddressList addrs{ makeAddr(AF_INET6, port_), makeAddr(AF_INET, port_) };
+    TestSocket sock(loop_);
+    uint32_t elapsed_ms = 0;
+    EXPECT_EQ(KMError::NOERR, connect(sock, addrs, elapsed_ms));
+    EXPECT_EQ(AF_INET6, peerFamily(sock));
+    EXPECT_LT(elapsed_ms, 250u);
+    sock.close();
+}
+
+TEST_F(SocketBaseTest, HappyEyeballs_Fallback_After_Attempt_Delay)
+{
+    if (!blackHole(fd6_, AF_INET6)) {
+        GTEST_SKIP() << "cannot black-hole ::1";
+    }
+    DnsResolver::AddressList addrs{ makeAddr(AF_INET6, port_), makeAddr(AF_INET, port_) };
+    TestSocket sock(loop_);
+    uint32_t elapsed_ms = 0;
+    EXPECT_EQ(KMError::NOERR, connect(sock, addrs, elapsed_ms));
+    EXPECT_EQ(AF_INET, peerFamily(sock));
+    // the second attempt starts after 250ms, before the SYN of first one is retransmitted
+    EXPECT_GE(elapsed_ms, 240u);
+    EXPECT_LT(elapsed_ms, 900u);
+    sock.close();
+}
+
+TEST_F(SocketBaseTest, HappyEyeballs_Fallback_On_Refused)
+{
+    closeListener(fd6_);
+    DnsResolver::AddressList addrs{ makeAddr(AF_INET6, port_), makeAddr(AF_INET, port_) };
+    TestSocket sock(loop_);
+    uint32_t elapsed_ms = 0;
+    EXPECT_EQ(KMError::NOERR, connect(sock, addrs, elapsed_ms));
+    EXPECT_EQ(AF_INET, peerFamily(sock));
+    // the next attempt starts at once when previous one failed
+    EXPECT_LT(elapsed_ms, 250u);
+    sock.close();
+}
+
+TEST_F(SocketBaseTest, HappyEyeballs_All_Failed)
+{
+    closeListener(fd6_);
+    closeListener(fd4_);
+    DnsResolver::AddressList addrs{ makeAddr(AF_INET6, port_), makeAddr(AF_INET, port_) };
+    TestSocket sock(loop_);
+    uint32_t elapsed_ms = 0;
+    EXPECT_NE(KMError::NOERR, connect(sock, addrs, elapsed_ms));
+    EXPECT_LT(elapsed_ms, 250u);
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+#include "http/StaticFileHandler.h"
+#include "http/HttpParserImpl.h"
+#include "http/FileCache.h"
+
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+
+using namespace kuma;
+
+namespace {
+
+using RangeVector = StaticFileHandler::Impl::RangeVector;
+
+void expectRanges(const RangeVector &ranges, std::initializer_list<std::pair<int64_t, int64_t>> expected)
+{
+    ASSERT_EQ(expected.size(), ranges.size());
+    size_t i = 0;
+    for (auto const &r : expected) {
+        EXPECT_EQ(r.first, ranges[i].first) << "i=" << i;
+        EXPECT_EQ(r.second, ranges[i].last) << "i=" << i;
+        ++i;
+    }
+}
+
+}
+
+TEST(StaticFileHandlerTest, Parse_Single_Range)
+{
+    RangeVector ranges;
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=0-99", 1000, ranges));
+    expectRanges(ranges, { { 0, 99 } });
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=900-", 1000, ranges));
+    expectRanges(ranges, { { 900, 999 } });
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=-100", 1000, ranges));
+    expectRanges(ranges, { { 900, 999 } });
+    // clamped to file size
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=500-5000", 1000, ranges));
+    expectRanges(ranges, { { 500, 999 } });
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=-5000", 1000, ranges));
+    expectRanges(ranges, { { 0, 999 } });
+}
+
+TEST(StaticFileHandlerTest, Parse_Multi_Range)
+{
+    RangeVector ranges;
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=0-99,200-,-50", 1000, ranges));
+    expectRanges(ranges, { { 0, 99 }, { 200, 999 }, { 950, 999 } });
+    // spaces around the specs, overlapped ranges are kept as they are
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=0-9, 5-14 ,20-20", 1000, ranges));
+    expectRanges(ranges, { { 0, 9 }, { 5, 14 }, { 20, 20 } });
+    // the unsatisfiable ones are dropped
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=0-9,2000-2100,-0,990-", 1000, ranges));
+    expectRanges(ranges, { { 0, 9 }, { 990, 999 } });
+    // nothing satisfiable
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=1000-,2000-3000", 1000, ranges));
+    EXPECT_TRUE(ranges.empty());
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange("bytes=-10", 0, ranges));
+    EXPECT_TRUE(ranges.empty());
+}
+
+TEST(StaticFileHandlerTest, Parse_Too_Many_Ranges)
+{
+    // the parsing stops once the count is over the limit, the caller ignores them
+    std::string value = "bytes=0-0";
+    for (int i = 1; i < 100; ++i) {
+        value += "," + std::to_string(i) + "-" + std::to_string(i);
+    }
+    RangeVector ranges;
+    ASSERT_TRUE(StaticFileHandler::Impl::parseRange(value, 1000, ranges));
+    EXPECT_GT(ranges.size(), 16u);
+    EXPECT_LT(ranges.size(), 100u);
+}
+
+TEST(StaticFileHandlerTest, Parse_Invalid_Range)
+{
+    const char* values[] = {
+        "", "bytes=", "bytes", "items=0-9", "bytes=abc", "bytes=9", "bytes=9-0",
+        "bytes=0-9,x-y", "bytes=0-9,20", "bytes=--9", "bytes=0x0-9", "bytes=0-9x",
+    };
+    for (auto const *value : values) {
+        RangeVector ranges;
+        ranges.push_back({});
+        EXPECT_FALSE(StaticFileHandler::Impl::parseRange(value, 1000, ranges)) << value;
+        EXPECT_TRUE(ranges.empty()) << value;
+    }
+    // the unit is case insensitive
+    RangeVector ranges;
+    EXPECT_TRUE(StaticFileHandler::Impl::parseRange("Bytes=0-9", 1000, ranges));
+}
+
+TEST(StaticFileHandlerTest, Map_Path)
+{
+    StaticFileHandler::Impl handler("/var/www/", "/static");
+    std::string path;
+    ASSERT_TRUE(handler.mapPath("/index.html", path));
+    EXPECT_EQ("/var/www/index.html", path);
+    ASSERT_TRUE(handler.mapPath("/a//b/c.txt", path));
+    EXPECT_EQ("/var/www/a/b/c.txt", path);
+    ASSERT_TRUE(handler.mapPath("/dir/", path));
+    EXPECT_EQ("/var/www/dir", path);
+    ASSERT_TRUE(handler.mapPath("", path));
+    EXPECT_EQ("/var/www", path);
+    // dots inside a segment are not special
+    ASSERT_TRUE(handler.mapPath("/..a/b../.hidden/...", path));
+    EXPECT_EQ("/var/www/..a/b../.hidden/...", path);
+}
+
+TEST(StaticFileHandlerTest, Map_Path_Reject_Traversal)
+{
+    StaticFileHandler::Impl handler("/var/www", "/static/");
+    const char* paths[] = {
+        "/..", "/../etc/passwd", "/a/../../etc/passwd", "/a/..", "/a/../b",
+        "/.", "/./a", "/a/./b", "..", "../a", "/a/..//b",
+        "/..\\etc\\passwd", "/a\\..\\..\\b", "/c:/windows", "/a:b",
+    };
+    for (auto const *p : paths) {
+        std::string path;
+        EXPECT_FALSE(handler.mapPath(p, path)) << p;
+    }
+    std::string with_nul("/a\0/../b", 8);
+    std::string path;
+    EXPECT_FALSE(handler.mapPath(with_nul, path));
+}
+
+TEST(StaticFileHandlerTest, Map_Path_Of_Decoded_Url)
+{
+    // the percent-encoded dots are decoded by the parser before mapping
+    HttpParser::Impl parser;
+    std::string req = "GET /static/%2e%2e/%2E%2E/etc/passwd HTTP/1.1\r\nHost: a\r\n\r\n";
+    parser.parse(req.c_str(), req.size());
+    ASSERT_TRUE(parser.complete());
+    auto const &url_path = parser.getUrlPath();
+    ASSERT_EQ(0u, url_path.find("/static/"));
+    StaticFileHandler::Impl handler("/var/www", "/static/");
+    std::string path;
+    EXPECT_FALSE(handler.mapPath(url_path.substr(7), path)) << url_path;
+}
+
+TEST(StaticFileHandlerTest, File_Read_After_Truncate)
+{
+    char path[] = "/tmp/kuma_ut_file_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    std::string data(64*1024, 'f');
+    ASSERT_EQ(ssize_t(data.size()), ::write(fd, data.c_str(), data.size()));
+    
+    FileCache cache;
+    cache.setOptions(0, 0);
+    FileCache::FilePtr file;
+    ASSERT_EQ(KMError::NOERR, cache.open(path, file));
+    auto buf = file->read(32*1024, 16*1024);
+    ASSERT_TRUE(buf);
+    // the buffer in flight owns its data, it is still readable after truncation
+    ASSERT_EQ(0, ::ftruncate(fd, 0));
+    std::string str(static_cast<const char*>(buf->readPtr()), buf->length());
+    EXPECT_EQ(data.substr(32*1024, 16*1024), str);
+    // the file is shorter than its cached size
+    EXPECT_FALSE(file->read(32*1024, 16*1024));
+    ::close(fd);
+    ::unlink(path);
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include "TcpConnection.h"
+#include "EventLoopImpl.h"
+#include "util/util.h"
+
+#include <string>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace kuma;
+
+namespace {
+
+class TestConnection : public TcpConnection
+{
+public:
+    using TcpConnection::TcpConnection;
+    
+    int write_count = 0;
+    
+protected:
+    KMError handleInputData(uint8_t *, size_t) override { return KMError::NOERR; }
+    void onWrite() override { ++write_count; }
+    void onError(KMError) override {}
+};
+
+}
+
+class TcpConnectionTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        loop_ = std::make_shared<EventLoop::Impl>();
+        ASSERT_TRUE(loop_->init());
+        int fds[2];
+        ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        peer_fd_ = fds[1];
+        ::fcntl(peer_fd_, F_SETFL, ::fcntl(peer_fd_, F_GETFL) | O_NONBLOCK);
+        conn_.reset(new TestConnection(loop_));
+        ASSERT_EQ(KMError::NOERR, conn_->attachFd(fds[0], nullptr));
+        conn_->setSendBufferWatermark(1024*1024, 0);
+        // the burst is used up by the first send, quota is 0 after that. the
+        // tokens are refilled in 1ms, so the queued bytes are not checked exactly
+        ASSERT_EQ(KMError::NOERR, conn_->setRateLimit(100000, 1000, ""));
+        ASSERT_EQ(1000, conn_->send(std::string(1000, 'a').c_str(), 1000));
+    }
+
+    void TearDown() override
+    {
+        conn_->close();
+        conn_.reset();
+        ::close(peer_fd_);
+    }
+
+    // the data peer received until expected_len or timeout
+    std::string receive(size_t expected_len, uint32_t &elapsed_ms)
+    {
+        std::string data;
+        auto start_tick = get_tick_count_ms();
+        while (data.size() < expected_len && calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < 3000) {
+            loop_->loopOnce(10);
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(peer_fd_, buf, sizeof(buf))) > 0) {
+                data.append(buf, n);
+            }
+        }
+        elapsed_ms = static_cast<uint32_t>(calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick));
+        return data;
+    }
+
+protected:
+    EventLoopPtr                    loop_;
+    std::unique_ptr<TestConnection> conn_;
+    int                             peer_fd_ = -1;
+};
+
+TEST_F(TcpConnectionTest, RateLimit_Queue_Data)
+{
+    std::string data(2000, 'b');
+    EXPECT_EQ(2000, conn_->send(data.c_str(), data.size()));
+    EXPECT_GT(conn_->sendBufferBytes(), 0u);
+    
+    uint32_t elapsed_ms = 0;
+    auto received = receive(3000, elapsed_ms);
+    EXPECT_EQ(std::string(1000, 'a') + data, received);
+    // 2000 bytes at 100000 bytes per second
+    EXPECT_GE(elapsed_ms, 15u);
+    EXPECT_EQ(0u, conn_->sendBufferBytes());
+    EXPECT_GT(conn_->write_count, 0);
+}
+
+TEST_F(TcpConnectionTest, RateLimit_Queue_Iovec)
+{
+    std::string data1(1000, 'b'), data2(1500, 'c');
+    iovec iovs[2];
+    iovs[0].iov_base = (char*)data1.c_str();
+    iovs[0].iov_len = data1.size();
+    iovs[1].iov_base = (char*)data2.c_str();
+    iovs[1].iov_len = data2.size();
+    EXPECT_EQ(2500, conn_->send(iovs, 2));
+    EXPECT_GT(conn_->sendBufferBytes(), 0u);
+    
+    uint32_t elapsed_ms = 0;
+    auto received = receive(3500, elapsed_ms);
+    EXPECT_EQ(std::string(1000, 'a') + data1 + data2, received);
+    EXPECT_EQ(0u, conn_->sendBufferBytes());
+    EXPECT_GT(conn_->write_count, 0);
+}
+
+TEST_F(TcpConnectionTest, RateLimit_Queue_KMBuffer)
+{
+    std::string data1(1000, 'b'), data2(1500, 'c');
+    KMBuffer buf1(data1.c_str(), data1.size(), data1.size());
+    KMBuffer buf2(data2.c_str(), data2.size(), data2.size());
+    buf1.append(&buf2);
+    EXPECT_EQ(2500, conn_->send(buf1));
+    EXPECT_GT(conn_->sendBufferBytes(), 0u);
+    
+    uint32_t elapsed_ms = 0;
+    auto received = receive(3500, elapsed_ms);
+    EXPECT_EQ(std::string(1000, 'a') + data1 + data2, received);
+    EXPECT_EQ(0u, conn_->sendBufferBytes());
+    EXPECT_GT(conn_->write_count, 0);
+}
+
+TEST_F(TcpConnectionTest, RateLimit_Queue_Behind_Buffered_Data)
+{
+    std::string data1(2000, 'b'), data2(500, 'c');
+    EXPECT_EQ(2000, conn_->send(data1.c_str(), data1.size()));
+    EXPECT_EQ(500, conn_->send(data2.c_str(), data2.size()));
+    EXPECT_GT(conn_->sendBufferBytes(), 0u);
+    
+    uint32_t elapsed_ms = 0;
+    auto received = receive(3500, elapsed_ms);
+    EXPECT_EQ(std::string(1000, 'a') + data1 + data2, received);
+}
+
+TEST_F(TcpConnectionTest, Send_On_Unconnected_Socket)
+{
+    TestConnection conn(loop_);
+    std::string data(100, 'b');
+    EXPECT_EQ(0, conn.send(data.c_str(), data.size()));
+    iovec iov;
+    iov.iov_base = (char*)data.c_str();
+    iov.iov_len = data.size();
+    EXPECT_EQ(0, conn.send(&iov, 1));
+    KMBuffer buf(data.c_str(), data.size(), data.size());
+    EXPECT_EQ(0, conn.send(buf));
+    // nothing is buffered for the socket that cannot send it
+    EXPECT_EQ(0u, conn.sendBufferBytes());
+    
+    // the rate limited connection either
+    ASSERT_EQ(KMError::NOERR, conn.setRateLimit(100000, 1000, ""));
+    EXPECT_EQ(0, conn.send(data.c_str(), data.size()));
+    EXPECT_EQ(0u, conn.sendBufferBytes());
+}
+
+TEST_F(TcpConnectionTest, Send_On_Closed_Socket)
+{
+    uint32_t elapsed_ms = 0;
+    receive(1000, elapsed_ms);
+    ASSERT_EQ(0u, conn_->sendBufferBytes());
+    conn_->close();
+    std::string data(100, 'b');
+    EXPECT_EQ(0, conn_->send(data.c_str(), data.size()));
+    EXPECT_EQ(0u, conn_->sendBufferBytes());
+}
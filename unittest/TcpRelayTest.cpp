@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include "TcpRelayImpl.h"
+#include "EventLoopImpl.h"
+#include "util/util.h"
+
+#include <string>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace kuma;
+
+/* peer1_fd_ <-> tcp1 -- relay -- tcp2 <-> peer2_fd_, forward is from tcp1 to tcp2
+ */
+class TcpRelayTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        loop_ = std::make_shared<EventLoop::Impl>();
+        ASSERT_TRUE(loop_->init());
+        relay_.reset(new TcpRelay::Impl(loop_));
+        relay_->setCloseCallback([this] (KMError err) {
+            closed_ = true;
+            close_err_ = err;
+        });
+    }
+
+    void TearDown() override
+    {
+        relay_.reset();
+        if (peer1_fd_ != -1) {
+            ::close(peer1_fd_);
+        }
+        if (peer2_fd_ != -1) {
+            ::close(peer2_fd_);
+        }
+    }
+
+    void attach(bool zero_copy)
+    {
+        ASSERT_EQ(KMError::NOERR, relay_->setZeroCopy(zero_copy));
+        TcpSocket::Impl tcp1(loop_), tcp2(loop_);
+        ASSERT_TRUE(createSocket(tcp1, peer1_fd_));
+        ASSERT_TRUE(createSocket(tcp2, peer2_fd_));
+        ASSERT_EQ(KMError::NOERR, relay_->attach(std::move(tcp1), std::move(tcp2)));
+    }
+
+    bool createSocket(TcpSocket::Impl &tcp, int &peer_fd)
+    {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return false;
+        }
+        peer_fd = fds[1];
+        ::fcntl(peer_fd, F_SETFL, ::fcntl(peer_fd, F_GETFL) | O_NONBLOCK);
+        return tcp.attachFd(fds[0]) == KMError::NOERR;
+    }
+
+    /* write data to src_fd, and read it from dst_fd until all of it is received,
+     * returns the data received
+     */
+    std::string transfer(int src_fd, int dst_fd, const std::string &data)
+    {
+        std::string received;
+        size_t written = 0;
+        auto start_tick = get_tick_count_ms();
+        while (received.size() < data.size() && calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < 3000) {
+            if (written < data.size()) {
+                auto n = ::write(src_fd, data.c_str() + written, data.size() - written);
+                if (n > 0) {
+                    written += n;
+                }
+            }
+            loop_->loopOnce(1);
+            char buf[16*1024];
+            ssize_t n;
+            while ((n = ::read(dst_fd, buf, sizeof(buf))) > 0) {
+                received.append(buf, n);
+            }
+        }
+        return received;
+    }
+
+    // wait for EOF on fd, the data read before it is discarded
+    bool waitForEOF(int fd)
+    {
+        auto start_tick = get_tick_count_ms();
+        while (calc_time_elapse_delta_ms(get_tick_count_ms(), start_tick) < 3000) {
+            loop_->loopOnce(1);
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+            }
+            if (0 == n) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* half-close the direction from first_fd, the other direction still relays
+     * data until second_fd is half-closed
+     */
+    void checkHalfClose(int first_fd, int second_fd)
+    {
+        ASSERT_EQ(0, ::shutdown(first_fd, SHUT_WR));
+        EXPECT_TRUE(waitForEOF(second_fd));
+        EXPECT_FALSE(closed_);
+        std::string data(64*1024, 'h');
+        EXPECT_EQ(data, transfer(second_fd, first_fd, data));
+
+        ASSERT_EQ(0, ::shutdown(second_fd, SHUT_WR));
+        EXPECT_TRUE(waitForEOF(first_fd));
+        EXPECT_TRUE(closed_);
+        EXPECT_EQ(KMError::NOERR, close_err_);
+    }
+
+protected:
+    EventLoopPtr                    loop_;
+    std::unique_ptr<TcpRelay::Impl> relay_;
+    int                             peer1_fd_ = -1;
+    int                             peer2_fd_ = -1;
+    bool                            closed_ = false;
+    KMError                         close_err_ = KMError::FAILED;
+};
+
+TEST_F(TcpRelayTest, Splice_Relay)
+{
+    attach(true);
+#ifndef KUMA_OS_LINUX
+    EXPECT_FALSE(relay_->isZeroCopy());
+    return;
+#endif
+    ASSERT_TRUE(relay_->isZeroCopy());
+    // larger than the pipe, so splice to socket blocks
+    std::string data1(1024*1024, 'a'), data2(300*1024, 'b');
+    EXPECT_EQ(data1, transfer(peer1_fd_, peer2_fd_, data1));
+    EXPECT_EQ(data2, transfer(peer2_fd_, peer1_fd_, data2));
+    EXPECT_EQ(data1.size(), relay_->bytesForward());
+    EXPECT_EQ(data2.size(), relay_->bytesBackward());
+    EXPECT_FALSE(closed_);
+}
+
+TEST_F(TcpRelayTest, Splice_Half_Close_Forward)
+{
+    attach(true);
+    if (!relay_->isZeroCopy()) {
+        return;
+    }
+    checkHalfClose(peer1_fd_, peer2_fd_);
+}
+
+TEST_F(TcpRelayTest, Splice_Half_Close_Backward)
+{
+    attach(true);
+    if (!relay_->isZeroCopy()) {
+        return;
+    }
+    checkHalfClose(peer2_fd_, peer1_fd_);
+}
+
+TEST_F(TcpRelayTest, Buffered_Relay)
+{
+    attach(false);
+    EXPECT_FALSE(relay_->isZeroCopy());
+    std::string data1(1024*1024, 'a'), data2(300*1024, 'b');
+    EXPECT_EQ(data1, transfer(peer1_fd_, peer2_fd_, data1));
+    EXPECT_EQ(data2, transfer(peer2_fd_, peer1_fd_, data2));
+    EXPECT_EQ(data1.size(), relay_->bytesForward());
+    EXPECT_EQ(data2.size(), relay_->bytesBackward());
+    EXPECT_FALSE(closed_);
+}
+
+/* TcpSocket closes itself on EOF, so the buffered relay forwards the EOF to both
+ * peers and is closed
+ */
+TEST_F(TcpRelayTest, Buffered_Half_Close_Forward)
+{
+    attach(false);
+    std::string data(64*1024, 'c');
+    EXPECT_EQ(data, transfer(peer1_fd_, peer2_fd_, data));
+    ASSERT_EQ(0, ::shutdown(peer1_fd_, SHUT_WR));
+    EXPECT_TRUE(waitForEOF(peer2_fd_));
+    EXPECT_TRUE(waitForEOF(peer1_fd_));
+    EXPECT_TRUE(closed_);
+    EXPECT_EQ(KMError::NOERR, close_err_);
+    EXPECT_EQ(data.size(), relay_->bytesForward());
+}
+
+TEST_F(TcpRelayTest, Buffered_Half_Close_Backward)
+{
+    attach(false);
+    std::string data(64*1024, 'd');
+    EXPECT_EQ(data, transfer(peer2_fd_, peer1_fd_, data));
+    ASSERT_EQ(0, ::shutdown(peer2_fd_, SHUT_WR));
+    EXPECT_TRUE(waitForEOF(peer1_fd_));
+    EXPECT_TRUE(waitForEOF(peer2_fd_));
+    EXPECT_TRUE(closed_);
+    EXPECT_EQ(KMError::NOERR, close_err_);
+    EXPECT_EQ(data.size(), relay_->bytesBackward());
+}